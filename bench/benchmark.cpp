@@ -0,0 +1,1891 @@
+// Headless benchmark: renders fixed scenes (fixed seeds, cameras and spp) with both integrators,
+// times single primitive intersections, the top-level BVH, voxel meshing, scene file loading, the
+// acceleration structure cache, the BVH builders, vector math and thread scaling, measures the noise
+// reduction of light sampling, the denoiser and texture LOD, the savings of the radiance cache, the cost of the
+// preview modes and of animated sequences, and prints a JSON report.
+//
+// usage: Benchmark [--width N] [--spp N] [--bounces N] [--frames N] [--threads N] [--res DIR] [--out FILE] [--quick]
+//        Benchmark --sequence scene.json DIR [--threads N]: renders the file's animation into DIR/frame_NNNN.ppm
+//        instead (what the windowed client does with --sequence)
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <random>
+#include <array>
+#include <filesystem>
+
+#if defined(_WIN32) || defined(_WIN64)
+	#include <windows.h>
+	#include <psapi.h>
+#else
+	#include <sys/resource.h>
+#endif
+
+#include "RayTracing/general.h"
+
+#include "RayTracing/vec.h"
+#include "RayTracing/color.h"
+#include "RayTracing/Ray.h"
+#include "RayTracing/AABB.h"
+#include "RayTracing/Camera.h"
+#include "RayTracing/parallel.h"
+
+#include "RayTracing/Profiling/Profiler.h"
+
+#include "RayTracing/Objects/hittable.h"
+#include "RayTracing/Objects/hittable_list.h"
+#include "RayTracing/Objects/Sphere.h"
+#include "RayTracing/Objects/Triangle.h"
+#include "RayTracing/Objects/Mesh.h"
+#include "RayTracing/Objects/VoxelVolume.h"
+#include "RayTracing/Objects/VoxelMesher.h"
+
+#include "RayTracing/Materials/MaterialTable.h"
+#include "RayTracing/Lights/LightList.h"
+#include "RayTracing/Caching/RadianceCache.h"
+#include "RayTracing/Caching/AccelCache.h"
+#include "RayTracing/Loaders/StlLoader.h"
+#include "RayTracing/Loaders/VoxLoader.h"
+#include "RayTracing/Loaders/SceneLoader.h"
+
+#include "RayTracing/Integrators/RecursiveIntegrator.h"
+#include "RayTracing/Integrators/WavefrontIntegrator.h"
+
+#include "RayTracing/Denoising/Denoiser.h"
+
+#include "RayTracing/Animation/Sequence.h"
+#include "RayTracing/Animation/SceneSequence.h"
+
+#include "RayTracing/exampleScenes.h"
+
+
+static constexpr uint32_t SEED = 1234;
+
+struct Settings {
+	uint32_t width = 256;
+	uint32_t spp = 4;
+	uint32_t bounces = 8;
+	uint32_t frames = 3;
+	uint32_t threads = hardwareThreads();
+	std::string res = "../res";
+	std::string out;
+	std::string sequenceScene, sequenceDirectory; // --sequence
+};
+
+static size_t peakMemoryBytes() {
+#if defined(_WIN32) || defined(_WIN64)
+	PROCESS_MEMORY_COUNTERS pmc;
+	if(!GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+		return 0;
+	return pmc.PeakWorkingSetSize;
+#else
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	#if defined(__APPLE__)
+	return (size_t)usage.ru_maxrss;
+	#else
+	return (size_t)usage.ru_maxrss * 1024;
+	#endif
+#endif
+}
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(const Clock::time_point start) {
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+// -- Ray counting
+
+struct alignas(64) CounterSlot {
+	std::atomic_uint64_t value = 0;
+};
+
+// Counts world.hit calls (= rays cast) in one padded slot per thread
+class CountingHittable : public hittable {
+	using Slot = CounterSlot;
+
+	static constexpr size_t NUM_SLOTS = 256;
+	static inline Slot slots[NUM_SLOTS];
+	static inline std::atomic_uint32_t nextSlot = 0;
+
+	const hittable& inner;
+
+	static Slot& slot() {
+		thread_local static Slot& s = slots[nextSlot.fetch_add(1) % NUM_SLOTS];
+		return s;
+	}
+
+public:
+	CountingHittable(const hittable& inner): inner(inner) { }
+
+	static uint64_t total() {
+		uint64_t sum = 0;
+		for(const Slot& s : slots)
+			sum += s.value.load(std::memory_order_relaxed);
+		return sum;
+	}
+
+	virtual bool hit(const Ray& r, const real t_min, const real t_max, hit_record& rec) const override {
+		slot().value.fetch_add(1, std::memory_order_relaxed);
+		return inner.hit(r, t_min, t_max, rec);
+	}
+
+	virtual bool occluded(const Ray& r, const real t_max) const override {
+		slot().value.fetch_add(1, std::memory_order_relaxed);
+		return inner.occluded(r, t_max);
+	}
+
+	virtual void occludedBatch(const Ray *const rays, const real *const t_max, uint8_t *const occluded, const size_t count) const override {
+		slot().value.fetch_add(count, std::memory_order_relaxed);
+		inner.occludedBatch(rays, t_max, occluded, count);
+	}
+};
+
+
+// -- Scenes
+
+struct BenchScene {
+	std::string name;
+	hittable_list world;
+	MaterialTable materials;
+	LightList lights;
+	Camera cam = Camera(vec3(0, 0, -2), vec3(0, 0, 1), vec3(0, 1, 0), 40);
+	std::string error; // set if the scene couldn't be built
+
+	// Once the scene is complete: lights and the top-level BVH
+	void prepare() {
+		world.collectLights(lights, materials);
+		lights.build();
+		world.build();
+	}
+};
+
+static Camera lookAt(const vec3& from, const vec3& at, const double fov) {
+	return Camera(from, at - from, vec3(0, 1, 0), fov, 1, 0, (at - from).length<float>());
+}
+
+static std::vector<std::function<void(BenchScene&)>> sceneBuilders(const Settings& settings) {
+	return {
+		[](BenchScene& s) {
+			s.name = "scene1";
+			genScene1(s.world, s.materials);
+			s.cam = Camera(vec3(0, 0, -2), vec3(0, 0, 1), vec3(0, 1, 0), 40);
+		},
+		[](BenchScene& s) {
+			s.name = "scene2_full";
+			genScene2(s.world, s.materials, 11);
+			s.cam = lookAt(vec3(13, -2, 3), vec3(0, 0, 0), 20);
+		},
+		[](BenchScene& s) {
+			s.name = "voxel_demo";
+			s.world.emplace<VoxelVolume>(s.materials);
+			s.cam = lookAt(vec3(-4, -3, -4), vec3(2, 1, 1), 40);
+		},
+		[&settings](BenchScene& s) {
+			s.name = "bunny";
+			const material_id ground = s.materials.add(Lambertian(color(.5f, .5f, .5f)));
+			const material_id metal = s.materials.add(Metal(color(1., .75, .75), .03));
+
+			const std::vector<Triangle> tris = loadSTL(settings.res + "/Bunny.stl", metal);
+
+			vec3 lo(1e30f), hi(-1e30f);
+			for(const Triangle& tri : tris) {
+				for(const vec3& p : { tri.p0, tri.p1, tri.p2 }) {
+					for(int i = 0; i < 3; i++) {
+						lo[i] = std::min(lo[i], p[i]);
+						hi[i] = std::max(hi[i], p[i]);
+					}
+				}
+			}
+			const vec3 center = (lo + hi) / 2.f;
+			const float size = (hi - lo).length<float>();
+
+			s.world.emplace<Mesh>(tris);
+			s.world.emplace<Sphere>(vec3(center.x(), hi.y() + 1000, center.z()), 1000, ground);
+			s.cam = lookAt(center + vec3(-1.2f, -.6f, -1.2f) * size, center, 35);
+		},
+		[](BenchScene& s) {
+			s.name = "voxel_lights";
+			genVoxelLights(s.world, s.materials, 48);
+			s.cam = lookAt(vec3(3, 7, 3), vec3(24, 13, 24), 60);
+		},
+		[](BenchScene& s) {
+			s.name = "voxel_models";
+			genVoxelModels(s.world, s.materials, 8, 16, (int)SEED);
+			s.cam = lookAt(vec3(-30, -40, -30), vec3(120, 16, 120), 45);
+		},
+		[](BenchScene& s) {
+			s.name = "voxel_terrain";
+			genVoxelTerrain(s.world, s.materials, 256, (int)SEED);
+			s.cam = lookAt(vec3(-40, -60, -40), vec3(128, 100, 128), 50);
+		},
+	};
+}
+
+static fTexture makeSkybox() {
+	fTexture skybox(512, 256);
+	for(int y = 0; y < skybox.height; y++) {
+		const float t = y * 1.f / skybox.height;
+		for(int x = 0; x < skybox.width; x++)
+			skybox.pixels[y * skybox.width + x] = intColor(lerp(color(.5f, .7f, 1.f), color(1.f, 1.f, 1.f), t) * .99f);
+	}
+	skybox.generateMips();
+	return skybox;
+}
+
+
+// -- Render timing
+
+struct RenderResult {
+	double seconds = 0;
+	uint64_t primaryRays = 0;
+	uint64_t secondaryRays = 0;
+	uint64_t counters[Profiler::NUM_COUNTERS]{}; // hot-path counters over the timed frames (RT_PROFILING builds)
+};
+
+template<typename Integrator>
+static RenderResult timeRender(Integrator& integrator, const BenchScene& scene, const fTexture& skybox, const Settings& settings, const uint32_t threads) {
+	CountingHittable counted(scene.world);
+	AOVBuffer aov(settings.width, settings.width);
+	integrator.numThreads = threads;
+	integrator.lights = scene.lights.empty() ? nullptr : &scene.lights;
+
+	seed_random(SEED);
+	integrator.render(counted, scene.materials, skybox, scene.cam, aov, settings.spp, settings.bounces); // warm-up
+
+	RenderResult result;
+	uint64_t countersBefore[Profiler::NUM_COUNTERS], countersAfter[Profiler::NUM_COUNTERS];
+	Profiler::totals(countersBefore);
+	const uint64_t before = CountingHittable::total();
+	const Clock::time_point start = Clock::now();
+	for(uint32_t f = 0; f < settings.frames; f++)
+		integrator.render(counted, scene.materials, skybox, scene.cam, aov, settings.spp, settings.bounces);
+	result.seconds = secondsSince(start);
+	Profiler::totals(countersAfter);
+	for(size_t c = 0; c < Profiler::NUM_COUNTERS; c++)
+		result.counters[c] = countersAfter[c] - countersBefore[c];
+
+	const uint64_t rays = CountingHittable::total() - before;
+	result.primaryRays = (uint64_t)settings.width * settings.width * settings.spp * settings.frames;
+	result.secondaryRays = rays - std::min(rays, result.primaryRays);
+	return result;
+}
+
+static std::string renderJSON(const RenderResult& r) {
+	std::ostringstream out;
+	out << "{ \"seconds\": " << r.seconds
+		<< ", \"primary_rays\": " << r.primaryRays
+		<< ", \"secondary_rays\": " << r.secondaryRays
+		<< ", \"primary_rays_per_second\": " << (r.primaryRays / r.seconds)
+		<< ", \"secondary_rays_per_second\": " << (r.secondaryRays / r.seconds)
+		<< ", \"rays_per_second\": " << ((r.primaryRays + r.secondaryRays) / r.seconds);
+#ifdef RT_PROFILING
+	out << ", \"counters\": {";
+	for(size_t c = 0; c < Profiler::NUM_COUNTERS; c++)
+		out << (c ? ", " : " ") << "\"" << Profiler::counterName((ProfileCounter)c) << "\": " << r.counters[c];
+	out << " }";
+#endif
+	out << " }";
+	return out.str();
+}
+
+
+// -- Vector math microbenchmarks
+
+static real checksum(const real v) { return v; }
+static real checksum(const vec3& v) { return v.x() + v.y() + v.z(); }
+
+// op(a, b) over a small (cache resident) set of random vectors; 4 independent accumulators
+// so the result measures throughput rather than the latency of one add chain
+template<typename F>
+static std::string timeVectorOp(const std::string& name, const size_t count, const F& op) {
+	constexpr size_t N = 4096;
+	seed_random(SEED);
+	std::vector<vec3> a(N), b(N);
+	for(size_t i = 0; i < N; i++) {
+		a[i] = random(-1, 1);
+		b[i] = random(-1, 1);
+	}
+
+	using Result = decltype(op(a[0], b[0]));
+	Result sinks[4]{};
+	const size_t rounds = (count + N - 1) / N;
+
+	const Clock::time_point start = Clock::now();
+	for(size_t round = 0; round < rounds; round++)
+		for(size_t i = 0; i < N; i += 4)
+			for(size_t k = 0; k < 4; k++)
+				sinks[k] += op(a[i + k], b[i + k]);
+	const double seconds = secondsSince(start);
+
+	std::ostringstream out;
+	out << "{ \"op\": \"" << name << "\""
+		<< ", \"ops\": " << rounds * N
+		<< ", \"ns_per_op\": " << (seconds * 1e9 / (rounds * N))
+		<< ", \"checksum\": " << checksum(sinks[0] + sinks[1] + sinks[2] + sinks[3]) << " }";
+	return out.str();
+}
+
+static std::vector<std::string> vectorBenchmarks(const size_t count) {
+	const AABB box(vec3(-.5f), vec3(.5f));
+
+	return {
+		timeVectorOp("dot", count, [](const vec3& a, const vec3& b) { return dot(a, b); }),
+		timeVectorOp("cross", count, [](const vec3& a, const vec3& b) { return cross(a, b); }),
+		timeVectorOp("normalize", count, [](const vec3& a, const vec3& b) { return normalize(a + b); }),
+		timeVectorOp("slab_test", count, [&](const vec3& a, const vec3& b) {
+			ivec3 normal;
+			real t;
+			return (real)box.intersects(Ray(a * 3, b), normal, t);
+		})
+	};
+}
+
+
+// -- Intersection microbenchmarks
+
+// Rays from a sphere around `center`, aimed at random points within `radius` of it
+static std::vector<Ray> randomRays(const vec3& center, const float radius, const size_t count) {
+	seed_random(SEED);
+	std::vector<Ray> rays;
+	rays.reserve(count);
+	for(size_t i = 0; i < count; i++) {
+		const vec3 from = center + random_unit_vector() * (radius * 3);
+		const vec3 to = center + random_in_unit_sphere() * radius;
+		rays.emplace_back(from, unit_vector(to - from));
+	}
+	return rays;
+}
+
+static std::string timeIntersections(const std::string& name, const vec3& center, const float radius, const std::function<bool(const Ray&)>& test, const size_t count) {
+	const std::vector<Ray> rays = randomRays(center, radius, count);
+
+	size_t hits = 0;
+	const Clock::time_point start = Clock::now();
+	for(const Ray& r : rays)
+		hits += test(r);
+	const double seconds = secondsSince(start);
+
+	std::ostringstream out;
+	out << "{ \"primitive\": \"" << name << "\""
+		<< ", \"tests\": " << count
+		<< ", \"hit_rate\": " << (hits * 1. / count)
+		<< ", \"ns_per_test\": " << (seconds * 1e9 / count) << " }";
+	return out.str();
+}
+
+// Every ray against a 4x4x4 grid of boxes; the precomp variants build RayPrecomp once per ray
+static std::vector<std::string> boxBenchmarks(const size_t count) {
+	std::vector<AABB> boxes;
+	for(int x = 0; x < 4; x++)
+		for(int y = 0; y < 4; y++)
+			for(int z = 0; z < 4; z++)
+				boxes.emplace_back(vec3(x - 2.f, y - 2.f, z - 2.f) * .5f + vec3(.05f), vec3(x - 1.f, y - 1.f, z - 1.f) * .5f - vec3(.05f));
+
+	const std::vector<Ray> rays = randomRays(vec3(0.f), 1, count / boxes.size());
+	const real INF = 1. / 0.;
+
+	const auto time = [&](const std::string& name, const auto& perRay) {
+		size_t hits = 0;
+		const Clock::time_point start = Clock::now();
+		for(const Ray& r : rays)
+			hits += perRay(r);
+		const double seconds = secondsSince(start);
+
+		const size_t tests = rays.size() * boxes.size();
+		std::ostringstream out;
+		out << "{ \"variant\": \"" << name << "\""
+			<< ", \"tests\": " << tests
+			<< ", \"hit_rate\": " << (hits * 1. / tests)
+			<< ", \"boxes_per_second\": " << (tests / seconds) << " }";
+		return out.str();
+	};
+
+	return {
+		time("ray", [&](const Ray& r) {
+			size_t hits = 0;
+			for(const AABB& box : boxes) {
+				ivec3 normal;
+				real t;
+				hits += box.intersects(r, normal, t);
+			}
+			return hits;
+		}),
+		time("precomp_hit_only", [&](const Ray& r) {
+			const RayPrecomp rp(r);
+			size_t hits = 0;
+			for(const AABB& box : boxes)
+				hits += box.hit(rp, 0, INF);
+			return hits;
+		}),
+		time("precomp_hit_normal", [&](const Ray& r) {
+			const RayPrecomp rp(r);
+			size_t hits = 0;
+			for(const AABB& box : boxes) {
+				ivec3 normal;
+				real t;
+				hits += box.intersects(rp, normal, t);
+			}
+			return hits;
+		})
+	};
+}
+
+static std::vector<std::string> intersectionBenchmarks(const Settings& settings, const size_t count) {
+	std::vector<std::string> results;
+	const real INF = 1. / 0.;
+	MaterialTable materials;
+	const material_id mat = materials.add(Lambertian(color(.5f)));
+
+	const Sphere sphere(vec3(0, 0, 0), 1, mat);
+	results.push_back(timeIntersections("sphere", vec3(0.f), 1, [&](const Ray& r) {
+		hit_record rec;
+		return sphere.hit(r, 0.00001, INF, rec);
+	}, count));
+	results.push_back(timeIntersections("sphere_occluded", vec3(0.f), 1, [&](const Ray& r) {
+		return sphere.occluded(r, INF);
+	}, count));
+
+	const Triangle triangle(vec3(-1, 0, 0), vec3(1, 0, 0), vec3(0, 1, 0), mat);
+	results.push_back(timeIntersections("triangle", vec3(0, .5f, 0), 1, [&](const Ray& r) {
+		hit_record rec;
+		return triangle.hit(r, 0.00001, INF, rec);
+	}, count));
+
+	const AABB box(vec3(-1.f), vec3(1.f));
+	results.push_back(timeIntersections("aabb", vec3(0.f), 1.5f, [&](const Ray& r) {
+		ivec3 normal;
+		real t;
+		return box.intersects(r, normal, t);
+	}, count));
+
+	{
+		MaterialTable demoMaterials;
+		const VoxelVolume volume(demoMaterials);
+		results.push_back(timeIntersections("voxel_volume_8", vec3(4.f), 6, [&](const Ray& r) {
+			hit_record rec;
+			return volume.hit(r, 0.00001, INF, rec);
+		}, count));
+	}
+
+	{
+		hittable_list world;
+		MaterialTable terrainMaterials;
+		genVoxelTerrain(world, terrainMaterials, 256, (int)SEED);
+		results.push_back(timeIntersections("voxel_terrain_256", vec3(128, 64, 128), 150, [&](const Ray& r) {
+			hit_record rec;
+			return world.hit(r, 0.00001, INF, rec);
+		}, count / 10));
+		results.push_back(timeIntersections("voxel_terrain_256_occluded", vec3(128, 64, 128), 150, [&](const Ray& r) {
+			return world.occluded(r, INF);
+		}, count / 10));
+	}
+
+	try {
+		const Mesh bunny(loadSTL(settings.res + "/Bunny.stl", mat));
+		results.push_back(timeIntersections("mesh_bunny", vec3(0, -.5f, 0), 1, [&](const Ray& r) {
+			hit_record rec;
+			return bunny.hit(r, 0.00001, INF, rec);
+		}, count / 10));
+		results.push_back(timeIntersections("mesh_bunny_occluded", vec3(0, -.5f, 0), 1, [&](const Ray& r) {
+			return bunny.occluded(r, INF);
+		}, count / 10));
+	} catch(const std::exception& ex) {
+		std::cerr << "mesh_bunny skipped: " << ex.what() << "\n";
+	}
+
+	return results;
+}
+
+
+// -- DDA kernel: VoxelVolume's traversal against the loop it replaced, on rays starting in the air
+// of the terrain (both skip the start cell, so they step through the same cells)
+
+// The previous kernel: float-equality axis search, bounds checks and a neighbour lookup per step
+static bool referenceMarch(const VoxelVolume& volume, const ivec3& size, const Ray& r, uint64_t& steps) {
+	const AABB aabb(vec3(0.f), vec3((real)size.x(), (real)size.y(), (real)size.z()));
+	real tHitBounds;
+	if(!aabb.hit(RayPrecomp(r), 0, 1. / 0., tHitBounds))
+		return false;
+
+	const real tEnter = tHitBounds + .01f / r.direction().length<real>();
+	const vec3 viewPos = r.at(tEnter);
+	const vec3 viewDir = r.direction();
+
+	ivec3 currentBlock = floor(viewPos);
+	const vec3 deltaT = abs(1.f / viewDir);
+
+	ivec3 step;
+	vec3 sideDist;
+	for(uint8_t dim = 0; dim < 3; dim++) {
+		step[dim] = viewDir[dim] < 0 ? -1 : 1;
+		sideDist[dim] = (viewDir[dim] < 0)
+			?  (viewPos[dim] - currentBlock[dim]) * deltaT[dim]
+			: -(viewPos[dim] - currentBlock[dim] - 1) * deltaT[dim];
+	}
+
+	const auto inside = [&](const ivec3& pos) -> bool {
+		if(pos.x() < 0 || pos.x() >= size.x()) return false;
+		if(pos.y() < 0 || pos.y() >= size.y()) return false;
+		if(pos.z() < 0 || pos.z() >= size.z()) return false;
+		return true;
+	};
+
+	int side = 0;
+	for(;;) {
+		steps++;
+
+		const real minDim = std::min<real>(std::min<real>(sideDist.x(), sideDist.y()), sideDist.z());
+		for(uint8_t dim = 0; dim < 3; dim++) {
+			if (sideDist[dim] == minDim) {
+				sideDist[dim] += deltaT[dim];
+				currentBlock[dim] += step[dim];
+				side = dim;
+				break;
+			}
+		}
+
+		if(!inside(currentBlock))
+			return false;
+
+		ivec3 normal(0);
+		normal[side] = viewDir[side] > 0 ? -1 : 1;
+		const ivec3 prev = currentBlock + normal;
+
+		const size_t mat = volume.get(currentBlock.x(), currentBlock.y(), currentBlock.z());
+		const size_t prevMat = inside(prev) ? volume.get(prev.x(), prev.y(), prev.z()) : 0;
+		if(mat != prevMat)
+			return true;
+	}
+}
+
+static std::string ddaBenchmark(const size_t count) {
+	hittable_list world;
+	MaterialTable materials;
+	genVoxelTerrain(world, materials, 256, (int)SEED);
+	VoxelVolume& volume = dynamic_cast<VoxelVolume&>(*world.objects[0]);
+	volume.maxLod = 0;
+	const ivec3 size(256, 128, 256);
+
+	seed_random(SEED);
+	std::vector<Ray> rays;
+	rays.reserve(count);
+	while(rays.size() < count) {
+		const vec3 from = vec3(random_real(0, 256), random_real(0, 128), random_real(0, 256));
+		const ivec3 cell = floor(from);
+		if(volume.get(cell.x(), cell.y(), cell.z()) == 0)
+			rays.emplace_back(from, random_unit_vector());
+	}
+
+	// steps per ray from the reference, which the kernel matches ray for ray
+	uint64_t steps = 0;
+	std::vector<uint8_t> referenceHits(count);
+	const Clock::time_point referenceStart = Clock::now();
+	for(size_t i = 0; i < count; i++)
+		referenceHits[i] = referenceMarch(volume, size, rays[i], steps);
+	const double referenceSeconds = secondsSince(referenceStart);
+
+	size_t mismatches = 0;
+	const Clock::time_point kernelStart = Clock::now();
+	for(size_t i = 0; i < count; i++)
+		mismatches += volume.occluded(rays[i], 1. / 0.) != (bool)referenceHits[i];
+	const double kernelSeconds = secondsSince(kernelStart);
+
+	std::ostringstream out;
+	out << "{ \"scene\": \"voxel_terrain_256\", \"rays\": " << count << ", \"steps\": " << steps << ", \"mismatches\": " << mismatches
+		<< ", \"reference_steps_per_second\": " << (steps / referenceSeconds)
+		<< ", \"kernel_steps_per_second\": " << (steps / kernelSeconds)
+		<< ", \"speedup\": " << (referenceSeconds / kernelSeconds) << " }";
+	return out.str();
+}
+
+// -- Top-level BVH: closest and any hit on the voxel models scene (many volumes, spheres and a mesh)
+// with every object tested in turn vs through the BVH, for a growing number of models
+
+static std::string topLevelBenchmark(const int count, const size_t rays) {
+	hittable_list world;
+	MaterialTable materials;
+	seed_random(SEED);
+	genVoxelModels(world, materials, count, 16, (int)SEED);
+
+	const real INF = 1. / 0.;
+	const real extent = count * 32.f;
+	seed_random(SEED + 1);
+	std::vector<Ray> queries;
+	for(size_t i = 0; i < rays; i++) {
+		const vec3 from(random_real(-extent / 4, extent), random_real(-40, 0), random_real(-extent / 4, extent));
+		const vec3 to(random_real(0, extent), 16, random_real(0, extent));
+		queries.emplace_back(from, unit_vector(to - from));
+	}
+
+	struct Run {
+		std::vector<real> t;
+		double hitSeconds, occludedSeconds;
+		uint64_t nodes;
+	};
+	const auto run = [&]() {
+		Run result;
+		result.t.reserve(queries.size());
+		uint64_t before[Profiler::NUM_COUNTERS], after[Profiler::NUM_COUNTERS];
+		Profiler::totals(before);
+		Clock::time_point start = Clock::now();
+		for(const Ray& r : queries) {
+			hit_record rec;
+			result.t.push_back(world.hit(r, RAY_T_MIN, INF, rec) ? rec.t : INF);
+		}
+		result.hitSeconds = secondsSince(start);
+		Profiler::totals(after);
+		result.nodes = after[(size_t)ProfileCounter::BVHNodesVisited] - before[(size_t)ProfileCounter::BVHNodesVisited];
+
+		size_t blocked = 0;
+		start = Clock::now();
+		for(const Ray& r : queries)
+			blocked += world.occluded(r, INF);
+		result.occludedSeconds = secondsSince(start);
+		return result;
+	};
+
+	const Run linear = run();
+	world.build();
+	const Run bvh = run();
+
+	size_t mismatches = 0;
+	for(size_t i = 0; i < queries.size(); i++)
+		mismatches += linear.t[i] != bvh.t[i];
+
+	std::ostringstream out;
+	out << "{ \"objects\": " << world.objects.size()
+		<< ", \"bvh_nodes\": " << world.hierarchy().size()
+		<< ", \"rays\": " << queries.size()
+		<< ", \"mismatches\": " << mismatches
+		<< ",\n    \"linear\": { \"hit_ns\": " << linear.hitSeconds * 1e9 / queries.size() << ", \"occluded_ns\": " << linear.occludedSeconds * 1e9 / queries.size() << " }"
+		<< ",\n    \"bvh\": { \"hit_ns\": " << bvh.hitSeconds * 1e9 / queries.size() << ", \"occluded_ns\": " << bvh.occludedSeconds * 1e9 / queries.size();
+#ifdef RT_PROFILING
+	out << ", \"nodes_per_ray\": " << bvh.nodes * 1. / queries.size();
+#endif
+	out << " }, \"hit_speedup\": " << linear.hitSeconds / bvh.hitSeconds << " }";
+	return out.str();
+}
+
+// -- Voxel meshing: the voxel scenes' volumes greedy-meshed into a Mesh vs traced with the DDA (at full
+// resolution, so both see the same surfaces). Meshing, remeshing after an edit and BVH build times,
+// then closest hit per ray and frame time of either representation.
+
+static std::vector<std::string> voxelMeshingBenchmarks(const Settings& settings, const fTexture& skybox, const size_t rays) {
+	const uint32_t width = std::min<uint32_t>(settings.width, 128);
+	const real INF = 1. / 0.;
+
+	std::vector<std::string> results;
+	for(const bool terrain : { false, true }) {
+		BenchScene voxels, meshed;
+		seed_random(SEED);
+		if(terrain) {
+			voxels.name = "voxel_terrain";
+			genVoxelTerrain(voxels.world, voxels.materials, 256, (int)SEED);
+			voxels.cam = lookAt(vec3(-40, -60, -40), vec3(128, 100, 128), 50);
+		} else {
+			voxels.name = "voxel_lights";
+			genVoxelLights(voxels.world, voxels.materials, 48);
+			voxels.cam = lookAt(vec3(3, 7, 3), vec3(24, 13, 24), 60);
+		}
+		VoxelVolume& volume = dynamic_cast<VoxelVolume&>(*voxels.world.objects[0]);
+		volume.maxLod = 0;
+
+		Clock::time_point start = Clock::now();
+		VoxelMesher mesher(volume, voxels.materials);
+		mesher.numThreads = settings.threads;
+		const size_t chunks = mesher.update();
+		const IndexedMesh mesh = mesher.mesh();
+		const double meshSeconds = secondsSince(start);
+
+		// one voxel on and off again: only the chunks around it are redone
+		const size_t x = volume.size(0) / 2, y = volume.size(1) / 2, z = volume.size(2) / 2;
+		const size_t before = volume.get(x, y, z);
+		volume.set(x, y, z, before == 0 ? 1 : 0);
+		start = Clock::now();
+		const size_t remeshedChunks = mesher.update();
+		const double remeshSeconds = secondsSince(start);
+		volume.set(x, y, z, before);
+		mesher.update();
+
+		start = Clock::now();
+		meshed.world.emplace<Mesh>(mesh.triangles());
+		const double bvhSeconds = secondsSince(start);
+		meshed.materials = voxels.materials;
+		meshed.cam = voxels.cam;
+		voxels.prepare();
+		meshed.prepare();
+
+		// rays from above the volume into it
+		AABB bounds;
+		volume.boundingBox(bounds);
+		const vec3 center = bounds.center(), extent = bounds.dimensions();
+		seed_random(SEED);
+		std::vector<Ray> queries;
+		for(size_t i = 0; i < rays; i++) {
+			const vec3 to = bounds._min + vec3(random_real(0, 1), random_real(0, 1), random_real(0, 1)) * extent;
+			const vec3 from = center + random_unit_vector() * (extent.length<real>() * .75f);
+			queries.emplace_back(from, unit_vector(to - from));
+		}
+		const auto trace = [&](const hittable& world, std::vector<real>& t) {
+			const Clock::time_point start = Clock::now();
+			for(const Ray& r : queries) {
+				hit_record rec;
+				t.push_back(world.hit(r, RAY_T_MIN, INF, rec) ? rec.t : INF);
+			}
+			return secondsSince(start) * 1e9 / queries.size();
+		};
+		std::vector<real> tVoxels, tMesh;
+		const double voxelNs = trace(voxels.world, tVoxels);
+		const double meshNs = trace(meshed.world, tMesh);
+		size_t mismatches = 0;
+		for(size_t i = 0; i < queries.size(); i++)
+			mismatches += tVoxels[i] != tMesh[i] && !(std::abs(tVoxels[i] - tMesh[i]) <= 1e-3f * std::max<real>(1, tVoxels[i]));
+
+		const auto frame = [&](const BenchScene& scene) {
+			RecursiveIntegrator integrator;
+			integrator.numThreads = settings.threads;
+			integrator.lights = scene.lights.empty() ? nullptr : &scene.lights;
+			AOVBuffer aov(width, width);
+			seed_random(SEED);
+			const Clock::time_point start = Clock::now();
+			integrator.render(scene.world, scene.materials, skybox, scene.cam, aov, settings.spp, settings.bounces);
+			return secondsSince(start) * 1e3;
+		};
+
+		std::ostringstream out;
+		out << "{ \"scene\": \"" << voxels.name << "\", \"chunks\": " << chunks
+			<< ", \"faces\": " << mesher.numFaces() << ", \"triangles\": " << mesh.numTriangles() << ", \"vertices\": " << mesh.vertices.size()
+			<< ",\n    \"mesh_ms\": " << meshSeconds * 1e3 << ", \"remesh_ms\": " << remeshSeconds * 1e3 << ", \"remeshed_chunks\": " << remeshedChunks
+			<< ", \"bvh_ms\": " << bvhSeconds * 1e3
+			<< ",\n    \"rays\": " << queries.size() << ", \"mismatches\": " << mismatches
+			<< ", \"dda_hit_ns\": " << voxelNs << ", \"mesh_hit_ns\": " << meshNs
+			<< ",\n    \"width\": " << width << ", \"dda_frame_ms\": " << frame(voxels) << ", \"mesh_frame_ms\": " << frame(meshed) << " }";
+		results.push_back(out.str());
+	}
+
+	return results;
+}
+
+// -- Scene arena: a field of spheres added as separate shared objects vs constructed in the list's arena;
+// construction, closest hit through the top-level BVH and teardown. Then the scratch blocks the
+// wavefront integrator's shadow batches allocate per frame once warmed up (must stay 0)
+
+static std::vector<std::string> arenaBenchmarks(const Settings& settings, const fTexture& skybox, const size_t count, const size_t rays) {
+	const real INF = 1. / 0.;
+	const int side = (int)std::sqrt((double)count);
+	const std::vector<Ray> queries = randomRays(vec3(side / 2.f, 0, side / 2.f), side / 2.f, rays);
+
+	std::vector<std::string> results;
+	for(const bool arena : { false, true }) {
+		seed_random(SEED);
+		std::unique_ptr<hittable_list> world = std::make_unique<hittable_list>();
+
+		Clock::time_point start = Clock::now();
+		for(int a = 0; a < side; a++) {
+			for(int b = 0; b < side; b++) {
+				const vec3 center(a + random_real(0, .5f), random_real(-.5f, .5f), b + random_real(0, .5f));
+				if(arena)
+					world->emplace<Sphere>(center, .25f, 0);
+				else
+					world->add(std::make_shared<Sphere>(center, .25f, 0));
+			}
+		}
+		world->build();
+		const double buildSeconds = secondsSince(start);
+
+		size_t hits = 0;
+		start = Clock::now();
+		for(const Ray& r : queries) {
+			hit_record rec;
+			hits += world->hit(r, RAY_T_MIN, INF, rec);
+		}
+		const double hitSeconds = secondsSince(start);
+
+		start = Clock::now();
+		world.reset();
+		const double teardownSeconds = secondsSince(start);
+
+		std::ostringstream out;
+		out << "{ \"objects\": \"" << (arena ? "arena" : "shared") << "\", \"count\": " << side * side
+			<< ", \"build_ms\": " << buildSeconds * 1e3
+			<< ", \"hit_ns\": " << hitSeconds * 1e9 / queries.size() << ", \"hit_rate\": " << hits * 1. / queries.size()
+			<< ", \"teardown_ms\": " << teardownSeconds * 1e3 << " }";
+		results.push_back(out.str());
+	}
+
+	{
+		BenchScene scene;
+		seed_random(SEED);
+		genVoxelLights(scene.world, scene.materials, 48);
+		scene.cam = lookAt(vec3(3, 7, 3), vec3(24, 13, 24), 60);
+		scene.prepare();
+
+		constexpr uint32_t FRAMES = 4;
+		WavefrontIntegrator integrator;
+		integrator.numThreads = settings.threads;
+		integrator.lights = &scene.lights;
+		AOVBuffer aov(settings.width, settings.width);
+		integrator.render(scene.world, scene.materials, skybox, scene.cam, aov, settings.spp, settings.bounces); // warm-up
+
+		const size_t blocksBefore = Arena::blocksAllocated.load();
+		for(uint32_t f = 0; f < FRAMES; f++)
+			integrator.render(scene.world, scene.materials, skybox, scene.cam, aov, settings.spp, settings.bounces);
+
+		std::ostringstream out;
+		out << "{ \"scratch\": \"wavefront_shadow_batches\", \"threads\": " << settings.threads << ", \"frames\": " << FRAMES
+			<< ", \"blocks_per_frame\": " << (double)(Arena::blocksAllocated.load() - blocksBefore) / FRAMES << " }";
+		results.push_back(out.str());
+	}
+	return results;
+}
+
+// -- Scene files: a scene of voxel models (.vox) and copies of the bunny (.stl) written to a temporary
+// directory, loaded on one thread, on all of them, and with an empty and a filled AccelCache; all
+// loads must give the same world
+
+static std::string sceneLoadingBenchmark(const Settings& settings, const int models, const size_t size, const size_t rays) {
+	const real INF = 1. / 0.;
+	const std::filesystem::path dir = std::filesystem::temp_directory_path() / "rt_scene_benchmark";
+	std::filesystem::create_directories(dir);
+
+	std::ostringstream desc;
+	desc << "{\n  \"camera\": { \"position\": [-20, -20, -20], \"look_at\": [" << models * size / 2 << ", 0, " << size << "] },\n"
+		<< "  \"materials\": [ { \"name\": \"chrome\", \"type\": \"metal\", \"albedo\": [1, 0.75, 0.75], \"fuzz\": 0.03 } ],\n"
+		<< "  \"objects\": [\n";
+	for(int m = 0; m < models; m++) {
+		// blob of palette indices by height
+		VoxelModel model;
+		model.width = model.height = model.depth = size;
+		model.voxels.assign(size * size * size, 0);
+		const float r = size / 2.f;
+		for(size_t z = 0; z < size; z++)
+			for(size_t y = 0; y < size; y++)
+				for(size_t x = 0; x < size; x++) {
+					const float dx = x - r, dy = y - r, dz = z - r;
+					const float wobble = .8f + .2f * std::sin(x * .3f + m) * std::cos(z * .25f);
+					if(dx * dx + dy * dy + dz * dz < r * r * wobble)
+						model.at(x, y, z) = (uint8_t)(1 + y * 8 / size);
+				}
+		for(int i = 1; i <= 8; i++)
+			model.palette[i] = color(.2f + .1f * i, .5f, .9f - .1f * i);
+
+		const std::string file = "model" + std::to_string(m) + ".vox";
+		saveVox((dir / file).string(), model);
+		desc << "    { \"type\": \"voxels\", \"file\": \"" << file << "\", \"origin\": [" << m * (size + 2) << ", 0, 0] },\n"
+			<< "    { \"type\": \"mesh\", \"file\": \"" << std::filesystem::absolute(settings.res + "/Bunny.stl").generic_string()
+			<< "\", \"material\": \"chrome\", \"offset\": [" << m * (size + 2) + r << ", -2, " << size * 2 << "] },\n";
+	}
+	desc << "    { \"type\": \"sphere\", \"center\": [0, 1000, 0], \"radius\": 990, \"material\": \"chrome\" }\n  ]\n}\n";
+
+	const std::string path = (dir / "scene.json").string();
+	std::ofstream(path) << desc.str();
+
+	const std::vector<Ray> queries = randomRays(vec3(models * (size + 2) / 2.f, 0, size), models * (size + 2.f), rays);
+
+	// load time and which queries hit
+	const auto load = [&](const uint32_t threads, double& seconds, std::vector<uint8_t>& hits, AccelCache *const cache) {
+		Scene scene;
+		const Clock::time_point start = Clock::now();
+		loadScene(path, scene, threads, cache);
+		seconds = secondsSince(start);
+
+		for(const Ray& r : queries) {
+			hit_record rec;
+			hits.push_back(scene.world.hit(r, RAY_T_MIN, INF, rec));
+		}
+	};
+
+	std::ostringstream out;
+	out << "{ \"models\": " << models << ", \"model_size\": " << size;
+	try {
+		double serialSeconds, parallelSeconds;
+		std::vector<uint8_t> serialHits, parallelHits;
+		load(1, serialSeconds, serialHits, nullptr);
+		load(settings.threads, parallelSeconds, parallelHits, nullptr);
+
+		AccelCache cache(dir / "cache");
+		double coldSeconds, warmSeconds;
+		std::vector<uint8_t> coldHits, warmHits;
+		load(settings.threads, coldSeconds, coldHits, &cache);
+		load(settings.threads, warmSeconds, warmHits, &cache);
+
+		out << ", \"load_ms_1_thread\": " << serialSeconds * 1e3
+			<< ", \"threads\": " << settings.threads << ", \"load_ms\": " << parallelSeconds * 1e3
+			<< ", \"cold_cache_load_ms\": " << coldSeconds * 1e3 << ", \"warm_cache_load_ms\": " << warmSeconds * 1e3
+			<< ", \"identical\": " << (serialHits == parallelHits && serialHits == warmHits ? "true" : "false") << " }";
+	} catch(const std::exception& ex) {
+		out << ", \"error\": \"" << ex.what() << "\" }";
+	}
+
+	std::filesystem::remove_all(dir);
+	return out.str();
+}
+
+// -- Acceleration structure cache: mesh BVHs (the bunny, the greedy-meshed terrain) and the terrain
+// volume's coarser levels built directly vs through an empty cache (build + store) vs a filled one
+// (mapped); the cached structures must give the same hits / cells
+
+static std::vector<std::string> accelCacheBenchmarks(const Settings& settings, const size_t rays) {
+	const real INF = 1. / 0.;
+	const std::filesystem::path dir = std::filesystem::temp_directory_path() / "rt_accel_cache_benchmark";
+	std::filesystem::remove_all(dir);
+	AccelCache cache(dir);
+
+	std::vector<std::string> results;
+	hittable_list terrain;
+	MaterialTable materials;
+	seed_random(SEED);
+	genVoxelTerrain(terrain, materials, 256, (int)SEED);
+	VoxelVolume& volume = dynamic_cast<VoxelVolume&>(*terrain.objects[0]);
+
+	for(const bool bunny : { true, false }) {
+		std::vector<Triangle> tris;
+		try {
+			if(bunny)
+				tris = loadSTL(settings.res + "/Bunny.stl", 0);
+			else {
+				VoxelMesher mesher(volume, materials);
+				mesher.update();
+				tris = mesher.mesh().triangles();
+			}
+		} catch(const std::exception& ex) {
+			results.push_back(std::string("{ \"structure\": \"mesh_bvh\", \"error\": \"") + ex.what() + "\" }");
+			continue;
+		}
+
+		Clock::time_point start = Clock::now();
+		const Mesh built(tris, BVHBuilder::SAH, settings.threads);
+		const double buildSeconds = secondsSince(start);
+
+		double seconds[2];
+		BVH bvhs[2];
+		for(int warm = 0; warm < 2; warm++) {
+			start = Clock::now();
+			cache.build(bvhs[warm], Mesh::boxes(tris), Mesh::LEAF_SIZE, BVHBuilder::SAH, settings.threads);
+			seconds[warm] = secondsSince(start);
+		}
+		const Mesh cached(tris, bvhs[1]);
+
+		AABB box;
+		built.boundingBox(box);
+		const std::vector<Ray> queries = randomRays(box.center(), box.dimensions().length<float>() / 2, rays);
+		size_t mismatches = 0;
+		for(const Ray& r : queries) {
+			hit_record a, b;
+			const bool hitA = built.hit(r, RAY_T_MIN, INF, a), hitB = cached.hit(r, RAY_T_MIN, INF, b);
+			mismatches += hitA != hitB || (hitA && a.t != b.t);
+		}
+
+		std::ostringstream out;
+		out << "{ \"structure\": \"mesh_bvh\", \"input\": \"" << (bunny ? "bunny" : "voxel_terrain_mesh") << "\", \"triangles\": " << tris.size()
+			<< ", \"build_ms\": " << buildSeconds * 1e3 << ", \"cold_cache_ms\": " << seconds[0] * 1e3 << ", \"warm_cache_ms\": " << seconds[1] * 1e3
+			<< ", \"mismatches\": " << mismatches << " }";
+		results.push_back(out.str());
+	}
+
+	{
+		Clock::time_point start = Clock::now();
+		volume.buildLevels();
+		const double buildSeconds = secondsSince(start);
+		std::vector<std::vector<size_t>> reference;
+		for(uint32_t l = 1; l < volume.numLevels(); l++)
+			reference.push_back(volume.levelCells(l));
+
+		double seconds[2];
+		for(int warm = 0; warm < 2; warm++) {
+			start = Clock::now();
+			cache.buildLevels(volume);
+			seconds[warm] = secondsSince(start);
+		}
+		bool identical = true;
+		for(uint32_t l = 1; l < volume.numLevels(); l++)
+			identical &= volume.levelCells(l) == reference[l - 1];
+
+		std::ostringstream out;
+		out << "{ \"structure\": \"voxel_levels\", \"input\": \"voxel_terrain\", \"levels\": " << volume.numLevels() - 1
+			<< ", \"build_ms\": " << buildSeconds * 1e3 << ", \"cold_cache_ms\": " << seconds[0] * 1e3 << ", \"warm_cache_ms\": " << seconds[1] * 1e3
+			<< ", \"identical\": " << (identical ? "true" : "false") << " }";
+		results.push_back(out.str());
+	}
+
+	if(cache.writeFailures > 0)
+		results.push_back("{ \"error\": \"" + std::to_string(cache.writeFailures) + " cache files couldn't be written\" }");
+	std::filesystem::remove_all(dir);
+	return results;
+}
+
+// -- BVH builders: median, binned SAH and LBVH over the bunny and the greedy-meshed terrain. Build time
+// against thread count (the trees don't depend on it), tree size and SAH cost, closest hit per ray
+// and hits against the median tree; then a refit after jittering every vertex (in place once the tree
+// isn't shared) vs a rebuild, and what the refitted tree costs per ray.
+
+static std::vector<std::string> bvhBuilderBenchmarks(const Settings& settings, const size_t rays) {
+	const real INF = 1. / 0.;
+	std::vector<std::string> results;
+
+	std::vector<uint32_t> threadCounts;
+	for(uint32_t t = 1; t < settings.threads; t *= 2)
+		threadCounts.push_back(t);
+	threadCounts.push_back(settings.threads);
+
+	for(const bool bunny : { true, false }) {
+		std::vector<Triangle> tris;
+		try {
+			if(bunny)
+				tris = loadSTL(settings.res + "/Bunny.stl", 0);
+			else {
+				hittable_list terrain;
+				MaterialTable materials;
+				seed_random(SEED);
+				genVoxelTerrain(terrain, materials, 256, (int)SEED);
+				VoxelMesher mesher(dynamic_cast<VoxelVolume&>(*terrain.objects[0]), materials);
+				mesher.update();
+				tris = mesher.mesh().triangles();
+			}
+		} catch(const std::exception& ex) {
+			results.push_back(std::string("{ \"input\": \"") + (bunny ? "bunny" : "voxel_terrain_mesh") + "\", \"error\": \"" + ex.what() + "\" }");
+			continue;
+		}
+		const std::vector<AABB> boxes = Mesh::boxes(tris);
+
+		const Mesh reference(tris, BVHBuilder::Median, settings.threads);
+		AABB box;
+		reference.boundingBox(box);
+		const std::vector<Ray> queries = randomRays(box.center(), box.dimensions().length<float>() / 2, rays);
+		std::vector<real> referenceT;
+		for(const Ray& r : queries) {
+			hit_record rec;
+			referenceT.push_back(reference.hit(r, RAY_T_MIN, INF, rec) ? rec.t : INF);
+		}
+
+		// closest hit ns per ray, mismatches against the median tree
+		const auto trace = [&](const Mesh& mesh, size_t& mismatches) {
+			mismatches = 0;
+			const Clock::time_point start = Clock::now();
+			for(size_t i = 0; i < queries.size(); i++) {
+				hit_record rec;
+				mismatches += (mesh.hit(queries[i], RAY_T_MIN, INF, rec) ? rec.t : INF) != referenceT[i];
+			}
+			return secondsSince(start) * 1e9 / queries.size();
+		};
+
+		// every vertex moved by up to 1% of the triangle's longest edge
+		seed_random(SEED + 2);
+		std::vector<Triangle> jittered;
+		jittered.reserve(tris.size());
+		for(const Triangle& t : tris) {
+			const real edge = std::max({ (t.p1 - t.p0).length<float>(), (t.p2 - t.p1).length<float>(), (t.p0 - t.p2).length<float>() }) * .01f;
+			jittered.emplace_back(t.p0 + random_in_unit_sphere() * edge, t.p1 + random_in_unit_sphere() * edge, t.p2 + random_in_unit_sphere() * edge, 0);
+		}
+
+		for(size_t b = 0; b < (size_t)BVHBuilder::Count; b++) {
+			const BVHBuilder builder = (BVHBuilder)b;
+
+			std::ostringstream build;
+			BVH bvh;
+			for(size_t i = 0; i < threadCounts.size(); i++) {
+				const Clock::time_point start = Clock::now();
+				bvh.build(boxes, Mesh::LEAF_SIZE, builder, threadCounts[i]);
+				build << (i > 0 ? ", " : "") << "\"" << threadCounts[i] << "\": " << secondsSince(start) * 1e3;
+			}
+
+			Mesh mesh(tris, bvh);
+			size_t mismatches;
+			const double hitNs = trace(mesh, mismatches);
+
+			mesh.update(tris); // the first refit copies the nodes `bvh` still shares, later ones work in place
+			const BVH::Node *const refitNodes = mesh.hierarchy().nodeData();
+			Clock::time_point start = Clock::now();
+			mesh.update(jittered);
+			const double refitSeconds = secondsSince(start);
+			const bool refitInPlace = mesh.hierarchy().nodeData() == refitNodes;
+			size_t ignored;
+			const double refitHitNs = trace(mesh, ignored);
+			start = Clock::now();
+			const Mesh rebuilt(jittered, builder, settings.threads);
+			const double rebuildSeconds = secondsSince(start);
+			const double rebuiltHitNs = trace(rebuilt, ignored);
+
+			std::ostringstream out;
+			out << "{ \"input\": \"" << (bunny ? "bunny" : "voxel_terrain_mesh") << "\", \"triangles\": " << tris.size()
+				<< ", \"builder\": \"" << bvhBuilderName(builder) << "\", \"nodes\": " << bvh.size() << ", \"sah_cost\": " << bvh.sahCost()
+				<< ",\n      \"build_ms\": { " << build.str() << " }"
+				<< ", \"hit_ns\": " << hitNs << ", \"mismatches\": " << mismatches
+				<< ",\n      \"refit_ms\": " << refitSeconds * 1e3 << ", \"refit_in_place\": " << (refitInPlace ? "true" : "false") << ", \"rebuild_ms\": " << rebuildSeconds * 1e3
+				<< ", \"refit_hit_ns\": " << refitHitNs << ", \"rebuilt_hit_ns\": " << rebuiltHitNs
+				<< ", \"refit_sah_cost\": " << mesh.hierarchy().sahCost() << ", \"rebuilt_sah_cost\": " << rebuilt.hierarchy().sahCost() << " }";
+			results.push_back(out.str());
+		}
+	}
+	return results;
+}
+
+// -- Animation: headless sequences of res/scenes/motion.json (a rotating bunny instance, keyframed
+// spheres) while it moves and after it came to rest. Per frame, moving the world into the shutter
+// interval and refitting vs rebuilding the top-level BVH and the bunny's own BVH (what a mesh
+// animated without an instance would need), render time and the share of pixels reusing history.
+
+static std::vector<std::string> animationBenchmarks(const Settings& settings) {
+	std::vector<std::string> results;
+	Scene scene;
+	try {
+		loadScene(settings.res + "/scenes/motion.json", scene, settings.threads);
+	} catch(const std::exception& ex) {
+		results.push_back(std::string("{ \"error\": \"") + ex.what() + "\" }");
+		return results;
+	}
+
+	double rebuildSeconds = 0;
+	{
+		const std::vector<Triangle> bunny = loadSTL(settings.res + "/Bunny.stl", 0);
+		const Clock::time_point start = Clock::now();
+		scene.world.build();
+		const Mesh rebuilt(bunny, BVHBuilder::SAH, settings.threads);
+		rebuildSeconds = secondsSince(start);
+	}
+
+	const uint32_t width = std::min<uint32_t>(settings.width, 128);
+	for(const real start : { real(0), real(2.5) }) {
+		SequenceSettings sequence;
+		sequence.frames = 8;
+		sequence.start = start;
+		sequence.fps = scene.settings.fps;
+		sequence.shutter = scene.settings.shutter;
+		sequence.spp = settings.spp;
+		sequence.bounces = settings.bounces;
+
+		SequenceRenderer renderer;
+		renderer.integrator.numThreads = settings.threads;
+		renderer.temporal.numThreads = settings.threads;
+		seed_random(SEED);
+		const std::vector<SequenceRenderer::FrameStats> frames = renderer.render(scene.world, scene.materials, scene.lights, scene.skybox,
+			scene.camera.camera(), width, width, sequence, [](const uint32_t, const fTexture&) { });
+
+		// frame 0 has no history
+		double animateMs = 0, renderMs = 0, reused = 0;
+		size_t moving = 0;
+		for(size_t f = 1; f < frames.size(); f++) {
+			animateMs += frames[f].animateMs;
+			renderMs += frames[f].renderMs;
+			reused += frames[f].reused;
+			moving += frames[f].moved;
+		}
+		const double n = frames.size() - 1.;
+
+		std::ostringstream out;
+		out << "{ \"phase\": \"" << (start == 0 ? "moving" : "resting") << "\", \"frames\": " << frames.size() << ", \"width\": " << width
+			<< ", \"frames_moved\": " << moving << ", \"animate_ms\": " << animateMs / n << ", \"rebuild_ms\": " << rebuildSeconds * 1e3
+			<< ", \"render_ms\": " << renderMs / n << ", \"reused_pixels\": " << reused / n << " }";
+		results.push_back(out.str());
+	}
+	return results;
+}
+
+// -- Light sampling: BSDF sampling only vs next-event estimation + MIS (power CDF / light tree
+// selection) at equal spp, as RMSE against a high-spp reference and as efficiency (1 / (MSE * time)) ratio
+
+static std::string lightSamplingBenchmark(const Settings& settings, const fTexture& skybox) {
+	BenchScene scene;
+	seed_random(SEED);
+	genVoxelLights(scene.world, scene.materials, 48);
+	scene.cam = lookAt(vec3(3, 7, 3), vec3(24, 13, 24), 60);
+	scene.prepare();
+
+	const uint32_t width = std::min<uint32_t>(settings.width, 64);
+	const uint32_t referenceSpp = settings.width >= 256 ? 256 : 64;
+
+	RecursiveIntegrator integrator;
+	integrator.numThreads = settings.threads;
+
+	const auto render = [&](const LightList *const lights, const uint32_t spp, double& seconds) {
+		AOVBuffer aov(width, width);
+		integrator.lights = lights;
+		seed_random(SEED);
+		const Clock::time_point start = Clock::now();
+		integrator.render(scene.world, scene.materials, skybox, scene.cam, aov, spp, settings.bounces);
+		seconds = secondsSince(start);
+
+		std::vector<float> pixels;
+		for(uint32_t y = 0; y < width; y++)
+			for(uint32_t x = 0; x < width; x++)
+				for(int c = 0; c < 3; c++)
+					pixels.push_back(aov.radiance[c][aov.index(x, y)]);
+		return pixels;
+	};
+
+	double referenceSeconds, bsdfSeconds, powerSeconds, treeSeconds;
+	const std::vector<float> reference = render(&scene.lights, referenceSpp, referenceSeconds);
+	const std::vector<float> bsdf = render(nullptr, settings.spp, bsdfSeconds);
+	const std::vector<float> tree = render(&scene.lights, settings.spp, treeSeconds);
+	scene.lights.setSelection(LightSelection::Power);
+	const std::vector<float> power = render(&scene.lights, settings.spp, powerSeconds);
+
+	const auto mse = [&](const std::vector<float>& image) {
+		double sum = 0;
+		for(size_t i = 0; i < image.size(); i++)
+			sum += (image[i] - reference[i]) * (image[i] - reference[i]);
+		return sum / image.size();
+	};
+	const double bsdfMSE = mse(bsdf), powerMSE = mse(power), treeMSE = mse(tree);
+
+	std::ostringstream out;
+	out << "{ \"scene\": \"voxel_lights\", \"lights\": " << scene.lights.size()
+		<< ", \"width\": " << width << ", \"spp\": " << settings.spp << ", \"reference_spp\": " << referenceSpp
+		<< ",\n    \"bsdf_only\": { \"seconds\": " << bsdfSeconds << ", \"rmse\": " << std::sqrt(bsdfMSE) << " }"
+		<< ",\n    \"nee_power\": { \"seconds\": " << powerSeconds << ", \"rmse\": " << std::sqrt(powerMSE)
+			<< ", \"efficiency_gain\": " << (bsdfMSE * bsdfSeconds) / (powerMSE * powerSeconds) << " }"
+		<< ",\n    \"nee_tree\": { \"seconds\": " << treeSeconds << ", \"rmse\": " << std::sqrt(treeMSE)
+			<< ", \"efficiency_gain\": " << (bsdfMSE * bsdfSeconds) / (treeMSE * treeSeconds) << " } }";
+	return out.str();
+}
+
+// -- Radiance cache: cost per pixel (rays, incl. shadow rays) and error against an uncached high-spp
+// reference, with and without the cache, for growing bounce limits. The cache is warmed up first.
+static std::vector<std::string> radianceCacheBenchmarks(const Settings& settings, const fTexture& skybox) {
+	BenchScene scene;
+	seed_random(SEED);
+	genVoxelLights(scene.world, scene.materials, 48);
+	scene.cam = lookAt(vec3(3, 7, 3), vec3(24, 13, 24), 60);
+	scene.prepare();
+
+	const uint32_t width = std::min<uint32_t>(settings.width, 64);
+	const uint32_t referenceSpp = settings.width >= 256 ? 256 : 64;
+	constexpr uint32_t WARMUP_FRAMES = 16;
+
+	const CountingHittable counted(scene.world);
+	RecursiveIntegrator integrator;
+	integrator.numThreads = settings.threads;
+	integrator.lights = &scene.lights;
+
+	struct Run {
+		std::vector<float> pixels;
+		double seconds;
+		double raysPerPixel;
+	};
+	const auto render = [&](RadianceCache *const cache, const uint32_t spp, const uint32_t bounces) {
+		AOVBuffer aov(width, width);
+		integrator.cache = cache;
+		Run run;
+		const uint64_t raysBefore = CountingHittable::total();
+		const Clock::time_point start = Clock::now();
+		integrator.render(counted, scene.materials, skybox, scene.cam, aov, spp, bounces);
+		run.seconds = secondsSince(start);
+		run.raysPerPixel = (double)(CountingHittable::total() - raysBefore) / ((size_t)width * width);
+
+		for(uint32_t y = 0; y < width; y++)
+			for(uint32_t x = 0; x < width; x++)
+				for(int c = 0; c < 3; c++)
+					run.pixels.push_back(aov.radiance[c][aov.index(x, y)]);
+		return run;
+	};
+
+	std::vector<std::string> results;
+	for(const uint32_t bounces : { 2, 4, 8, 16 }) {
+		seed_random(SEED);
+		const Run reference = render(nullptr, referenceSpp, bounces);
+		const auto rmse = [&](const Run& run) {
+			double sum = 0;
+			for(size_t i = 0; i < run.pixels.size(); i++)
+				sum += (run.pixels[i] - reference.pixels[i]) * (run.pixels[i] - reference.pixels[i]);
+			return std::sqrt(sum / run.pixels.size());
+		};
+
+		seed_random(SEED);
+		const Run plain = render(nullptr, settings.spp, bounces);
+
+		RadianceCache cache;
+		cache.numThreads = settings.threads;
+		for(uint32_t f = 0; f < WARMUP_FRAMES; f++)
+			render(&cache, settings.spp, bounces);
+		seed_random(SEED);
+		const Run cached = render(&cache, settings.spp, bounces);
+
+		std::ostringstream out;
+		out << "{ \"bounces\": " << bounces
+			<< ", \"uncached\": { \"ms\": " << plain.seconds * 1e3 << ", \"rays_per_pixel\": " << plain.raysPerPixel << ", \"rmse\": " << rmse(plain) << " }"
+			<< ", \"cached\": { \"ms\": " << cached.seconds * 1e3 << ", \"rays_per_pixel\": " << cached.raysPerPixel << ", \"rmse\": " << rmse(cached)
+			<< ", \"cells\": " << cache.size() << ", \"memory_bytes\": " << cache.memoryBytes() << " } }";
+		results.push_back(out.str());
+	}
+
+	return results;
+}
+
+// -- Denoiser: filter time and error against a high-spp reference (gamma encoded, as displayed) of a
+// 1 spp render, raw and denoised; once at a width that isn't a multiple of 4 and an odd height
+
+static std::vector<std::string> denoiserBenchmarks(const Settings& settings, const fTexture& skybox) {
+	BenchScene scene;
+	genScene1(scene.world, scene.materials);
+	scene.prepare();
+
+	RecursiveIntegrator integrator;
+	integrator.numThreads = settings.threads;
+	Denoiser denoiser;
+	denoiser.numThreads = settings.threads;
+
+	const uint32_t size = std::min<uint32_t>(settings.width, 128);
+	std::vector<std::string> results;
+	const Camera cam(vec3(0, 0, -2), vec3(0, 0, 1), vec3(0, 1, 0), 40);
+	for(const auto& [width, height] : { std::pair<uint32_t, uint32_t>{ size, size }, { size - 3, size / 2 + 1 } }) {
+		const auto render = [&](const uint32_t spp, AOVBuffer& aov) {
+			seed_random(SEED);
+			integrator.render(scene.world, scene.materials, skybox, cam, aov, spp, settings.bounces);
+		};
+
+		AOVBuffer referenceAOV(width, height), noisyAOV(width, height);
+		render(64, referenceAOV);
+		render(1, noisyAOV);
+		fTexture reference(width, height), noisy(width, height), denoised(width, height);
+		referenceAOV.resolve(reference);
+		noisyAOV.resolve(noisy);
+
+		const Clock::time_point start = Clock::now();
+		for(uint32_t f = 0; f < settings.frames; f++)
+			denoiser.filter(noisyAOV, denoised);
+		const double filterSeconds = secondsSince(start) / settings.frames;
+
+		const auto rmse = [&](const fTexture& image) {
+			double sum = 0;
+			for(size_t i = 0; i < (size_t)width * height; i++)
+				for(int shift = 0; shift < 24; shift += 8) {
+					const double d = ((int)((image.pixels[i] >> shift) & 0xFF) - (int)((reference.pixels[i] >> shift) & 0xFF)) / 255.;
+					sum += d * d;
+				}
+			return std::sqrt(sum / (3. * width * height));
+		};
+
+		std::ostringstream out;
+		out << "{ \"width\": " << width << ", \"height\": " << height << ", \"filter_ms\": " << filterSeconds * 1e3
+			<< ", \"noisy_rmse\": " << rmse(noisy) << ", \"denoised_rmse\": " << rmse(denoised) << " }";
+		results.push_back(out.str());
+	}
+	return results;
+}
+
+// -- Texture LOD: a large noise skybox seen directly and through the spheres of scene2, looked up at
+// level 0 only vs at the level the ray cone selects. Error at low spp against a supersampled
+// level-0 reference, plus frame time (the level-0 lookups stride over the whole texture).
+static std::string textureLodBenchmark(const Settings& settings) {
+	fTexture noise(4096, 2048);
+	std::mt19937 rng(SEED);
+	for(int i = 0; i < noise.width * noise.height; i++)
+		noise.pixels[i] = rng() & 0xFFFFFF;
+	fTexture noiseMipped(noise.width, noise.height);
+	std::copy(noise.pixels, noise.pixels + noise.width * noise.height, noiseMipped.pixels);
+	noiseMipped.generateMips();
+
+	BenchScene scene;
+	seed_random(SEED);
+	genScene2(scene.world, scene.materials, 11);
+	scene.cam = lookAt(vec3(13, -2, 3), vec3(0, 0, 0), 20);
+
+	const uint32_t width = std::min<uint32_t>(settings.width, 128);
+	const uint32_t referenceSpp = settings.width >= 256 ? 256 : 64;
+
+	RecursiveIntegrator integrator;
+	integrator.numThreads = settings.threads;
+
+	const auto render = [&](const fTexture& skybox, const uint32_t spp, double& seconds) {
+		AOVBuffer aov(width, width);
+		seed_random(SEED);
+		const Clock::time_point start = Clock::now();
+		integrator.render(scene.world, scene.materials, skybox, scene.cam, aov, spp, settings.bounces);
+		seconds = secondsSince(start);
+
+		std::vector<float> pixels;
+		for(uint32_t y = 0; y < width; y++)
+			for(uint32_t x = 0; x < width; x++)
+				for(int c = 0; c < 3; c++)
+					pixels.push_back(aov.radiance[c][aov.index(x, y)]);
+		return pixels;
+	};
+
+	double referenceSeconds, level0Seconds, mippedSeconds;
+	const std::vector<float> reference = render(noise, referenceSpp, referenceSeconds);
+	const std::vector<float> level0 = render(noise, settings.spp, level0Seconds);
+	const std::vector<float> mipped = render(noiseMipped, settings.spp, mippedSeconds);
+
+	const auto rmse = [&](const std::vector<float>& image) {
+		double sum = 0;
+		for(size_t i = 0; i < image.size(); i++)
+			sum += (image[i] - reference[i]) * (image[i] - reference[i]);
+		return std::sqrt(sum / image.size());
+	};
+
+	std::ostringstream out;
+	out << "{ \"scene\": \"scene2_full\", \"skybox\": \"" << noise.width << "x" << noise.height << " noise\""
+		<< ", \"width\": " << width << ", \"spp\": " << settings.spp << ", \"reference_spp\": " << referenceSpp
+		<< ",\n    \"level0\": { \"seconds\": " << level0Seconds << ", \"rmse\": " << rmse(level0) << " }"
+		<< ",\n    \"ray_cone_lod\": { \"seconds\": " << mippedSeconds << ", \"rmse\": " << rmse(mipped) << " } }";
+	return out.str();
+}
+
+// -- Voxel LOD: the voxel scenes traced at full resolution only (maxLod 0) vs with the ray cones
+// switching to coarser levels. Frame time and error against a full-resolution reference, plus the
+// DDA steps taken (RT_PROFILING builds).
+static std::vector<std::string> voxelLodBenchmarks(const Settings& settings, const fTexture& skybox) {
+	const uint32_t width = std::min<uint32_t>(settings.width, 128);
+	const uint32_t referenceSpp = settings.width >= 256 ? 256 : 64;
+
+	std::vector<std::string> results;
+	for(const bool terrain : { false, true }) {
+		BenchScene scene;
+		seed_random(SEED);
+		if(terrain) {
+			scene.name = "voxel_terrain";
+			genVoxelTerrain(scene.world, scene.materials, 256, (int)SEED);
+			scene.cam = lookAt(vec3(-40, -60, -40), vec3(128, 100, 128), 50);
+		} else {
+			scene.name = "voxel_lights";
+			genVoxelLights(scene.world, scene.materials, 48);
+			scene.cam = lookAt(vec3(3, 7, 3), vec3(24, 13, 24), 60);
+		}
+		scene.prepare();
+
+		std::vector<VoxelVolume*> volumes;
+		for(const auto& object : scene.world.objects)
+			if(VoxelVolume *const volume = dynamic_cast<VoxelVolume*>(object.get()))
+				volumes.push_back(volume);
+
+		RecursiveIntegrator integrator;
+		integrator.numThreads = settings.threads;
+		integrator.lights = scene.lights.empty() ? nullptr : &scene.lights;
+
+		struct Run {
+			std::vector<float> pixels;
+			double seconds;
+			uint64_t ddaSteps;
+		};
+		const auto render = [&](const uint32_t maxLod, const uint32_t spp) {
+			for(VoxelVolume *const volume : volumes)
+				volume->maxLod = maxLod;
+
+			AOVBuffer aov(width, width);
+			uint64_t before[Profiler::NUM_COUNTERS], after[Profiler::NUM_COUNTERS];
+			Profiler::totals(before);
+			seed_random(SEED);
+			Run run;
+			const Clock::time_point start = Clock::now();
+			integrator.render(scene.world, scene.materials, skybox, scene.cam, aov, spp, settings.bounces);
+			run.seconds = secondsSince(start);
+			Profiler::totals(after);
+			run.ddaSteps = after[(size_t)ProfileCounter::DDASteps] - before[(size_t)ProfileCounter::DDASteps];
+
+			for(uint32_t y = 0; y < width; y++)
+				for(uint32_t x = 0; x < width; x++)
+					for(int c = 0; c < 3; c++)
+						run.pixels.push_back(aov.radiance[c][aov.index(x, y)]);
+			return run;
+		};
+
+		const Run reference = render(0, referenceSpp);
+		const auto rmse = [&](const Run& run) {
+			double sum = 0;
+			for(size_t i = 0; i < run.pixels.size(); i++)
+				sum += (run.pixels[i] - reference.pixels[i]) * (run.pixels[i] - reference.pixels[i]);
+			return std::sqrt(sum / run.pixels.size());
+		};
+
+		const auto runJSON = [&](const Run& run) {
+			std::ostringstream out;
+			out << "{ \"ms\": " << run.seconds * 1e3 << ", \"rmse\": " << rmse(run);
+#ifdef RT_PROFILING
+			out << ", \"dda_steps\": " << run.ddaSteps;
+#endif
+			out << " }";
+			return out.str();
+		};
+
+		const Run full = render(0, settings.spp);
+		const Run lod = render(VoxelVolume::MAX_LEVELS, settings.spp);
+
+		std::ostringstream out;
+		out << "{ \"scene\": \"" << scene.name << "\", \"width\": " << width << ", \"spp\": " << settings.spp << ", \"reference_spp\": " << referenceSpp
+			<< ", \"levels\": " << (volumes.empty() ? 0 : volumes[0]->numLevels())
+			<< ",\n    \"full_resolution\": " << runJSON(full)
+			<< ",\n    \"lod\": " << runJSON(lod) << " }";
+		results.push_back(out.str());
+	}
+
+	return results;
+}
+
+// -- Render modes: frame time and rays per pixel (shadow / AO rays included) of the path tracer and
+// the preview modes on the same scene, both integrators
+static std::vector<std::string> renderModeBenchmarks(const Settings& settings, const fTexture& skybox) {
+	BenchScene scene;
+	seed_random(SEED);
+	genVoxelLights(scene.world, scene.materials, 48);
+	scene.cam = lookAt(vec3(3, 7, 3), vec3(24, 13, 24), 60);
+	scene.prepare();
+
+	const CountingHittable counted(scene.world);
+	AOVBuffer aov(settings.width, settings.width);
+
+	RecursiveIntegrator recursive;
+	WavefrontIntegrator wavefront;
+	recursive.numThreads = wavefront.numThreads = settings.threads;
+	recursive.lights = wavefront.lights = &scene.lights;
+
+	const auto time = [&](auto& integrator, double& raysPerPixel) {
+		const uint64_t raysBefore = CountingHittable::total();
+		const Clock::time_point start = Clock::now();
+		for(uint32_t f = 0; f < settings.frames; f++)
+			integrator.render(counted, scene.materials, skybox, scene.cam, aov, settings.spp, settings.bounces);
+		raysPerPixel = (double)(CountingHittable::total() - raysBefore) / ((size_t)settings.width * settings.width * settings.frames);
+		return secondsSince(start) * 1e3 / settings.frames;
+	};
+
+	std::vector<std::string> results;
+	for(uint8_t m = 0; m < (uint8_t)RenderMode::Count; m++) {
+		recursive.mode = wavefront.mode = (RenderMode)m;
+
+		double recursiveRays, wavefrontRays;
+		seed_random(SEED);
+		const double recursiveMs = time(recursive, recursiveRays);
+		seed_random(SEED);
+		const double wavefrontMs = time(wavefront, wavefrontRays);
+
+		std::ostringstream out;
+		out << "{ \"mode\": \"" << renderModeName((RenderMode)m) << "\""
+			<< ", \"recursive_ms\": " << recursiveMs << ", \"wavefront_ms\": " << wavefrontMs
+			<< ", \"rays_per_pixel\": " << recursiveRays << ", \"wavefront_rays_per_pixel\": " << wavefrontRays << " }";
+		results.push_back(out.str());
+	}
+
+	return results;
+}
+
+// Light tree cost vs number of emissive voxels: one selection + its pmf per shading point, and one
+// incremental voxel edit (light added / removed, neighbours refit)
+static std::vector<std::string> lightTreeBenchmarks(const size_t samples) {
+	std::vector<std::string> results;
+
+	for(const size_t numEmitters : { 64, 1024, 16384, 131072 }) {
+		MaterialTable materials;
+		const std::vector<material_id> palette { materials.add(Emissive(color(4.f, 3.f, 2.f))) };
+		constexpr size_t SIZE = 128;
+		VoxelVolume volume(SIZE, SIZE / 2, SIZE, palette);
+
+		std::mt19937 rng(SEED);
+		const auto coord = [&](const size_t n) { return (size_t)(rng() % n); };
+		std::vector<std::array<size_t, 3>> emitters;
+		while(emitters.size() < numEmitters) {
+			const size_t x = coord(SIZE), y = coord(SIZE / 2), z = coord(SIZE);
+			if(!volume.get(x, y, z)) {
+				volume.set(x, y, z, 1);
+				emitters.push_back({ x, y, z });
+			}
+		}
+
+		LightList lights;
+		const Clock::time_point buildStart = Clock::now();
+		volume.collectLights(lights, materials);
+		lights.build();
+		const double buildSeconds = secondsSince(buildStart);
+		const size_t numLights = lights.size(), depth = lights.lightTree().depth();
+
+		std::vector<vec3> points(4096);
+		for(vec3& p : points)
+			p = vec3(random_real(0, SIZE), random_real(0, SIZE / 2), random_real(0, SIZE));
+
+		real checksum = 0;
+		const Clock::time_point sampleStart = Clock::now();
+		for(size_t i = 0; i < samples; i++) {
+			const vec3& p = points[i % points.size()];
+			uint32_t id;
+			real pmf;
+			if(lights.lightTree().select(p, id, pmf))
+				checksum += pmf + lights.lightTree().pmf(p, id);
+		}
+		const double sampleSeconds = secondsSince(sampleStart);
+
+		// switch an emitter off and back on: light + neighbour faces removed, then restored
+		const size_t edits = 10000;
+		const Clock::time_point editStart = Clock::now();
+		for(size_t i = 0; i < edits; i += 2) {
+			const std::array<size_t, 3>& e = emitters[coord(emitters.size())];
+			volume.set(e[0], e[1], e[2], 0);
+			volume.set(e[0], e[1], e[2], 1);
+		}
+		const double editSeconds = secondsSince(editStart);
+
+		std::ostringstream out;
+		out << "{ \"emitters\": " << numEmitters
+			<< ", \"lights\": " << numLights
+			<< ", \"depth\": " << depth
+			<< ", \"depth_after_edits\": " << lights.lightTree().depth()
+			<< ", \"build_seconds\": " << buildSeconds
+			<< ", \"ns_per_select_and_pmf\": " << (sampleSeconds * 1e9 / samples)
+			<< ", \"ns_per_voxel_edit\": " << (editSeconds * 1e9 / edits)
+			<< ", \"checksum\": " << checksum << " }";
+		results.push_back(out.str());
+	}
+
+	return results;
+}
+
+
+int main(int argc, char** argv) {
+	Settings settings;
+
+	for(int i = 1; i < argc; i++) {
+		const auto next = [&]() -> std::string {
+			if(i + 1 >= argc)
+				throw std::runtime_error(std::string("Missing value for ") + argv[i]);
+			return argv[++i];
+		};
+
+		if(!strcmp(argv[i], "--width")) settings.width = std::stoi(next());
+		else if(!strcmp(argv[i], "--spp")) settings.spp = std::stoi(next());
+		else if(!strcmp(argv[i], "--bounces")) settings.bounces = std::stoi(next());
+		else if(!strcmp(argv[i], "--frames")) settings.frames = std::stoi(next());
+		else if(!strcmp(argv[i], "--threads")) settings.threads = std::stoi(next());
+		else if(!strcmp(argv[i], "--res")) settings.res = next();
+		else if(!strcmp(argv[i], "--out")) settings.out = next();
+		else if(!strcmp(argv[i], "--sequence")) {
+			settings.sequenceScene = next();
+			settings.sequenceDirectory = next();
+		}
+		else if(!strcmp(argv[i], "--quick")) {
+			settings.width = 64;
+			settings.spp = 1;
+			settings.frames = 1;
+		} else {
+			std::cerr << "Unknown argument: " << argv[i] << "\n";
+			return 1;
+		}
+	}
+
+	if(!settings.sequenceScene.empty()) {
+		Scene scene;
+		AccelCache accelCache(std::filesystem::path(settings.sequenceScene).parent_path() / ".accel");
+		try {
+			loadScene(settings.sequenceScene, scene, settings.threads, &accelCache);
+		} catch(const std::exception& ex) {
+			std::cerr << ex.what() << "\n";
+			return 1;
+		}
+		return renderSequence(scene, settings.sequenceDirectory, std::cerr, settings.threads);
+	}
+
+	const fTexture skybox = makeSkybox();
+
+	std::ostringstream json;
+	json << "{\n";
+	json << "  \"config\": { \"width\": " << settings.width << ", \"height\": " << settings.width
+		<< ", \"spp\": " << settings.spp << ", \"bounces\": " << settings.bounces
+		<< ", \"frames\": " << settings.frames << ", \"threads\": " << settings.threads
+		<< ", \"seed\": " << SEED << ", \"precision\": \"" << (sizeof(real) == sizeof(double) ? "double" : "float") << "\" },\n";
+
+	// -- scenes
+	json << "  \"scenes\": [\n";
+	const auto builders = sceneBuilders(settings);
+	for(size_t i = 0; i < builders.size(); i++) {
+		BenchScene scene;
+		seed_random(SEED);
+
+		const Clock::time_point buildStart = Clock::now();
+		try {
+			builders[i](scene);
+			scene.prepare();
+		} catch(const std::exception& ex) {
+			scene.error = ex.what();
+		}
+		const double buildSeconds = secondsSince(buildStart);
+
+		std::cerr << "scene " << scene.name << "\n";
+		json << "    { \"name\": \"" << scene.name << "\"";
+
+		if(!scene.error.empty()) {
+			json << ", \"error\": \"" << scene.error << "\" }";
+		} else {
+			RecursiveIntegrator recursive;
+			WavefrontIntegrator wavefront;
+			json << ", \"build_seconds\": " << buildSeconds
+				<< ", \"objects\": " << scene.world.objects.size()
+				<< ", \"materials\": " << scene.materials.size()
+				<< ", \"lights\": " << scene.lights.size()
+				<< ",\n      \"recursive\": " << renderJSON(timeRender(recursive, scene, skybox, settings, settings.threads))
+				<< ",\n      \"wavefront\": " << renderJSON(timeRender(wavefront, scene, skybox, settings, settings.threads))
+				<< ",\n      \"peak_memory_bytes\": " << peakMemoryBytes() << " }";
+		}
+		json << (i + 1 < builders.size() ? ",\n" : "\n");
+	}
+	json << "  ],\n";
+
+	// -- intersections
+	std::cerr << "intersections\n";
+	const std::vector<std::string> intersections = intersectionBenchmarks(settings, settings.width >= 256 ? 1000000 : 100000);
+	json << "  \"intersections\": [\n";
+	for(size_t i = 0; i < intersections.size(); i++)
+		json << "    " << intersections[i] << (i + 1 < intersections.size() ? ",\n" : "\n");
+	json << "  ],\n";
+
+	std::cerr << "dda\n";
+	json << "  \"dda\": " << ddaBenchmark(settings.width >= 256 ? 1000000 : 200000) << ",\n";
+
+	std::cerr << "voxel meshing\n";
+	const std::vector<std::string> voxelMeshing = voxelMeshingBenchmarks(settings, skybox, settings.width >= 256 ? 100000 : 20000);
+	json << "  \"voxel_meshing\": [\n";
+	for(size_t i = 0; i < voxelMeshing.size(); i++)
+		json << "    " << voxelMeshing[i] << (i + 1 < voxelMeshing.size() ? ",\n" : "\n");
+	json << "  ],\n";
+
+	std::cerr << "arena\n";
+	const std::vector<std::string> arena = arenaBenchmarks(settings, skybox, settings.width >= 256 ? 1000000 : 250000, settings.width >= 256 ? 100000 : 20000);
+	json << "  \"arena\": [\n";
+	for(size_t i = 0; i < arena.size(); i++)
+		json << "    " << arena[i] << (i + 1 < arena.size() ? ",\n" : "\n");
+	json << "  ],\n";
+
+	std::cerr << "scene loading\n";
+	json << "  \"scene_loading\": " << sceneLoadingBenchmark(settings, 8, settings.width >= 256 ? 128 : 64, 20000) << ",\n";
+
+	std::cerr << "accel cache\n";
+	const std::vector<std::string> accelCache = accelCacheBenchmarks(settings, settings.width >= 256 ? 100000 : 20000);
+	json << "  \"accel_cache\": [\n";
+	for(size_t i = 0; i < accelCache.size(); i++)
+		json << "    " << accelCache[i] << (i + 1 < accelCache.size() ? ",\n" : "\n");
+	json << "  ],\n";
+
+	std::cerr << "bvh builders\n";
+	const std::vector<std::string> bvhBuilders = bvhBuilderBenchmarks(settings, settings.width >= 256 ? 100000 : 20000);
+	json << "  \"bvh_builders\": [\n";
+	for(size_t i = 0; i < bvhBuilders.size(); i++)
+		json << "    " << bvhBuilders[i] << (i + 1 < bvhBuilders.size() ? ",\n" : "\n");
+	json << "  ],\n";
+
+	std::cerr << "top-level bvh\n";
+	json << "  \"top_level_bvh\": [\n";
+	for(const int count : { 2, 4, 8, 16 })
+		json << "    " << topLevelBenchmark(count, settings.width >= 256 ? 100000 : 20000) << (count < 16 ? ",\n" : "\n");
+	json << "  ],\n";
+
+	// -- vector math
+	std::cerr << "vector math\n";
+	const std::vector<std::string> vectorMath = vectorBenchmarks(settings.width >= 256 ? 10000000 : 1000000);
+	json << "  \"vector_math\": { \"simd\": " <<
+#ifdef RT_SIMD_VEC
+		"true"
+#else
+		"false"
+#endif
+		<< ", \"ops\": [\n";
+	for(size_t i = 0; i < vectorMath.size(); i++)
+		json << "    " << vectorMath[i] << (i + 1 < vectorMath.size() ? ",\n" : "\n");
+	json << "  ] },\n";
+
+	// -- slab tests
+	std::cerr << "slab tests\n";
+	const std::vector<std::string> slabs = boxBenchmarks(settings.width >= 256 ? 10000000 : 1000000);
+	json << "  \"slab_tests\": [\n";
+	for(size_t i = 0; i < slabs.size(); i++)
+		json << "    " << slabs[i] << (i + 1 < slabs.size() ? ",\n" : "\n");
+	json << "  ],\n";
+
+	// -- light sampling
+	std::cerr << "light sampling\n";
+	json << "  \"light_sampling\": " << lightSamplingBenchmark(settings, skybox) << ",\n";
+
+	std::cerr << "denoiser\n";
+	const std::vector<std::string> denoising = denoiserBenchmarks(settings, skybox);
+	json << "  \"denoiser\": [\n";
+	for(size_t i = 0; i < denoising.size(); i++)
+		json << "    " << denoising[i] << (i + 1 < denoising.size() ? ",\n" : "\n");
+	json << "  ],\n";
+
+	std::cerr << "texture lod\n";
+	json << "  \"texture_lod\": " << textureLodBenchmark(settings) << ",\n";
+
+	std::cerr << "voxel lod\n";
+	const std::vector<std::string> voxelLod = voxelLodBenchmarks(settings, skybox);
+	json << "  \"voxel_lod\": [\n";
+	for(size_t i = 0; i < voxelLod.size(); i++)
+		json << "    " << voxelLod[i] << (i + 1 < voxelLod.size() ? ",\n" : "\n");
+	json << "  ],\n";
+
+	std::cerr << "render modes\n";
+	const std::vector<std::string> renderModes = renderModeBenchmarks(settings, skybox);
+	json << "  \"render_modes\": [\n";
+	for(size_t i = 0; i < renderModes.size(); i++)
+		json << "    " << renderModes[i] << (i + 1 < renderModes.size() ? ",\n" : "\n");
+	json << "  ],\n";
+
+	std::cerr << "radiance cache\n";
+	const std::vector<std::string> radianceCache = radianceCacheBenchmarks(settings, skybox);
+	json << "  \"radiance_cache\": [\n";
+	for(size_t i = 0; i < radianceCache.size(); i++)
+		json << "    " << radianceCache[i] << (i + 1 < radianceCache.size() ? ",\n" : "\n");
+	json << "  ],\n";
+
+	std::cerr << "animation\n";
+	const std::vector<std::string> animation = animationBenchmarks(settings);
+	json << "  \"animation\": [\n";
+	for(size_t i = 0; i < animation.size(); i++)
+		json << "    " << animation[i] << (i + 1 < animation.size() ? ",\n" : "\n");
+	json << "  ],\n";
+
+	std::cerr << "light tree\n";
+	const std::vector<std::string> lightTree = lightTreeBenchmarks(settings.width >= 256 ? 1000000 : 100000);
+	json << "  \"light_tree\": [\n";
+	for(size_t i = 0; i < lightTree.size(); i++)
+		json << "    " << lightTree[i] << (i + 1 < lightTree.size() ? ",\n" : "\n");
+	json << "  ],\n";
+
+	// -- thread scaling (terrain, recursive integrator)
+	std::cerr << "thread scaling\n";
+	{
+		BenchScene scene;
+		seed_random(SEED);
+		builders.back()(scene);
+		scene.prepare();
+
+		json << "  \"thread_scaling\": { \"scene\": \"" << scene.name << "\", \"integrator\": \"recursive\", \"points\": [\n";
+		double baseline = 0;
+		for(uint32_t threads = 1; ; threads = std::min(threads * 2, settings.threads)) {
+			RecursiveIntegrator recursive;
+			const RenderResult r = timeRender(recursive, scene, skybox, settings, threads);
+			const double raysPerSecond = (r.primaryRays + r.secondaryRays) / r.seconds;
+			if(threads == 1)
+				baseline = raysPerSecond;
+
+			json << "    { \"threads\": " << threads
+				<< ", \"rays_per_second\": " << raysPerSecond
+				<< ", \"speedup\": " << (raysPerSecond / baseline) << " }";
+
+			if(threads >= settings.threads)
+				break;
+			json << ",\n";
+		}
+		json << "\n  ] },\n";
+	}
+
+	json << "  \"peak_memory_bytes\": " << peakMemoryBytes() << "\n";
+	json << "}\n";
+
+	if(settings.out.empty()) {
+		std::cout << json.str();
+	} else {
+		std::ofstream file(settings.out);
+		file << json.str();
+		std::cerr << "Wrote " << settings.out << "\n";
+	}
+
+	return 0;
+}
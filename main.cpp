@@ -1,458 +1,585 @@
-#include <iostream>
-#include <cstdint>
-#include <cmath>
-
-#include <string>
-#include <ostream>
-
-#include <thread>
-#include <mutex>
-
-#include "BWindow/GDIWindow.h"
-
-#include "RayTracing/general.h"
-
-#include "RayTracing/vec.h"
-#include "RayTracing/color.h"
-#include "RayTracing/Ray.h"
-#include "RayTracing/Camera.h"
-
-#include "RayTracing/Objects/hittable.h"
-#include "RayTracing/Objects/hittable_list.h"
-
-#include "RayTracing/Objects/Sphere.h"
-#include "RayTracing/Objects/Mesh.h"
-#include "RayTracing/Objects/VoxelVolume.h"
-
-#include "RayTracing/Materials/Lambertian.h"
-#include "RayTracing/Materials/Metal.h"
-#include "RayTracing/Materials/Dielectric.h"
-
-#include "RayTracing/Texture/fTexture.h"
-
-#include "RayTracing/exampleScenes.h"
-
-#include "stb/stb_image.h"
-
-
-
-
-
-inline uint32_t pixelColor(const vec3 uv, const vec3 pixelSize, const hittable_list& world, const fTexture& skybox, const Camera& cam, const uint32_t SAMPLES_PER_PIXEL, const uint32_t MAX_NUM_BOUNCES, const uint32_t x, const uint32_t y) {
-	color pixel_color{};
-
-	for (uint32_t s = 0; s < SAMPLES_PER_PIXEL; s++) {
-		const vec3 screenPos = uv + vec3(random_double(0, 1), random_double(0, 1), 0) * pixelSize;
-
-		const Ray r = cam.getRay(screenPos.x(), screenPos.y());
-
-		pixel_color += ray_color(r, world, skybox, MAX_NUM_BOUNCES);
-	}
-
-	const double scale = 1. / SAMPLES_PER_PIXEL;
-	pixel_color[0] = sqrt(scale * pixel_color.x());
-	pixel_color[1] = sqrt(scale * pixel_color.y());
-	pixel_color[2] = sqrt(scale * pixel_color.z());
-
-	return intColor(pixel_color);
-}
-
-std::atomic_uint32_t SAMPLES_PER_PIXEL = 1;
-std::atomic_uint32_t MAX_NUM_BOUNCES = 8;
-
-fTexture tex(400, 400);
-
-std::atomic_uint32_t lastLine = 0;
-std::atomic_uint32_t threadsWorking = 0;
-void renderThread(volatile bool* stopThread, volatile Camera *camRef, const hittable_list& world, const fTexture& skybox, volatile bool *idle) {
-	// static std::atomic_uint32_t lastLine = 0;
-
-	for(;;) {
-		// LARGE_INTEGER before, after;
-		// QueryPerformanceCounter(&before);
-		// for(; !running; );
-
-		uint32_t targetLine = lastLine.fetch_add(1);// % tex.height;
-
-		// if(targetLine == tex.height - 1)
-		// 	lastLine.fetch_sub(tex.height);
-
-		++threadsWorking;
-		if(targetLine > tex.height - 1) {
-			--threadsWorking;
-			// *idle = true;
-			continue;
-		}
-
-		// *idle = false;
-
-		for (uint32_t x = 0; x < tex.width; x++) {
-			if(*stopThread)
-				return;
-
-			Camera cam = *(Camera*)camRef;
-
-			tex.pixels[targetLine * tex.width + x] = pixelColor(
-					vec3(x*1./tex.width - .5, targetLine*1./tex.width - .5, 0),
-					vec3(1. / tex.width, 1. / tex.height, 0),
-					world,
-					skybox,
-					cam,
-					SAMPLES_PER_PIXEL.load(),
-					MAX_NUM_BOUNCES.load(),
-					x,
-					targetLine);
-			// tex.pixels[targetLine * tex.width + x] = skybox.pixels[
-			// 	(targetLine * skybox.height / tex.height)
-			// 	* skybox.width
-			// 	+ (x * skybox.width / tex.width)
-			// ];
-		}
-
-		// QueryPerformanceCounter(&after);
-		// double elapsed = (after.QuadPart - before.QuadPart) / 10.; // micros
-		// std::cout << "Line took: " << (elapsed / 1000.) << "ms\n";
-	}
-}
-
-int main2(int argc, char** argv);
-
-int main(int argc, char** argv) {
-	std::cout << "Current Working directory: ";
-	#if defined(_WIN32) || defined(_WIN64)
-	system("cd");
-	#else
-	system("pwd");
-	#endif
-
-	try {
-		return main2(argc, argv);
-	} catch(const std::exception& ex) {
-		std::cout << "Unhandled Exception: " << ex.what() << "\n";
-	}
-}
-
-int main2(int argc, char** argv) {
-	std::cout << "Program started\n";
-	fTexture skybox;
-
-	{
-		int nChannelsSkybox;
-		int width, height;
-		stbi_set_flip_vertically_on_load(false); // dont flip loaded textures on the y-axis.
-
-		uint8_t *const data = stbi_load("../res/Desert_Highway/Road_to_MonumentValley_8k.jpg", &width, &height, &nChannelsSkybox, 0);
-		// uint8_t *const data = stbi_load("../res/Desert_Highway/Road_to_MonumentValley_Ref.hdr", &width, &height, &nChannelsSkybox, 0);
-		// uint8_t *const data = stbi_load("../res/OutdoorHDRI024_4K-HDR.exr", &width, &height, &nChannelsSkybox, 0);
-		// uint8_t *const data = stbi_load("../res/full-seamless-spherical-hdri-panorama-degrees-angle-view-wooden-pier-near-lake-evening-equirectangular-projection-159712935.jpg", &width, &height, &nChannelsSkybox, 0);
-
-		if (!data)
-			throw std::runtime_error("Failed to load skybox image file");
-
-		// std::cout << "channels: " << nChannelsSkybox << "\n";
-
-		std::cout << "Loading Skybox\n";
-		skybox = fTexture(width, height);
-		std::cout << "Loaded Skybox\n";
-
-		for(size_t y = 0; y < height; y++)
-			for(size_t x = 0; x < width; x++)
-				skybox.pixels[y * width + x] = intColor( // todo: blur
-						vec3(
-							data[(y * width + x) * 3 + 0],
-							data[(y * width + x) * 3 + 1],
-							data[(y * width + x) * 3 + 2]
-						) / 255.
-					);
-
-		stbi_image_free(data);
-	}
-
-	volatile bool stopThreads = false;
-
-	// -- Simple Scene
-	// vec3 camPos(0, 0, -2);
-	// vec3 camDir(0, 0, 1);
-	// float camFOV = 40;
-	// float focusDist = 1.;
-	// float aperture = 0;
-	// hittable_list world;
-	// genScene1(world);
-
-	// -- Complex Scene
-	vec3 camPos = vec3(-10, 4, 4);
-	float camDirHor = 0, camDirVert = 0;
-	vec3 camDir = vec3(1, 0, 0);
-	// vec3 camDir = unit_vector(-camPos);
-	float camFOV = 20; // 100
-	float focusDist = 10.;
-	float aperture = 0;//0.1;
-	hittable_list world;
-
-	// genScene2(world);
-	world.add(std::make_shared<VoxelVolume>());
-
-	// Flat mirror:
-	// std::shared_ptr<Material> material4 = std::make_shared<Metal>(color(1., .75, .75), .2);
-	// // std::shared_ptr<Material> material4 = std::make_shared<Metal>(color(1., .75, .75), .0);
-	// world.add(std::make_shared<Triangle>(vec3(4, 0, 2), vec3(4, -2, 2), vec3(6, 0, 2), material4));
-	// world.add(std::make_shared<Triangle>(vec3(6, -2, 2), vec3(4, -2, 2), vec3(6, 0, 2), material4));
-
-	std::shared_ptr<Material> material5 = std::make_shared<Metal>(color(1., .75, .75), .03);
-	// std::shared_ptr<Material> material5 = std::make_shared<Metal>(color(1., .75, .75), .0);
-	// std::shared_ptr<Dielectric> material5 = std::make_shared<Dielectric>(1.5);
-	/*
-	{
-		FILE *const fp = fopen("../res/Bunny.stl", "rb");
-
-		if(fp == nullptr)
-			throw std::runtime_error("Error reading STL File.");
-
-		uint8_t header[80];
-		fread(header, 1, 80, fp);
-
-		uint32_t numTris;
-		fread(&numTris, 4, 1, fp);
-		printf("Number of Triangles: %d\n", numTris);
-
-		struct StlTriangle {
-			vec3 normal;
-			vec3 vertices[3];
-
-			uint16_t attrCount;
-		};
-
-		StlTriangle *triangles = new StlTriangle[numTris];
-
-		// read triangles:
-		for(size_t i = 0; i < numTris; i++) {
-			fread(&triangles[i].normal.x(), sizeof(float), 1, fp);
-			fread(&triangles[i].normal.y(), sizeof(float), 1, fp);
-			fread(&triangles[i].normal.z(), sizeof(float), 1, fp);
-
-			for(size_t vert = 0; vert < 3; vert++) {
-				fread(&triangles[i].vertices[vert].x(), sizeof(float), 1, fp);
-				fread(&triangles[i].vertices[vert].y(), sizeof(float), 1, fp);
-				fread(&triangles[i].vertices[vert].z(), sizeof(float), 1, fp);
-			}
-
-			fread(&triangles[i].attrCount, sizeof(uint16_t), 1, fp);
-		}
-
-		fclose(fp);
-
-		// correct coordinates:
-		for(int i = 0; i < numTris; i++) {
-			for(int j = 0; j < 3; j++) {
-				std::swap(triangles[i].vertices[j].y(), triangles[i].vertices[j].z());
-				triangles[i].vertices[j].y() *= -1;
-			}
-		}
-
-		std::vector<Triangle> mesh;
-
-		for(int i = 0; i < numTris; i++) {
-			vec3 v0{ triangles[i].vertices[0].x(), triangles[i].vertices[0].y(), triangles[i].vertices[0].z() };
-			vec3 v1{ triangles[i].vertices[1].x(), triangles[i].vertices[1].y(), triangles[i].vertices[1].z() };
-			vec3 v2{ triangles[i].vertices[2].x(), triangles[i].vertices[2].y(), triangles[i].vertices[2].z() };
-			// world.add(std::make_shared<Triangle>(v0 * .01, v1 * .01, v2 * .01, material4));
-			mesh.push_back(Triangle(v0 * .01, v1 * .01, v2 * .01, material5));
-		}
-
-		world.add(std::make_shared<Mesh>(std::move(mesh)));
-
-		delete[] triangles;
-	}
-	*/
-
-	// fTexture tex(800, 800);
-	// tex = fTexture(800, 800);
-	// renderTarget = &tex;
-	Camera cam(camPos, camDir, vec3(0, 1, 0), camFOV, 1, aperture, focusDist);
-
-	static constexpr uint16_t NUM_THREADS = 6;
-	std::thread *renderThreads[NUM_THREADS];
-	volatile bool idleThreads[NUM_THREADS];
-	for(uint16_t t = 0; t < NUM_THREADS; t++)
-		renderThreads[t] = new std::thread(renderThread, &stopThreads, &cam, std::cref(world), std::cref(skybox), idleThreads + t);
-
-	GDIWindow win(800, 800);
-	// GDIWindowCustom win(800, 800);
-	int32_t pmouseX, pmouseY;
-
-	for(;;) {
-		win.pollMsg();
-
-		if(win.shouldClose())
-			break;
-
-		// if(tex.width != win.width/2 || tex.height != win.height/2) {
-		// 	while(lastLine < tex.height);
-		// 	for(;;) {
-		// 		bool idle = true;
-		// 		for(int t = 0; t < NUM_THREADS; t++)
-		// 			if(idleThreads[t] == false)
-		// 				idle = false;
-		// 		if(idle)
-		// 			break;
-		// 	}
-		// 	delete[] tex.pixels;
-		// 	tex.width = win.width / 2;
-		// 	tex.height = win.height / 2;
-		// 	tex.pixels = new uint32_t[tex.width * tex.height];
-		// 	lastLine = 0;
-		// }
-
-		if(lastLine > tex.height)
-			lastLine = 0;
-
-		int32_t mouseX = win.win.mouseX;
-		int32_t mouseY = win.win.mouseY;
-
-		constexpr float moveSpeed = .02;
-
-		if (GetAsyncKeyState('W') & 0x8000)
-    		camPos += (unit_vector(camDir) * (moveSpeed));
-		if (GetAsyncKeyState('S') & 0x8000)
-			camPos += (unit_vector(camDir) * (-moveSpeed));
-		
-		if (GetAsyncKeyState('D') & 0x8000)
-			camPos += (unit_vector(cam.horizontal) * (moveSpeed));
-		if (GetAsyncKeyState('A') & 0x8000)
-			camPos += (unit_vector(cam.horizontal) * (-moveSpeed));
-
-		if (GetAsyncKeyState(VK_SHIFT) & 0x8000)
-			camPos += (unit_vector(cam.vertical) * (moveSpeed));
-		if (GetAsyncKeyState(' ') & 0x8000)
-			camPos += (unit_vector(cam.vertical) * (-moveSpeed));
-
-		if (GetAsyncKeyState('R') & 0x0001)
-			camFOV += 5;
-		if (GetAsyncKeyState('F') & 0x0001)
-			camFOV -= 5;
-
-		if (GetAsyncKeyState('E') & 0x0001)
-			SAMPLES_PER_PIXEL = SAMPLES_PER_PIXEL.load() * 2;
-		if (GetAsyncKeyState('Q') & 0x0001)
-			if (SAMPLES_PER_PIXEL > 1)
-				SAMPLES_PER_PIXEL = SAMPLES_PER_PIXEL.load() / 2;
-
-		if (GetAsyncKeyState('T') & 0x8000)
-			focusDist += .1;
-		if (GetAsyncKeyState('G') & 0x8000)
-			focusDist -= focusDist>3 ? .1 : 0;
-
-		if (GetAsyncKeyState('Z') & 0x8000)
-			aperture += .003;
-		if (GetAsyncKeyState('H') & 0x8000)
-			aperture -= aperture>=.01 ? .003 : 0;
-
-		// if(GetAsyncKeyState(VK_MBUTTON) & 0x8000) {
-		if(GetAsyncKeyState(VK_LBUTTON) & 0x8000) {
-			vec3 up(0, 1, 0);
-
-			const float dX = mouseX - pmouseX;
-			const float dY = mouseY - pmouseY;
-
-			// const float aHor = (float)radians(dX) / 10.f; // horizontal rotation angle
-			// const float aVert = (float)radians(dY) / 10.f; // vertical rotation angle
-			camDirHor += (float)radians(dX) * .08f; // horizontal rotation angle
-			camDirVert += (float)radians(dY) * .08f; // vertical rotation angle
-
-			camDirVert = std::min<float>(std::max<float>(camDirVert, -radians(90)), radians(90));
-
-
-			// float aX = atan2(camDir.z(), camDir.x()); // left / right tilt
-			// float aY = acos(dot(up, camDir)); // up * camDir = cos(aY) <=> acos(up * camDir) = aY
-			// aY += radians(dY) / 10.;
-			// camDir[1] = cos(aY);
-			// camDir[2] = sin(aY);
-			// {
-			// 	float mX = vec3(0, camDir.x(), camDir.z()).length();
-			// 	aX -= radians(dX) / 10.;
-			// 	camDir[2] = sin(aX) * mX;
-			// 	camDir[0] = cos(aX) * mX;
-			// }
-
-			camDir = vec3(1, 0, 0);
-
-			// Rotate Vertically:
-			camDir = vec3(
-				cos(camDirVert) * camDir.x() + sin(camDirVert) * camDir.y(),
-				-sin(camDirVert) * camDir.x() + cos(camDirVert) * camDir.y(),
-				camDir.z()
-			);
-
-			// Rotate Horizontally (around y axis):
-			camDir = vec3(
-				cos(camDirHor) * camDir.x() + sin(camDirHor) * camDir.z(),
-				camDir.y(),
-				-sin(camDirHor) * camDir.x() + cos(camDirHor) * camDir.z()
-			);
-		}
-
-		cam = Camera(camPos, camDir, vec3(0, 1, 0), camFOV, 1, aperture, focusDist);
-
-		// stretch rendertexture
-		// for (int y = 0; y < win.height; y++) {
-		// 	for (int x = 0; x < win.width; x++) {
-		// 		const uint32_t texIndex = (y*tex.height/win.height) * tex.width + (x*tex.width/win.width);
-		// 		win.graphics.buffer[(y) * win.width + x] = tex.pixels[texIndex];
-		// 	}
-		// }
-
-		// fill overhang with bars
-		const bool fillHorizontal = (win.width* 1. / win.height) > (tex.width * 1. / tex.height);
-		for (int y = 0; y < win.height; y++) {
-			for (int x = 0; x < win.width; x++) {
-				if(fillHorizontal) {
-					const float texScale = win.height * 1. / tex.height;
-
-					const int wLeft = (win.width - tex.width*texScale) / 2;
-					const int xTex = x - wLeft;
-
-					if(xTex < 0 || xTex >= tex.width * texScale) {
-						win.graphics.buffer[y * win.width + x] = 0x00;
-						continue;
-					}
-
-					const uint32_t texIndex = (y * tex.height/win.height) * tex.width + (xTex * tex.height/win.height);
-
-					win.graphics.buffer[(y) * win.width + x] = tex.pixels[texIndex];
-				} else {
-					const float texScale = win.width * 1. / tex.width;
-
-					const int hTop = (win.height - tex.height*texScale) / 2;
-					const int yTex = y - hTop;
-
-					if(yTex < 0 || yTex >= tex.height * texScale) {
-						win.graphics.buffer[y * win.width + x] = 0x00;
-						continue;
-					}
-
-					const uint32_t texIndex = (yTex * tex.width/win.width) * tex.width + (x * tex.width/win.width);
-
-					win.graphics.buffer[y * win.width + x] = tex.pixels[texIndex];
-				}
-			}
-		}
-
-		// win.graphics.clear(0xFF666666); // A R G B
-		// win.graphics.fillCircle(mouseX, mouseY, 5, 0xFF00FF00);
-
-		win.updateScreen();
-
-		pmouseX = mouseX;
-		pmouseY = mouseY;
-	}
-
-	stopThreads = true;
-
-	for(size_t i = 0; i < NUM_THREADS; i++) {
-		renderThreads[i]->join();
-		delete renderThreads[i];
-	}
-
-	std::cout << "Reached end without crashing!\n";
-	return 0;
+#include <iostream>
+#include <cstdint>
+#include <cmath>
+
+#include <string>
+#include <ostream>
+
+#include <thread>
+#include <mutex>
+#include <chrono>
+
+#include "BWindow/GDIWindow.h"
+
+#include "RayTracing/general.h"
+#include "RayTracing/RenderMode.h"
+
+#include "RayTracing/vec.h"
+#include "RayTracing/color.h"
+#include "RayTracing/Ray.h"
+#include "RayTracing/Camera.h"
+
+#include "RayTracing/Objects/hittable.h"
+#include "RayTracing/Objects/hittable_list.h"
+
+#include "RayTracing/Objects/Sphere.h"
+#include "RayTracing/Objects/Mesh.h"
+#include "RayTracing/Objects/VoxelVolume.h"
+
+#include "RayTracing/Loaders/StlLoader.h"
+#include "RayTracing/Loaders/SceneLoader.h"
+
+#include "RayTracing/Materials/Lambertian.h"
+#include "RayTracing/Materials/Metal.h"
+#include "RayTracing/Materials/Dielectric.h"
+#include "RayTracing/Materials/Emissive.h"
+#include "RayTracing/Materials/MaterialTable.h"
+
+#include "RayTracing/Lights/LightList.h"
+
+#include "RayTracing/Caching/RadianceCache.h"
+#include "RayTracing/Caching/AccelCache.h"
+
+#include "RayTracing/Texture/fTexture.h"
+
+#include "RayTracing/Denoising/AOVBuffer.h"
+#include "RayTracing/Denoising/Denoiser.h"
+#include "RayTracing/Denoising/TemporalAccumulator.h"
+
+#include "RayTracing/Integrators/WavefrontIntegrator.h"
+
+#include "RayTracing/Animation/Sequence.h"
+#include "RayTracing/Animation/SceneSequence.h"
+
+#include "RayTracing/Profiling/Profiler.h"
+#include "RayTracing/Profiling/CostHeatmap.h"
+
+#include "RayTracing/exampleScenes.h"
+
+#include "stb/stb_image.h"
+
+
+
+
+
+std::atomic_uint32_t SAMPLES_PER_PIXEL = 1;
+std::atomic_uint32_t MAX_NUM_BOUNCES = 8;
+
+fTexture tex(400, 400);
+AOVBuffer aovs(400, 400);
+CostHeatmap heatmap(400, 400);
+Denoiser denoiser;
+TemporalAccumulator temporal;
+WavefrontIntegrator wavefront;
+RadianceCache radianceCache;
+std::atomic_bool DENOISE = true;
+std::atomic_bool ACCUMULATE = true;
+std::atomic_bool NEE = true; // sample emissive surfaces directly (next-event estimation + MIS)
+std::atomic_bool CACHE = false; // end secondary diffuse bounces in the radiance cache
+std::atomic<RenderMode> RENDER_MODE = RenderMode::Path; // while the camera rests
+std::atomic<RenderMode> PREVIEW_MODE = RenderMode::AmbientOcclusion; // while it moves
+std::atomic_bool AUTO_PREVIEW = true;
+std::atomic<RenderMode> frameMode = RenderMode::Path; // of the frame in flight, only changed between frames
+PreviewSettings preview;
+std::atomic<HeatmapMode> HEATMAP = HeatmapMode::Off; // per-pixel cost instead of radiance
+
+std::atomic_uint32_t lastLine = 0;
+std::atomic_uint32_t linesDone = 0;
+std::atomic_uint32_t threadsWorking = 0;
+void renderThread(volatile bool* stopThread, volatile Camera *camRef, const hittable_list& world, const MaterialTable& materials, const LightList& lights, const fTexture& skybox, volatile bool *idle) {
+	// static std::atomic_uint32_t lastLine = 0;
+
+	for(;;) {
+		// LARGE_INTEGER before, after;
+		// QueryPerformanceCounter(&before);
+		// for(; !running; );
+
+		uint32_t targetLine = lastLine.fetch_add(1);// % tex.height;
+
+		// if(targetLine == tex.height - 1)
+		// 	lastLine.fetch_sub(tex.height);
+
+		++threadsWorking;
+		if(targetLine > tex.height - 1) {
+			--threadsWorking;
+			// *idle = true;
+			continue;
+		}
+
+		// *idle = false;
+
+		RT_ZONE("renderLine");
+
+		for (uint32_t x = 0; x < tex.width; x++) {
+			if(*stopThread)
+				return;
+
+			Camera cam = *(Camera*)camRef;
+
+			const HeatmapMode heatmapMode = HEATMAP.load();
+			const CostProbe probe(heatmapMode);
+
+			AOVSample aov;
+			const color radiance = pixelColor(
+					vec3(x*1./tex.width - .5, targetLine*1./tex.width - .5, 0),
+					vec3(1. / tex.width, 1. / tex.height, 0),
+					world,
+					materials,
+					skybox,
+					cam,
+					SAMPLES_PER_PIXEL.load(),
+					MAX_NUM_BOUNCES.load(),
+					x,
+					targetLine,
+					aov,
+					NEE ? &lights : nullptr,
+					CACHE ? &radianceCache : nullptr,
+					frameMode.load(),
+					preview);
+
+			aovs.store(x, targetLine, radiance, aov);
+
+			if(heatmapMode != HeatmapMode::Off)
+				heatmap.store(x, targetLine, probe.stop(), SAMPLES_PER_PIXEL.load());
+
+			if(!DENOISE && !ACCUMULATE && heatmapMode == HeatmapMode::Off) // otherwise tex keeps the last resolved frame until this one is complete
+				tex.pixels[targetLine * tex.width + x] = gammaColor(radiance);
+			// tex.pixels[targetLine * tex.width + x] = skybox.pixels[
+			// 	(targetLine * skybox.height / tex.height)
+			// 	* skybox.width
+			// 	+ (x * skybox.width / tex.width)
+			// ];
+		}
+
+		++linesDone;
+
+		// QueryPerformanceCounter(&after);
+		// double elapsed = (after.QuadPart - before.QuadPart) / 10.; // micros
+		// std::cout << "Line took: " << (elapsed / 1000.) << "ms\n";
+	}
+}
+
+int main2(int argc, char** argv);
+
+int main(int argc, char** argv) {
+	std::cout << "Current Working directory: ";
+	#if defined(_WIN32) || defined(_WIN64)
+	system("cd");
+	#else
+	system("pwd");
+	#endif
+
+	try {
+		return main2(argc, argv);
+	} catch(const std::exception& ex) {
+		std::cout << "Unhandled Exception: " << ex.what() << "\n";
+	}
+}
+
+int main2(int argc, char** argv) {
+	std::cout << "Program started\n";
+	Scene scene;
+	fTexture& skybox = scene.skybox;
+	hittable_list& world = scene.world;
+	MaterialTable& materials = scene.materials;
+	LightList& lights = scene.lights;
+
+	// usage: Client [scene.json [--sequence DIR]], without a file the scene built below; --sequence
+	// renders the file's animation into DIR/frame_NNNN.ppm instead of opening a window
+	const bool sceneFile = argc > 1;
+	if(sceneFile) {
+		std::cout << "Loading " << argv[1] << "\n";
+		AccelCache accelCache(std::filesystem::path(argv[1]).parent_path() / ".accel"); // built BVHs / voxel levels of earlier launches
+		loadScene(argv[1], scene, hardwareThreads(), &accelCache);
+		SAMPLES_PER_PIXEL = scene.settings.spp;
+		MAX_NUM_BOUNCES = scene.settings.bounces;
+		RENDER_MODE = scene.settings.mode;
+
+		if(argc > 3 && std::string(argv[2]) == "--sequence")
+			return renderSequence(scene, argv[3], std::cout);
+	}
+
+	if(!sceneFile) {
+		int nChannelsSkybox;
+		int width, height;
+		stbi_set_flip_vertically_on_load(false); // dont flip loaded textures on the y-axis.
+
+		uint8_t *const data = stbi_load("../res/Desert_Highway/Road_to_MonumentValley_8k.jpg", &width, &height, &nChannelsSkybox, 0);
+		// uint8_t *const data = stbi_load("../res/Desert_Highway/Road_to_MonumentValley_Ref.hdr", &width, &height, &nChannelsSkybox, 0);
+		// uint8_t *const data = stbi_load("../res/OutdoorHDRI024_4K-HDR.exr", &width, &height, &nChannelsSkybox, 0);
+		// uint8_t *const data = stbi_load("../res/full-seamless-spherical-hdri-panorama-degrees-angle-view-wooden-pier-near-lake-evening-equirectangular-projection-159712935.jpg", &width, &height, &nChannelsSkybox, 0);
+
+		if (!data)
+			throw std::runtime_error("Failed to load skybox image file");
+
+		// std::cout << "channels: " << nChannelsSkybox << "\n";
+
+		std::cout << "Loading Skybox\n";
+		skybox = fTexture(width, height);
+		std::cout << "Loaded Skybox\n";
+
+		for(size_t y = 0; y < height; y++)
+			for(size_t x = 0; x < width; x++)
+				skybox.pixels[y * width + x] = intColor( // todo: blur
+						vec3(
+							data[(y * width + x) * 3 + 0],
+							data[(y * width + x) * 3 + 1],
+							data[(y * width + x) * 3 + 2]
+						) / 255.
+					);
+
+		stbi_image_free(data);
+		skybox.generateMips(); // lookups pick the level matching the ray cone
+	}
+
+	volatile bool stopThreads = false;
+
+	// -- Simple Scene
+	// vec3 camPos(0, 0, -2);
+	// vec3 camDir(0, 0, 1);
+	// float camFOV = 40;
+	// float focusDist = 1.;
+	// float aperture = 0;
+	// hittable_list world;
+	// MaterialTable materials;
+	// genScene1(world, materials);
+
+	// -- Complex Scene
+	vec3 camPos = vec3(-10, 4, 4);
+	float camDirHor = 0, camDirVert = 0;
+	vec3 camDir = vec3(1, 0, 0);
+	// vec3 camDir = unit_vector(-camPos);
+	float camFOV = 20; // 100
+	float focusDist = 10.;
+	float aperture = 0;//0.1;
+
+	if(sceneFile) {
+		camPos = scene.camera.position;
+		camDir = unit_vector(scene.camera.direction);
+		camFOV = (float)scene.camera.fov;
+		focusDist = (float)scene.camera.focusDistance;
+		aperture = (float)scene.camera.aperture;
+	} else {
+		// genScene2(world, materials);
+		// genVoxelLights(world, materials);
+		world.emplace<VoxelVolume>(materials);
+
+		// Flat mirror:
+		// const material_id material4 = materials.add(Metal(color(1., .75, .75), .2));
+		// // const material_id material4 = materials.add(Metal(color(1., .75, .75), .0));
+		// world.emplace<Triangle>(vec3(4, 0, 2), vec3(4, -2, 2), vec3(6, 0, 2), material4);
+		// world.emplace<Triangle>(vec3(6, -2, 2), vec3(4, -2, 2), vec3(6, 0, 2), material4);
+
+		const material_id material5 = materials.add(Metal(color(1., .75, .75), .03));
+		// const material_id material5 = materials.add(Metal(color(1., .75, .75), .0));
+		// const material_id material5 = materials.add(Dielectric(1.5));
+		// world.emplace<Mesh>(loadSTL("../res/Bunny.stl", material5));
+
+		world.collectLights(lights, materials);
+		lights.build();
+		world.build();
+	}
+
+	// fTexture tex(800, 800);
+	// tex = fTexture(800, 800);
+	// renderTarget = &tex;
+	Camera cam(camPos, camDir, vec3(0, 1, 0), camFOV, 1, aperture, focusDist);
+	Camera frameCam = cam; // camera of the frame in flight, only updated between frames
+
+	static constexpr uint16_t NUM_THREADS = 6;
+	std::thread *renderThreads[NUM_THREADS];
+	volatile bool idleThreads[NUM_THREADS];
+	for(uint16_t t = 0; t < NUM_THREADS; t++)
+		renderThreads[t] = new std::thread(renderThread, &stopThreads, &frameCam, std::cref(world), std::cref(materials), std::cref(lights), std::cref(skybox), idleThreads + t);
+
+	GDIWindow win(800, 800);
+	// GDIWindowCustom win(800, 800);
+	int32_t pmouseX, pmouseY;
+
+	// the render threads' line loop, or one WavefrontIntegrator pass per frame on the main thread
+	bool wavefrontMode = false, useWavefront = false;
+
+	auto frameStart = std::chrono::steady_clock::now();
+	double frameTimeSum = 0;
+	uint32_t frameCount = 0;
+
+	bool cameraMoved = false; // since the frame in flight started
+
+	for(;;) {
+		win.pollMsg();
+
+		if(win.shouldClose())
+			break;
+
+		// if(tex.width != win.width/2 || tex.height != win.height/2) {
+		// 	while(lastLine < tex.height);
+		// 	for(;;) {
+		// 		bool idle = true;
+		// 		for(int t = 0; t < NUM_THREADS; t++)
+		// 			if(idleThreads[t] == false)
+		// 				idle = false;
+		// 		if(idle)
+		// 			break;
+		// 	}
+		// 	delete[] tex.pixels;
+		// 	tex.width = win.width / 2;
+		// 	tex.height = win.height / 2;
+		// 	tex.pixels = new uint32_t[tex.width * tex.height];
+		// 	lastLine = 0;
+		// }
+
+		if(wavefrontMode) {
+			wavefront.lights = NEE ? &lights : nullptr;
+			wavefront.cache = CACHE ? &radianceCache : nullptr;
+			wavefront.mode = frameMode;
+			wavefront.preview = preview;
+			wavefront.render(world, materials, skybox, frameCam, aovs, SAMPLES_PER_PIXEL.load(), MAX_NUM_BOUNCES.load());
+		}
+
+		// frame complete: reproject + accumulate, denoise, then start the next one
+		if(wavefrontMode || linesDone >= tex.height) {
+			const auto frameEnd = std::chrono::steady_clock::now();
+			frameTimeSum += std::chrono::duration<double, std::milli>(frameEnd - frameStart).count();
+			frameStart = frameEnd;
+			if(++frameCount == 30) {
+				std::cout << (wavefrontMode ? "wavefront" : "recursive") << " " << renderModeName(frameMode) << ": " << (frameTimeSum / frameCount) << "ms/frame\n";
+				frameTimeSum = 0;
+				frameCount = 0;
+			}
+
+			if(CACHE && !wavefrontMode && frameMode == RenderMode::Path) // the wavefront integrator resolves it itself
+				radianceCache.endFrame();
+
+			if(ACCUMULATE)
+				temporal.accumulate(aovs, frameCam);
+
+			if(heatmap.mode != HeatmapMode::Off)
+				heatmap.resolve(tex);
+			else if(DENOISE)
+				denoiser.filter(aovs, tex);
+			else
+				aovs.resolve(tex);
+			heatmap.mode = HEATMAP;
+
+			// no line is in flight here, so this is where the integrators can be swapped
+			if(wavefrontMode != useWavefront) {
+				wavefrontMode = useWavefront;
+				frameTimeSum = 0;
+				frameCount = 0;
+			}
+
+			// fast preview while the camera moves, the selected mode once it rests
+			const RenderMode nextMode = AUTO_PREVIEW && cameraMoved ? PREVIEW_MODE.load() : RENDER_MODE.load();
+			cameraMoved = false;
+			if(nextMode != frameMode) {
+				frameMode = nextMode;
+				temporal.reset(); // history of another mode
+				frameTimeSum = 0;
+				frameCount = 0;
+			}
+
+			frameCam = cam;
+			linesDone = 0;
+			lastLine = wavefrontMode ? tex.height : 0; // keeps the render threads idle in wavefront mode
+
+#ifdef RT_PROFILING
+			std::cout << Profiler::statsLine(Profiler::endFrame()) << "\n";
+#endif
+		}
+
+		int32_t mouseX = win.win.mouseX;
+		int32_t mouseY = win.win.mouseY;
+
+		const vec3 prevCamPos = camPos, prevCamDir = camDir;
+		const float prevCamFOV = camFOV, prevFocusDist = focusDist, prevAperture = aperture;
+
+		constexpr float moveSpeed = .02;
+
+		if (GetAsyncKeyState('W') & 0x8000)
+    		camPos += (unit_vector(camDir) * (moveSpeed));
+		if (GetAsyncKeyState('S') & 0x8000)
+			camPos += (unit_vector(camDir) * (-moveSpeed));
+		
+		if (GetAsyncKeyState('D') & 0x8000)
+			camPos += (unit_vector(cam.horizontal) * (moveSpeed));
+		if (GetAsyncKeyState('A') & 0x8000)
+			camPos += (unit_vector(cam.horizontal) * (-moveSpeed));
+
+		if (GetAsyncKeyState(VK_SHIFT) & 0x8000)
+			camPos += (unit_vector(cam.vertical) * (moveSpeed));
+		if (GetAsyncKeyState(' ') & 0x8000)
+			camPos += (unit_vector(cam.vertical) * (-moveSpeed));
+
+		if (GetAsyncKeyState('R') & 0x0001)
+			camFOV += 5;
+		if (GetAsyncKeyState('F') & 0x0001)
+			camFOV -= 5;
+
+		if (GetAsyncKeyState('E') & 0x0001)
+			SAMPLES_PER_PIXEL = SAMPLES_PER_PIXEL.load() * 2;
+		if (GetAsyncKeyState('Q') & 0x0001)
+			if (SAMPLES_PER_PIXEL > 1)
+				SAMPLES_PER_PIXEL = SAMPLES_PER_PIXEL.load() / 2;
+
+		if (GetAsyncKeyState('N') & 0x0001)
+			DENOISE = !DENOISE;
+		if (GetAsyncKeyState('M') & 0x0001) {
+			ACCUMULATE = !ACCUMULATE;
+			temporal.reset();
+		}
+		if (GetAsyncKeyState('I') & 0x0001)
+			useWavefront = !useWavefront && HEATMAP == HeatmapMode::Off; // costs are measured per pixel
+		if (GetAsyncKeyState('V') & 0x0001) {
+			HEATMAP = (HeatmapMode)(((uint8_t)HEATMAP.load() + 1) % (uint8_t)HeatmapMode::Count);
+			useWavefront = false;
+			std::cout << "Heatmap: " << heatmapModeName(HEATMAP) << "\n";
+		}
+		if (GetAsyncKeyState('B') & 0x0001)
+			heatmap.writeHistogram(std::cout);
+		if (GetAsyncKeyState('L') & 0x0001) {
+			NEE = !NEE;
+			std::cout << "Light sampling " << (NEE ? "on" : "off") << " (" << lights.size() << " lights)\n";
+		}
+		if (GetAsyncKeyState('O') & 0x0001) {
+			RENDER_MODE = (RenderMode)(((uint8_t)RENDER_MODE.load() + 1) % (uint8_t)RenderMode::Count);
+			std::cout << "Render mode: " << renderModeName(RENDER_MODE) << "\n";
+		}
+		if (GetAsyncKeyState('Y') & 0x0001) {
+			PREVIEW_MODE = (RenderMode)((uint8_t)PREVIEW_MODE.load() % ((uint8_t)RenderMode::Count - 1) + 1); // all but Path
+			std::cout << "Preview mode: " << renderModeName(PREVIEW_MODE) << "\n";
+		}
+		if (GetAsyncKeyState('U') & 0x0001) {
+			AUTO_PREVIEW = !AUTO_PREVIEW;
+			std::cout << "Preview while moving " << (AUTO_PREVIEW ? "on" : "off") << "\n";
+		}
+		if (GetAsyncKeyState('C') & 0x0001) {
+			CACHE = !CACHE;
+			std::cout << "Radiance cache " << (CACHE ? "on" : "off") << " (" << radianceCache.size() << " cells, " << (radianceCache.memoryBytes() >> 20) << " MiB)\n";
+		}
+#ifdef RT_PROFILING
+		if (GetAsyncKeyState('P') & 0x0001)
+			std::cout << (Profiler::writeChromeTrace("trace.json") ? "Wrote trace.json\n" : "Could not write trace.json\n");
+#endif
+
+		if (GetAsyncKeyState('T') & 0x8000)
+			focusDist += .1;
+		if (GetAsyncKeyState('G') & 0x8000)
+			focusDist -= focusDist>3 ? .1 : 0;
+
+		if (GetAsyncKeyState('Z') & 0x8000)
+			aperture += .003;
+		if (GetAsyncKeyState('H') & 0x8000)
+			aperture -= aperture>=.01 ? .003 : 0;
+
+		// if(GetAsyncKeyState(VK_MBUTTON) & 0x8000) {
+		if(GetAsyncKeyState(VK_LBUTTON) & 0x8000) {
+			vec3 up(0, 1, 0);
+
+			const float dX = mouseX - pmouseX;
+			const float dY = mouseY - pmouseY;
+
+			// const float aHor = (float)radians(dX) / 10.f; // horizontal rotation angle
+			// const float aVert = (float)radians(dY) / 10.f; // vertical rotation angle
+			camDirHor += (float)radians(dX) * .08f; // horizontal rotation angle
+			camDirVert += (float)radians(dY) * .08f; // vertical rotation angle
+
+			camDirVert = std::min<float>(std::max<float>(camDirVert, -radians(90)), radians(90));
+
+
+			// float aX = atan2(camDir.z(), camDir.x()); // left / right tilt
+			// float aY = acos(dot(up, camDir)); // up * camDir = cos(aY) <=> acos(up * camDir) = aY
+			// aY += radians(dY) / 10.;
+			// camDir[1] = cos(aY);
+			// camDir[2] = sin(aY);
+			// {
+			// 	float mX = vec3(0, camDir.x(), camDir.z()).length();
+			// 	aX -= radians(dX) / 10.;
+			// 	camDir[2] = sin(aX) * mX;
+			// 	camDir[0] = cos(aX) * mX;
+			// }
+
+			camDir = vec3(1, 0, 0);
+
+			// Rotate Vertically:
+			camDir = vec3(
+				cos(camDirVert) * camDir.x() + sin(camDirVert) * camDir.y(),
+				-sin(camDirVert) * camDir.x() + cos(camDirVert) * camDir.y(),
+				camDir.z()
+			);
+
+			// Rotate Horizontally (around y axis):
+			camDir = vec3(
+				cos(camDirHor) * camDir.x() + sin(camDirHor) * camDir.z(),
+				camDir.y(),
+				-sin(camDirHor) * camDir.x() + cos(camDirHor) * camDir.z()
+			);
+		}
+
+		cam = Camera(camPos, camDir, vec3(0, 1, 0), camFOV, 1, aperture, focusDist);
+		if(length_squared(camPos - prevCamPos) > 0 || length_squared(camDir - prevCamDir) > 0
+				|| camFOV != prevCamFOV || focusDist != prevFocusDist || aperture != prevAperture)
+			cameraMoved = true;
+
+		// stretch rendertexture
+		// for (int y = 0; y < win.height; y++) {
+		// 	for (int x = 0; x < win.width; x++) {
+		// 		const uint32_t texIndex = (y*tex.height/win.height) * tex.width + (x*tex.width/win.width);
+		// 		win.graphics.buffer[(y) * win.width + x] = tex.pixels[texIndex];
+		// 	}
+		// }
+
+		// fill overhang with bars
+		const bool fillHorizontal = (win.width* 1. / win.height) > (tex.width * 1. / tex.height);
+		for (int y = 0; y < win.height; y++) {
+			for (int x = 0; x < win.width; x++) {
+				if(fillHorizontal) {
+					const float texScale = win.height * 1. / tex.height;
+
+					const int wLeft = (win.width - tex.width*texScale) / 2;
+					const int xTex = x - wLeft;
+
+					if(xTex < 0 || xTex >= tex.width * texScale) {
+						win.graphics.buffer[y * win.width + x] = 0x00;
+						continue;
+					}
+
+					const uint32_t texIndex = (y * tex.height/win.height) * tex.width + (xTex * tex.height/win.height);
+
+					win.graphics.buffer[(y) * win.width + x] = tex.pixels[texIndex];
+				} else {
+					const float texScale = win.width * 1. / tex.width;
+
+					const int hTop = (win.height - tex.height*texScale) / 2;
+					const int yTex = y - hTop;
+
+					if(yTex < 0 || yTex >= tex.height * texScale) {
+						win.graphics.buffer[y * win.width + x] = 0x00;
+						continue;
+					}
+
+					const uint32_t texIndex = (yTex * tex.width/win.width) * tex.width + (x * tex.width/win.width);
+
+					win.graphics.buffer[y * win.width + x] = tex.pixels[texIndex];
+				}
+			}
+		}
+
+		// win.graphics.clear(0xFF666666); // A R G B
+		// win.graphics.fillCircle(mouseX, mouseY, 5, 0xFF00FF00);
+
+		win.updateScreen();
+
+		pmouseX = mouseX;
+		pmouseY = mouseY;
+	}
+
+	stopThreads = true;
+
+	for(size_t i = 0; i < NUM_THREADS; i++) {
+		renderThreads[i]->join();
+		delete renderThreads[i];
+	}
+
+	std::cout << "Reached end without crashing!\n";
+	return 0;
 }
\ No newline at end of file
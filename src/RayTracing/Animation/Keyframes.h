@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/AABB.h"
+
+// Unit quaternion
+struct Rotation {
+	real x = 0, y = 0, z = 0, w = 1;
+
+	static Rotation axisAngle(const vec3& axis, const real degrees) {
+		const real half = real(degrees * 3.1415926535 / 360.);
+		const vec3 a = unit_vector(axis) * std::sin(half);
+		return Rotation{ a.x(), a.y(), a.z(), std::cos(half) };
+	}
+
+	inline Rotation inverse() const { return Rotation{ -x, -y, -z, w }; }
+
+	inline vec3 rotate(const vec3& v) const {
+		const vec3 q(x, y, z);
+		const vec3 u = real(2) * cross(q, v);
+		return v + w * u + cross(q, u);
+	}
+
+	inline real dot(const Rotation& o) const { return x * o.x + y * o.y + z * o.z + w * o.w; }
+
+	// Angle (radians) between two rotations
+	real angleTo(const Rotation& o) const {
+		return 2 * std::acos(std::min<real>(1, std::abs(dot(o))));
+	}
+
+	// The short way round; nearly equal rotations are interpolated linearly
+	static Rotation slerp(const Rotation& a, Rotation b, const real t) {
+		real d = a.dot(b);
+		if(d < 0) {
+			b = Rotation{ -b.x, -b.y, -b.z, -b.w };
+			d = -d;
+		}
+
+		real wa = 1 - t, wb = t;
+		if(d < real(.9995)) {
+			const real theta = std::acos(d);
+			const real s = std::sin(theta);
+			wa = std::sin((1 - t) * theta) / s;
+			wb = std::sin(t * theta) / s;
+		}
+		Rotation r{ wa * a.x + wb * b.x, wa * a.y + wb * b.y, wa * a.z + wb * b.z, wa * a.w + wb * b.w };
+		const real len = std::sqrt(r.dot(r));
+		return Rotation{ r.x / len, r.y / len, r.z / len, r.w / len };
+	}
+};
+
+// Object space -> world: uniform scale, then rotation, then translation
+struct Transform {
+	vec3 translation = vec3(0.f);
+	Rotation rotation;
+	real scale = 1;
+
+	inline point3 point(const point3& p) const { return translation + rotation.rotate(p * scale); }
+	inline vec3 vector(const vec3& v) const { return rotation.rotate(v * scale); }
+	inline vec3 normal(const vec3& n) const { return rotation.rotate(n); }
+
+	inline point3 inversePoint(const point3& p) const { return rotation.inverse().rotate(p - translation) / scale; }
+	inline vec3 inverseVector(const vec3& v) const { return rotation.inverse().rotate(v) / scale; }
+
+	// Box around the transformed corners of `box`
+	AABB box(const AABB& box) const {
+		AABB result;
+		for(int corner = 0; corner < 8; corner++) {
+			const point3 p = point(vec3(
+				corner & 1 ? box._max.x() : box._min.x(),
+				corner & 2 ? box._max.y() : box._min.y(),
+				corner & 4 ? box._max.z() : box._min.z()));
+			result = corner == 0 ? AABB(p, p) : AABB(min(result._min, p), max(result._max, p));
+		}
+		return result;
+	}
+
+	bool operator==(const Transform& o) const {
+		return translation.x() == o.translation.x() && translation.y() == o.translation.y() && translation.z() == o.translation.z()
+			&& rotation.x == o.rotation.x && rotation.y == o.rotation.y && rotation.z == o.rotation.z && rotation.w == o.rotation.w
+			&& scale == o.scale;
+	}
+
+	static Transform lerp(const Transform& a, const Transform& b, const real t) {
+		return Transform{ a.translation + (b.translation - a.translation) * t, Rotation::slerp(a.rotation, b.rotation, t), a.scale + (b.scale - a.scale) * t };
+	}
+};
+
+// Transforms at increasing times. In between, translation and scale are interpolated linearly and
+// the rotation spherically (the short way, so consecutive keys must be less than 180 degrees
+// apart); before the first and after the last key the object rests there. No keys: identity.
+class Keyframes {
+	std::vector<real> times;
+	std::vector<Transform> keys;
+
+public:
+	// Sub-intervals sweep() samples between keys
+	static constexpr int SWEEP_STEPS = 8;
+
+	// Keys may come in any order; one at an existing time replaces it
+	void add(const real time, const Transform& key) {
+		const size_t i = std::lower_bound(times.begin(), times.end(), time) - times.begin();
+		if(i < times.size() && times[i] == time) {
+			keys[i] = key;
+			return;
+		}
+		times.insert(times.begin() + i, time);
+		keys.insert(keys.begin() + i, key);
+	}
+
+	inline bool empty() const { return keys.empty(); }
+	inline size_t size() const { return keys.size(); }
+	inline real time(const size_t i) const { return times[i]; }
+	inline const Transform& key(const size_t i) const { return keys[i]; }
+
+	// Whether the transform changes over [open, close]
+	bool moves(const real open, const real close) const {
+		return keys.size() > 1 && close > times.front() && open < times.back();
+	}
+
+	// Whether going from shutter interval [open0, close0] to [open1, close1] moves the object at all
+	bool changes(const real open0, const real close0, const real open1, const real close1) const {
+		return moves(open0, close0) || moves(open1, close1) || !(at(open0) == at(open1));
+	}
+
+	Transform at(const real time) const {
+		if(keys.empty())
+			return Transform();
+		if(time <= times.front())
+			return keys.front();
+		if(time >= times.back())
+			return keys.back();
+
+		const size_t i = std::upper_bound(times.begin(), times.end(), time) - times.begin();
+		return Transform::lerp(keys[i - 1], keys[i], (time - times[i - 1]) / (times[i] - times[i - 1]));
+	}
+
+	// Box around `box` transformed at every time in [open, close]: sampled SWEEP_STEPS times between
+	// any two keys, and padded by how far a corner on an arc can bulge out between two samples
+	AABB sweep(const AABB& box, const real open, const real close) const {
+		if(!moves(open, close))
+			return at(open).box(box);
+
+		std::vector<real> stops{ open };
+		for(const real t : times)
+			if(t > open && t < close)
+				stops.push_back(t);
+		stops.push_back(close);
+
+		real radius = 0;
+		for(int corner = 0; corner < 8; corner++)
+			radius = std::max(radius, vec3(
+				corner & 1 ? box._max.x() : box._min.x(),
+				corner & 2 ? box._max.y() : box._min.y(),
+				corner & 4 ? box._max.z() : box._min.z()).length<real>());
+
+		AABB result = at(open).box(box);
+		for(size_t s = 0; s + 1 < stops.size(); s++) {
+			Transform prev = at(stops[s]);
+			for(int step = 1; step <= SWEEP_STEPS; step++) {
+				const Transform next = at(stops[s] + (stops[s + 1] - stops[s]) * step / SWEEP_STEPS);
+				const real pad = radius * std::max(prev.scale, next.scale) * (1 - std::cos(prev.rotation.angleTo(next.rotation) / 2));
+				const AABB b = next.box(box);
+				result = AABB::surrounding(result, AABB(b._min - vec3(pad), b._max + vec3(pad)));
+				prev = next;
+			}
+		}
+		return result;
+	}
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <filesystem>
+
+#include "RayTracing/parallel.h"
+
+#include "RayTracing/Loaders/SceneLoader.h"
+#include "RayTracing/Animation/Sequence.h"
+
+// A scene file's animation, headless: one PPM per frame in directory (frame_NNNN.ppm), with the
+// file's settings. Progress goes to log; 0 on success, 1 if a frame could not be written.
+inline int renderSequence(Scene& scene, const std::filesystem::path& directory, std::ostream& log, const uint32_t numThreads = hardwareThreads()) {
+	std::filesystem::create_directories(directory);
+
+	SequenceSettings settings;
+	settings.frames = scene.settings.frames;
+	settings.fps = scene.settings.fps;
+	settings.shutter = scene.settings.shutter;
+	settings.spp = scene.settings.spp;
+	settings.bounces = scene.settings.bounces;
+	settings.mode = scene.settings.mode;
+
+	const uint32_t width = scene.settings.width, height = scene.settings.height;
+	SequenceRenderer sequence;
+	sequence.integrator.numThreads = sequence.temporal.numThreads = numThreads;
+	bool failed = false;
+	const std::vector<SequenceRenderer::FrameStats> stats = sequence.render(scene.world, scene.materials, scene.lights, scene.skybox,
+		scene.camera.camera((double)width / height), width, height, settings, [&](const uint32_t frame, const fTexture& image) {
+			char name[32];
+			snprintf(name, sizeof(name), "frame_%04u.ppm", frame);
+			if(!savePPM((directory / name).string(), image)) {
+				log << "Failed to write " << (directory / name).string() << "\n";
+				failed = true;
+			}
+		});
+
+	for(size_t f = 0; f < stats.size(); f++)
+		log << "frame " << f << ": animate " << stats[f].animateMs << "ms, render " << stats[f].renderMs << "ms, "
+			<< (int)(stats[f].reused * 100) << "% reused" << (stats[f].moved ? "" : ", static") << "\n";
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/Camera.h"
+#include "RayTracing/RenderMode.h"
+
+#include "RayTracing/Objects/hittable.h"
+#include "RayTracing/Materials/MaterialTable.h"
+#include "RayTracing/Lights/LightList.h"
+#include "RayTracing/Texture/fTexture.h"
+
+#include "RayTracing/Denoising/AOVBuffer.h"
+#include "RayTracing/Denoising/Denoiser.h"
+#include "RayTracing/Denoising/TemporalAccumulator.h"
+
+#include "RayTracing/Integrators/WavefrontIntegrator.h"
+
+#include "RayTracing/Profiling/Profiler.h"
+
+struct SequenceSettings {
+	uint32_t frames = 24;
+	real fps = 24;
+	real start = 0; // scene time of frame 0
+	real shutter = .5f; // fraction of a frame the shutter is open (.5: 180 degrees), 0 for no motion blur
+	uint32_t spp = 4;
+	uint32_t bounces = 8;
+	RenderMode mode = RenderMode::Path;
+	// Frames of history blended into surfaces that stayed put while something else moved (their
+	// lighting may have changed with it); while nothing moves at all, history keeps converging
+	uint32_t maxHistory = 4;
+	bool reuse = true; // reproject and blend earlier frames at all
+	bool denoise = false;
+};
+
+// Binary PPM (P6) of an image as stored in fTexture::pixels (0xRRGGBB)
+inline bool savePPM(const std::string& path, const fTexture& image) {
+	FILE *const fp = fopen(path.c_str(), "wb");
+	if(fp == nullptr)
+		return false;
+
+	std::vector<uint8_t> rgb((size_t)image.width * image.height * 3);
+	for(size_t i = 0; i < (size_t)image.width * image.height; i++) {
+		rgb[3 * i + 0] = (uint8_t)(image.pixels[i] >> 16);
+		rgb[3 * i + 1] = (uint8_t)(image.pixels[i] >> 8);
+		rgb[3 * i + 2] = (uint8_t)image.pixels[i];
+	}
+	bool ok = fprintf(fp, "P6\n%d %d\n255\n", image.width, image.height) > 0
+		&& fwrite(rgb.data(), 1, rgb.size(), fp) == rgb.size();
+	ok &= fclose(fp) == 0;
+	return ok;
+}
+
+// Headless rendering of an animation, a frame at a time with the WavefrontIntegrator. Each frame
+// first moves the world into its shutter interval (hittable::animate: keyframed objects sweep their
+// boxes over it, the BVHs are refitted rather than rebuilt, moving lights are updated), then gives
+// the camera the same interval, so every ray samples its own time in it (motion blur).
+// Earlier frames are reused through the TemporalAccumulator: surfaces that moved fail its position
+// test and start over, the static rest blends in up to maxHistory frames while anything moves.
+class SequenceRenderer {
+public:
+	struct FrameStats {
+		double animateMs = 0, renderMs = 0;
+		real reused = 0; // fraction of the pixels that blended in history
+		bool moved = false;
+	};
+
+	WavefrontIntegrator integrator;
+	TemporalAccumulator temporal;
+	Denoiser denoiser;
+
+	// output(frame, image) receives every finished frame
+	template<typename Output>
+	std::vector<FrameStats> render(hittable& world, const MaterialTable& materials, LightList& lights, const fTexture& skybox, Camera cam,
+			const uint32_t width, const uint32_t height, const SequenceSettings& settings, Output&& output) {
+		using Clock = std::chrono::steady_clock;
+
+		AOVBuffer aovs(width, height);
+		fTexture image(width, height);
+		integrator.lights = lights.empty() ? nullptr : &lights;
+		integrator.cache = nullptr;
+		integrator.mode = settings.mode;
+		temporal.reset();
+
+		std::vector<FrameStats> stats;
+		bool movedBefore = false;
+		for(uint32_t frame = 0; frame < settings.frames; frame++) {
+			RT_ZONE("sequence.frame");
+			FrameStats s;
+
+			const real open = settings.start + frame / settings.fps;
+			const real close = open + std::max<real>(0, settings.shutter) / settings.fps;
+			Clock::time_point start = Clock::now();
+			s.moved = world.animate(open, close, lights);
+			s.animateMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			start = Clock::now();
+			cam.setShutter(open, close);
+			integrator.render(world, materials, skybox, cam, aovs, settings.spp, settings.bounces);
+			s.renderMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+			if(settings.reuse) {
+				// lighting on static surfaces only settles once nothing moves (this frame and the last)
+				temporal.minAlpha = s.moved || movedBefore ? 1.f / std::max<uint32_t>(1, settings.maxHistory) : .01f;
+				s.reused = (real)temporal.accumulate(aovs, cam) / ((real)width * height);
+			}
+			movedBefore = s.moved;
+
+			if(settings.denoise)
+				denoiser.filter(aovs, image);
+			else
+				aovs.resolve(image);
+			output(frame, (const fTexture&)image);
+			stats.push_back(s);
+		}
+		return stats;
+	}
+};
@@ -0,0 +1,556 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <limits>
+#include <numeric>
+#include <algorithm>
+
+#include "vec.h"
+#include "Ray.h"
+#include "AABB.h"
+#include "parallel.h"
+
+#include "RayTracing/Profiling/Profiler.h"
+
+// How BVH::build splits a node's primitives
+enum class BVHBuilder : uint8_t {
+	Median, // at the median of the widest axis of the box centers: balanced, no cost model
+	SAH, // binned surface area heuristic: the cheapest trees to trace, the slowest to build
+	LBVH, // Morton order, split where the codes' highest bit changes: builds in O(n), for rebuilding every frame
+	Count
+};
+
+inline const char* bvhBuilderName(const BVHBuilder builder) {
+	static constexpr const char* NAMES[(size_t)BVHBuilder::Count] = { "median", "sah", "lbvh" };
+	return NAMES[(size_t)builder];
+}
+
+// Bounding volume hierarchy over primitives known only by their boxes; the caller intersects them.
+// Nodes are stored depth first: an inner node's first child directly follows it, the second is at
+// `offset`. Built top-down (see BVHBuilder): the first splits on the calling thread, then the
+// subtrees below them as parallel tasks, which are stitched back into one depth first array.
+// Traversal goes front to back (the child on the near side of the split first) and skips nodes
+// that start beyond the closest hit so far, so a hit on a near primitive culls the far ones.
+class BVH {
+public:
+	struct Node {
+		AABB bounds;
+		uint32_t offset = 0; // inner: second child, leaf: first entry of its range in `order`
+		uint16_t count = 0; // leaf: number of primitives, 0 for inner nodes
+		uint16_t axis = 0; // inner: split axis
+	};
+
+	static constexpr size_t MAX_DEPTH = 64; // builders fall back to median splits below BALANCED_DEPTH
+	static constexpr uint32_t SAH_BINS = 16;
+
+private:
+	static constexpr size_t BALANCED_DEPTH = MAX_DEPTH - 32; // median splits from here on: at most log2(2^32) more levels
+	static constexpr size_t PARALLEL_PRIMITIVES = 1 << 14; // fewer are built on the calling thread
+	static constexpr size_t BINNING_CHUNK = 1 << 14; // of large nodes binned in parallel
+
+	struct Storage {
+		std::vector<Node> nodes;
+		std::vector<uint32_t> order;
+	};
+
+	// Nodes and primitive indices (grouped by leaf) live in `storage`: what build() made, or memory
+	// someone else owns, e.g. a mapped cache file (see view). Only refit() modifies them, and only
+	// when this BVH is their sole user (`built`); copies of a BVH share them.
+	std::shared_ptr<const void> storage;
+	std::shared_ptr<Storage> built;
+	const Node *nodes = nullptr;
+	const uint32_t *order = nullptr;
+	uint32_t numNodes = 0, numPrimitives = 0;
+
+public:
+	inline bool empty() const { return numNodes == 0; }
+	inline size_t size() const { return numNodes; }
+	inline size_t primitives() const { return numPrimitives; }
+	inline const Node& node(const uint32_t i) const { return nodes[i]; }
+	inline const Node* nodeData() const { return nodes; }
+	inline const uint32_t* orderData() const { return order; }
+
+	void clear() {
+		storage.reset();
+		built.reset();
+		nodes = nullptr;
+		order = nullptr;
+		numNodes = numPrimitives = 0;
+	}
+
+	// boxes[i] bounds primitive i
+	void build(const std::vector<AABB>& boxes, const uint32_t maxLeafSize = 1, const BVHBuilder builder = BVHBuilder::Median, const uint32_t numThreads = hardwareThreads()) {
+		RT_ZONE("bvh.build");
+		clear();
+		if(boxes.empty())
+			return;
+
+		const std::shared_ptr<Storage> s = std::make_shared<Storage>();
+		Builder(boxes, s->order, std::clamp<uint32_t>(maxLeafSize, 1, UINT16_MAX), builder, numThreads).build(s->nodes);
+
+		view(s, s->nodes.data(), s->nodes.size(), s->order.data(), s->order.size());
+		built = s;
+	}
+
+	// Uses nodes / order as laid out by build() (nodeData / orderData of another BVH) without copying
+	// them; owner keeps them alive
+	void view(std::shared_ptr<const void> owner, const Node *const nodeData, const size_t nodeCount, const uint32_t *const orderData, const size_t primitiveCount) {
+		storage = std::move(owner);
+		built.reset();
+		nodes = nodeData;
+		order = orderData;
+		numNodes = (uint32_t)nodeCount;
+		numPrimitives = (uint32_t)primitiveCount;
+	}
+
+	// Whether nodes / order from somewhere untrusted (e.g. a cache file) are safe to traverse: every
+	// child and primitive index in range, no deeper than the traversal stack. O(n)
+	static bool valid(const Node *const nodeData, const size_t nodeCount, const uint32_t *const orderData, const size_t primitiveCount) {
+		if(nodeCount == 0 || nodeCount > UINT32_MAX || primitiveCount > UINT32_MAX)
+			return nodeCount == 0 && primitiveCount == 0;
+
+		for(size_t k = 0; k < primitiveCount; k++)
+			if(orderData[k] >= primitiveCount)
+				return false;
+
+		std::vector<uint8_t> depth(nodeCount, 0); // children come after their parent
+		for(size_t i = 0; i < nodeCount; i++) {
+			const Node& n = nodeData[i];
+			if(n.count > 0) {
+				if((size_t)n.offset + n.count > primitiveCount)
+					return false;
+				continue;
+			}
+			const size_t childDepth = (size_t)depth[i] + 1;
+			if(n.offset <= i || n.offset >= nodeCount || n.axis > 2 || childDepth >= MAX_DEPTH)
+				return false;
+			depth[i + 1] = std::max(depth[i + 1], (uint8_t)childDepth);
+			depth[n.offset] = std::max(depth[n.offset], (uint8_t)childDepth);
+		}
+		return true;
+	}
+
+	// New boxes for the same primitives (animated geometry): recomputes the bounds bottom up and
+	// keeps the tree. O(n) and much cheaper than a rebuild, but the tree gets worse the further the
+	// primitives move from where it was built. Nodes shared with other BVHs are copied first.
+	void refit(const std::vector<AABB>& boxes) {
+		RT_ZONE("bvh.refit");
+		if(empty())
+			return;
+
+		// storage holds the other reference to what build() / refit() made
+		if(!built || built.use_count() > 2) {
+			const std::shared_ptr<Storage> s = std::make_shared<Storage>();
+			s->nodes.assign(nodes, nodes + numNodes);
+			s->order.assign(order, order + numPrimitives);
+			view(s, s->nodes.data(), s->nodes.size(), s->order.data(), s->order.size());
+			built = s;
+		}
+
+		// children come after their parent
+		std::vector<Node>& n = built->nodes;
+		for(size_t i = n.size(); i-- > 0; ) {
+			if(n[i].count == 0) {
+				n[i].bounds = AABB::surrounding(n[i + 1].bounds, n[n[i].offset].bounds);
+				continue;
+			}
+			AABB bounds = boxes[order[n[i].offset]];
+			for(uint32_t k = n[i].offset + 1; k < n[i].offset + n[i].count; k++)
+				bounds = AABB::surrounding(bounds, boxes[order[k]]);
+			n[i].bounds = bounds;
+		}
+	}
+
+	// Expected cost of a random ray relative to testing one primitive: node surface areas relative to
+	// the root's, times traversalCost for inner nodes and the primitive count for leaves
+	real sahCost(const real traversalCost = 1) const {
+		if(empty())
+			return 0;
+		const real rootArea = std::max<real>(nodes[0].bounds.surfaceArea(), 1e-30f);
+		real cost = 0;
+		for(uint32_t i = 0; i < numNodes; i++)
+			cost += nodes[i].bounds.surfaceArea() / rootArea * (nodes[i].count == 0 ? traversalCost : nodes[i].count);
+		return cost;
+	}
+
+	// Closest hit: intersect(primitive, t_max) tests one primitive and on a hit lowers t_max to its
+	// distance and returns true
+	template<typename Intersect>
+	bool closest(const Ray& r, real t_max, Intersect&& intersect) const {
+		if(empty())
+			return false;
+
+		const RayPrecomp rp(r);
+		uint32_t stack[MAX_DEPTH];
+		size_t top = 0;
+		uint32_t n = 0;
+		bool found = false;
+		for(;;) {
+			RT_COUNT(BVHNodesVisited);
+			const Node& node = nodes[n];
+			if(node.bounds.hit(rp, 0, t_max)) {
+				if(node.count == 0) {
+					const bool secondFirst = rp.sign[node.axis];
+					stack[top++] = secondFirst ? n + 1 : node.offset;
+					n = secondFirst ? node.offset : n + 1;
+					continue;
+				}
+				for(uint32_t k = node.offset; k < node.offset + node.count; k++)
+					found |= intersect(order[k], t_max);
+			}
+			if(top == 0)
+				return found;
+			n = stack[--top];
+		}
+	}
+
+	// Any hit: test(primitive) returns true if it blocks the ray, which ends the traversal
+	template<typename Test>
+	bool any(const Ray& r, const real t_max, Test&& test) const {
+		if(empty())
+			return false;
+
+		const RayPrecomp rp(r);
+		uint32_t stack[MAX_DEPTH];
+		size_t top = 0;
+		uint32_t n = 0;
+		for(;;) {
+			RT_COUNT(BVHNodesVisited);
+			const Node& node = nodes[n];
+			if(node.bounds.hit(rp, 0, t_max)) {
+				if(node.count == 0) {
+					const bool secondFirst = rp.sign[node.axis];
+					stack[top++] = secondFirst ? n + 1 : node.offset;
+					n = secondFirst ? node.offset : n + 1;
+					continue;
+				}
+				for(uint32_t k = node.offset; k < node.offset + node.count; k++)
+					if(test(order[k]))
+						return true;
+			}
+			if(top == 0)
+				return false;
+			n = stack[--top];
+		}
+	}
+
+private:
+	struct Builder {
+		const std::vector<AABB>& boxes;
+		std::vector<uint32_t>& order;
+		const uint32_t maxLeafSize;
+		const BVHBuilder builder;
+		const uint32_t numThreads;
+		std::vector<vec3> centers; // of boxes[i]
+		std::vector<uint32_t> codes; // LBVH: Morton code of order[i], ascending
+
+		// A node of the top of the tree, split on the calling thread; its children are other top nodes
+		// or subtrees built by a task
+		struct Top {
+			uint32_t begin, end;
+			uint16_t axis = 0;
+			int32_t children[2] = { -1, -1 }; // top nodes
+			int32_t task = -1; // or built by this task
+		};
+		struct Task {
+			uint32_t begin, end, depth;
+			std::vector<Node> nodes;
+		};
+
+		Builder(const std::vector<AABB>& boxes, std::vector<uint32_t>& order, const uint32_t maxLeafSize, const BVHBuilder builder, const uint32_t numThreads):
+				boxes(boxes), order(order), maxLeafSize(maxLeafSize), builder(builder), numThreads(std::max<uint32_t>(1, numThreads)) { }
+
+		void build(std::vector<Node>& out) {
+			const uint32_t n = (uint32_t)boxes.size();
+			const uint32_t threads = n >= PARALLEL_PRIMITIVES ? numThreads : 1;
+
+			centers.resize(n);
+			parallel_for(0, n, [&](const size_t i) { centers[i] = boxes[i].center(); }, threads, 4096);
+			order.resize(n);
+			std::iota(order.begin(), order.end(), 0);
+			if(builder == BVHBuilder::LBVH)
+				sortMorton(threads);
+
+			// split on this thread until there are enough subtrees to keep every thread busy
+			const uint32_t taskSize = threads == 1 ? n : std::max<uint32_t>((uint32_t)PARALLEL_PRIMITIVES / 4, n / (threads * 8));
+			std::vector<Top> top;
+			std::vector<Task> tasks;
+			plan(top, tasks, 0, n, 0, taskSize, threads);
+
+			parallel_for(0, tasks.size(), [&](const size_t t) {
+				Task& task = tasks[t];
+				task.nodes.reserve(2 * (task.end - task.begin) / maxLeafSize + 1);
+				subtree(task.nodes, task.begin, task.end, task.depth);
+			}, threads);
+
+			out.reserve(2 * n / maxLeafSize + 1);
+			emit(out, top, tasks, 0);
+		}
+
+		// Top node for [begin, end) at `depth`; returns its index in `top`
+		int32_t plan(std::vector<Top>& top, std::vector<Task>& tasks, const uint32_t begin, const uint32_t end, const uint32_t depth, const uint32_t taskSize, const uint32_t threads) {
+			const int32_t i = (int32_t)top.size();
+			top.push_back(Top{ begin, end });
+
+			uint32_t mid;
+			uint16_t axis;
+			if(end - begin <= taskSize || !split(begin, end, depth, threads, mid, axis)) {
+				top[i].task = (int32_t)tasks.size();
+				tasks.push_back(Task{ begin, end, depth, {} });
+				return i;
+			}
+
+			top[i].axis = axis;
+			const int32_t left = plan(top, tasks, begin, mid, depth + 1, taskSize, threads);
+			const int32_t right = plan(top, tasks, mid, end, depth + 1, taskSize, threads);
+			top[i].children[0] = left;
+			top[i].children[1] = right;
+			return i;
+		}
+
+		// Depth first copy of top node t and everything below it; returns its index in out
+		uint32_t emit(std::vector<Node>& out, const std::vector<Top>& top, std::vector<Task>& tasks, const int32_t t) {
+			const Top& node = top[t];
+			const uint32_t i = (uint32_t)out.size();
+			if(node.task >= 0) {
+				// the task's node indices are relative to its own array
+				for(Node n : tasks[node.task].nodes) {
+					if(n.count == 0)
+						n.offset += i;
+					out.push_back(n);
+				}
+				tasks[node.task].nodes = std::vector<Node>();
+				return i;
+			}
+
+			out.emplace_back();
+			emit(out, top, tasks, node.children[0]);
+			const uint32_t second = emit(out, top, tasks, node.children[1]);
+			out[i].offset = second;
+			out[i].axis = node.axis;
+			out[i].bounds = AABB::surrounding(out[i + 1].bounds, out[second].bounds);
+			return i;
+		}
+
+		// Single threaded, bounds bottom up; returns the node's index in nodes
+		uint32_t subtree(std::vector<Node>& nodes, const uint32_t begin, const uint32_t end, const uint32_t depth) {
+			const uint32_t i = (uint32_t)nodes.size();
+			nodes.emplace_back();
+
+			uint32_t mid;
+			uint16_t axis;
+			if(!split(begin, end, depth, 1, mid, axis)) {
+				AABB bounds = boxes[order[begin]];
+				for(uint32_t k = begin + 1; k < end; k++)
+					bounds = AABB::surrounding(bounds, boxes[order[k]]);
+				nodes[i].bounds = bounds;
+				nodes[i].offset = begin;
+				nodes[i].count = (uint16_t)(end - begin);
+				return i;
+			}
+
+			subtree(nodes, begin, mid, depth + 1);
+			const uint32_t second = subtree(nodes, mid, end, depth + 1);
+			nodes[i].offset = second;
+			nodes[i].axis = axis;
+			nodes[i].bounds = AABB::surrounding(nodes[i + 1].bounds, nodes[second].bounds);
+			return i;
+		}
+
+		// Partitions order[begin, end) into [begin, mid) and [mid, end); false for a leaf
+		bool split(const uint32_t begin, const uint32_t end, const uint32_t depth, const uint32_t threads, uint32_t& mid, uint16_t& axis) {
+			if(end - begin <= maxLeafSize)
+				return false;
+
+			if(builder == BVHBuilder::LBVH && depth < BALANCED_DEPTH)
+				return splitMorton(begin, end, mid, axis);
+			if(builder == BVHBuilder::SAH && depth < BALANCED_DEPTH && splitSAH(begin, end, threads, mid, axis))
+				return true;
+			splitMedian(begin, end, mid, axis);
+			return true;
+		}
+
+		AABB centerBounds(const uint32_t begin, const uint32_t end) const {
+			AABB bounds(centers[order[begin]], centers[order[begin]]);
+			for(uint32_t k = begin + 1; k < end; k++) {
+				bounds._min = min(bounds._min, centers[order[k]]);
+				bounds._max = max(bounds._max, centers[order[k]]);
+			}
+			return bounds;
+		}
+
+		static int widestAxis(const vec3& extent) {
+			return extent.x() >= extent.y() && extent.x() >= extent.z() ? 0 : (extent.y() >= extent.z() ? 1 : 2);
+		}
+
+		void splitMedian(const uint32_t begin, const uint32_t end, uint32_t& mid, uint16_t& axis) {
+			const int a = widestAxis(centerBounds(begin, end).dimensions());
+			mid = (begin + end) / 2;
+			if(builder == BVHBuilder::LBVH) { // Morton order is spatial already
+				axis = (uint16_t)a;
+				return;
+			}
+			std::nth_element(order.begin() + begin, order.begin() + mid, order.begin() + end, [&](const uint32_t x, const uint32_t y) {
+				return centers[x][a] < centers[y][a];
+			});
+			axis = (uint16_t)a;
+		}
+
+		struct Bins {
+			AABB bounds[3][SAH_BINS];
+			uint32_t counts[3][SAH_BINS] = {};
+
+			void add(const int axis, const uint32_t bin, const AABB& box) {
+				bounds[axis][bin] = counts[axis][bin]++ == 0 ? box : AABB::surrounding(bounds[axis][bin], box);
+			}
+			void merge(const Bins& other) {
+				for(int a = 0; a < 3; a++)
+					for(uint32_t b = 0; b < SAH_BINS; b++)
+						if(other.counts[a][b] > 0) {
+							bounds[a][b] = counts[a][b] == 0 ? other.bounds[a][b] : AABB::surrounding(bounds[a][b], other.bounds[a][b]);
+							counts[a][b] += other.counts[a][b];
+						}
+			}
+		};
+
+		inline uint32_t bin(const AABB& centroids, const vec3& scale, const int axis, const uint32_t prim) const {
+			return std::min<uint32_t>(SAH_BINS - 1, (uint32_t)((centers[prim][axis] - centroids._min[axis]) * scale[axis]));
+		}
+
+		// Best of the SAH_BINS - 1 planes per axis between equal width bins of the centers; false if all
+		// centers coincide
+		bool splitSAH(const uint32_t begin, const uint32_t end, const uint32_t threads, uint32_t& mid, uint16_t& axis) {
+			const AABB centroids = centerBounds(begin, end);
+			const vec3 extent = centroids.dimensions();
+			if(std::max({ extent.x(), extent.y(), extent.z() }) <= 0)
+				return false;
+			vec3 scale;
+			for(int a = 0; a < 3; a++)
+				scale[a] = extent[a] > 0 ? SAH_BINS / extent[a] : 0;
+
+			const auto binRange = [&](const uint32_t from, const uint32_t to, Bins& bins) {
+				for(uint32_t k = from; k < to; k++)
+					for(int a = 0; a < 3; a++)
+						bins.add(a, bin(centroids, scale, a, order[k]), boxes[order[k]]);
+			};
+			Bins bins;
+			const size_t chunks = (end - begin + BINNING_CHUNK - 1) / BINNING_CHUNK;
+			if(threads > 1 && chunks > 1) {
+				std::vector<Bins> partial(chunks);
+				parallel_for(0, chunks, [&](const size_t c) {
+					binRange(begin + (uint32_t)(c * BINNING_CHUNK), std::min<uint32_t>(end, begin + (uint32_t)((c + 1) * BINNING_CHUNK)), partial[c]);
+				}, threads);
+				for(const Bins& p : partial)
+					bins.merge(p);
+			} else
+				binRange(begin, end, bins);
+
+			// cost of the plane after bin b: area * count on both sides
+			real bestCost = std::numeric_limits<real>::max();
+			int bestAxis = -1;
+			uint32_t bestBin = 0;
+			for(int a = 0; a < 3; a++) {
+				if(extent[a] <= 0)
+					continue;
+				real rightCost[SAH_BINS];
+				AABB right;
+				uint32_t rightCount = 0;
+				for(uint32_t b = SAH_BINS - 1; b > 0; b--) {
+					if(bins.counts[a][b] > 0) {
+						right = rightCount == 0 ? bins.bounds[a][b] : AABB::surrounding(right, bins.bounds[a][b]);
+						rightCount += bins.counts[a][b];
+					}
+					rightCost[b - 1] = rightCount == 0 ? 0 : right.surfaceArea() * rightCount;
+				}
+				AABB left;
+				uint32_t leftCount = 0;
+				for(uint32_t b = 0; b + 1 < SAH_BINS; b++) {
+					if(bins.counts[a][b] > 0) {
+						left = leftCount == 0 ? bins.bounds[a][b] : AABB::surrounding(left, bins.bounds[a][b]);
+						leftCount += bins.counts[a][b];
+					}
+					if(leftCount == 0 || leftCount == end - begin)
+						continue;
+					const real cost = left.surfaceArea() * leftCount + rightCost[b];
+					if(cost < bestCost) {
+						bestCost = cost;
+						bestAxis = a;
+						bestBin = b;
+					}
+				}
+			}
+			if(bestAxis < 0)
+				return false;
+
+			const uint32_t *const split = std::partition(order.data() + begin, order.data() + end, [&](const uint32_t prim) {
+				return bin(centroids, scale, bestAxis, prim) <= bestBin;
+			});
+			mid = (uint32_t)(split - order.data());
+			axis = (uint16_t)bestAxis;
+			return mid > begin && mid < end;
+		}
+
+		// Codes are ascending: the first one with the highest bit the range's codes differ in set
+		bool splitMorton(const uint32_t begin, const uint32_t end, uint32_t& mid, uint16_t& axis) {
+			const uint32_t diff = codes[begin] ^ codes[end - 1];
+			if(diff == 0) { // same cell
+				splitMedian(begin, end, mid, axis);
+				return true;
+			}
+
+			int bit = 31;
+			while(!(diff >> bit & 1))
+				bit--;
+			mid = (uint32_t)(std::partition_point(codes.begin() + begin, codes.begin() + end, [&](const uint32_t code) {
+				return !(code >> bit & 1);
+			}) - codes.begin());
+			axis = (uint16_t)(2 - bit % 3); // x is the highest bit of each triple
+			return true;
+		}
+
+		// 10 bits per axis, interleaved xyzxyz...
+		static uint32_t morton(const uint32_t x, const uint32_t y, const uint32_t z) {
+			const auto spread = [](uint32_t v) {
+				v = (v | (v << 16)) & 0x030000FF;
+				v = (v | (v << 8)) & 0x0300F00F;
+				v = (v | (v << 4)) & 0x030C30C3;
+				v = (v | (v << 2)) & 0x09249249;
+				return v;
+			};
+			return (spread(x) << 2) | (spread(y) << 1) | spread(z);
+		}
+
+		// order and codes by the Morton code of the centers in their bounds (stable: equal codes stay
+		// in index order, so the result doesn't depend on the number of threads)
+		void sortMorton(const uint32_t threads) {
+			const uint32_t n = (uint32_t)centers.size();
+			const AABB bounds = centerBounds(0, n);
+			const vec3 extent = bounds.dimensions();
+			vec3 scale;
+			for(int a = 0; a < 3; a++)
+				scale[a] = extent[a] > 0 ? 1023.f / extent[a] : 0;
+
+			std::vector<uint32_t> unsorted(n);
+			parallel_for(0, n, [&](const size_t i) {
+				const vec3 p = (centers[i] - bounds._min) * scale;
+				unsorted[i] = morton((uint32_t)p.x(), (uint32_t)p.y(), (uint32_t)p.z());
+			}, threads, 4096);
+
+			// LSD radix sort, 8 bits per pass
+			codes = unsorted;
+			std::vector<uint32_t> codesTmp(n), orderTmp(n);
+			for(int shift = 0; shift < 30; shift += 8) {
+				parallel_counting_sort(n, 256,
+					[&](const size_t k) { return codes[k] >> shift & 0xFF; },
+					[&](const size_t k, const size_t slot) {
+						codesTmp[slot] = codes[k];
+						orderTmp[slot] = order[k];
+					}, threads);
+				codes.swap(codesTmp);
+				order.swap(orderTmp);
+			}
+		}
+	};
+};
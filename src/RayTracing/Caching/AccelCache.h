@@ -0,0 +1,236 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <random>
+#include <utility>
+#include <filesystem>
+#include <functional>
+#include <type_traits>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/AABB.h"
+#include "RayTracing/BVH.h"
+
+#include "RayTracing/Objects/VoxelVolume.h"
+
+#include "RayTracing/Memory/MappedFile.h"
+
+#include "RayTracing/Profiling/Profiler.h"
+
+// 64 bit hash of a byte range, a word at a time (multiply-xorshift, splitmix64 finalizer)
+inline uint64_t hashBytes(const void *const data, const size_t size, uint64_t h = 0x9E3779B97F4A7C15ull) {
+	const uint8_t *const bytes = (const uint8_t*)data;
+	const auto mix = [](uint64_t x) {
+		x ^= x >> 30;
+		x *= 0xBF58476D1CE4E5B9ull;
+		x ^= x >> 27;
+		x *= 0x94D049BB133111EBull;
+		return x ^ (x >> 31);
+	};
+
+	size_t i = 0;
+	for(; i + 8 <= size; i += 8) {
+		uint64_t word;
+		memcpy(&word, bytes + i, 8);
+		h = (h ^ mix(word)) * 0x100000001B3ull;
+	}
+	uint64_t tail = 0;
+	memcpy(&tail, bytes + i, size - i);
+	return mix(h ^ mix(tail ^ size));
+}
+
+template<typename T>
+inline uint64_t hashValue(const T& value, const uint64_t h) {
+	return hashBytes(&value, sizeof(T), h);
+}
+
+// Nodes are written and mapped as raw bytes
+static_assert(std::is_trivially_copyable_v<BVH::Node>);
+
+// Built acceleration structures on disk, so the next launch maps them instead of building them
+// again: BVHs (nodes and primitive order, used in place from the mapping) and the coarser levels of
+// VoxelVolumes (copied out of it). A file is named after a hash of everything its structure is
+// built from (boxes, leaf size and builder, voxels and emitters) plus VERSION and the layout of this build
+// (`real`, node size), so any change to the input or the code simply misses. Files are raw memory
+// images, written to a temporary name and renamed into place, so concurrent writers and readers
+// never see half a file; a mapped BVH is still checked (BVH::valid) before it's traversed.
+class AccelCache {
+	std::filesystem::path directory;
+
+public:
+	static constexpr uint32_t VERSION = 1;
+
+	// since construction
+	std::atomic_size_t hits = 0, misses = 0, writeFailures = 0;
+
+	explicit AccelCache(const std::filesystem::path& directory): directory(directory) { }
+
+	inline const std::filesystem::path& path() const { return directory; }
+
+	// bvh.build(boxes, maxLeafSize, builder, numThreads), or what an earlier one stored
+	void build(BVH& bvh, const std::vector<AABB>& boxes, const uint32_t maxLeafSize = 1, const BVHBuilder builder = BVHBuilder::Median, const uint32_t numThreads = hardwareThreads()) {
+		RT_ZONE("accelCache.bvh");
+
+		uint64_t key = hashValue(layout('B'), hashValue(builder, hashValue(maxLeafSize, boxes.size())));
+		std::vector<real> extents(6 * boxes.size());
+		for(size_t i = 0; i < boxes.size(); i++)
+			for(int axis = 0; axis < 3; axis++) {
+				extents[6 * i + axis] = boxes[i]._min[axis];
+				extents[6 * i + 3 + axis] = boxes[i]._max[axis];
+			}
+		key = hashBytes(extents.data(), extents.size() * sizeof(real), key);
+
+		Section sections[2];
+		if(const std::shared_ptr<const MappedFile> file = open(key, sections, 2)) {
+			const BVH::Node *const nodes = (const BVH::Node*)(file->data() + sections[0].offset);
+			const uint32_t *const order = (const uint32_t*)(file->data() + sections[1].offset);
+			const size_t numNodes = sections[0].size / sizeof(BVH::Node);
+			// a stale, damaged or colliding file must not turn into reads out of bounds
+			if(sections[0].size % sizeof(BVH::Node) == 0 && sections[1].size == boxes.size() * sizeof(uint32_t)
+					&& BVH::valid(nodes, numNodes, order, boxes.size())) {
+				bvh.view(file, nodes, numNodes, order, boxes.size());
+				hits++;
+				return;
+			}
+		}
+
+		misses++;
+		bvh.build(boxes, maxLeafSize, builder, numThreads);
+		store(key, {
+			{ bvh.nodeData(), bvh.size() * sizeof(BVH::Node) },
+			{ bvh.orderData(), bvh.primitives() * sizeof(uint32_t) },
+		});
+	}
+
+	// volume.buildLevels(), or what an earlier one stored
+	void buildLevels(VoxelVolume& volume) {
+		RT_ZONE("accelCache.voxelLevels");
+
+		uint64_t key = hashValue(layout('V'), hashValue(VoxelVolume::MAX_LEVELS, 0));
+		for(int axis = 0; axis < 3; axis++)
+			key = hashValue(volume.size(axis), key);
+		for(const bool e : volume.emitters())
+			key = hashValue(e, key);
+		key = hashBytes(volume.data(), volume.dataSize() * sizeof(size_t), key);
+
+		const size_t numLevels = volume.numLevels() - 1;
+		std::vector<Section> sections(numLevels);
+		if(const std::shared_ptr<const MappedFile> file = open(key, sections.data(), numLevels)) {
+			std::vector<std::pair<const size_t*, size_t>> cells;
+			for(const Section& s : sections)
+				cells.emplace_back((const size_t*)(file->data() + s.offset), s.size / sizeof(size_t));
+			if(volume.restoreLevels(cells)) {
+				hits++;
+				return;
+			}
+		}
+
+		misses++;
+		volume.buildLevels();
+		std::vector<std::pair<const void*, size_t>> data;
+		for(uint32_t l = 1; l < volume.numLevels(); l++)
+			data.emplace_back(volume.levelCells(l).data(), volume.levelCells(l).size() * sizeof(size_t));
+		store(key, data);
+	}
+
+	// Deletes every cache file
+	void clear() {
+		std::error_code error;
+		for(const auto& entry : std::filesystem::directory_iterator(directory, error))
+			if(entry.path().extension() == EXTENSION)
+				std::filesystem::remove(entry.path(), error);
+	}
+
+private:
+	static constexpr const char *EXTENSION = ".accel";
+	static constexpr size_t ALIGNMENT = 64; // of the sections in the file
+
+	struct Header {
+		char magic[4];
+		uint32_t version;
+		uint64_t key;
+		uint64_t sections;
+	};
+	struct Section {
+		uint64_t offset, size;
+	};
+
+	// What a file depends on besides its input: the kind of structure and this build's memory layout
+	static uint64_t layout(const char kind) {
+		const uint64_t sizes[] = { (uint64_t)kind, VERSION, sizeof(real), sizeof(AABB), sizeof(BVH::Node), sizeof(size_t) };
+		return hashBytes(sizes, sizeof(sizes));
+	}
+
+	std::filesystem::path file(const uint64_t key) const {
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+		return directory / (std::string(name) + EXTENSION);
+	}
+
+	// The file for key if it's complete and holds `count` sections
+	std::shared_ptr<const MappedFile> open(const uint64_t key, Section *const sections, const size_t count) const {
+		const std::shared_ptr<const MappedFile> mapped = std::make_shared<const MappedFile>(file(key).string());
+		if(!mapped->valid() || mapped->size() < sizeof(Header) + count * sizeof(Section))
+			return nullptr;
+
+		Header header;
+		memcpy(&header, mapped->data(), sizeof(Header));
+		if(memcmp(header.magic, "RTAC", 4) != 0 || header.version != VERSION || header.key != key || header.sections != count)
+			return nullptr;
+
+		memcpy(sections, mapped->data() + sizeof(Header), count * sizeof(Section));
+		for(size_t i = 0; i < count; i++)
+			if(sections[i].offset % ALIGNMENT != 0 || sections[i].offset > mapped->size() || sections[i].size > mapped->size() - sections[i].offset)
+				return nullptr;
+		return mapped;
+	}
+
+	void store(const uint64_t key, const std::vector<std::pair<const void*, size_t>>& data) {
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+
+		const Header header{ { 'R', 'T', 'A', 'C' }, VERSION, key, data.size() };
+		std::vector<Section> sections;
+		uint64_t offset = sizeof(Header) + data.size() * sizeof(Section);
+		for(const auto& [bytes, size] : data) {
+			offset = (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+			sections.push_back(Section{ offset, size });
+			offset += size;
+		}
+
+		const std::filesystem::path target = file(key);
+		// unique among processes (a random nonce per process) and among calls (a counter)
+		static const uint64_t nonce = ((uint64_t)std::random_device()() << 32) | std::random_device()();
+		static std::atomic_uint64_t sequence = 0;
+		const std::filesystem::path temporary = target.string() + "." + std::to_string(nonce) + "-" + std::to_string(sequence.fetch_add(1)) + ".tmp";
+		FILE *const fp = fopen(temporary.string().c_str(), "wb");
+		if(fp == nullptr) {
+			writeFailures++;
+			return;
+		}
+
+		bool ok = fwrite(&header, sizeof(Header), 1, fp) == 1
+			&& fwrite(sections.data(), sizeof(Section), sections.size(), fp) == sections.size();
+		uint64_t written = sizeof(Header) + sections.size() * sizeof(Section);
+		static const char zeros[ALIGNMENT] = {};
+		for(size_t i = 0; ok && i < data.size(); i++) {
+			ok = fwrite(zeros, 1, sections[i].offset - written, fp) == sections[i].offset - written
+				&& fwrite(data[i].first, 1, data[i].second, fp) == data[i].second;
+			written = sections[i].offset + data[i].second;
+		}
+		ok &= fclose(fp) == 0;
+
+		if(ok)
+			std::filesystem::rename(temporary, target, error);
+		if(!ok || error) {
+			std::filesystem::remove(temporary, error);
+			writeFailures++;
+		}
+	}
+};
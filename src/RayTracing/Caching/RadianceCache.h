@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/color.h"
+#include "RayTracing/hit_record.h"
+#include "RayTracing/parallel.h"
+
+#include "RayTracing/Profiling/Profiler.h"
+
+// World-space radiance cache: a fixed-size hash table of cells (cellSize^3 boxes, split by the
+// dominant axis + sign of the surface normal, so with cellSize 1 every voxel face gets its own cell)
+// holding the outgoing radiance reflected by diffuse surfaces.
+// Paths add a sample at each diffuse hit once the rest of the path is known (update), and end at
+// secondary diffuse hits whose cell has enough history (lookup), so the cost of a path no longer
+// grows with the number of bounces.
+//
+// During a frame only update / lookup run, from any number of threads. endFrame() folds the frame's
+// samples into the cells and evicts the least recently used ones; it must not overlap with rendering.
+class RadianceCache {
+public:
+	float cellSize = 1.f;
+	uint32_t minSamples = 16; // a cell answers lookups after this many samples
+	uint32_t maxSamples = 256; // history cap: older samples fade out, so lighting changes propagate
+	uint32_t maxAge = 120; // frames without update / lookup after which a cell is freed
+	float refreshProbability = .1f; // lookups that report a miss anyway, keeping cells only seen indirectly up to date
+	uint32_t numThreads = hardwareThreads();
+
+	static constexpr uint64_t EMPTY = ~0ull;
+
+private:
+	static constexpr uint32_t PROBES = 8; // slots searched per key
+	static constexpr float FIXED_SCALE = 1024.f; // samples are summed as fixed point
+	static constexpr float MAX_SAMPLE = 1024.f; // clamp before summing
+
+	struct alignas(64) Entry {
+		std::atomic_uint64_t key = EMPTY;
+		std::atomic_uint32_t lastUsed = 0; // frame
+		std::atomic_uint32_t count = 0; // samples this frame
+		std::atomic_uint64_t sum[3]{}; // this frame, fixed point
+
+		// resolved in endFrame, read-only during a frame
+		float radiance[3]{};
+		uint32_t samples = 0;
+	};
+
+	std::unique_ptr<Entry[]> entries;
+	size_t mask = 0;
+	uint32_t frame = 1;
+	size_t numEntries = 0;
+	std::atomic_uint64_t insertFailures = 0; // this frame, all probed slots taken
+
+public:
+	// The table holds as many cells as fit into budgetBytes (rounded down to a power of 2)
+	RadianceCache(const size_t budgetBytes = 16 << 20) {
+		size_t capacity = 1;
+		while(capacity * 2 * sizeof(Entry) <= budgetBytes)
+			capacity *= 2;
+		entries.reset(new Entry[capacity]);
+		mask = capacity - 1;
+	}
+
+	inline size_t capacity() const { return mask + 1; }
+	inline size_t size() const { return numEntries; } // as of the last endFrame
+	inline size_t memoryBytes() const { return capacity() * sizeof(Entry); }
+
+	void clear() {
+		for(size_t i = 0; i <= mask; i++)
+			reset(entries[i]);
+		numEntries = 0;
+		insertFailures = 0;
+	}
+
+	// Cell of a surface point: 20 bits per axis + 3 bits of normal direction
+	inline uint64_t key(const vec3& p, const vec3& n) const {
+		const vec3 a(std::abs(n.x()), std::abs(n.y()), std::abs(n.z()));
+		const int axis = a.x() >= a.y() && a.x() >= a.z() ? 0 : (a.y() >= a.z() ? 1 : 2);
+		const uint64_t face = (uint64_t)(axis * 2 + (n[axis] < 0));
+
+		// half a cell behind the surface, so points on a voxel face all land in that voxel
+		const vec3 inside = (p - n * real(cellSize * .5f)) / real(cellSize);
+		const auto cell = [](const real v) { return (uint64_t)(int64_t)std::floor(v) & 0xFFFFF; };
+		return cell(inside.x()) | (cell(inside.y()) << 20) | (cell(inside.z()) << 40) | (face << 60);
+	}
+
+	inline uint64_t key(const hit_record& rec) const {
+		return key(rec.p, rec.normal);
+	}
+
+	// Cached outgoing radiance of the cell; false if it has too little history (or for refresh)
+	bool lookup(const uint64_t k, color& radiance) {
+		Entry *const e = find(k);
+		if(!e)
+			return false;
+
+		e->lastUsed.store(frame, std::memory_order_relaxed);
+		if(e->samples < minSamples || random_real() < refreshProbability)
+			return false;
+
+		radiance = color(e->radiance[0], e->radiance[1], e->radiance[2]);
+		return true;
+	}
+
+	// Adds one sample of the outgoing radiance at a surface point in the cell
+	void update(const uint64_t k, const color& radiance) {
+		if(!(radiance.x() >= 0 && radiance.y() >= 0 && radiance.z() >= 0)) // NaN, negative
+			return;
+
+		Entry *const e = findOrInsert(k);
+		if(!e)
+			return;
+
+		e->lastUsed.store(frame, std::memory_order_relaxed);
+		for(int c = 0; c < 3; c++)
+			e->sum[c].fetch_add((uint64_t)(std::min<float>((float)radiance[c], MAX_SAMPLE) * FIXED_SCALE), std::memory_order_relaxed);
+		e->count.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	// Folds this frame's samples into the cells, frees cells unused for maxAge frames and, if
+	// inserts failed for lack of space, the least recently used ones until there's room for them
+	void endFrame() {
+		RT_ZONE("radianceCache.endFrame");
+
+		std::vector<std::atomic_uint64_t> ages(maxAge + 1);
+		std::atomic_size_t live = 0;
+
+		parallel_for(0, capacity() / 4096 + 1, [&](const size_t chunk) {
+			size_t chunkLive = 0;
+			const size_t end = std::min(capacity(), (chunk + 1) * 4096);
+			for(size_t i = chunk * 4096; i < end; i++) {
+				Entry& e = entries[i];
+				if(e.key.load(std::memory_order_relaxed) == EMPTY)
+					continue;
+
+				const uint32_t n = e.count.exchange(0, std::memory_order_relaxed);
+				if(n > 0) {
+					const uint32_t samples = std::min(e.samples + n, maxSamples);
+					const float weight = std::min(1.f, (float)n / samples);
+					for(int c = 0; c < 3; c++) {
+						const float mean = e.sum[c].exchange(0, std::memory_order_relaxed) / (FIXED_SCALE * n);
+						e.radiance[c] += (mean - e.radiance[c]) * weight;
+					}
+					e.samples = samples;
+				}
+
+				const uint32_t age = frame - e.lastUsed.load(std::memory_order_relaxed);
+				if(age > maxAge) {
+					reset(e);
+					continue;
+				}
+				ages[age].fetch_add(1, std::memory_order_relaxed);
+				chunkLive++;
+			}
+			live += chunkLive;
+		}, numThreads);
+
+		numEntries = live;
+
+		// LRU: the oldest age groups go until twice the failed inserts are freed
+		const uint64_t failures = insertFailures.exchange(0);
+		if(failures > 0) {
+			uint64_t freed = 0;
+			uint32_t oldestKept = maxAge + 1;
+			while(oldestKept > 1 && freed < 2 * failures)
+				freed += ages[--oldestKept];
+
+			for(size_t i = 0; i <= mask; i++) {
+				Entry& e = entries[i];
+				if(e.key.load(std::memory_order_relaxed) != EMPTY && frame - e.lastUsed.load(std::memory_order_relaxed) >= oldestKept) {
+					reset(e);
+					numEntries--;
+				}
+			}
+		}
+
+		frame++;
+	}
+
+private:
+	inline size_t slot(const uint64_t k) const {
+		return (size_t)((k * 0x9E3779B97F4A7C15ull) >> 20) & mask;
+	}
+
+	// All probed slots are checked: evictions leave holes in front of live keys
+	Entry* find(const uint64_t k) {
+		const size_t first = slot(k);
+		for(uint32_t p = 0; p < PROBES; p++) {
+			Entry& e = entries[(first + p) & mask];
+			if(e.key.load(std::memory_order_acquire) == k)
+				return &e;
+		}
+		return nullptr;
+	}
+
+	Entry* findOrInsert(const uint64_t k) {
+		if(Entry *const e = find(k))
+			return e;
+
+		const size_t first = slot(k);
+		for(uint32_t p = 0; p < PROBES; p++) {
+			Entry& e = entries[(first + p) & mask];
+			uint64_t current = e.key.load(std::memory_order_acquire);
+			if(current == EMPTY && e.key.compare_exchange_strong(current, k, std::memory_order_acq_rel))
+				return &e;
+			if(current == k) // another thread inserted it first
+				return &e;
+		}
+		insertFailures.fetch_add(1, std::memory_order_relaxed);
+		return nullptr;
+	}
+
+	static void reset(Entry& e) {
+		e.key.store(EMPTY, std::memory_order_relaxed);
+		e.lastUsed.store(0, std::memory_order_relaxed);
+		e.count.store(0, std::memory_order_relaxed);
+		for(int c = 0; c < 3; c++) {
+			e.sum[c].store(0, std::memory_order_relaxed);
+			e.radiance[c] = 0;
+		}
+		e.samples = 0;
+	}
+};
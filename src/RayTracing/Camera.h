@@ -1,56 +1,91 @@
-#pragma once
-
-#include "vec.h"
-#include "Ray.h"
-
-static inline double radians(const double degrees) noexcept {
-	return degrees * 2. * 3.1415926535 / 360.;
-}
-
-class Camera {
-public:
-	vec3 horizontal, vertical, center_of_viewplane;
-
-private:
-	vec3 origin;
-	double lens_radius;//, focus_dist;
-
-public:
-	Camera(
-		vec3 lookfrom,
-		vec3 viewDir,
-		vec3 vup,
-		double vfov, // vertical field-of-view in degrees
-		double aspect_ratio = 1,
-		double aperture = 0,
-		double focus_dist = 1):
-			origin(lookfrom),
-			lens_radius(aperture/2) /*, focus_dist(focus_dist)*/ {
-
-		double h = tan(radians(vfov) / 2);
-		double viewport_height = 2.0 * h;
-		double viewport_width = aspect_ratio * viewport_height;
-
-		vec3 w = -unit_vector(viewDir);
-		vec3 u = unit_vector(cross(vup, w)); // horizontal
-		vec3 v = cross(w, u); // vertical
-
-		horizontal = u * (viewport_width * focus_dist);
-		vertical = v * (viewport_height * focus_dist);
-
-		// lower_left_corner = origin*0 - horizontal/2*0 - vertical/2*0 - focus_dist*w;
-		center_of_viewplane = -focus_dist * w;
-	}
-
-	Camera(const Camera&) = default;
-	Camera& operator=(const Camera&) = default;
-
-	Ray getRay(const double s, const double t) const {
-		const vec3 rd = lens_radius * random_in_unit_disk();
-        const vec3 offset = unit_vector(horizontal) * rd.x() + unit_vector(vertical) * rd.y();
-
-		vec3 pixelPos = center_of_viewplane + horizontal * s + vertical * t - offset;
-
-		return Ray(origin + offset, unit_vector(pixelPos));
-	}
+#pragma once
+
+#include <algorithm>
+
+#include "vec.h"
+#include "Ray.h"
+
+static inline double radians(const double degrees) noexcept {
+	return degrees * 2. * 3.1415926535 / 360.;
+}
+
+class Camera {
+public:
+	vec3 horizontal, vertical, center_of_viewplane;
+
+private:
+	vec3 origin;
+	real lens_radius;//, focus_dist;
+	real shutterOpen = 0, shutterClose = 0; // scene time
+
+public:
+	Camera(
+		vec3 lookfrom,
+		vec3 viewDir,
+		vec3 vup,
+		double vfov, // vertical field-of-view in degrees
+		double aspect_ratio = 1,
+		double aperture = 0,
+		double focus_dist = 1):
+			origin(lookfrom),
+			lens_radius(aperture/2) /*, focus_dist(focus_dist)*/ {
+
+		double h = tan(radians(vfov) / 2);
+		double viewport_height = 2.0 * h;
+		double viewport_width = aspect_ratio * viewport_height;
+
+		vec3 w = -unit_vector(viewDir);
+		vec3 u = unit_vector(cross(vup, w)); // horizontal
+		vec3 v = cross(w, u); // vertical
+
+		horizontal = u * (viewport_width * focus_dist);
+		vertical = v * (viewport_height * focus_dist);
+
+		// lower_left_corner = origin*0 - horizontal/2*0 - vertical/2*0 - focus_dist*w;
+		center_of_viewplane = -focus_dist * w;
+	}
+
+	Camera(const Camera&) = default;
+	Camera& operator=(const Camera&) = default;
+
+	// Rays get a uniformly distributed time in [open, close] (motion blur); an empty interval
+	// doesn't draw a random number, so still frames render exactly as before
+	void setShutter(const real open, const real close) {
+		shutterOpen = open;
+		shutterClose = std::max(open, close);
+	}
+	real shutterStart() const { return shutterOpen; }
+	real shutterEnd() const { return shutterClose; }
+
+	// spread: cone angle of the ray, see pixelSpread
+	Ray getRay(const real s, const real t, const real spread = 0) const {
+		const vec3 rd = lens_radius * random_in_unit_disk();
+        const vec3 offset = unit_vector(horizontal) * rd.x() + unit_vector(vertical) * rd.y();
+
+		vec3 pixelPos = center_of_viewplane + horizontal * s + vertical * t - offset;
+
+		const real time = shutterClose > shutterOpen ? random_real(shutterOpen, shutterClose) : shutterOpen;
+		return Ray(origin + offset, unit_vector(pixelPos), 0, spread, time);
+	}
+
+	// Angle one pixel subtends, for a pixel pixelSize wide in screen coordinates (s spans 1)
+	real pixelSpread(const real pixelSize) const {
+		return pixelSize * horizontal.length<real>() / center_of_viewplane.length<real>();
+	}
+
+	point3 position() const { return origin; }
+
+	// Inverse of getRay (ignoring the lens offset): screen coordinates of a world position.
+	// Returns false if p lies behind the camera.
+	bool project(const point3& p, real& s, real& t) const {
+		const vec3 d = p - origin;
+
+		const real k = dot(d, center_of_viewplane) / length_squared(center_of_viewplane);
+		if (k <= 0)
+			return false;
+
+		s = dot(d, horizontal) / (k * length_squared(horizontal));
+		t = dot(d, vertical) / (k * length_squared(vertical));
+		return true;
+	}
 };
\ No newline at end of file
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/color.h"
+#include "RayTracing/Ray.h"
+#include "RayTracing/hit_record.h"
+
+#include "RayTracing/Texture/fTexture.h"
+
+// First-hit features of one sample (averaged per pixel by the caller)
+struct AOVSample {
+	static constexpr float SKY_DEPTH = 1e20f;
+
+	color albedo;
+	vec3 normal;
+	point3 position; // sky: far along the ray direction
+	float depth = 0;
+
+	static AOVSample fromHit(const Ray& r, const hit_record& rec, const color& albedo) {
+		AOVSample aov;
+		aov.albedo = albedo;
+		aov.normal = rec.normal;
+		aov.position = rec.p;
+		aov.depth = (rec.p - r.orig).length<float>(); // rec.t isn't set by every hittable
+		return aov;
+	}
+
+	static AOVSample fromSky(const Ray& r, const color& sky) {
+		AOVSample aov;
+		aov.albedo = sky;
+		aov.normal = vec3(0.f);
+		aov.position = r.orig + unit_vector(r.dir) * SKY_DEPTH;
+		aov.depth = SKY_DEPTH;
+		return aov;
+	}
+};
+
+// Noisy radiance + first-hit albedo / normal / depth as float planes (SoA).
+// Every plane is padded by PADDING pixels on each side, so filters can read
+// neighbours without bounds checks; padding pixels carry an invalid normal. Rows are
+// rounded up to a multiple of 4 pixels first, so groups of 4 never run past the padding.
+class AOVBuffer {
+public:
+	static constexpr uint32_t PADDING = 32; // 2 taps * largest à-trous step (16)
+	static constexpr float INVALID_NORMAL = 1e4f;
+
+	uint32_t width = 0, height = 0;
+	uint32_t stride = 0, paddedHeight = 0;
+
+	std::vector<float> radiance[3];
+	std::vector<float> albedo[3];
+	std::vector<float> normal[3];
+	std::vector<float> position[3];
+	std::vector<float> depth;
+
+public:
+	AOVBuffer() { }
+	AOVBuffer(const uint32_t width, const uint32_t height) { resize(width, height); }
+
+	void resize(const uint32_t width, const uint32_t height) {
+		this->width = width;
+		this->height = height;
+		stride = (width + 3) / 4 * 4 + 2 * PADDING;
+		paddedHeight = height + 2 * PADDING;
+
+		const size_t size = (size_t)stride * paddedHeight;
+		for(int c = 0; c < 3; c++) {
+			radiance[c].assign(size, 0.f);
+			albedo[c].assign(size, 0.f);
+			normal[c].assign(size, INVALID_NORMAL);
+			position[c].assign(size, 0.f);
+		}
+		depth.assign(size, AOVSample::SKY_DEPTH);
+	}
+
+	inline size_t index(const uint32_t x, const uint32_t y) const {
+		return (size_t)(y + PADDING) * stride + (x + PADDING);
+	}
+
+	void store(const uint32_t x, const uint32_t y, const color& rad, const AOVSample& aov) {
+		const size_t i = index(x, y);
+		for(int c = 0; c < 3; c++) {
+			radiance[c][i] = rad[c];
+			albedo[c][i] = aov.albedo[c];
+			normal[c][i] = aov.normal[c];
+			position[c][i] = aov.position[c];
+		}
+		depth[i] = aov.depth;
+	}
+
+	color radianceAt(const uint32_t x, const uint32_t y) const {
+		const size_t i = index(x, y);
+		return color(radiance[0][i], radiance[1][i], radiance[2][i]);
+	}
+
+	// Writes the (undenoised) radiance gamma-encoded into target
+	void resolve(fTexture& target) const {
+		for(uint32_t y = 0; y < height; y++)
+			for(uint32_t x = 0; x < width; x++)
+				target.pixels[y * target.width + x] = gammaColor(radianceAt(x, y));
+	}
+};
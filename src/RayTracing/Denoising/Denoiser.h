@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/color.h"
+#include "RayTracing/simd.h"
+#include "RayTracing/parallel.h"
+
+#include "RayTracing/Texture/fTexture.h"
+
+#include "RayTracing/Denoising/AOVBuffer.h"
+
+#include "RayTracing/Profiling/Profiler.h"
+
+// Edge-avoiding À-trous wavelet filter (Dammertz et al. 2010), SVGF-style albedo demodulation.
+// Each iteration is a 5x5 B3-spline kernel with holes (step 1, 2, 4, ...), weighted by
+// color, normal and relative depth differences. Rows run in parallel, 4 pixels per SIMD lane group.
+class Denoiser {
+public:
+	static constexpr uint32_t MAX_ITERATIONS = 5; // step 16 * 2 taps = AOVBuffer::PADDING
+	static constexpr float ALBEDO_EPSILON = 1e-3f;
+
+	uint32_t iterations = 5;
+	float sigmaColor = 3.f; // halved every iteration, large enough to absorb 1 spp noise
+	float sigmaNormal = .5f;
+	float sigmaDepth = .05f; // relative to the center pixel's depth
+	uint32_t numThreads = hardwareThreads();
+
+private:
+	std::vector<float> illumination[2][3]; // ping-pong, same padded layout as AOVBuffer
+
+public:
+	// Filters aov.radiance and writes the gamma-encoded result into target (same dimensions)
+	void filter(const AOVBuffer& aov, fTexture& target) {
+		RT_ZONE("denoise");
+
+		const size_t size = (size_t)aov.stride * aov.paddedHeight;
+		for(int b = 0; b < 2; b++)
+			for(int c = 0; c < 3; c++)
+				if(illumination[b][c].size() != size)
+					illumination[b][c].assign(size, 0.f);
+
+		// demodulate albedo, so surface color detail isn't blurred
+		parallel_for(0, aov.height, [&](const size_t y) {
+			for(uint32_t x = 0; x < aov.width; x++) {
+				const size_t i = aov.index(x, y);
+				for(int c = 0; c < 3; c++)
+					illumination[0][c][i] = aov.radiance[c][i] / std::max(aov.albedo[c][i], ALBEDO_EPSILON);
+			}
+		}, numThreads);
+
+		int src = 0;
+		const uint32_t numIterations = std::min(iterations, MAX_ITERATIONS);
+		for(uint32_t it = 0; it < numIterations; it++) {
+			const uint32_t step = 1u << it;
+			const float sigmaC = sigmaColor / step;
+
+			parallel_for(0, aov.height, [&](const size_t y) {
+				filterRow(aov, illumination[src], illumination[1 - src], (uint32_t)y, step, sigmaC);
+			}, numThreads);
+
+			src = 1 - src;
+		}
+
+		// re-modulate
+		parallel_for(0, aov.height, [&](const size_t y) {
+			for(uint32_t x = 0; x < aov.width; x++) {
+				const size_t i = aov.index(x, y);
+				color col;
+				for(int c = 0; c < 3; c++)
+					col[c] = illumination[src][c][i] * std::max(aov.albedo[c][i], ALBEDO_EPSILON);
+				target.pixels[y * target.width + x] = gammaColor(col);
+			}
+		}, numThreads);
+	}
+
+private:
+	void filterRow(const AOVBuffer& aov, const std::vector<float> (&in)[3], std::vector<float> (&out)[3], const uint32_t y, const uint32_t step, const float sigmaC) const {
+		static constexpr float KERNEL[5] = { 1.f/16, 1.f/4, 3.f/8, 1.f/4, 1.f/16 };
+
+		const float4 invSigmaC2(1.f / (sigmaC * sigmaC));
+		const float4 invSigmaN2(1.f / (sigmaNormal * sigmaNormal));
+		const float4 invSigmaZ2(1.f / (sigmaDepth * sigmaDepth));
+
+		const size_t rowStart = aov.index(0, y);
+
+		// rows are padded to a multiple of 4, so the last group of 4 may spill into the padding
+		for(uint32_t x = 0; x < aov.width; x += 4) {
+			const size_t p = rowStart + x;
+
+			float4 c0[3], n0[3];
+			for(int c = 0; c < 3; c++) {
+				c0[c] = float4::load(&in[c][p]);
+				n0[c] = float4::load(&aov.normal[c][p]);
+			}
+			const float4 z0 = float4::load(&aov.depth[p]);
+			const float4 invZ0 = float4(1.f) / max(z0, float4(1e-6f));
+
+			float4 sum[3], weightSum;
+
+			for(int j = -2; j <= 2; j++) {
+				for(int i = -2; i <= 2; i++) {
+					const size_t q = p + (ptrdiff_t)j * step * aov.stride + (ptrdiff_t)i * step;
+
+					float4 cq[3];
+					float4 distC, distN;
+					for(int c = 0; c < 3; c++) {
+						cq[c] = float4::load(&in[c][q]);
+						const float4 dc = cq[c] - c0[c];
+						const float4 dn = float4::load(&aov.normal[c][q]) - n0[c];
+						distC += dc * dc;
+						distN += dn * dn;
+					}
+					const float4 dz = (float4::load(&aov.depth[q]) - z0) * invZ0;
+
+					const float4 w = float4(KERNEL[i + 2] * KERNEL[j + 2])
+						* exp_neg(float4(0.f) - (distC * invSigmaC2 + distN * invSigmaN2 + dz * dz * invSigmaZ2));
+
+					for(int c = 0; c < 3; c++)
+						sum[c] += w * cq[c];
+					weightSum += w;
+				}
+			}
+
+			const float4 invWeight = float4(1.f) / weightSum;
+			for(int c = 0; c < 3; c++)
+				(sum[c] * invWeight).store(&out[c][p]);
+		}
+	}
+};
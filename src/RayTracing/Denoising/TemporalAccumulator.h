@@ -0,0 +1,157 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <vector>
+#include <optional>
+#include <utility>
+#include <cmath>
+#include <algorithm>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/color.h"
+#include "RayTracing/Camera.h"
+#include "RayTracing/parallel.h"
+
+#include "RayTracing/Denoising/AOVBuffer.h"
+
+#include "RayTracing/Profiling/Profiler.h"
+
+// Temporal accumulation with reprojection: last frame's accumulated radiance is looked up
+// (bilinearly) where each pixel's first-hit position lay in the previous camera, and blended
+// with the new samples. Taps whose stored position/normal disagree (disocclusion) or that
+// fall off-screen are rejected; the blend factor shrinks with the surviving history length.
+// Pixels map to screen coordinates like main.cpp: s = x / width - .5, t = y / width - .5
+class TemporalAccumulator {
+public:
+	float minAlpha = .05f; // weight of the newest frame once the history is long
+	float positionTolerance = .02f; // relative to the distance from the camera
+	float normalTolerance = .1f; // max squared difference of the (averaged) normals
+	uint32_t numThreads = hardwareThreads();
+
+private:
+	struct History {
+		std::vector<float> radiance[3];
+		std::vector<float> position[3];
+		std::vector<float> normal[3];
+		std::vector<float> length; // accumulated frames
+
+		void resize(const size_t size) {
+			for(int c = 0; c < 3; c++) {
+				radiance[c].assign(size, 0.f);
+				position[c].assign(size, 0.f);
+				normal[c].assign(size, 0.f);
+			}
+			length.assign(size, 0.f);
+		}
+	};
+
+	uint32_t width = 0, height = 0;
+	History history, next;
+	std::optional<Camera> prevCam;
+
+public:
+	void reset() {
+		prevCam.reset();
+	}
+
+	// Replaces aov.radiance with the accumulated radiance; cam is the camera the frame was rendered with.
+	// Returns the number of pixels that reused history.
+	size_t accumulate(AOVBuffer& aov, const Camera& cam) {
+		RT_ZONE("temporal.accumulate");
+
+		if(width != aov.width || height != aov.height) {
+			width = aov.width;
+			height = aov.height;
+			history.resize((size_t)width * height);
+			next.resize((size_t)width * height);
+			prevCam.reset();
+		}
+
+		std::atomic_size_t reusedPixels = 0;
+		parallel_for(0, height, [&](const size_t y) {
+			size_t rowReused = 0;
+			for(uint32_t x = 0; x < width; x++) {
+				const size_t i = aov.index(x, (uint32_t)y);
+				const size_t o = y * width + x;
+
+				const point3 p(aov.position[0][i], aov.position[1][i], aov.position[2][i]);
+				const vec3 n(aov.normal[0][i], aov.normal[1][i], aov.normal[2][i]);
+				const color current = aov.radianceAt(x, (uint32_t)y);
+
+				color accumulated;
+				float length = 0;
+				const bool reused = prevCam && reproject(p, n, cam, accumulated, length);
+
+				length = reused ? length + 1 : 1;
+				const float alpha = std::max(1.f / length, minAlpha);
+				const color result = reused ? lerp(accumulated, current, alpha) : current;
+
+				for(int c = 0; c < 3; c++) {
+					next.radiance[c][o] = result[c];
+					next.position[c][o] = p[c];
+					next.normal[c][o] = n[c];
+					aov.radiance[c][i] = result[c];
+				}
+				next.length[o] = length;
+				rowReused += reused;
+			}
+			reusedPixels += rowReused;
+		}, numThreads);
+
+		std::swap(history, next);
+		prevCam = cam;
+		return reusedPixels;
+	}
+
+private:
+	bool reproject(const point3& p, const vec3& n, const Camera& cam, color& accumulated, float& length) const {
+		real s, t;
+		if(!prevCam->project(p, s, t))
+			return false;
+
+		const float fx = (float)((s + .5) * width - .5);
+		const float fy = (float)((t + .5) * width - .5);
+		if(fx <= -1 || fy <= -1 || fx >= width || fy >= height)
+			return false;
+
+		const int x0 = (int)std::floor(fx);
+		const int y0 = (int)std::floor(fy);
+		const float wx = fx - x0;
+		const float wy = fy - y0;
+
+		const float maxDist = positionTolerance * (p - cam.position()).length<float>();
+		const float maxDistSQ = maxDist * maxDist;
+
+		float weightSum = 0;
+		accumulated = color(0.f);
+		length = 0;
+
+		for(int dy = 0; dy <= 1; dy++) {
+			for(int dx = 0; dx <= 1; dx++) {
+				const int x = x0 + dx, y = y0 + dy;
+				if(x < 0 || y < 0 || x >= (int)width || y >= (int)height)
+					continue;
+
+				const size_t o = (size_t)y * width + x;
+
+				const vec3 dp = vec3(history.position[0][o], history.position[1][o], history.position[2][o]) - p;
+				const vec3 dn = vec3(history.normal[0][o], history.normal[1][o], history.normal[2][o]) - n;
+				if(length_squared(dp) > maxDistSQ || length_squared(dn) > normalTolerance)
+					continue; // disoccluded
+
+				const float w = (dx ? wx : 1 - wx) * (dy ? wy : 1 - wy);
+				accumulated += color(history.radiance[0][o], history.radiance[1][o], history.radiance[2][o]) * w;
+				length += history.length[o] * w;
+				weightSum += w;
+			}
+		}
+
+		if(weightSum < 1e-3f)
+			return false;
+
+		accumulated /= weightSum;
+		length /= weightSum;
+		return true;
+	}
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+
+#include "RayTracing/general.h"
+#include "RayTracing/RenderMode.h"
+#include "RayTracing/vec.h"
+#include "RayTracing/Camera.h"
+#include "RayTracing/parallel.h"
+
+#include "RayTracing/Objects/hittable.h"
+#include "RayTracing/Materials/MaterialTable.h"
+#include "RayTracing/Texture/fTexture.h"
+#include "RayTracing/Lights/LightList.h"
+#include "RayTracing/Caching/RadianceCache.h"
+#include "RayTracing/Denoising/AOVBuffer.h"
+
+#include "RayTracing/Profiling/CostHeatmap.h"
+
+// One pixelColor (recursive ray_color) per pixel, rows in parallel; the headless
+// counterpart of main.cpp's render threads
+class RecursiveIntegrator {
+public:
+	uint32_t numThreads = hardwareThreads();
+	CostHeatmap *heatmap = nullptr; // optional, filled per pixel when its mode isn't Off
+	const LightList *lights = nullptr; // optional, enables next-event estimation
+	RadianceCache *cache = nullptr; // optional, ends secondary diffuse bounces early; endFrame() runs after each render
+	RenderMode mode = RenderMode::Path;
+	PreviewSettings preview;
+
+public:
+	void render(const hittable& world, const MaterialTable& materials, const fTexture& skybox, const Camera& cam, AOVBuffer& aov, const uint32_t samplesPerPixel, const uint32_t maxBounces) const {
+		const uint32_t width = aov.width, height = aov.height;
+		const HeatmapMode heatmapMode = heatmap ? heatmap->mode : HeatmapMode::Off;
+
+		parallel_for(0, height, [&](const size_t y) {
+			for(uint32_t x = 0; x < width; x++) {
+				const CostProbe probe(heatmapMode);
+
+				AOVSample pixelAOV;
+				const color radiance = pixelColor(
+						vec3(x*1./width - .5, y*1./width - .5, 0),
+						vec3(1. / width, 1. / height, 0),
+						world,
+						materials,
+						skybox,
+						cam,
+						samplesPerPixel,
+						maxBounces,
+						x,
+						(uint32_t)y,
+						pixelAOV,
+						lights,
+						cache,
+						mode,
+						preview);
+				aov.store(x, (uint32_t)y, radiance, pixelAOV);
+
+				if(heatmapMode != HeatmapMode::Off)
+					heatmap->store(x, (uint32_t)y, probe.stop(), samplesPerPixel);
+			}
+		}, numThreads);
+
+		if(cache && mode == RenderMode::Path)
+			cache->endFrame();
+	}
+};
@@ -0,0 +1,443 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <numeric>
+#include <utility>
+#include <algorithm>
+
+#include "RayTracing/general.h"
+#include "RayTracing/RenderMode.h"
+#include "RayTracing/vec.h"
+#include "RayTracing/color.h"
+#include "RayTracing/Ray.h"
+#include "RayTracing/Camera.h"
+#include "RayTracing/hit_record.h"
+#include "RayTracing/parallel.h"
+
+#include "RayTracing/Objects/hittable.h"
+#include "RayTracing/Materials/MaterialTable.h"
+#include "RayTracing/Texture/fTexture.h"
+#include "RayTracing/Lights/LightList.h"
+#include "RayTracing/Caching/RadianceCache.h"
+#include "RayTracing/Denoising/AOVBuffer.h"
+#include "RayTracing/Memory/Arena.h"
+
+#include "RayTracing/Profiling/Profiler.h"
+
+// Structure-of-arrays queue of path segments, one entry per live path
+class RayQueue {
+public:
+	std::vector<real> ox, oy, oz; // origin
+	std::vector<real> dx, dy, dz; // direction
+	std::vector<real> tr, tg, tb; // path throughput
+	std::vector<real> pdf; // density the direction was sampled with, 0 for camera rays and specular bounces
+	std::vector<real> coneWidth, coneSpread;
+	std::vector<real> time;
+	std::vector<uint32_t> path; // index into the per-path accumulators
+
+	std::atomic_size_t count = 0;
+
+public:
+	void reserve(const size_t capacity) {
+		for(std::vector<real>* v : { &ox, &oy, &oz, &dx, &dy, &dz, &tr, &tg, &tb, &pdf, &coneWidth, &coneSpread, &time })
+			v->resize(capacity);
+		path.resize(capacity);
+		count = 0;
+	}
+
+	inline Ray ray(const size_t i) const {
+		return Ray(point3(ox[i], oy[i], oz[i]), vec3(dx[i], dy[i], dz[i]), coneWidth[i], coneSpread[i], time[i]);
+	}
+
+	inline color throughput(const size_t i) const {
+		return color(tr[i], tg[i], tb[i]);
+	}
+
+	inline void set(const size_t i, const Ray& r, const color& thr, const uint32_t pathIndex, const real scatterPdf = 0) {
+		ox[i] = r.orig.x(); oy[i] = r.orig.y(); oz[i] = r.orig.z();
+		dx[i] = r.dir.x(); dy[i] = r.dir.y(); dz[i] = r.dir.z();
+		tr[i] = thr.x(); tg[i] = thr.y(); tb[i] = thr.z();
+		pdf[i] = scatterPdf;
+		coneWidth[i] = r.coneWidth;
+		coneSpread[i] = r.coneSpread;
+		time[i] = r.time;
+		path[i] = pathIndex;
+	}
+
+	// Thread-safe append
+	inline void push(const Ray& r, const color& thr, const uint32_t pathIndex, const real scatterPdf = 0) {
+		set(count.fetch_add(1, std::memory_order_relaxed), r, thr, pathIndex, scatterPdf);
+	}
+
+	inline void copy(const RayQueue& src, const size_t from, const size_t to) {
+		ox[to] = src.ox[from]; oy[to] = src.oy[from]; oz[to] = src.oz[from];
+		dx[to] = src.dx[from]; dy[to] = src.dy[from]; dz[to] = src.dz[from];
+		tr[to] = src.tr[from]; tg[to] = src.tg[from]; tb[to] = src.tb[from];
+		pdf[to] = src.pdf[from];
+		coneWidth[to] = src.coneWidth[from];
+		coneSpread[to] = src.coneSpread[from];
+		time[to] = src.time[from];
+		path[to] = src.path[from];
+	}
+};
+
+// Structure-of-arrays queue of shadow rays: the contribution is added to the path if nothing
+// blocks the segment up to tmax
+class ShadowQueue {
+public:
+	std::vector<real> ox, oy, oz; // origin
+	std::vector<real> dx, dy, dz; // direction
+	std::vector<real> tmax;
+	std::vector<real> coneWidth;
+	std::vector<real> time;
+	std::vector<real> cr, cg, cb; // unoccluded contribution
+	std::vector<uint32_t> path;
+
+	std::atomic_size_t count = 0;
+
+public:
+	void reserve(const size_t capacity) {
+		for(std::vector<real>* v : { &ox, &oy, &oz, &dx, &dy, &dz, &tmax, &coneWidth, &time, &cr, &cg, &cb })
+			v->resize(capacity);
+		path.resize(capacity);
+		count = 0;
+	}
+
+	inline Ray ray(const size_t i) const {
+		return Ray(point3(ox[i], oy[i], oz[i]), vec3(dx[i], dy[i], dz[i]), coneWidth[i], 0, time[i]);
+	}
+
+	inline color contribution(const size_t i) const {
+		return color(cr[i], cg[i], cb[i]);
+	}
+
+	// Thread-safe append
+	inline void push(const Ray& r, const real t_max, const color& c, const uint32_t pathIndex) {
+		const size_t i = count.fetch_add(1, std::memory_order_relaxed);
+		ox[i] = r.orig.x(); oy[i] = r.orig.y(); oz[i] = r.orig.z();
+		dx[i] = r.dir.x(); dy[i] = r.dir.y(); dz[i] = r.dir.z();
+		tmax[i] = t_max;
+		coneWidth[i] = r.coneWidth;
+		time[i] = r.time;
+		cr[i] = c.x(); cg[i] = c.y(); cb[i] = c.z();
+		path[i] = pathIndex;
+	}
+};
+
+// Path tracer that runs each bounce as a sequence of large parallel stages instead of one
+// recursive ray_color per path:
+//   generate (camera rays) -> bin (sort by direction octant + origin cell)
+//   -> extend (closest hit) -> shade (sorted by material; misses look up the skybox)
+//   -> connect (any-hit shadow rays queued by shade for next-event estimation, traced in batches)
+// Produces the same estimate and AOVs as pixelColor/ray_color. The preview modes stop after the
+// primary extend and shade each hit with previewShade.
+class WavefrontIntegrator {
+public:
+	struct Stats {
+		uint64_t primaryRays = 0;
+		uint64_t secondaryRays = 0;
+		uint64_t shadowRays = 0;
+	};
+
+	float binCellSize = 1.f; // world-space size of the origin cells rays are binned by
+	uint32_t numThreads = hardwareThreads();
+	size_t grain = 256; // rays per parallel work item
+	const LightList *lights = nullptr; // optional, enables next-event estimation
+	RadianceCache *cache = nullptr; // optional, ends secondary diffuse bounces early; endFrame() runs after each render
+	RenderMode mode = RenderMode::Path;
+	PreviewSettings preview;
+
+private:
+	// Diffuse hit whose outgoing radiance goes to the cache once its path is done: everything the
+	// path gathers after it, divided by the throughput up to it
+	struct CacheVertex {
+		uint64_t key;
+		color throughput;
+		color radiance; // path radiance before the vertex's reflection
+	};
+	static constexpr uint32_t CACHE_VERTICES = 2; // per path
+
+
+	RayQueue current, sorted;
+	ShadowQueue shadow;
+	std::vector<hit_record> hits;
+	std::vector<uint8_t> didHit;
+
+	std::vector<uint16_t> keys;
+	std::vector<uint32_t> order, orderTmp;
+
+	std::vector<color> pathRadiance;
+	std::vector<AOVSample> pathAOV;
+
+	std::vector<CacheVertex> cacheVertices;
+	std::vector<uint8_t> numCacheVertices;
+
+public:
+	// Renders a full frame into aov (radiance + first-hit features), pixel mapping as in main.cpp
+	Stats render(const hittable& world, const MaterialTable& materials, const fTexture& skybox, const Camera& cam, AOVBuffer& aov, const uint32_t samplesPerPixel, const uint32_t maxBounces) {
+		RT_ZONE("wavefront.render");
+
+		const uint32_t width = aov.width, height = aov.height;
+		const size_t numPaths = (size_t)width * height * samplesPerPixel;
+
+		current.reserve(numPaths);
+		sorted.reserve(numPaths);
+		shadow.reserve(numPaths);
+		hits.resize(numPaths);
+		didHit.resize(numPaths);
+		pathRadiance.assign(numPaths, color(0.f));
+		pathAOV.assign(numPaths, AOVSample{});
+		RadianceCache *const pathCache = mode == RenderMode::Path ? cache : nullptr;
+		if(pathCache) {
+			cacheVertices.resize(numPaths * CACHE_VERTICES);
+			numCacheVertices.assign(numPaths, 0);
+		}
+
+		Stats stats;
+
+		// -- generate
+		const real spread = cam.pixelSpread(real(1. / width));
+		parallel_for(0, height, [&](const size_t y) {
+			for(uint32_t x = 0; x < width; x++) {
+				for(uint32_t s = 0; s < samplesPerPixel; s++) {
+					const vec3 screenPos = vec3(x*1./width - .5, y*1./width - .5, 0)
+						+ vec3(random_real(0, 1), random_real(0, 1), 0) * vec3(1. / width, 1. / height, 0);
+
+					const uint32_t path = (uint32_t)((y * width + x) * samplesPerPixel + s);
+					current.set(path, cam.getRay(screenPos.x(), screenPos.y(), spread), color(1.f), path);
+				}
+			}
+		}, numThreads);
+		current.count = numPaths;
+		stats.primaryRays = numPaths;
+
+		for(uint32_t bounce = 0; bounce < maxBounces && current.count > 0; bounce++) {
+			if(bounce > 0)
+				stats.secondaryRays += current.count;
+
+			bin(current, sorted);
+			extend(world, sorted);
+
+			if(mode != RenderMode::Path) {
+				shadePreview(world, materials, skybox, sorted);
+				break;
+			}
+
+			current.count = 0;
+			shadow.count = 0;
+			shade(materials, skybox, sorted, current, pathCache, bounce == 0, bounce + 1 == maxBounces);
+
+			stats.shadowRays += shadow.count;
+			connect(world, shadow);
+		}
+
+		if(pathCache) {
+			feedCache(*pathCache, numPaths);
+			pathCache->endFrame();
+		}
+
+		// -- resolve paths into pixels
+		parallel_for(0, height, [&](const size_t y) {
+			const float scale = 1.f / samplesPerPixel;
+			for(uint32_t x = 0; x < width; x++) {
+				color radiance(0.f);
+				AOVSample pixelAOV;
+				for(uint32_t s = 0; s < samplesPerPixel; s++) {
+					const size_t path = (y * width + x) * samplesPerPixel + s;
+					radiance += pathRadiance[path];
+					pixelAOV.albedo += pathAOV[path].albedo;
+					pixelAOV.normal += pathAOV[path].normal;
+					pixelAOV.position += pathAOV[path].position;
+					pixelAOV.depth += pathAOV[path].depth;
+				}
+				pixelAOV.albedo *= scale;
+				pixelAOV.normal *= scale;
+				pixelAOV.position *= scale;
+				pixelAOV.depth *= scale;
+				aov.store(x, (uint32_t)y, radiance * scale, pixelAOV);
+			}
+		}, numThreads);
+
+		return stats;
+	}
+
+private:
+	template<typename F>
+	void forChunks(const size_t count, const F& body) {
+		parallel_for(0, (count + grain - 1) / grain, [&](const size_t chunk) {
+			const size_t end = std::min(count, (chunk + 1) * grain);
+			for(size_t i = chunk * grain; i < end; i++)
+				body(i);
+		}, numThreads);
+	}
+
+	// 3 bits direction octant, 12 bits morton code of the origin cell (modulo 16 per axis)
+	inline uint16_t binKey(const RayQueue& q, const size_t i) const {
+		const auto spread = [](uint32_t v) -> uint32_t { // 4 bits -> every 3rd bit
+			v &= 0xF;
+			v = (v | (v << 4)) & 0x0C3;
+			v = (v | (v << 2)) & 0x249;
+			return v;
+		};
+
+		const uint32_t octant = (q.dx[i] < 0) | ((q.dy[i] < 0) << 1) | ((q.dz[i] < 0) << 2);
+		const uint32_t cx = (uint32_t)(int32_t)std::floor(q.ox[i] / binCellSize);
+		const uint32_t cy = (uint32_t)(int32_t)std::floor(q.oy[i] / binCellSize);
+		const uint32_t cz = (uint32_t)(int32_t)std::floor(q.oz[i] / binCellSize);
+
+		return (uint16_t)((octant << 12) | spread(cx) | (spread(cy) << 1) | (spread(cz) << 2));
+	}
+
+	// -- bin: coherent rays end up next to each other before traversal
+	void bin(const RayQueue& in, RayQueue& out) {
+		RT_ZONE("wavefront.bin");
+
+		const size_t n = in.count;
+		keys.resize(n);
+		order.resize(n);
+		orderTmp.resize(n);
+
+		forChunks(n, [&](const size_t i) { keys[i] = binKey(in, i); });
+
+		std::iota(order.begin(), order.end(), 0);
+		for(int shift = 0; shift < 16; shift += 8) { // LSD radix sort, 2 x 8 bits
+			parallel_counting_sort(n, 256,
+				[&](const size_t i) { return (keys[order[i]] >> shift) & 0xFF; },
+				[&](const size_t i, const size_t slot) { orderTmp[slot] = order[i]; }, numThreads);
+			std::swap(order, orderTmp);
+		}
+
+		forChunks(n, [&](const size_t i) { out.copy(in, order[i], i); });
+		out.count = n;
+	}
+
+	// -- extend: closest hit for every queued ray
+	void extend(const hittable& world, const RayQueue& q) {
+		RT_ZONE("wavefront.extend");
+
+		const real INF = 1. / 0.;
+		forChunks(q.count, [&](const size_t i) {
+			RT_COUNT(RaysCast);
+			didHit[i] = world.hit(q.ray(i), RAY_T_MIN, INF, hits[i]);
+		});
+	}
+
+	// -- connect: any-hit traversal for the queued shadow rays, `grain` rays per batch
+	void connect(const hittable& world, const ShadowQueue& q) {
+		RT_ZONE("wavefront.connect");
+
+		const size_t n = q.count;
+		parallel_for(0, (n + grain - 1) / grain, [&](const size_t chunk) {
+			const size_t first = chunk * grain;
+			const size_t count = std::min(n, first + grain) - first;
+
+			ScratchScope scratch;
+			Ray *const rays = scratch.array<Ray>(count);
+			real *const tmax = scratch.array<real>(count);
+			uint8_t *const blocked = scratch.array<uint8_t>(count);
+			for(size_t k = 0; k < count; k++) {
+				rays[k] = q.ray(first + k);
+				tmax[k] = q.tmax[first + k];
+				blocked[k] = 0;
+			}
+
+			RT_COUNT_N(ShadowRays, count);
+			world.occludedBatch(rays, tmax, blocked, count);
+
+			for(size_t k = 0; k < count; k++)
+				if(!blocked[k])
+					pathRadiance[q.path[first + k]] += q.contribution(first + k);
+		}, numThreads);
+	}
+
+	// -- feed the cache with the radiance gathered after each recorded vertex
+	void feedCache(RadianceCache& cache, const size_t numPaths) {
+		RT_ZONE("wavefront.feedCache");
+
+		forChunks(numPaths, [&](const size_t path) {
+			for(uint32_t v = 0; v < numCacheVertices[path]; v++) {
+				const CacheVertex& vertex = cacheVertices[path * CACHE_VERTICES + v];
+				const color& thr = vertex.throughput;
+				if(thr.x() > 0 && thr.y() > 0 && thr.z() > 0)
+					cache.update(vertex.key, max(pathRadiance[path] - vertex.radiance, color(0.f)) / thr);
+			}
+		});
+	}
+
+	// -- preview modes: primary hits only
+	void shadePreview(const hittable& world, const MaterialTable& materials, const fTexture& skybox, const RayQueue& q) {
+		RT_ZONE("wavefront.shadePreview");
+
+		forChunks(q.count, [&](const size_t i) {
+			const uint32_t path = q.path[i];
+			pathRadiance[path] = previewShade(q.ray(i), didHit[i], hits[i], world, materials, skybox, mode, preview, lights, &pathAOV[path]);
+		});
+	}
+
+	// -- shade: hits grouped by material id (misses last), scattered rays go to `out`
+	void shade(const MaterialTable& materials, const fTexture& skybox, const RayQueue& q, RayQueue& out, RadianceCache *const cache, const bool primary, const bool last) {
+		RT_ZONE("wavefront.shade");
+
+		const size_t n = q.count;
+		const size_t MISS = materials.size();
+
+		order.resize(n);
+		parallel_counting_sort(n, MISS + 1,
+			[&](const size_t i) -> size_t { return didHit[i] ? hits[i].material : MISS; },
+			[&](const size_t i, const size_t slot) { order[slot] = (uint32_t)i; }, numThreads);
+
+		forChunks(n, [&](const size_t k) {
+			const uint32_t i = order[k];
+			const uint32_t path = q.path[i];
+			const Ray r = q.ray(i);
+
+			if(!didHit[i]) {
+				const color sky = skyColor(r.dir, skybox, r.coneSpread);
+				pathRadiance[path] += q.throughput(i) * sky;
+				if(primary)
+					pathAOV[path] = AOVSample::fromSky(r, sky);
+				return;
+			}
+
+			const color emitted = emittedRadiance(r, hits[i], materials, lights, q.pdf[i]);
+			pathRadiance[path] += q.throughput(i) * emitted;
+
+			Ray scattered;
+			color attenuation;
+			if(materials.scatter(r, hits[i], attenuation, scattered)) {
+				RT_COUNT(Bounces);
+				if(primary)
+					pathAOV[path] = AOVSample::fromHit(r, hits[i], attenuation);
+
+				const bool diffuse = materials.samplesLights(hits[i].material);
+				if(cache && diffuse) {
+					const uint64_t key = cache->key(hits[i]);
+					color cached;
+					if(!primary && cache->lookup(key, cached)) {
+						pathRadiance[path] += q.throughput(i) * cached;
+						return;
+					}
+					if(!last && numCacheVertices[path] < CACHE_VERTICES)
+						cacheVertices[path * CACHE_VERTICES + numCacheVertices[path]++] = CacheVertex{ key, q.throughput(i), pathRadiance[path] };
+				}
+
+				real pdf = 0;
+				if(lights && diffuse && !last) { // a light sample is one more bounce
+					Ray shadowRay;
+					real t_max;
+					color contribution;
+					if(sampleDirect(hits[i], r.widthAt(hits[i].p), r.time, materials, *lights, shadowRay, t_max, contribution))
+						shadow.push(shadowRay, t_max, q.throughput(i) * contribution, path);
+
+					materials.eval(hits[i], scattered.dir, pdf);
+				}
+
+				out.push(scattered, q.throughput(i) * attenuation, path, pdf);
+			} else if(primary) { // emitter
+				pathAOV[path] = AOVSample::fromHit(r, hits[i], min(emitted, color(1.f)));
+			}
+		});
+	}
+};
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/color.h"
+#include "RayTracing/AABB.h"
+
+#include "RayTracing/Animation/Keyframes.h"
+
+enum class LightShape : uint8_t {
+	Sphere,
+	Triangle,
+	Box, // axis-aligned, e.g. an emissive voxel
+};
+
+// Faces of a box light, bit 2 * axis for the min and 2 * axis + 1 for the max side
+constexpr uint8_t ALL_BOX_FACES = 0x3F;
+
+// Geometry + radiance of one emitter, registered by the hittable that owns it (hittable::collectLights)
+struct Light {
+	LightShape shape;
+	vec3 a, b, c; // Sphere: center, (radius, 0, 0) | Triangle: vertices, emits on the cross(b - a, c - a) side | Box: min, max
+	color emission;
+
+	// Bounding cone of the emitting normals: axis + half angle (pi = all directions)
+	vec3 axis = vec3(0, 0, 1);
+	real thetaO = real(3.1415926535);
+
+	uint8_t faces = ALL_BOX_FACES; // Box: the ones that emit, the rest are covered (e.g. by a neighbouring voxel)
+
+	// Moving sphere: keyframes of the sphere with center c and radius b.y() (owned by the hittable that
+	// registered the light). a and b.x() are its placement mid-shutter, for selection (bounds, power);
+	// samples place it at the ray's time (see sphereAt).
+	const Keyframes *motion = nullptr;
+
+	static Light sphere(const vec3& center, const real radius, const color& emission) {
+		return Light{ LightShape::Sphere, center, vec3(radius, 0, 0), vec3(), emission };
+	}
+
+	static Light movingSphere(const vec3& center, const real radius, const color& emission, const Keyframes& motion, const real open, const real close) {
+		const Transform mid = motion.at((open + close) / 2);
+		Light light = sphere(mid.point(center), radius * mid.scale, emission);
+		light.b[1] = radius;
+		light.c = center;
+		light.motion = &motion;
+		return light;
+	}
+
+	// Sphere: center and radius at `time`
+	inline void sphereAt(const real time, vec3& center, real& radius) const {
+		if(!motion) {
+			center = a;
+			radius = b.x();
+			return;
+		}
+		const Transform t = motion->at(time);
+		center = t.point(c);
+		radius = b.y() * t.scale;
+	}
+
+	static Light triangle(const vec3& p0, const vec3& p1, const vec3& p2, const color& emission) {
+		return Light{ LightShape::Triangle, p0, p1, p2, emission, normalize(cross(p1 - p0, p2 - p0)), 0 };
+	}
+
+	// Only `faces` emit (and are sampled); the normal cone is narrowed down to them
+	static Light box(const vec3& min, const vec3& max, const color& emission, const uint8_t faces = ALL_BOX_FACES) {
+		vec3 normals[6];
+		int numFaces = 0;
+		vec3 axis(0.f);
+		for(int f = 0; f < 6; f++) {
+			if(!(faces & (1 << f)))
+				continue;
+			vec3 n(0.f);
+			n[f / 2] = f % 2 ? real(1) : real(-1);
+			normals[numFaces++] = n;
+			axis += n;
+		}
+
+		real thetaO = real(3.1415926535);
+		if(length_squared(axis) > 1e-6f) {
+			axis = normalize(axis);
+			real cosMin = 1;
+			for(int f = 0; f < numFaces; f++)
+				cosMin = std::min<real>(cosMin, dot(axis, normals[f]));
+			thetaO = std::acos(std::clamp<real>(cosMin, -1, 1));
+		} else {
+			axis = vec3(0, 0, 1);
+		}
+		return Light{ LightShape::Box, min, max, vec3(), emission, axis, thetaO, faces };
+	}
+
+	// Area of box face f (see ALL_BOX_FACES), whether it emits or not
+	real faceArea(const int f) const {
+		const vec3 e = b - a;
+		return e[(f / 2 + 1) % 3] * e[(f / 2 + 2) % 3];
+	}
+
+	AABB bounds() const {
+		switch(shape) {
+			case LightShape::Sphere: return AABB(a - vec3(b.x()), a + vec3(b.x()));
+			case LightShape::Triangle: return AABB(min(min(a, b), c), max(max(a, b), c));
+			default: return AABB(a, b);
+		}
+	}
+
+	real area() const {
+		switch(shape) {
+			case LightShape::Sphere: return real(4 * 3.1415926535) * a.x() * a.x();
+			case LightShape::Triangle: return cross(b - a, c - a).length<real>() / 2;
+			default: {
+				real sum = 0;
+				for(int f = 0; f < 6; f++)
+					if(faces & (1 << f))
+						sum += faceArea(f);
+				return sum;
+			}
+		}
+	}
+
+	real power() const {
+		return (emission.x() + emission.y() + emission.z()) / 3 * area();
+	}
+};
@@ -0,0 +1,279 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/color.h"
+
+#include "RayTracing/Lights/Light.h"
+#include "RayTracing/Lights/LightTree.h"
+
+// A light sample as seen from a reference point
+struct LightSample {
+	vec3 dir; // unit
+	real dist; // to the sampled point along dir
+	real pdf; // solid angle, light selection included
+	color emission;
+};
+
+enum class LightSelection : uint8_t {
+	Tree, // LightTree: importance for the shading point, O(log n)
+	Power, // global CDF by power, O(log n) to sample but O(n) per edit; for comparison
+};
+
+// All sampleable emitters of a scene. A light is picked by `selection`, then a point on it
+// (spheres: uniform in the subtended cone, boxes: their emitting faces turned towards the reference point).
+// Ids stay stable across edits; edits must not overlap with sampling (e.g. between frames).
+class LightList {
+	std::vector<Light> lights;
+	std::vector<uint8_t> alive;
+	std::vector<uint32_t> freeIds;
+
+	LightTree tree;
+	std::vector<real> cdf; // Power selection: cdf[i] = power of lights [0, i] / total
+
+	LightSelection selection = LightSelection::Tree;
+	bool built = false;
+
+public:
+	// Returns the light_id hits on this emitter should report. Before build() lights are only
+	// collected, afterwards they're inserted into the tree right away.
+	uint32_t add(const Light& light) {
+		uint32_t id;
+		if(!freeIds.empty()) {
+			id = freeIds.back();
+			freeIds.pop_back();
+			lights[id] = light;
+			alive[id] = true;
+		} else {
+			id = (uint32_t)lights.size();
+			lights.push_back(light);
+			alive.push_back(true);
+		}
+
+		if(built) {
+			tree.insert(light, id);
+			refreshCdf();
+		}
+		return id;
+	}
+
+	void remove(const uint32_t id) {
+		if(!alive[id])
+			return;
+		alive[id] = false;
+		freeIds.push_back(id);
+
+		if(built) {
+			tree.remove(id);
+			refreshCdf();
+		}
+	}
+
+	void update(const uint32_t id, const Light& light) {
+		lights[id] = light;
+		if(built) {
+			tree.update(light, id);
+			refreshCdf();
+		}
+	}
+
+	void build() {
+		std::vector<uint32_t> ids;
+		for(uint32_t id = 0; id < lights.size(); id++)
+			if(alive[id])
+				ids.push_back(id);
+		tree.build(lights, ids);
+		built = true;
+		refreshCdf();
+	}
+
+	void setSelection(const LightSelection s) {
+		selection = s;
+		refreshCdf();
+	}
+
+	inline size_t size() const { return lights.size() - freeIds.size(); }
+	inline bool empty() const { return size() == 0; }
+	inline const Light& operator[](const uint32_t id) const { return lights[id]; }
+	inline const LightTree& lightTree() const { return tree; }
+
+	inline real selectionPmf(const vec3& ref, const uint32_t id) const {
+		if(selection == LightSelection::Tree)
+			return tree.pmf(ref, id);
+		return alive[id] ? cdf[id] - (id ? cdf[id - 1] : 0) : 0;
+	}
+
+	// Moving lights are placed at `time` (the ray's)
+	bool sample(const vec3& ref, const real time, LightSample& out) const {
+		if(empty())
+			return false;
+
+		uint32_t id;
+		real pmf;
+		if(selection == LightSelection::Tree) {
+			if(!tree.select(ref, id, pmf))
+				return false;
+		} else {
+			id = (uint32_t)std::min<size_t>(
+				std::upper_bound(cdf.begin(), cdf.end(), random_real(0, 1)) - cdf.begin(),
+				lights.size() - 1);
+			pmf = selectionPmf(ref, id);
+		}
+
+		if(!sampleLight(lights[id], ref, time, out))
+			return false;
+
+		out.pdf *= pmf;
+		return out.pdf > 0;
+	}
+
+	// Solid-angle density sample() produces for point p (normal n) on light id, seen from ref at time
+	real pdf(const vec3& ref, const real time, const uint32_t id, const vec3& p, const vec3& n) const {
+		const real pmf = selectionPmf(ref, id);
+		return pmf > 0 ? lightPdf(lights[id], ref, time, p, n) * pmf : 0;
+	}
+
+	static inline real powerHeuristic(const real pdf, const real otherPdf) {
+		return pdf * pdf / (pdf * pdf + otherPdf * otherPdf);
+	}
+
+	// Sampling one light, pdf without the selection probability
+	static bool sampleLight(const Light& light, const vec3& ref, const real time, LightSample& out) {
+		out.emission = light.emission;
+
+		switch(light.shape) {
+			case LightShape::Sphere: {
+				vec3 center;
+				real r;
+				light.sphereAt(time, center, r);
+				const vec3 toCenter = center - ref;
+				const real d2 = length_squared(toCenter);
+				if(d2 <= r * r)
+					return false;
+
+				// uniform direction in the cone the sphere subtends
+				const real d = std::sqrt(d2);
+				const real sin2Max = r * r / d2;
+				const real oneMinusCosMax = sin2Max / (1 + std::sqrt(1 - sin2Max));
+				const real cosTheta = 1 - random_real(0, 1) * oneMinusCosMax;
+				const real sinTheta = std::sqrt(std::max<real>(0, 1 - cosTheta * cosTheta));
+				const real phi = random_real(0, real(2 * 3.1415926535));
+
+				const vec3 w = toCenter / d;
+				const vec3 u = normalize(cross(std::abs(w.x()) > .9f ? vec3(0, 1, 0) : vec3(1, 0, 0), w));
+				const vec3 v = cross(w, u);
+
+				out.dir = u * (std::cos(phi) * sinTheta) + v * (std::sin(phi) * sinTheta) + w * cosTheta;
+				out.dist = d * cosTheta - std::sqrt(std::max<real>(0, r * r - d2 * sinTheta * sinTheta));
+				out.pdf = 1 / (real(2 * 3.1415926535) * oneMinusCosMax);
+				return true;
+			}
+
+			case LightShape::Triangle: {
+				const real su = std::sqrt(random_real(0, 1)), v = random_real(0, 1);
+				const vec3 p = light.a * (1 - su) + light.b * (su * (1 - v)) + light.c * (su * v);
+				const vec3 N = cross(light.b - light.a, light.c - light.a);
+				const real area = N.length<real>() / 2;
+				return toPoint(ref, p, N / (2 * area), 1 / area, out);
+			}
+
+			default: {
+				// emitting faces turned towards ref, picked by area
+				real faceArea[3];
+				const real visibleArea = boxVisibleArea(light, ref, faceArea);
+				if(visibleArea <= 0)
+					return false;
+
+				real pick = random_real(0, visibleArea);
+				int axis = 0;
+				while(axis < 2 && (faceArea[axis] == 0 || pick >= faceArea[axis]))
+					pick -= faceArea[axis++];
+
+				vec3 p = light.a + vec3(random_real(0, 1), random_real(0, 1), random_real(0, 1)) * (light.b - light.a);
+				vec3 n(0.f);
+				if(ref[axis] < light.a[axis]) {
+					p[axis] = light.a[axis];
+					n[axis] = -1;
+				} else {
+					p[axis] = light.b[axis];
+					n[axis] = 1;
+				}
+				return toPoint(ref, p, n, 1 / visibleArea, out);
+			}
+		}
+	}
+
+	static real lightPdf(const Light& light, const vec3& ref, const real time, const vec3& p, const vec3& n) {
+		switch(light.shape) {
+			case LightShape::Sphere: {
+				vec3 center;
+				real r;
+				light.sphereAt(time, center, r);
+				const real d2 = length_squared(center - ref);
+				if(d2 <= r * r)
+					return 0;
+				const real sin2Max = r * r / d2;
+				return 1 / (real(2 * 3.1415926535) * sin2Max / (1 + std::sqrt(1 - sin2Max)));
+			}
+
+			case LightShape::Triangle:
+				return areaToSolidAngle(ref, p, n, 2 / cross(light.b - light.a, light.c - light.a).length<real>());
+
+			default: {
+				real faceArea[3];
+				const real visibleArea = boxVisibleArea(light, ref, faceArea);
+				return visibleArea > 0 ? areaToSolidAngle(ref, p, n, 1 / visibleArea) : 0;
+			}
+		}
+	}
+
+private:
+	void refreshCdf() {
+		if(selection != LightSelection::Power) {
+			cdf.clear();
+			return;
+		}
+
+		cdf.resize(lights.size());
+		real sum = 0;
+		for(size_t i = 0; i < lights.size(); i++)
+			cdf[i] = sum += alive[i] ? lights[i].power() : 0;
+		for(real& c : cdf)
+			c = sum > 0 ? c / sum : 1;
+	}
+
+	// Areas of the (at most 3) emitting box faces ref sees, by axis
+	static real boxVisibleArea(const Light& light, const vec3& ref, real (&faceArea)[3]) {
+		for(int axis = 0; axis < 3; axis++) {
+			const int face = ref[axis] < light.a[axis] ? 2 * axis : (ref[axis] > light.b[axis] ? 2 * axis + 1 : -1);
+			faceArea[axis] = face >= 0 && (light.faces & (1 << face)) ? light.faceArea(face) : 0;
+		}
+		return faceArea[0] + faceArea[1] + faceArea[2];
+	}
+
+	static real areaToSolidAngle(const vec3& ref, const vec3& p, const vec3& n, const real areaPdf) {
+		const vec3 toLight = p - ref;
+		const real dist2 = length_squared(toLight);
+		const real cosLight = std::abs(dot(toLight, n)) / std::sqrt(dist2);
+		return cosLight > 0 ? areaPdf * dist2 / cosLight : 0;
+	}
+
+	// Single-sided emitter at p with normal n
+	static bool toPoint(const vec3& ref, const vec3& p, const vec3& n, const real areaPdf, LightSample& out) {
+		const vec3 toLight = p - ref;
+		const real dist2 = length_squared(toLight);
+		out.dist = std::sqrt(dist2);
+		out.dir = toLight / out.dist;
+
+		const real cosLight = -dot(out.dir, n);
+		if(cosLight <= 0)
+			return false;
+
+		out.pdf = areaPdf * dist2 / cosLight;
+		return true;
+	}
+};
@@ -0,0 +1,334 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/AABB.h"
+
+#include "RayTracing/Lights/Light.h"
+
+// Bounding cone of emission directions
+struct LightCone {
+	vec3 axis = vec3(0, 0, 1);
+	real thetaO = 0; // half angle around axis, pi = all directions
+
+	static LightCone merge(const LightCone& a, const LightCone& b) {
+		constexpr real PI = real(3.1415926535);
+		if(b.thetaO > a.thetaO)
+			return merge(b, a);
+
+		const real thetaD = std::acos(std::clamp<real>(dot(a.axis, b.axis), -1, 1));
+		if(std::min<real>(thetaD + b.thetaO, PI) <= a.thetaO)
+			return a;
+
+		const real thetaO = (a.thetaO + thetaD + b.thetaO) / 2;
+		if(thetaO >= PI)
+			return LightCone{ a.axis, PI };
+
+		// rotate a's axis towards b's by the growth of the angle
+		const real thetaR = thetaO - a.thetaO;
+		const vec3 ortho = b.axis - a.axis * dot(a.axis, b.axis);
+		if(length_squared(ortho) < 1e-12f)
+			return LightCone{ a.axis, thetaO };
+		return LightCone{ normalize(a.axis * std::cos(thetaR) + normalize(ortho) * std::sin(thetaR)), thetaO };
+	}
+};
+
+// Light BVH (Conty & Kulla 2018, simplified): every node bounds the position, emitted power and emission
+// directions of its lights. Selection walks from the root and picks a child proportionally to its
+// importance for the shading point, so the cost is logarithmic in the number of lights and nearby,
+// facing lights are chosen much more often than a global power CDF would.
+// Leaves are single lights; insert / remove / update keep the tree valid without a rebuild.
+class LightTree {
+public:
+	struct Node {
+		AABB bounds;
+		LightCone cone;
+		real power = 0;
+		int32_t parent = -1, left = -1, right = -1; // left < 0: leaf
+		uint32_t light = 0; // leaves only
+	};
+
+private:
+	std::vector<Node> nodes;
+	std::vector<int32_t> freeNodes;
+	std::vector<int32_t> leafOf; // light id -> leaf node, -1 if not in the tree
+	int32_t root = -1;
+
+public:
+	inline bool empty() const { return root < 0; }
+	inline const Node& node(const int32_t i) const { return nodes[i]; }
+	inline int32_t rootNode() const { return root; }
+	inline bool contains(const uint32_t id) const { return id < leafOf.size() && leafOf[id] >= 0; }
+
+	void clear() {
+		nodes.clear();
+		freeNodes.clear();
+		leafOf.clear();
+		root = -1;
+	}
+
+	// Top-down median split of the given lights (ids index into `lights`)
+	void build(const std::vector<Light>& lights, std::vector<uint32_t> ids) {
+		clear();
+		leafOf.assign(lights.size(), -1);
+		if(!ids.empty())
+			root = buildRange(lights, ids, 0, ids.size());
+	}
+
+	void insert(const Light& light, const uint32_t id) {
+		if(id >= leafOf.size())
+			leafOf.resize(id + 1, -1);
+
+		const int32_t leaf = allocate();
+		setLeaf(nodes[leaf], light, id);
+		leafOf[id] = leaf;
+
+		if(root < 0) {
+			root = leaf;
+			return;
+		}
+
+		// descend towards the cheapest sibling by surface area (like a dynamic AABB tree)
+		const AABB leafBounds = nodes[leaf].bounds;
+		int32_t sibling = root;
+		while(nodes[sibling].left >= 0) {
+			const Node& n = nodes[sibling];
+			const real area = n.bounds.surfaceArea();
+			const real combined = AABB::surrounding(n.bounds, leafBounds).surfaceArea();
+			const real cost = 2 * combined;
+			const real inheritance = 2 * (combined - area);
+
+			const auto descendCost = [&](const int32_t child) {
+				const real merged = AABB::surrounding(nodes[child].bounds, leafBounds).surfaceArea();
+				return (nodes[child].left < 0 ? merged : merged - nodes[child].bounds.surfaceArea()) + inheritance;
+			};
+			const real costLeft = descendCost(n.left), costRight = descendCost(n.right);
+
+			if(cost < costLeft && cost < costRight)
+				break;
+			sibling = costLeft < costRight ? n.left : n.right;
+		}
+
+		const int32_t oldParent = nodes[sibling].parent;
+		const int32_t parent = allocate();
+		nodes[parent].parent = oldParent;
+		nodes[parent].left = sibling;
+		nodes[parent].right = leaf;
+		nodes[sibling].parent = parent;
+		nodes[leaf].parent = parent;
+
+		if(oldParent < 0)
+			root = parent;
+		else if(nodes[oldParent].left == sibling)
+			nodes[oldParent].left = parent;
+		else
+			nodes[oldParent].right = parent;
+
+		refit(parent);
+	}
+
+	void remove(const uint32_t id) {
+		if(!contains(id))
+			return;
+
+		const int32_t leaf = leafOf[id];
+		leafOf[id] = -1;
+
+		const int32_t parent = nodes[leaf].parent;
+		release(leaf);
+		if(parent < 0) {
+			root = -1;
+			return;
+		}
+
+		// the sibling takes the parent's place
+		const int32_t sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+		const int32_t grandParent = nodes[parent].parent;
+		nodes[sibling].parent = grandParent;
+		release(parent);
+
+		if(grandParent < 0) {
+			root = sibling;
+			return;
+		}
+		if(nodes[grandParent].left == parent)
+			nodes[grandParent].left = sibling;
+		else
+			nodes[grandParent].right = sibling;
+		refit(grandParent);
+	}
+
+	// Same light id with new power / cone / bounds
+	void update(const Light& light, const uint32_t id) {
+		if(!contains(id)) {
+			insert(light, id);
+			return;
+		}
+
+		const AABB before = nodes[leafOf[id]].bounds;
+		const AABB after = light.bounds();
+		if(before._min.x() != after._min.x() || before._min.y() != after._min.y() || before._min.z() != after._min.z()
+				|| before._max.x() != after._max.x() || before._max.y() != after._max.y() || before._max.z() != after._max.z()) {
+			remove(id);
+			insert(light, id);
+			return;
+		}
+
+		setLeaf(nodes[leafOf[id]], light, id);
+		if(nodes[leafOf[id]].parent >= 0)
+			refit(nodes[leafOf[id]].parent);
+	}
+
+	// Picks a light for shading point p; pmf receives its selection probability
+	bool select(const vec3& p, uint32_t& id, real& pmf) const {
+		if(root < 0)
+			return false;
+
+		pmf = 1;
+		int32_t n = root;
+		while(nodes[n].left >= 0) {
+			const real importanceLeft = importance(nodes[nodes[n].left], p);
+			const real importanceRight = importance(nodes[nodes[n].right], p);
+			const real sum = importanceLeft + importanceRight;
+			if(!(sum > 0))
+				return false;
+
+			const real pLeft = importanceLeft / sum;
+			if(random_real() < pLeft) {
+				n = nodes[n].left;
+				pmf *= pLeft;
+			} else {
+				n = nodes[n].right;
+				pmf *= importanceRight / sum;
+			}
+		}
+
+		id = nodes[n].light;
+		return pmf > 0;
+	}
+
+	// Probability select(p) returns light id
+	real pmf(const vec3& p, const uint32_t id) const {
+		if(!contains(id))
+			return 0;
+
+		real pmf = 1;
+		for(int32_t n = leafOf[id]; nodes[n].parent >= 0; n = nodes[n].parent) {
+			const Node& parent = nodes[nodes[n].parent];
+			const int32_t sibling = parent.left == n ? parent.right : parent.left;
+			const real importanceNode = importance(nodes[n], p);
+			const real sum = importanceNode + importance(nodes[sibling], p);
+			if(!(sum > 0))
+				return 0;
+			pmf *= importanceNode / sum;
+		}
+		return pmf;
+	}
+
+	size_t depth() const {
+		return root < 0 ? 0 : depthOf(root);
+	}
+
+	// Power * cosine bound towards p / squared distance; all emitters are cosine (thetaE = pi / 2)
+	static real importance(const Node& n, const vec3& p) {
+		constexpr real HALF_PI = real(3.1415926535 / 2);
+
+		const vec3 center = n.bounds.center();
+		const vec3 toPoint = p - center;
+		const real d2 = length_squared(toPoint);
+		const real radius2 = length_squared(n.bounds.dimensions()) / 4;
+		if(d2 <= radius2) // inside the bounding sphere: no useful distance or angle bound
+			return n.power / std::max<real>(radius2, 1e-8f);
+
+		if(n.cone.thetaO >= real(3.1415926535))
+			return n.power / d2;
+
+		const real d = std::sqrt(d2);
+		const real theta = std::acos(std::clamp<real>(dot(n.cone.axis, toPoint) / d, -1, 1));
+		const real thetaU = std::asin(std::min<real>(1, std::sqrt(radius2) / d));
+		const real thetaP = std::max<real>(0, theta - n.cone.thetaO - thetaU);
+		if(thetaP >= HALF_PI)
+			return 0;
+
+		return n.power * std::cos(thetaP) / d2;
+	}
+
+private:
+	size_t depthOf(const int32_t i) const {
+		return nodes[i].left < 0 ? 1 : 1 + std::max(depthOf(nodes[i].left), depthOf(nodes[i].right));
+	}
+
+	int32_t allocate() {
+		if(!freeNodes.empty()) {
+			const int32_t i = freeNodes.back();
+			freeNodes.pop_back();
+			nodes[i] = Node{};
+			return i;
+		}
+		nodes.emplace_back();
+		return (int32_t)nodes.size() - 1;
+	}
+
+	void release(const int32_t i) {
+		nodes[i] = Node{};
+		freeNodes.push_back(i);
+	}
+
+	static void setLeaf(Node& n, const Light& light, const uint32_t id) {
+		n.bounds = light.bounds();
+		n.cone = LightCone{ light.axis, light.thetaO };
+		n.power = light.power();
+		n.left = n.right = -1;
+		n.light = id;
+	}
+
+	void combine(const int32_t i) {
+		Node& n = nodes[i];
+		const Node& l = nodes[n.left];
+		const Node& r = nodes[n.right];
+		n.bounds = AABB::surrounding(l.bounds, r.bounds);
+		n.power = l.power + r.power;
+		n.cone = l.power <= 0 ? r.cone : r.power <= 0 ? l.cone : LightCone::merge(l.cone, r.cone);
+	}
+
+	void refit(int32_t i) {
+		for(; i >= 0; i = nodes[i].parent)
+			combine(i);
+	}
+
+	int32_t buildRange(const std::vector<Light>& lights, std::vector<uint32_t>& ids, const size_t begin, const size_t end) {
+		const int32_t i = allocate();
+
+		if(end - begin == 1) {
+			setLeaf(nodes[i], lights[ids[begin]], ids[begin]);
+			leafOf[ids[begin]] = i;
+			return i;
+		}
+
+		AABB centroids(lights[ids[begin]].bounds().center(), lights[ids[begin]].bounds().center());
+		for(size_t k = begin + 1; k < end; k++) {
+			const vec3 c = lights[ids[k]].bounds().center();
+			centroids = AABB::surrounding(centroids, AABB(c, c));
+		}
+		const vec3 extent = centroids.dimensions();
+		const int axis = extent.x() >= extent.y() && extent.x() >= extent.z() ? 0 : (extent.y() >= extent.z() ? 1 : 2);
+
+		const size_t mid = (begin + end) / 2;
+		std::nth_element(ids.begin() + begin, ids.begin() + mid, ids.begin() + end, [&](const uint32_t a, const uint32_t b) {
+			return lights[a].bounds().center()[axis] < lights[b].bounds().center()[axis];
+		});
+
+		const int32_t left = buildRange(lights, ids, begin, mid);
+		const int32_t right = buildRange(lights, ids, mid, end);
+		nodes[i].left = left;
+		nodes[i].right = right;
+		nodes[left].parent = i;
+		nodes[right].parent = i;
+		combine(i);
+		return i;
+	}
+};
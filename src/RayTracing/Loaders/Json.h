@@ -0,0 +1,233 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cctype>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <algorithm>
+
+// Parsed JSON document, just enough for scene files: numbers are doubles, objects keep their
+// members in file order (looked up linearly, they're small) and errors throw std::runtime_error
+// with the line they occurred on.
+class JsonValue {
+public:
+	enum class Type : uint8_t { Null, Bool, Number, String, Array, Object };
+
+private:
+	Type type_ = Type::Null;
+	bool boolValue = false;
+	double numberValue = 0;
+	std::string stringValue;
+	std::vector<std::string> keys; // objects: name of values[i]
+	std::vector<JsonValue> values; // array elements / object members
+
+	friend class JsonParser;
+
+public:
+	inline Type type() const { return type_; }
+	inline bool isNull() const { return type_ == Type::Null; }
+	inline bool isNumber() const { return type_ == Type::Number; }
+	inline bool isString() const { return type_ == Type::String; }
+	inline bool isArray() const { return type_ == Type::Array; }
+	inline bool isObject() const { return type_ == Type::Object; }
+
+	bool asBool() const { expect(Type::Bool, "a boolean"); return boolValue; }
+	double asNumber() const { expect(Type::Number, "a number"); return numberValue; }
+	const std::string& asString() const { expect(Type::String, "a string"); return stringValue; }
+
+	// Elements of an array, members of an object (0 for anything else)
+	inline size_t size() const { return values.size(); }
+	const JsonValue& operator[](const size_t i) const { return values[i]; }
+	inline const std::string& key(const size_t i) const { return keys[i]; }
+
+	inline bool has(const std::string& name) const { return find(name) != nullptr; }
+
+	// Member `name`, a null value if there is none (or this isn't an object)
+	const JsonValue& operator[](const std::string& name) const {
+		static const JsonValue null;
+		const JsonValue *const member = find(name);
+		return member ? *member : null;
+	}
+
+	// Member `name` or `fallback` if it's missing
+	double number(const std::string& name, const double fallback) const {
+		const JsonValue& v = (*this)[name];
+		return v.isNull() ? fallback : v.asNumber();
+	}
+	std::string str(const std::string& name, const std::string& fallback) const {
+		const JsonValue& v = (*this)[name];
+		return v.isNull() ? fallback : v.asString();
+	}
+
+private:
+	const JsonValue* find(const std::string& name) const {
+		for(size_t i = 0; i < keys.size(); i++)
+			if(keys[i] == name)
+				return &values[i];
+		return nullptr;
+	}
+
+	void expect(const Type t, const char *const what) const {
+		if(type_ != t)
+			throw std::runtime_error(std::string("JSON: expected ") + what);
+	}
+};
+
+class JsonParser {
+	const std::string& text;
+	size_t pos = 0;
+
+public:
+	explicit JsonParser(const std::string& text): text(text) { }
+
+	JsonValue parse() {
+		JsonValue root = value(0);
+		skipSpace();
+		if(pos != text.size())
+			fail("trailing characters");
+		return root;
+	}
+
+private:
+	static constexpr int MAX_NESTING = 256;
+
+	[[noreturn]] void fail(const std::string& what) const {
+		size_t line = 1;
+		for(size_t i = 0; i < pos && i < text.size(); i++)
+			line += text[i] == '\n';
+		throw std::runtime_error("JSON: " + what + " on line " + std::to_string(line));
+	}
+
+	void skipSpace() {
+		while(pos < text.size() && (text[pos] == ' ' || text[pos] == '\t' || text[pos] == '\n' || text[pos] == '\r'))
+			pos++;
+	}
+
+	bool consume(const char c) {
+		skipSpace();
+		if(pos < text.size() && text[pos] == c) {
+			pos++;
+			return true;
+		}
+		return false;
+	}
+
+	void literal(const char *const word) {
+		for(const char *c = word; *c; c++, pos++)
+			if(pos >= text.size() || text[pos] != *c)
+				fail(std::string("invalid literal, expected ") + word);
+	}
+
+	JsonValue value(const int depth) {
+		if(depth > MAX_NESTING)
+			fail("nested too deeply");
+
+		skipSpace();
+		if(pos >= text.size())
+			fail("unexpected end");
+
+		JsonValue v;
+		const char c = text[pos];
+		if(c == '{') {
+			pos++;
+			v.type_ = JsonValue::Type::Object;
+			if(consume('}'))
+				return v;
+			do {
+				skipSpace();
+				if(pos >= text.size() || text[pos] != '"')
+					fail("expected a member name");
+				v.keys.push_back(stringLiteral());
+				if(!consume(':'))
+					fail("expected ':'");
+				v.values.push_back(value(depth + 1));
+			} while(consume(','));
+			if(!consume('}'))
+				fail("expected ',' or '}'");
+		} else if(c == '[') {
+			pos++;
+			v.type_ = JsonValue::Type::Array;
+			if(consume(']'))
+				return v;
+			do
+				v.values.push_back(value(depth + 1));
+			while(consume(','));
+			if(!consume(']'))
+				fail("expected ',' or ']'");
+		} else if(c == '"') {
+			v.type_ = JsonValue::Type::String;
+			v.stringValue = stringLiteral();
+		} else if(c == 't' || c == 'f') {
+			v.type_ = JsonValue::Type::Bool;
+			v.boolValue = c == 't';
+			literal(v.boolValue ? "true" : "false");
+		} else if(c == 'n') {
+			literal("null");
+		} else {
+			const char *const begin = text.c_str() + pos;
+			char *end = nullptr;
+			v.type_ = JsonValue::Type::Number;
+			v.numberValue = std::strtod(begin, &end);
+			if(end == begin)
+				fail("unexpected character");
+			pos += end - begin;
+		}
+		return v;
+	}
+
+	// At the opening quote
+	std::string stringLiteral() {
+		std::string s;
+		for(pos++; ; pos++) {
+			if(pos >= text.size())
+				fail("unterminated string");
+			const char c = text[pos];
+			if(c == '"') {
+				pos++;
+				return s;
+			}
+			if(c != '\\') {
+				s += c;
+				continue;
+			}
+
+			if(++pos >= text.size())
+				fail("unterminated string");
+			switch(text[pos]) {
+				case '"': s += '"'; break;
+				case '\\': s += '\\'; break;
+				case '/': s += '/'; break;
+				case 'b': s += '\b'; break;
+				case 'f': s += '\f'; break;
+				case 'n': s += '\n'; break;
+				case 'r': s += '\r'; break;
+				case 't': s += '\t'; break;
+				case 'u': {
+					if(pos + 4 >= text.size() || !std::all_of(text.begin() + pos + 1, text.begin() + pos + 5, [](const char c) { return std::isxdigit((unsigned char)c) != 0; }))
+						fail("invalid \\u escape");
+					const uint32_t cp = (uint32_t)std::strtoul(text.substr(pos + 1, 4).c_str(), nullptr, 16);
+					pos += 4;
+					// UTF-8, surrogate pairs are kept as two code points
+					if(cp < 0x80)
+						s += (char)cp;
+					else if(cp < 0x800) {
+						s += (char)(0xC0 | (cp >> 6));
+						s += (char)(0x80 | (cp & 0x3F));
+					} else {
+						s += (char)(0xE0 | (cp >> 12));
+						s += (char)(0x80 | ((cp >> 6) & 0x3F));
+						s += (char)(0x80 | (cp & 0x3F));
+					}
+					break;
+				}
+				default: fail("invalid escape");
+			}
+		}
+	}
+};
+
+inline JsonValue parseJson(const std::string& text) {
+	return JsonParser(text).parse();
+}
@@ -0,0 +1,508 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <unordered_map>
+#include <stdexcept>
+#include <algorithm>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/color.h"
+#include "RayTracing/Camera.h"
+#include "RayTracing/RenderMode.h"
+#include "RayTracing/parallel.h"
+
+#include "RayTracing/Objects/hittable_list.h"
+#include "RayTracing/Objects/Sphere.h"
+#include "RayTracing/Objects/Triangle.h"
+#include "RayTracing/Objects/Mesh.h"
+#include "RayTracing/Objects/VoxelVolume.h"
+#include "RayTracing/Objects/Instance.h"
+
+#include "RayTracing/Materials/Lambertian.h"
+#include "RayTracing/Materials/Metal.h"
+#include "RayTracing/Materials/Dielectric.h"
+#include "RayTracing/Materials/Emissive.h"
+#include "RayTracing/Materials/MaterialTable.h"
+
+#include "RayTracing/Lights/LightList.h"
+#include "RayTracing/Texture/fTexture.h"
+
+#include "RayTracing/Caching/AccelCache.h"
+
+#include "RayTracing/Animation/Keyframes.h"
+
+#include "RayTracing/Loaders/Json.h"
+#include "RayTracing/Loaders/StlLoader.h"
+#include "RayTracing/Loaders/VoxLoader.h"
+
+#include "RayTracing/Profiling/Profiler.h"
+
+#include "RayTracing/exampleScenes.h"
+
+#include "stb/stb_image.h"
+
+// Render settings stored with a scene, so a scene file renders the same everywhere
+struct SceneSettings {
+	uint32_t width = 800, height = 800;
+	uint32_t spp = 1;
+	uint32_t bounces = 8;
+	RenderMode mode = RenderMode::Path;
+	uint32_t seed = 1234; // seed_random before the scene is built (generators draw from it)
+
+	// Animation (see SequenceRenderer)
+	uint32_t frames = 1;
+	real fps = 24;
+	real shutter = .5f; // fraction of a frame, 0 for no motion blur
+};
+
+struct SceneCamera {
+	vec3 position = vec3(0, 0, -2);
+	vec3 direction = vec3(0, 0, 1);
+	vec3 up = vec3(0, 1, 0);
+	real fov = 40; // vertical, degrees
+	real aperture = 0;
+	real focusDistance = 1;
+
+	Camera camera(const double aspect = 1) const {
+		return Camera(position, direction, up, fov, aspect, aperture, focusDistance);
+	}
+};
+
+// What a scene file describes, ready to render: lights collected, top-level BVH built
+struct Scene {
+	hittable_list world;
+	MaterialTable materials;
+	LightList lights;
+	fTexture skybox;
+	SceneCamera camera;
+	SceneSettings settings;
+	std::unordered_map<std::string, material_id> materialNames;
+};
+
+// Reads a JSON scene description (paths relative to the file):
+//
+// {
+//   "settings": { "width": 800, "height": 800, "spp": 4, "bounces": 8, "mode": "path", "seed": 1234,
+//                 "frames": 1, "fps": 24, "shutter": .5 },
+//   "camera": { "position": [x, y, z], "look_at": [x, y, z] (or "direction"), "up": [0, 1, 0],
+//               "fov": 40, "aperture": 0, "focus_distance": 1 (default: distance to look_at) },
+//   "environment": { "file": "sky.jpg" } (or .hdr, clamped to 8 bits like every fTexture) | { "color": [r, g, b] },
+//   "materials": [
+//     { "name": "floor", "type": "lambertian", "albedo": [r, g, b], "roughness": .2 },
+//     { "name": "chrome", "type": "metal", "albedo": [r, g, b], "fuzz": 0 },
+//     { "name": "glass", "type": "dielectric", "ior": 1.5 },
+//     { "name": "lamp", "type": "emissive", "emission": [r, g, b] } ],
+//   "objects": [
+//     { "type": "sphere", "center": [x, y, z], "radius": 1, "material": "floor" },
+//     { "type": "triangle", "vertices": [[x, y, z], [x, y, z], [x, y, z]], "material": "floor" },
+//     { "type": "mesh", "file": "Bunny.stl", "material": "chrome", "scale": .01, "offset": [x, y, z],
+//       "bvh": "sah" (default, the fastest to trace) | "lbvh" (the fastest to build) | "median" },
+//     { "type": "voxels", "file": "model.vox", "scale": 1 (or [x, y, z]), "origin": [x, y, z],
+//       "materials": { "12": "lamp" } (palette index -> material, the rest are lambertian in their palette color) },
+//     { "type": "generator", "name": "voxel_terrain", "size": 128, "seed": 1337 } ] (one of the example scenes)
+// }
+//
+// Every object but generators may move: "keyframes": [{ "time": 0 (seconds), "translate": [x, y, z],
+// "axis": [0, 1, 0], "angle": 0 (degrees), "scale": 1 }, ...] places it (about the scene origin) at
+// those times. Spheres move themselves, everything else is wrapped in an Instance.
+//
+// Assets (meshes, voxel files, the environment map) are read in parallel, then the objects' own
+// acceleration structures (mesh BVHs, voxel levels) are built in parallel; the objects end up in the
+// world in file order either way, so the result doesn't depend on the number of threads.
+// With an AccelCache those structures are looked up there first (and stored after building them).
+class SceneLoader {
+	std::filesystem::path directory;
+	uint32_t numThreads;
+	AccelCache *cache;
+
+	// An object that loads a file
+	struct Asset {
+		const JsonValue *desc;
+		size_t object; // index in "objects"
+		bool mesh; // else voxels
+
+		std::vector<Triangle> triangles;
+		VoxelModel model;
+		std::vector<material_id> palette; // voxel value - 1 -> material
+		std::shared_ptr<hittable> result;
+		std::string error;
+	};
+
+public:
+	SceneLoader(const std::string& path, const uint32_t numThreads = hardwareThreads(), AccelCache *const cache = nullptr):
+			directory(std::filesystem::path(path).parent_path()), numThreads(numThreads), cache(cache) { }
+
+	void load(const JsonValue& root, Scene& scene) {
+		RT_ZONE("sceneLoader.load");
+
+		readSettings(root["settings"], scene.settings);
+		readCamera(root["camera"], scene.camera);
+		seed_random(scene.settings.seed);
+
+		const JsonValue& materials = root["materials"];
+		for(size_t i = 0; i < materials.size(); i++)
+			context("materials", i, [&]() { readMaterial(materials[i], scene); });
+
+		const JsonValue& objects = root["objects"];
+		std::vector<Asset> assets;
+		for(size_t i = 0; i < objects.size(); i++) {
+			context("objects", i, [&]() {
+				const std::string& type = objects[i]["type"].asString();
+				if(type == "mesh" || type == "voxels")
+					assets.push_back(Asset{ &objects[i], i, type == "mesh", {}, {}, {}, nullptr, {} });
+			});
+		}
+
+		// read, then build: the voxel palettes become materials in between, in order
+		const JsonValue& environment = root["environment"];
+		std::string environmentError;
+		{
+			RT_ZONE("sceneLoader.read");
+			parallel_for(0, assets.size() + 1, [&](const size_t i) {
+				if(i == assets.size()) {
+					guard(environmentError, [&]() { readEnvironment(environment, scene.skybox); });
+					return;
+				}
+				Asset& a = assets[i];
+				guard(a.error, [&]() { read(a, scene); });
+			}, numThreads);
+		}
+		if(!environmentError.empty())
+			throw std::runtime_error("environment: " + environmentError);
+		for(Asset& a : assets) {
+			rethrow(a);
+			if(!a.mesh)
+				context("objects", a.object, [&]() { makePalette(a, scene); });
+		}
+
+		{
+			RT_ZONE("sceneLoader.build");
+			const uint32_t threadsPerAsset = std::max<uint32_t>(1, numThreads / (uint32_t)std::max<size_t>(1, assets.size()));
+			parallel_for(0, assets.size(), [&](const size_t i) {
+				Asset& a = assets[i];
+				guard(a.error, [&]() { build(a, threadsPerAsset); });
+			}, numThreads);
+		}
+
+		size_t nextAsset = 0;
+		for(size_t i = 0; i < objects.size(); i++) {
+			if(nextAsset < assets.size() && assets[nextAsset].object == i) {
+				rethrow(assets[nextAsset]);
+				const std::shared_ptr<hittable> object = assets[nextAsset++].result;
+				context("objects", i, [&]() {
+					if(objects[i].has("keyframes"))
+						scene.world.emplace<Instance>(object, keyframes(objects[i]));
+					else
+						scene.world.add(object);
+				});
+				continue;
+			}
+			context("objects", i, [&]() { addObject(objects[i], scene); });
+		}
+
+		scene.world.collectLights(scene.lights, scene.materials);
+		scene.lights.build();
+		scene.world.build();
+	}
+
+private:
+	template<typename F>
+	static void context(const char *const list, const size_t i, const F& f) {
+		try {
+			f();
+		} catch(const std::exception& ex) {
+			throw std::runtime_error(std::string(list) + "[" + std::to_string(i) + "]: " + ex.what());
+		}
+	}
+
+	// Exceptions must not leave a parallel_for body; they're reported after it
+	template<typename F>
+	static void guard(std::string& error, const F& f) {
+		try {
+			f();
+		} catch(const std::exception& ex) {
+			error = ex.what();
+		}
+	}
+
+	static void rethrow(const Asset& a) {
+		if(!a.error.empty())
+			throw std::runtime_error("objects[" + std::to_string(a.object) + "]: " + a.error);
+	}
+
+	std::string resolve(const std::string& file) const {
+		return (directory / file).string();
+	}
+
+	static vec3 vector(const JsonValue& v, const char *const name) {
+		if(!v.isArray() || v.size() != 3)
+			throw std::runtime_error(std::string("'") + name + "' must be [x, y, z]");
+		return vec3((real)v[0].asNumber(), (real)v[1].asNumber(), (real)v[2].asNumber());
+	}
+
+	static vec3 vector(const JsonValue& desc, const char *const name, const vec3& fallback) {
+		return desc.has(name) ? vector(desc[name], name) : fallback;
+	}
+
+	static material_id material(const JsonValue& desc, const Scene& scene) {
+		const std::string& name = desc["material"].asString();
+		const auto it = scene.materialNames.find(name);
+		if(it == scene.materialNames.end())
+			throw std::runtime_error("unknown material '" + name + "'");
+		return it->second;
+	}
+
+	static Keyframes keyframes(const JsonValue& desc) {
+		const JsonValue& keys = desc["keyframes"];
+		if(!keys.isArray() || keys.size() == 0)
+			throw std::runtime_error("'keyframes' must be a non-empty array");
+
+		Keyframes result;
+		for(size_t i = 0; i < keys.size(); i++) {
+			const JsonValue& k = keys[i];
+			const real scale = (real)k.number("scale", 1);
+			if(scale <= 0)
+				throw std::runtime_error("keyframes[" + std::to_string(i) + "]: 'scale' must be positive");
+			result.add((real)k["time"].asNumber(), Transform{
+				vector(k, "translate", vec3(0.f)),
+				Rotation::axisAngle(vector(k, "axis", vec3(0, 1, 0)), (real)k.number("angle", 0)),
+				scale });
+		}
+		return result;
+	}
+
+	static BVHBuilder bvhBuilder(const JsonValue& desc) {
+		const std::string name = desc.str("bvh", bvhBuilderName(BVHBuilder::SAH));
+		for(size_t b = 0; b < (size_t)BVHBuilder::Count; b++)
+			if(name == bvhBuilderName((BVHBuilder)b))
+				return (BVHBuilder)b;
+		throw std::runtime_error("unknown bvh builder '" + name + "'");
+	}
+
+	static void readSettings(const JsonValue& desc, SceneSettings& settings) {
+		const auto positive = [&](const char *const name, const uint32_t fallback) {
+			const double value = desc.number(name, fallback);
+			if(!(value >= 1 && value <= UINT32_MAX))
+				throw std::runtime_error(std::string("settings: '") + name + "' must be positive");
+			return (uint32_t)value;
+		};
+		settings.width = positive("width", settings.width);
+		settings.height = positive("height", settings.height);
+		settings.spp = positive("spp", settings.spp);
+		settings.bounces = (uint32_t)desc.number("bounces", settings.bounces);
+		settings.frames = std::max<uint32_t>(1, (uint32_t)desc.number("frames", settings.frames));
+		settings.fps = (real)desc.number("fps", settings.fps);
+		settings.shutter = (real)desc.number("shutter", settings.shutter);
+		if(settings.fps <= 0)
+			throw std::runtime_error("settings: 'fps' must be positive");
+		settings.seed = (uint32_t)desc.number("seed", settings.seed);
+
+		const std::string mode = desc.str("mode", renderModeName(settings.mode));
+		for(size_t m = 0; m <= (size_t)RenderMode::Count; m++) {
+			if(m == (size_t)RenderMode::Count)
+				throw std::runtime_error("settings: unknown render mode '" + mode + "'");
+			if(mode == renderModeName((RenderMode)m)) {
+				settings.mode = (RenderMode)m;
+				break;
+			}
+		}
+	}
+
+	static void readCamera(const JsonValue& desc, SceneCamera& camera) {
+		camera.position = vector(desc, "position", camera.position);
+		camera.up = vector(desc, "up", camera.up);
+		if(desc.has("look_at")) {
+			camera.direction = vector(desc["look_at"], "look_at") - camera.position;
+			camera.focusDistance = camera.direction.length<real>();
+		} else
+			camera.direction = vector(desc, "direction", camera.direction);
+		camera.fov = (real)desc.number("fov", camera.fov);
+		camera.aperture = (real)desc.number("aperture", camera.aperture);
+		camera.focusDistance = (real)desc.number("focus_distance", camera.focusDistance);
+	}
+
+	static void readMaterial(const JsonValue& desc, Scene& scene) {
+		const std::string& type = desc["type"].asString();
+		material_id id;
+		if(type == "lambertian")
+			id = scene.materials.add(Lambertian(vector(desc, "albedo", color(.5f)), (real)desc.number("roughness", .2)));
+		else if(type == "metal")
+			id = scene.materials.add(Metal(vector(desc, "albedo", color(.8f)), (real)desc.number("fuzz", 0)));
+		else if(type == "dielectric")
+			id = scene.materials.add(Dielectric((real)desc.number("ior", 1.5)));
+		else if(type == "emissive")
+			id = scene.materials.add(Emissive(vector(desc, "emission", color(1.f))));
+		else
+			throw std::runtime_error("unknown material type '" + type + "'");
+
+		if(desc.has("name"))
+			scene.materialNames[desc["name"].asString()] = id;
+	}
+
+	void readEnvironment(const JsonValue& desc, fTexture& skybox) const {
+		if(desc.has("file")) {
+			const std::string path = resolve(desc["file"].asString());
+			int width, height, channels;
+			const bool hdr = stbi_is_hdr(path.c_str());
+			float *const hdrData = hdr ? stbi_loadf(path.c_str(), &width, &height, &channels, 3) : nullptr;
+			uint8_t *const data = hdr ? nullptr : stbi_load(path.c_str(), &width, &height, &channels, 3);
+			if(!data && !hdrData)
+				throw std::runtime_error("Failed to load environment map: " + path);
+
+			skybox = fTexture(width, height);
+			for(size_t i = 0; i < (size_t)width * height; i++) {
+				const color c = hdr ? color(hdrData[i * 3], hdrData[i * 3 + 1], hdrData[i * 3 + 2])
+					: color(data[i * 3], data[i * 3 + 1], data[i * 3 + 2]) / 255.f;
+				skybox.pixels[i] = intColor(color(std::min<real>(c.x(), 1), std::min<real>(c.y(), 1), std::min<real>(c.z(), 1)));
+			}
+			stbi_image_free(hdr ? (void*)hdrData : (void*)data);
+		} else {
+			skybox = fTexture(1, 1);
+			skybox.pixels[0] = intColor(vector(desc, "color", color(0.f)));
+		}
+		skybox.generateMips();
+	}
+
+	// Worker thread: the file, nothing shared
+	void read(Asset& a, const Scene& scene) const {
+		const JsonValue& desc = *a.desc;
+		const std::string path = resolve(desc["file"].asString());
+		if(a.mesh) {
+			const material_id m = material(desc, scene);
+			const vec3 offset = vector(desc, "offset", vec3(0.f));
+			const std::vector<Triangle> triangles = loadSTL(path, m, (float)desc.number("scale", .01));
+			a.triangles.reserve(triangles.size());
+			for(const Triangle& t : triangles)
+				a.triangles.emplace_back(t.p0 + offset, t.p1 + offset, t.p2 + offset, m);
+		} else
+			a.model = loadVox(path);
+	}
+
+	// Main thread: one value (and material) per palette index in use, in index order
+	static void makePalette(Asset& a, Scene& scene) {
+		bool used[256] = {};
+		for(const uint8_t v : a.model.voxels)
+			used[v] = true;
+
+		const JsonValue& overrides = (*a.desc)["materials"];
+		uint8_t values[256] = {};
+		for(size_t i = 1; i < 256; i++) {
+			if(!used[i])
+				continue;
+
+			const JsonValue& name = overrides[std::to_string(i)];
+			material_id m;
+			if(name.isNull())
+				m = scene.materials.add(Lambertian(a.model.palette[i]));
+			else {
+				const auto it = scene.materialNames.find(name.asString());
+				if(it == scene.materialNames.end())
+					throw std::runtime_error("unknown material '" + name.asString() + "'");
+				m = it->second;
+			}
+			a.palette.push_back(m);
+			values[i] = (uint8_t)a.palette.size();
+		}
+
+		for(uint8_t& v : a.model.voxels)
+			v = values[v];
+	}
+
+	// Worker thread: the object and its acceleration structure, with its share of the threads
+	void build(Asset& a, const uint32_t threads) const {
+		if(a.mesh) {
+			const BVHBuilder builder = bvhBuilder(*a.desc);
+			if(cache) {
+				BVH bvh;
+				cache->build(bvh, Mesh::boxes(a.triangles), Mesh::LEAF_SIZE, builder, threads);
+				a.result = std::make_shared<Mesh>(a.triangles, bvh);
+			} else
+				a.result = std::make_shared<Mesh>(a.triangles, builder, threads);
+			a.triangles = std::vector<Triangle>();
+			return;
+		}
+
+		const JsonValue& desc = *a.desc;
+		const JsonValue& scale = desc["scale"];
+		const vec3 voxelSize = scale.isArray() ? vector(scale, "scale") : vec3((real)desc.number("scale", 1));
+		const std::shared_ptr<VoxelVolume> volume = std::make_shared<VoxelVolume>(
+				a.model.width, a.model.height, a.model.depth, a.palette, voxelSize, vector(desc, "origin", vec3(0.f)));
+		volume->assign(a.model.voxels.data(), cache == nullptr);
+		if(cache)
+			cache->buildLevels(*volume);
+		a.model = {};
+		a.result = volume;
+	}
+
+	static void addObject(const JsonValue& desc, Scene& scene) {
+		const std::string& type = desc["type"].asString();
+		const bool animated = desc.has("keyframes");
+		if(type == "sphere") {
+			if(animated)
+				scene.world.emplace<Sphere>(vector(desc["center"], "center"), (real)desc["radius"].asNumber(), material(desc, scene), std::make_shared<const Keyframes>(keyframes(desc)));
+			else
+				scene.world.emplace<Sphere>(vector(desc["center"], "center"), (real)desc["radius"].asNumber(), material(desc, scene));
+		} else if(type == "triangle") {
+			const JsonValue& v = desc["vertices"];
+			if(v.size() != 3)
+				throw std::runtime_error("'vertices' must hold 3 points");
+			if(animated)
+				scene.world.emplace<Instance>(std::make_shared<Triangle>(vector(v[0], "vertices"), vector(v[1], "vertices"), vector(v[2], "vertices"), material(desc, scene)), keyframes(desc));
+			else
+				scene.world.emplace<Triangle>(vector(v[0], "vertices"), vector(v[1], "vertices"), vector(v[2], "vertices"), material(desc, scene));
+		} else if(type == "generator") {
+			if(animated)
+				throw std::runtime_error("generators can't be animated");
+			generate(desc, scene);
+		}
+		else
+			throw std::runtime_error("unknown object type '" + type + "'");
+	}
+
+	static void generate(const JsonValue& desc, Scene& scene) {
+		const std::string& name = desc["name"].asString();
+		const int seed = (int)desc.number("seed", 1337);
+		if(name == "scene1")
+			genScene1(scene.world, scene.materials);
+		else if(name == "scene2")
+			genScene2(scene.world, scene.materials, (int)desc.number("extent", 4));
+		else if(name == "voxel_demo")
+			scene.world.emplace<VoxelVolume>(scene.materials);
+		else if(name == "voxel_terrain")
+			genVoxelTerrain(scene.world, scene.materials, (size_t)desc.number("size", 128), seed);
+		else if(name == "voxel_lights")
+			genVoxelLights(scene.world, scene.materials, (size_t)desc.number("size", 48));
+		else if(name == "voxel_models")
+			genVoxelModels(scene.world, scene.materials, (int)desc.number("count", 8), (size_t)desc.number("size", 16), seed);
+		else
+			throw std::runtime_error("unknown generator '" + name + "'");
+	}
+};
+
+// Replaces `scene` with the one described by the file
+inline void loadScene(const std::string& path, Scene& scene, const uint32_t numThreads = hardwareThreads(), AccelCache *const cache = nullptr) {
+	std::ifstream file(path, std::ios::binary);
+	if(!file)
+		throw std::runtime_error("Error reading scene file: " + path);
+	std::stringstream text;
+	text << file.rdbuf();
+
+	scene.world.clear();
+	scene.materials = MaterialTable();
+	scene.lights = LightList();
+	scene.materialNames.clear();
+	scene.settings = SceneSettings();
+	scene.camera = SceneCamera();
+
+	try {
+		SceneLoader(path, numThreads, cache).load(parseJson(text.str()), scene);
+	} catch(const std::exception& ex) {
+		throw std::runtime_error(path + ": " + ex.what());
+	}
+}
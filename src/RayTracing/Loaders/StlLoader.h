@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <utility>
+
+#include "RayTracing/vec.h"
+
+#include "RayTracing/Objects/Triangle.h"
+#include "RayTracing/Materials/Material.h"
+
+// Binary STL -> triangles; converts z-up to y-down like the rest of the scene and applies `scale`
+inline std::vector<Triangle> loadSTL(const std::string& path, const material_id material, const float scale = .01f) {
+	FILE *const fp = fopen(path.c_str(), "rb");
+
+	if(fp == nullptr)
+		throw std::runtime_error("Error reading STL File: " + path);
+
+	uint8_t header[80];
+	uint32_t numTris = 0;
+	if(fread(header, 1, 80, fp) != 80 || fread(&numTris, 4, 1, fp) != 1) {
+		fclose(fp);
+		throw std::runtime_error("Truncated STL File: " + path);
+	}
+
+	std::vector<Triangle> mesh;
+	mesh.reserve(numTris);
+
+	for(size_t i = 0; i < numTris; i++) {
+		float data[12]; // normal, 3 vertices
+		uint16_t attrCount;
+		if(fread(data, sizeof(float), 12, fp) != 12 || fread(&attrCount, sizeof(uint16_t), 1, fp) != 1) {
+			fclose(fp);
+			throw std::runtime_error("Truncated STL File: " + path);
+		}
+
+		vec3 vertices[3];
+		for(int vert = 0; vert < 3; vert++) {
+			vertices[vert] = vec3(data[3 + vert * 3 + 0], data[3 + vert * 3 + 1], data[3 + vert * 3 + 2]);
+
+			// correct coordinates:
+			std::swap(vertices[vert].y(), vertices[vert].z());
+			vertices[vert].y() *= -1;
+		}
+
+		mesh.push_back(Triangle(vertices[0] * scale, vertices[1] * scale, vertices[2] * scale, material));
+	}
+
+	fclose(fp);
+
+	return mesh;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/color.h"
+
+// Voxel grid with a color palette, as stored in MagicaVoxel .vox files
+struct VoxelModel {
+	size_t width = 0, height = 0, depth = 0;
+	std::vector<uint8_t> voxels; // palette index, 0 = air; voxel (x, y, z) is [(z * height + y) * width + x]
+	std::array<color, 256> palette; // [index]
+
+	VoxelModel() { palette.fill(color(.5f, .5f, .5f)); }
+
+	inline uint8_t& at(const size_t x, const size_t y, const size_t z) { return voxels[(z * height + y) * width + x]; }
+	inline uint8_t at(const size_t x, const size_t y, const size_t z) const { return voxels[(z * height + y) * width + x]; }
+};
+
+// MagicaVoxel .vox -> the first model in the file. Converts z-up to y-down like the rest of the scene
+// (file (x, y, z) is voxel (x, sizeZ - 1 - z, y)). Without an RGBA chunk all colors are gray; scene
+// graph, material and layer chunks are skipped.
+inline VoxelModel loadVox(const std::string& path) {
+	FILE *const fp = fopen(path.c_str(), "rb");
+	if(fp == nullptr)
+		throw std::runtime_error("Error reading VOX File: " + path);
+
+	std::vector<uint8_t> data;
+	uint8_t buffer[1 << 16];
+	for(size_t n; (n = fread(buffer, 1, sizeof(buffer), fp)) > 0; )
+		data.insert(data.end(), buffer, buffer + n);
+	fclose(fp);
+
+	const auto truncated = [&]() { return std::runtime_error("Truncated VOX File: " + path); };
+	const auto u32 = [&](const size_t offset) {
+		if(offset + 4 > data.size())
+			throw truncated();
+		uint32_t v;
+		memcpy(&v, data.data() + offset, 4);
+		return v;
+	};
+
+	if(data.size() < 8 || memcmp(data.data(), "VOX ", 4) != 0)
+		throw std::runtime_error("Not a VOX File: " + path);
+
+	VoxelModel model;
+	size_t sizeX = 0, sizeY = 0, sizeZ = 0;
+	bool haveSize = false, haveVoxels = false;
+
+	for(size_t offset = 8; offset + 12 <= data.size(); ) {
+		const char *const id = (const char*)data.data() + offset;
+		const size_t content = u32(offset + 4), children = u32(offset + 8);
+		const size_t begin = offset + 12;
+		if(begin + content > data.size())
+			throw truncated();
+
+		if(!memcmp(id, "MAIN", 4)) {
+			offset = begin + content; // the other chunks are its children
+			continue;
+		}
+
+		if(!memcmp(id, "SIZE", 4) && !haveSize) {
+			sizeX = u32(begin);
+			sizeY = u32(begin + 4);
+			sizeZ = u32(begin + 8);
+			haveSize = true;
+		} else if(!memcmp(id, "XYZI", 4) && haveSize && !haveVoxels) {
+			model.width = sizeX;
+			model.height = sizeZ;
+			model.depth = sizeY;
+			model.voxels.assign(sizeX * sizeY * sizeZ, 0);
+
+			const size_t count = u32(begin);
+			if(begin + 4 + count * 4 > data.size())
+				throw truncated();
+			for(size_t i = 0; i < count; i++) {
+				const uint8_t *const v = data.data() + begin + 4 + i * 4;
+				if(v[0] < sizeX && v[1] < sizeY && v[2] < sizeZ)
+					model.at(v[0], sizeZ - 1 - v[2], v[1]) = v[3];
+			}
+			haveVoxels = true;
+		} else if(!memcmp(id, "RGBA", 4)) {
+			if(content < 256 * 4)
+				throw truncated();
+			for(size_t i = 1; i < 256; i++) { // entry i - 1 is the color of index i
+				const uint8_t *const c = data.data() + begin + (i - 1) * 4;
+				model.palette[i] = color(c[0], c[1], c[2]) / 255.f;
+			}
+		}
+
+		offset = begin + content + children;
+	}
+
+	if(!haveVoxels)
+		throw std::runtime_error("No voxels in VOX File: " + path);
+
+	return model;
+}
+
+// Inverse of loadVox: one model plus its palette
+inline void saveVox(const std::string& path, const VoxelModel& model) {
+	if(model.width > 256 || model.height > 256 || model.depth > 256)
+		throw std::runtime_error("VOX models are at most 256^3: " + path);
+
+	std::vector<uint8_t> xyzi;
+	for(size_t z = 0; z < model.depth; z++)
+		for(size_t y = 0; y < model.height; y++)
+			for(size_t x = 0; x < model.width; x++)
+				if(const uint8_t v = model.at(x, y, z))
+					xyzi.insert(xyzi.end(), { (uint8_t)x, (uint8_t)z, (uint8_t)(model.height - 1 - y), v });
+
+	std::vector<uint8_t> out;
+	const auto u32 = [&](const uint32_t v) {
+		const uint8_t *const b = (const uint8_t*)&v;
+		out.insert(out.end(), b, b + 4);
+	};
+	const auto chunk = [&](const char *const id, const uint32_t content, const uint32_t children) {
+		out.insert(out.end(), id, id + 4);
+		u32(content);
+		u32(children);
+	};
+
+	const uint32_t sizeChunk = 12 + 12, xyziChunk = 12 + 4 + (uint32_t)xyzi.size(), rgbaChunk = 12 + 256 * 4;
+	out.insert(out.end(), { 'V', 'O', 'X', ' ' });
+	u32(150);
+	chunk("MAIN", 0, sizeChunk + xyziChunk + rgbaChunk);
+
+	chunk("SIZE", 12, 0);
+	u32((uint32_t)model.width);
+	u32((uint32_t)model.depth);
+	u32((uint32_t)model.height);
+
+	chunk("XYZI", 4 + (uint32_t)xyzi.size(), 0);
+	u32((uint32_t)(xyzi.size() / 4));
+	out.insert(out.end(), xyzi.begin(), xyzi.end());
+
+	chunk("RGBA", 256 * 4, 0);
+	for(size_t i = 1; i <= 256; i++) {
+		const color c = model.palette[i % 256] * 255.f + color(.5f);
+		const auto byte = [](const real v) { return (uint8_t)std::clamp<real>(v, 0, 255); };
+		out.insert(out.end(), { byte(c.x()), byte(c.y()), byte(c.z()), 255 });
+	}
+
+	FILE *const fp = fopen(path.c_str(), "wb");
+	if(fp == nullptr)
+		throw std::runtime_error("Error writing VOX File: " + path);
+	const bool ok = fwrite(out.data(), 1, out.size(), fp) == out.size();
+	fclose(fp);
+	if(!ok)
+		throw std::runtime_error("Error writing VOX File: " + path);
+}
@@ -1,56 +1,69 @@
-#pragma once
-
-#include <algorithm>
-
-#include "RayTracing/vec.h"
-#include "RayTracing/Ray.h"
-#include "RayTracing/hit_record.h"
-#include "RayTracing/color.h"
-
-#include "RayTracing/Materials/Material.h"
-
-class Dielectric : public Material {
-	double ir; // Index of Refraction
-
-public:
-	Dielectric(double ir): ir(ir) { }
-
-	virtual bool scatter(const Ray& r_in, const hit_record& rec, color& attenuation, Ray& scattered) const override {
-		attenuation = color(1., 1., 1.);
-		double refraction_ratio = rec.front_face ? (1.0 / ir) : ir;
-
-		vec3 unit_direction = unit_vector(r_in.dir);
-		double cos_theta = std::min<double>(dot(-unit_direction, rec.normal), 1.0);
-		double sin_theta = std::sqrt(1.0 - cos_theta*cos_theta);
-
-		bool cannot_refract = refraction_ratio * sin_theta > 1.0;
-
-		constexpr auto urand = []()->uint32_t{ return rand(); };
-
-		vec3 direction;
-		// if (cannot_refract || reflectance(cos_theta, refraction_ratio) > urand()%10000/10000.)
-		if (false) // always refract
-			direction = reflect(unit_direction, rec.normal);
-		else
-			direction = refract(unit_direction, rec.normal, refraction_ratio);
-
-		scattered.orig = rec.p;
-		scattered.dir = direction;
-
-		return true;
-	}
-
-	static vec3 refract(const vec3& uv, const vec3& n, const double etai_over_etat) {
-		double cos_theta = std::min<double>(dot(-uv, n), 1.0);
-		vec3 r_out_perp =  ((n * cos_theta) + uv) * etai_over_etat;
-		vec3 r_out_parallel = n * (-std::sqrt(std::abs(1.0 - length_squared(r_out_perp))));
-		return r_out_perp + r_out_parallel;
-	}
-
-	static double reflectance(double cosine, double ref_idx) {
-		// Use Schlick's approximation for reflectance.
-		double r0 = (1-ref_idx) / (1+ref_idx);
-		r0 = r0*r0;
-		return r0 + (1-r0)*pow((1 - cosine), 5.);
-	}
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/Ray.h"
+#include "RayTracing/hit_record.h"
+#include "RayTracing/color.h"
+
+class Dielectric {
+	real ir; // Index of Refraction
+
+public:
+	static constexpr bool SAMPLES_LIGHTS = false;
+
+	Dielectric(real ir): ir(ir) { }
+
+	bool scatter(const Ray& r_in, const hit_record& rec, color& attenuation, Ray& scattered) const {
+		attenuation = color(1, 1, 1);
+		real refraction_ratio = rec.front_face ? (1 / ir) : ir;
+
+		vec3 unit_direction = unit_vector(r_in.dir);
+		real cos_theta = std::min<real>(dot(-unit_direction, rec.normal), 1);
+		real sin_theta = std::sqrt(1 - cos_theta*cos_theta);
+
+		bool cannot_refract = refraction_ratio * sin_theta > 1;
+
+		constexpr auto urand = []()->uint32_t{ return rand(); };
+
+		vec3 direction;
+		// if (cannot_refract || reflectance(cos_theta, refraction_ratio) > urand()%10000/10000.)
+		if (false) // always refract
+			direction = reflect(unit_direction, rec.normal);
+		else
+			direction = refract(unit_direction, rec.normal, refraction_ratio);
+
+		scattered.orig = rec.p;
+		scattered.dir = direction;
+		scattered.coneWidth = r_in.widthAt(rec.p);
+		scattered.coneSpread = r_in.coneSpread; // surface curvature ignored
+		scattered.time = r_in.time;
+
+		return true;
+	}
+
+	color emitted(const hit_record& rec) const {
+		return color(0.f);
+	}
+
+	color eval(const hit_record& rec, const vec3& dir, real& pdf) const {
+		pdf = 0; // (near-)specular, never sampled towards lights
+		return color(0.f);
+	}
+
+	static vec3 refract(const vec3& uv, const vec3& n, const real etai_over_etat) {
+		real cos_theta = std::min<real>(dot(-uv, n), 1);
+		vec3 r_out_perp =  ((n * cos_theta) + uv) * etai_over_etat;
+		vec3 r_out_parallel = n * (-std::sqrt(std::abs(1 - length_squared(r_out_perp))));
+		return r_out_perp + r_out_parallel;
+	}
+
+	static real reflectance(real cosine, real ref_idx) {
+		// Use Schlick's approximation for reflectance.
+		real r0 = (1-ref_idx) / (1+ref_idx);
+		r0 = r0*r0;
+		return r0 + (1-r0)*std::pow((1 - cosine), 5);
+	}
 };
\ No newline at end of file
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "RayTracing/vec.h"
+#include "RayTracing/Ray.h"
+#include "RayTracing/hit_record.h"
+#include "RayTracing/color.h"
+
+// Area light: emits from its front face, absorbs everything that hits it
+class Emissive {
+	color emission;
+
+public:
+	static constexpr bool SAMPLES_LIGHTS = false;
+
+	Emissive(color emission): emission(emission) { }
+
+	bool scatter(const Ray& r_in, const hit_record& rec, color& attenuation, Ray& scattered) const {
+		return false;
+	}
+
+	color emitted(const hit_record& rec) const {
+		return rec.front_face ? emission : color(0.f);
+	}
+
+	color eval(const hit_record& rec, const vec3& dir, real& pdf) const {
+		pdf = 0;
+		return color(0.f);
+	}
+
+	inline const color& radiance() const { return emission; }
+};
@@ -1,29 +1,57 @@
-#pragma once
-
-#include "RayTracing/vec.h"
-#include "RayTracing/Ray.h"
-#include "RayTracing/hit_record.h"
-#include "RayTracing/color.h"
-
-#include "RayTracing/Materials/Material.h"
-
-class Lambertian : public Material {
-	const color albedo;
-
-public:
-	Lambertian(color albedo): albedo(albedo) { }
-
-	virtual bool scatter(const Ray& r_in, const hit_record& rec, color& attenuation, Ray& scattered) const override {
-		// vec3 scatter_direction = rec.normal + random_unit_vector(); // TODO parametric roughness
-		vec3 scatter_direction = rec.normal + random_unit_vector() * .2f; // TODO parametric roughness
-
-		// Catch degenerate scatter direction
-		if (near_zero(scatter_direction))
-			scatter_direction = rec.normal;
-
-		scattered.orig = rec.p;
-		scattered.dir = scatter_direction;
-		attenuation = albedo;
-		return true;
-	}
+#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/Ray.h"
+#include "RayTracing/hit_record.h"
+#include "RayTracing/color.h"
+
+class Lambertian {
+	color albedo;
+	real roughness; // radius of the sphere around the normal that scatter directions point to, 1 = ideal diffuse
+
+public:
+	static constexpr bool SAMPLES_LIGHTS = true;
+
+	Lambertian(color albedo, real roughness = .2f): albedo(albedo), roughness(std::clamp<real>(roughness, .001f, 1)) { }
+
+	bool scatter(const Ray& r_in, const hit_record& rec, color& attenuation, Ray& scattered) const {
+		// vec3 scatter_direction = rec.normal + random_unit_vector(); // TODO parametric roughness
+		vec3 scatter_direction = rec.normal + random_unit_vector() * roughness;
+
+		// Catch degenerate scatter direction
+		if (near_zero(scatter_direction))
+			scatter_direction = rec.normal;
+
+		scattered.orig = rec.p;
+		scattered.dir = scatter_direction;
+		scattered.coneWidth = r_in.widthAt(rec.p);
+		scattered.coneSpread = r_in.coneSpread + roughness; // lobe width ~ radius of the sampling sphere
+		scattered.time = r_in.time;
+		attenuation = albedo;
+		return true;
+	}
+
+	color emitted(const hit_record& rec) const {
+		return color(0.f);
+	}
+
+	// Solid-angle density of scatter()'s direction: normal + roughness * (uniform unit vector).
+	// The ray through dir crosses that sphere at two points; roughness 1 gives cos / pi.
+	real pdf(const hit_record& rec, const vec3& dir) const {
+		const real cosTheta = dot(rec.normal, dir) / dir.length<real>();
+		const real halfChord2 = roughness * roughness - (1 - cosTheta * cosTheta);
+		if (cosTheta <= 0 || halfChord2 <= 0)
+			return 0;
+
+		return (cosTheta * cosTheta + halfChord2) / (real(2 * 3.1415926535) * roughness * std::sqrt(halfChord2));
+	}
+
+	// BSDF * cosine towards dir; scatter() weights its samples by albedo, so this is albedo * pdf
+	color eval(const hit_record& rec, const vec3& dir, real& pdf) const {
+		pdf = this->pdf(rec, dir);
+		return albedo * pdf;
+	}
 };
\ No newline at end of file
@@ -1,12 +1,6 @@
-#pragma once
-
-#include "RayTracing/vec.h"
-#include "RayTracing/Ray.h"
-// #include "hit_record.h"
-
-class hit_record;
-
-class Material {
-public:
-	virtual bool scatter(const Ray& r_in, const hit_record& rec, color& attenuation, Ray& scattered) const = 0;
-};
\ No newline at end of file
+#pragma once
+
+#include <cstdint>
+
+// Index of a material in the scene's MaterialTable
+using material_id = uint32_t;
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <variant>
+#include <type_traits>
+#include <vector>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/Ray.h"
+#include "RayTracing/hit_record.h"
+#include "RayTracing/color.h"
+
+#include "RayTracing/Materials/Material.h"
+#include "RayTracing/Materials/Lambertian.h"
+#include "RayTracing/Materials/Metal.h"
+#include "RayTracing/Materials/Dielectric.h"
+#include "RayTracing/Materials/Emissive.h"
+
+// A material is stored by value; its alternative index doubles as the type tag
+using Material = std::variant<Lambertian, Metal, Dielectric, Emissive>;
+
+enum class MaterialType : uint8_t {
+	Lambertian,
+	Metal,
+	Dielectric,
+	Emissive,
+};
+
+// All materials of a scene in one contiguous array, addressed by material_id.
+// Shading dispatches through std::visit (a jump table) instead of virtual calls on shared_ptrs.
+class MaterialTable {
+	std::vector<Material> materials;
+
+public:
+	material_id add(const Material& material) {
+		materials.push_back(material);
+		return (material_id)(materials.size() - 1);
+	}
+
+	inline const Material& operator[](const material_id id) const { return materials[id]; }
+	inline size_t size() const { return materials.size(); }
+
+	// For batching shading work by material type
+	inline MaterialType type(const material_id id) const {
+		return (MaterialType)materials[id].index();
+	}
+
+	inline bool scatter(const Ray& r_in, const hit_record& rec, color& attenuation, Ray& scattered) const {
+		return std::visit(
+			[&](const auto& material) { return material.scatter(r_in, rec, attenuation, scattered); },
+			materials[rec.material]);
+	}
+
+	inline color emitted(const hit_record& rec) const {
+		return std::visit(
+			[&](const auto& material) { return material.emitted(rec); },
+			materials[rec.material]);
+	}
+
+	// Whether hits on this material sample a light (next-event estimation); false for (near-)specular ones
+	inline bool samplesLights(const material_id id) const {
+		return std::visit(
+			[](const auto& material) { return std::decay_t<decltype(material)>::SAMPLES_LIGHTS; },
+			materials[id]);
+	}
+
+	// BSDF * cosine towards dir, pdf receives the density scatter() samples dir with
+	inline color eval(const hit_record& rec, const vec3& dir, real& pdf) const {
+		return std::visit(
+			[&](const auto& material) { return material.eval(rec, dir, pdf); },
+			materials[rec.material]);
+	}
+
+	// Radiance of an Emissive material, black for all others
+	inline color emission(const material_id id) const {
+		const Emissive *const emissive = std::get_if<Emissive>(&materials[id]);
+		return emissive ? emissive->radiance() : color(0.f);
+	}
+};
\ No newline at end of file
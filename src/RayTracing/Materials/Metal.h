@@ -1,24 +1,36 @@
-#pragma once
-
-#include "RayTracing/vec.h"
-#include "RayTracing/Ray.h"
-#include "RayTracing/hit_record.h"
-#include "RayTracing/color.h"
-
-#include "RayTracing/Materials/Material.h"
-
-class Metal : public Material {
-	color albedo;
-	double fuzz; // reflection randomization
-
-public:
-	Metal(color albedo, double fuzz): albedo(albedo), fuzz(fuzz) { }
-
-	virtual bool scatter(const Ray& r_in, const hit_record& rec, color& attenuation, Ray& scattered) const override {
-		vec3 reflected = reflect(unit_vector(r_in.dir), rec.normal);
-		scattered.orig = rec.p;
-		scattered.dir = reflected + (random_in_unit_sphere() * fuzz); // TODO random scattering
-		attenuation = albedo;
-		return true;
-	}
+#pragma once
+
+#include "RayTracing/vec.h"
+#include "RayTracing/Ray.h"
+#include "RayTracing/hit_record.h"
+#include "RayTracing/color.h"
+
+class Metal {
+	color albedo;
+	real fuzz; // reflection randomization
+
+public:
+	static constexpr bool SAMPLES_LIGHTS = false;
+
+	Metal(color albedo, real fuzz): albedo(albedo), fuzz(fuzz) { }
+
+	bool scatter(const Ray& r_in, const hit_record& rec, color& attenuation, Ray& scattered) const {
+		vec3 reflected = reflect(unit_vector(r_in.dir), rec.normal);
+		scattered.orig = rec.p;
+		scattered.dir = reflected + (random_in_unit_sphere() * fuzz); // TODO random scattering
+		scattered.coneWidth = r_in.widthAt(rec.p);
+		scattered.coneSpread = r_in.coneSpread + fuzz; // the lobe widens the cone
+		scattered.time = r_in.time;
+		attenuation = albedo;
+		return true;
+	}
+
+	color emitted(const hit_record& rec) const {
+		return color(0.f);
+	}
+
+	color eval(const hit_record& rec, const vec3& dir, real& pdf) const {
+		pdf = 0; // (near-)specular, never sampled towards lights
+		return color(0.f);
+	}
 };
\ No newline at end of file
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <atomic>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+// Bump allocator: objects are placed one after another in large blocks and freed all at once.
+// reset() keeps the blocks for reuse, so an arena that is refilled every frame stops allocating
+// after the first one. Only objects that aren't trivially destructible are remembered (to run
+// their destructors), so freeing plain data is O(1) regardless of how much was allocated.
+class Arena {
+	struct Block {
+		std::unique_ptr<std::byte[]> data;
+		size_t size = 0, used = 0;
+	};
+	struct Destructor {
+		void (*destroy)(void*);
+		void *object;
+	};
+
+	std::vector<Block> blocks;
+	size_t current = 0; // block allocations are taken from; the ones after it are free
+	std::vector<Destructor> destructors;
+	size_t blockSize;
+
+public:
+	static constexpr size_t BLOCK_SIZE = 64 << 10;
+
+	// Blocks allocated by all arenas so far, so steady-state reuse can be checked
+	static inline std::atomic_size_t blocksAllocated = 0;
+
+	// Position to rewind() to, freeing everything allocated after it
+	struct Marker {
+		size_t block, used, destructors;
+	};
+
+	explicit Arena(const size_t blockSize = BLOCK_SIZE): blockSize(blockSize) { }
+
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	~Arena() {
+		destroy(0);
+	}
+
+	void* allocate(const size_t size, const size_t align = alignof(std::max_align_t)) {
+		for(; current < blocks.size(); current++) {
+			Block& b = blocks[current];
+			const uintptr_t base = (uintptr_t)b.data.get();
+			const size_t offset = ((base + b.used + align - 1) & ~(uintptr_t)(align - 1)) - base;
+			if(offset + size <= b.size) {
+				b.used = offset + size;
+				return b.data.get() + offset;
+			}
+			if(current + 1 < blocks.size())
+				blocks[current + 1].used = 0;
+		}
+
+		// oversized allocations get a block of their own
+		const size_t newSize = std::max(blockSize, size + align);
+		blocksAllocated.fetch_add(1, std::memory_order_relaxed);
+		blocks.push_back(Block{ std::unique_ptr<std::byte[]>(new std::byte[newSize]), newSize, 0 });
+		current = blocks.size() - 1;
+		return allocate(size, align);
+	}
+
+	// Uninitialized storage for n T
+	template<typename T>
+	T* allocateArray(const size_t n) {
+		static_assert(std::is_trivially_destructible_v<T>, "arrays are never destroyed");
+		return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+	}
+
+	template<typename T, typename... Args>
+	T* create(Args&&... args) {
+		T *const object = new(allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+		if constexpr(!std::is_trivially_destructible_v<T>)
+			destructors.push_back(Destructor{ [](void *const p) { static_cast<T*>(p)->~T(); }, object });
+		return object;
+	}
+
+	inline Marker mark() const {
+		return Marker{ current, current < blocks.size() ? blocks[current].used : 0, destructors.size() };
+	}
+
+	void rewind(const Marker& marker) {
+		destroy(marker.destructors);
+		current = marker.block;
+		if(current < blocks.size())
+			blocks[current].used = marker.used;
+	}
+
+	// Frees everything, keeps the blocks
+	void reset() {
+		rewind(Marker{ 0, 0, 0 });
+	}
+
+	size_t bytesUsed() const {
+		size_t used = 0;
+		for(size_t b = 0; b <= current && b < blocks.size(); b++)
+			used += blocks[b].used;
+		return used;
+	}
+
+	size_t bytesReserved() const {
+		size_t reserved = 0;
+		for(const Block& b : blocks)
+			reserved += b.size;
+		return reserved;
+	}
+
+private:
+	// Runs the destructors registered after the first `keep`, newest first
+	void destroy(const size_t keep) {
+		while(destructors.size() > keep) {
+			const Destructor d = destructors.back();
+			destructors.pop_back();
+			d.destroy(d.object);
+		}
+	}
+};
+
+// The calling thread's arena for short-lived scratch data, e.g. the rays of one batch. It lives as
+// long as the thread; parallel_for runs on long-lived workers, so its blocks are reused from one
+// call to the next.
+inline Arena& threadScratch() {
+	thread_local Arena arena(256 << 10);
+	return arena;
+}
+
+// Allocations from the thread's scratch arena that are freed when the scope ends
+class ScratchScope {
+	Arena& arena;
+	const Arena::Marker marker;
+
+public:
+	ScratchScope(): arena(threadScratch()), marker(arena.mark()) { }
+	~ScratchScope() { arena.rewind(marker); }
+
+	ScratchScope(const ScratchScope&) = delete;
+	ScratchScope& operator=(const ScratchScope&) = delete;
+
+	// Uninitialized
+	template<typename T>
+	inline T* array(const size_t n) {
+		return arena.allocateArray<T>(n);
+	}
+};
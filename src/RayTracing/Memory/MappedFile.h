@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#if defined(_WIN32) || defined(_WIN64)
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <unistd.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+#endif
+
+// Read-only memory mapping of a whole file: pages are read on first access, and stay shared with
+// the OS file cache, so reopening a file that was just used costs next to nothing
+class MappedFile {
+	const std::byte *bytes = nullptr;
+	size_t length = 0;
+
+#if defined(_WIN32) || defined(_WIN64)
+	HANDLE file = INVALID_HANDLE_VALUE, mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+
+public:
+	// Check valid(): missing or empty files aren't mapped
+	explicit MappedFile(const std::string& path) {
+#if defined(_WIN32) || defined(_WIN64)
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if(file == INVALID_HANDLE_VALUE)
+			return;
+		LARGE_INTEGER size;
+		if(!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+			return;
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if(!mapping)
+			return;
+		bytes = (const std::byte*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		if(bytes)
+			length = (size_t)size.QuadPart;
+#else
+		fd = open(path.c_str(), O_RDONLY);
+		if(fd < 0)
+			return;
+		struct stat st;
+		if(fstat(fd, &st) != 0 || st.st_size == 0)
+			return;
+		void *const p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(p == MAP_FAILED)
+			return;
+		bytes = (const std::byte*)p;
+		length = (size_t)st.st_size;
+#endif
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile() {
+#if defined(_WIN32) || defined(_WIN64)
+		if(bytes)
+			UnmapViewOfFile(bytes);
+		if(mapping)
+			CloseHandle(mapping);
+		if(file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+#else
+		if(bytes)
+			munmap((void*)bytes, length);
+		if(fd >= 0)
+			close(fd);
+#endif
+	}
+
+	inline bool valid() const { return bytes != nullptr; }
+	inline const std::byte* data() const { return bytes; }
+	inline size_t size() const { return length; }
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/Ray.h"
+#include "RayTracing/AABB.h"
+#include "RayTracing/hit_record.h"
+
+#include "RayTracing/Objects/hittable.h"
+
+#include "RayTracing/Animation/Keyframes.h"
+
+// Another hittable placed by keyframed transforms: each ray is moved into the object's space at its
+// own time and the hit moved back out, so one object (shared by any number of instances) can move
+// without touching its geometry or its BVH. The object's emitters aren't collected for light
+// sampling (their lights would sit in object space); BSDF sampling still finds them.
+class Instance : public hittable {
+	std::shared_ptr<hittable> object;
+	Keyframes motion;
+	AABB objectBox, box; // box: objectBox swept over the shutter interval
+	bool bounded;
+	real open = 0, close = 0;
+
+public:
+	Instance(std::shared_ptr<hittable> object, Keyframes motion)
+		: object(std::move(object)), motion(std::move(motion)) {
+		bounded = this->object->boundingBox(objectBox);
+		box = this->motion.sweep(objectBox, open, close);
+	}
+
+	inline const Keyframes& keyframes() const { return motion; }
+
+	virtual bool hit(const Ray& r, const real t_min, const real t_max, hit_record& rec) const override {
+		const Transform xf = motion.at(r.time);
+		if (!object->hit(local(r, xf), t_min, t_max, rec))
+			return false;
+
+		// same t: the local direction is scaled along with everything else
+		rec.p = xf.point(rec.p);
+		rec.normal = xf.normal(rec.normal);
+		return true;
+	}
+
+	virtual bool occluded(const Ray& r, const real t_max) const override {
+		return object->occluded(local(r, motion.at(r.time)), t_max);
+	}
+
+	virtual bool boundingBox(AABB& b) const override {
+		if (!bounded)
+			return false;
+		b = box;
+		return true;
+	}
+
+	virtual bool animate(const real shutterOpen, const real shutterClose, LightList& lights) override {
+		const bool changed = motion.changes(open, close, shutterOpen, shutterClose);
+		open = shutterOpen;
+		close = shutterClose;
+		const bool inner = object->animate(open, close, lights);
+		if (inner)
+			bounded = object->boundingBox(objectBox);
+		if (!inner && !changed)
+			return false;
+
+		box = motion.sweep(objectBox, open, close);
+		return true;
+	}
+
+private:
+	static Ray local(const Ray& r, const Transform& xf) {
+		return Ray(xf.inversePoint(r.orig), xf.inverseVector(r.dir), r.coneWidth / xf.scale, r.coneSpread, r.time);
+	}
+};
@@ -1,77 +1,85 @@
-#pragma once
-
-#include <memory>
-#include <vector>
-
-#include "RayTracing/vec.h"
-#include "RayTracing/Ray.h"
-#include "RayTracing/hit_record.h"
-
-#include "RayTracing/Objects/hittable.h"
-#include "RayTracing/Objects/Triangle.h"
-
-#include "RayTracing/Materials/Material.h"
-
-
-class Mesh : public hittable {
-	const std::vector<Triangle> mesh;
-	// std::shared_ptr<Material> material;
-	// const vec3 center;
-	// const double radius;
-
-public:
-	Mesh(const std::vector<Triangle>& mesh/*, std::shared_ptr<Material>& material*/)
-		: mesh(mesh)/*, material(material)*/ {};
-
-	virtual bool hit(const Ray& r, const double t_min, const double t_max, hit_record& rec) const override {
-		hit_record temp_rec;
-		bool hit_anything = false;
-		auto closest_so_far = t_max;
-
-		vec3 center(0.f, 0.f, 0.f);
-		for(const Triangle& tri : mesh)
-			center += (tri.p0 + tri.p1 + tri.p2) / 3.f;
-		center /= mesh.size();
-
-		float maxDistSQ = 0.f;
-		for(const Triangle& tri : mesh) {
-			vec3 verts[3] { tri.p0, tri.p1, tri.p2 };
-			for(int i = 0; i < 3; i++) {
-				const vec3 diff = verts[i] - center;
-				const float distSQ = dot(diff, diff);
-				if(distSQ > maxDistSQ)
-					maxDistSQ = distSQ;
-			}
-		}
-
-		{
-			const vec3 L = center - r.orig; // rayOrig to sphere
-			float tca = dot(L, normalize(r.dir));
-			// if (tca < 0) return false;
-			float dSquared = dot(L, L) - tca * tca;
-
-			if(dSquared > maxDistSQ)
-				return false;
-		}
-
-
-
-		for(const Triangle& tri : mesh) {
-			if(tri.hit(r, t_min, closest_so_far, temp_rec)) {
-				hit_anything = true;
-				closest_so_far = temp_rec.t;
-				rec = temp_rec;
-			}
-		}
-
-		// for (const auto& object : objects) {
-		// 	if (object->hit(r, t_min, closest_so_far, temp_rec)) {
-		// 		hit_anything = true;
-		// 		closest_so_far = temp_rec.t;
-		// 		rec = temp_rec;
-		// 	}
-		// }
-
-		return hit_anything;
-	}
-};
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/Ray.h"
+#include "RayTracing/AABB.h"
+#include "RayTracing/BVH.h"
+#include "RayTracing/hit_record.h"
+
+#include "RayTracing/Objects/hittable.h"
+#include "RayTracing/Objects/Triangle.h"
+
+#include "RayTracing/Materials/Material.h"
+
+
+// Triangles in a BVH (leaves of up to LEAF_SIZE), SAH built unless told otherwise
+class Mesh : public hittable {
+	std::vector<Triangle> mesh;
+	// std::shared_ptr<Material> material;
+	BVH bvh;
+
+public:
+	static constexpr uint32_t LEAF_SIZE = 4;
+
+	Mesh(const std::vector<Triangle>& mesh/*, std::shared_ptr<Material>& material*/, const BVHBuilder builder = BVHBuilder::SAH, const uint32_t numThreads = hardwareThreads())
+		: mesh(mesh)/*, material(material)*/ {
+		bvh.build(boxes(mesh), LEAF_SIZE, builder, numThreads);
+	};
+
+	// With a BVH built over boxes(mesh) elsewhere (e.g. AccelCache)
+	Mesh(const std::vector<Triangle>& mesh, const BVH& bvh)
+		: mesh(mesh), bvh(bvh) { }
+
+	static std::vector<AABB> boxes(const std::vector<Triangle>& mesh) {
+		std::vector<AABB> boxes(mesh.size());
+		for(size_t i = 0; i < mesh.size(); i++)
+			mesh[i].boundingBox(boxes[i]);
+		return boxes;
+	}
+
+	inline size_t size() const { return mesh.size(); }
+	inline const BVH& hierarchy() const { return bvh; }
+
+	// Moved vertices of the same triangles, in the same order (animation): refits the BVH instead of
+	// rebuilding it. A parent list's BVH holds the old bounds until its refit().
+	void update(const std::vector<Triangle>& triangles) {
+		if(triangles.size() != mesh.size())
+			throw std::runtime_error("Mesh::update: " + std::to_string(triangles.size()) + " triangles for a mesh of " + std::to_string(mesh.size()));
+		std::vector<Triangle>(triangles).swap(mesh);
+		bvh.refit(boxes(mesh));
+	}
+
+	virtual bool hit(const Ray& r, const real t_min, const real t_max, hit_record& rec) const override {
+		hit_record temp_rec;
+		return bvh.closest(r, t_max, [&](const uint32_t i, real& t) {
+			if(!mesh[i].hit(r, t_min, t, temp_rec))
+				return false;
+			t = temp_rec.t;
+			rec = temp_rec;
+			return true;
+		});
+	}
+
+	virtual bool occluded(const Ray& r, const real t_max) const override {
+		return bvh.any(r, t_max, [&](const uint32_t i) {
+			return mesh[i].occluded(r, t_max);
+		});
+	}
+
+	virtual bool boundingBox(AABB& box) const override {
+		if(bvh.empty())
+			return false;
+		box = bvh.node(0).bounds;
+		return true;
+	}
+
+	virtual void collectLights(LightList& lights, const MaterialTable& materials) override {
+		for(Triangle& tri : mesh)
+			tri.collectLights(lights, materials);
+	}
+};
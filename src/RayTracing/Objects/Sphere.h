@@ -1,51 +1,144 @@
-#pragma once
-
-#include <memory>
-
-#include "RayTracing/vec.h"
-#include "RayTracing/Ray.h"
-#include "RayTracing/hit_record.h"
-
-#include "RayTracing/Objects/hittable.h"
-
-#include "RayTracing/Materials/Material.h"
-
-class Sphere : public hittable {
-	const vec3 center;
-	const double radius;
-	std::shared_ptr<Material> material;
-
-public:
-	// Sphere() {}
-	Sphere(const point3& center, const double r, std::shared_ptr<Material>& m)
-		: center(center), radius(r), material(m) {};
-
-	virtual bool hit(const Ray& r, const double t_min, const double t_max, hit_record& rec) const override {
-		const vec3 oc = r.orig - center; // from sphere-center to ray Origin
-		const double a = length_squared(r.dir);
-		const double half_b = dot(oc, r.dir);
-		const double c = length_squared(oc) - radius*radius;
-
-		const double discriminant = half_b*half_b - a*c;
-		if (discriminant < 0)
-			return false;
-
-		const double sqrtd = sqrt(discriminant);
-
-		// Find the nearest root that lies in the acceptable range.
-		double root = (-half_b - sqrtd) / a;
-		if (root < t_min ||  root > t_max) {
-			root = (-half_b + sqrtd) / a;
-			if (root < t_min || t_max < root)
-				return false;
-		}
-
-		rec.t = root;
-		rec.p = r.at(rec.t);
-		const vec3 outward_normal = (rec.p - center) / radius;
-		rec.set_face_normal(r, outward_normal);
-		rec.material = material;
-
-		return true;
-	}
-};
+#pragma once
+
+#include <cmath>
+#include <memory>
+#include <algorithm>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/Ray.h"
+#include "RayTracing/AABB.h"
+#include "RayTracing/hit_record.h"
+
+#include "RayTracing/Objects/hittable.h"
+
+#include "RayTracing/Materials/Material.h"
+#include "RayTracing/Materials/MaterialTable.h"
+
+#include "RayTracing/Lights/LightList.h"
+
+#include "RayTracing/Animation/Keyframes.h"
+
+class Sphere : public hittable {
+	const vec3 center;
+	const real radius;
+	material_id material;
+	uint32_t lightId = NO_LIGHT;
+
+	// Moving spheres: keyframes applied to the sphere above (its center transformed, its radius
+	// scaled), and the shutter interval set by animate()
+	std::shared_ptr<const Keyframes> motion;
+	real open = 0, close = 0;
+
+public:
+	// Sphere() {}
+	Sphere(const point3& center, const real r, const material_id m)
+		: center(center), radius(r), material(m) {};
+
+	Sphere(const point3& center, const real r, const material_id m, std::shared_ptr<const Keyframes> motion)
+		: center(center), radius(r), material(m), motion(std::move(motion)) {};
+
+	virtual bool hit(const Ray& r, const real t_min, const real t_max, hit_record& rec) const override {
+		vec3 c;
+		real rad;
+		placement(r.time, c, rad);
+
+		real root;
+		if (!nearestRoot(r, c, rad, t_min, t_max, root))
+			return false;
+
+		rec.t = root;
+		rec.p = r.at(rec.t);
+		const vec3 outward_normal = (rec.p - c) / rad;
+		rec.set_face_normal(r, outward_normal);
+		rec.material = material;
+		rec.light_id = lightId;
+
+		return true;
+	}
+
+	virtual bool occluded(const Ray& r, const real t_max) const override {
+		vec3 c;
+		real rad;
+		placement(r.time, c, rad);
+
+		real root;
+		return nearestRoot(r, c, rad, RAY_T_MIN, t_max, root);
+	}
+
+	virtual bool boundingBox(AABB& box) const override {
+		const vec3 r(std::abs(radius));
+		box = AABB(center - r, center + r);
+		if (motion)
+			box = motion->sweep(box, open, close);
+		return true;
+	}
+
+	virtual void collectLights(LightList& lights, const MaterialTable& materials) override {
+		const color emission = materials.emission(material);
+		if (emission.x() + emission.y() + emission.z() > 0)
+			lightId = lights.add(light(emission));
+	}
+
+	virtual bool animate(const real shutterOpen, const real shutterClose, LightList& lights) override {
+		if (!motion)
+			return false;
+
+		const bool changed = motion->changes(open, close, shutterOpen, shutterClose);
+		open = shutterOpen;
+		close = shutterClose;
+		if (!changed)
+			return false;
+
+		if (lightId != NO_LIGHT)
+			lights.update(lightId, light(lights[lightId].emission));
+		return true;
+	}
+
+private:
+	// Moving: sampled where the sphere is at the shadow ray's time
+	inline Light light(const color& emission) const {
+		if (!motion)
+			return Light::sphere(center, radius, emission);
+		return Light::movingSphere(center, radius, emission, *motion, open, close);
+	}
+
+	inline void placement(const real time, vec3& c, real& rad) const {
+		if (!motion) {
+			c = center;
+			rad = radius;
+			return;
+		}
+		const Transform t = motion->at(time);
+		c = t.point(center);
+		rad = radius * t.scale;
+	}
+
+	static bool nearestRoot(const Ray& r, const vec3& center, const real radius, const real t_min, const real t_max, real& root) {
+		const vec3 oc = r.orig - center; // from sphere-center to ray Origin
+		const real a = length_squared(r.dir);
+		const real half_b = dot(oc, r.dir);
+		const real c = length_squared(oc) - radius*radius;
+
+		// half_b² - a*c without the cancellation that breaks large spheres in float
+		const vec3 l = oc - (half_b / a) * r.dir;
+		const real discriminant = a * (radius*radius - length_squared(l));
+		if (discriminant <= 0) // tangent rays count as misses, q would be 0
+			return false;
+
+		const real sqrtd = std::sqrt(discriminant);
+
+		// Both roots without subtracting nearly equal values
+		const real q = -(half_b + std::copysign(sqrtd, half_b));
+		const real root0 = c / q, root1 = q / a;
+
+		// Find the nearest root that lies in the acceptable range.
+		root = std::min(root0, root1);
+		if (root < t_min ||  root > t_max) {
+			root = std::max(root0, root1);
+			if (root < t_min || t_max < root)
+				return false;
+		}
+
+		return true;
+	}
+};
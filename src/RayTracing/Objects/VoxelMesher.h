@@ -0,0 +1,237 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/parallel.h"
+
+#include "RayTracing/Objects/Triangle.h"
+#include "RayTracing/Objects/VoxelVolume.h"
+
+#include "RayTracing/Materials/MaterialTable.h"
+
+#include "RayTracing/Profiling/Profiler.h"
+
+// Triangles sharing vertices: triangle i is vertices[indices[3 * i + 0..2]] with materials[i]
+struct IndexedMesh {
+	std::vector<vec3> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<material_id> materials;
+
+	inline size_t numTriangles() const { return materials.size(); }
+
+	void append(const IndexedMesh& other) {
+		const uint32_t offset = (uint32_t)vertices.size();
+		vertices.insert(vertices.end(), other.vertices.begin(), other.vertices.end());
+		for(const uint32_t i : other.indices)
+			indices.push_back(offset + i);
+		materials.insert(materials.end(), other.materials.begin(), other.materials.end());
+	}
+
+	std::vector<Triangle> triangles() const {
+		std::vector<Triangle> tris;
+		tris.reserve(numTriangles());
+		for(size_t t = 0; t < numTriangles(); t++)
+			tris.emplace_back(vertices[indices[3 * t]], vertices[indices[3 * t + 1]], vertices[indices[3 * t + 2]], materials[t]);
+		return tris;
+	}
+};
+
+// Surface of a VoxelVolume as triangles, for views where tracing (or rasterizing) triangles is cheaper
+// than the DDA. A voxel gets a face towards air and towards other values it can be seen through
+// (faces between opaque voxels are culled); in each slice, faces of the same value are merged into
+// maximal rectangles (greedy meshing), two triangles each, wound so their normal points out of the voxel.
+// The volume is meshed per VoxelVolume::CHUNK_SIZE^3 chunk, in parallel, and the chunks are kept:
+// update() only redoes those whose revision changed since (edits touch the chunks next to them too).
+class VoxelMesher {
+	const VoxelVolume& volume;
+	std::vector<bool> opaque; // per voxel value
+
+	struct Chunk {
+		IndexedMesh mesh;
+		uint32_t revision = 0;
+		size_t faces = 0; // before merging
+		bool meshed = false;
+	};
+	std::vector<Chunk> chunks;
+
+public:
+	uint32_t numThreads = hardwareThreads();
+
+	VoxelMesher(const VoxelVolume& volume, const std::vector<bool>& opaque):
+			volume(volume), opaque(opaque),
+			chunks(volume.numChunks(0) * volume.numChunks(1) * volume.numChunks(2)) { }
+
+	// Opacity of every value from its material (Dielectric: see-through)
+	VoxelMesher(const VoxelVolume& volume, const MaterialTable& materials):
+			VoxelMesher(volume, opaqueValues(volume, materials)) { }
+
+	inline size_t numChunks() const { return chunks.size(); }
+	inline const IndexedMesh& chunk(const size_t i) const { return chunks[i].mesh; }
+
+	// Remeshes the chunks that changed (all of them the first time); returns how many
+	size_t update() {
+		RT_ZONE("voxelMesher.update");
+
+		std::vector<size_t> dirty;
+		for(size_t i = 0; i < chunks.size(); i++)
+			if(!chunks[i].meshed || chunks[i].revision != revision(i))
+				dirty.push_back(i);
+
+		parallel_for(0, dirty.size(), [&](const size_t k) {
+			Chunk& c = chunks[dirty[k]];
+			c.revision = revision(dirty[k]);
+			c.faces = meshChunk(dirty[k], c.mesh);
+			c.meshed = true;
+		}, numThreads);
+
+		return dirty.size();
+	}
+
+	// All chunks in one mesh
+	IndexedMesh mesh() const {
+		IndexedMesh all;
+		for(const Chunk& c : chunks)
+			all.append(c.mesh);
+		return all;
+	}
+
+	// Voxel faces the mesh covers
+	size_t numFaces() const {
+		size_t faces = 0;
+		for(const Chunk& c : chunks)
+			faces += c.faces;
+		return faces;
+	}
+
+private:
+	static std::vector<bool> opaqueValues(const VoxelVolume& volume, const MaterialTable& materials) {
+		std::vector<bool> opaque(volume.numValues() + 1, false);
+		for(size_t v = 1; v <= volume.numValues(); v++)
+			opaque[v] = materials.type(volume.material(v)) != MaterialType::Dielectric;
+		return opaque;
+	}
+
+	inline ivec3 chunkCoords(const size_t i) const {
+		const size_t nx = volume.numChunks(0), ny = volume.numChunks(1);
+		return ivec3((int)(i % nx), (int)(i / nx % ny), (int)(i / (nx * ny)));
+	}
+
+	inline uint32_t revision(const size_t i) const {
+		const ivec3 c = chunkCoords(i);
+		return volume.chunkRevision(c.x(), c.y(), c.z());
+	}
+
+	// Value whose face voxel p shows towards neighbour n, 0 for none
+	inline size_t face(const size_t v, const size_t n) const {
+		if(v == 0 || v == n)
+			return 0;
+		return n == 0 || !(n < opaque.size() && opaque[n]) ? v : 0;
+	}
+
+	// Greedy meshing of one chunk; returns the number of voxel faces
+	size_t meshChunk(const size_t i, IndexedMesh& out) const {
+		out = IndexedMesh{};
+
+		const ivec3 c = chunkCoords(i);
+		int lo[3], hi[3];
+		for(int axis = 0; axis < 3; axis++) {
+			lo[axis] = c[axis] * (int)VoxelVolume::CHUNK_SIZE;
+			hi[axis] = std::min(lo[axis] + (int)VoxelVolume::CHUNK_SIZE, (int)volume.size(axis));
+		}
+
+		// the chunk's voxels plus a border of their neighbours (air outside the volume)
+		const int size[3] = { hi[0] - lo[0] + 2, hi[1] - lo[1] + 2, hi[2] - lo[2] + 2 };
+		std::vector<size_t> voxels((size_t)size[0] * size[1] * size[2], 0);
+		bool solid = false;
+		for(int z = std::max(lo[2] - 1, 0); z < std::min(hi[2] + 1, (int)volume.size(2)); z++)
+			for(int y = std::max(lo[1] - 1, 0); y < std::min(hi[1] + 1, (int)volume.size(1)); y++)
+				for(int x = std::max(lo[0] - 1, 0); x < std::min(hi[0] + 1, (int)volume.size(0)); x++) {
+					const size_t v = volume.get(x, y, z);
+					voxels[((size_t)(z - lo[2] + 1) * size[1] + (y - lo[1] + 1)) * size[0] + (x - lo[0] + 1)] = v;
+					solid |= v != 0;
+				}
+		if(!solid)
+			return 0;
+		const ptrdiff_t strides[3] = { 1, size[0], (ptrdiff_t)size[0] * size[1] };
+
+		std::unordered_map<uint64_t, uint32_t> vertexIds; // grid corner -> vertex
+		const auto vertex = [&](const int p[3]) {
+			const uint64_t key = (uint64_t)(p[0] - lo[0]) | ((uint64_t)(p[1] - lo[1]) << 21) | ((uint64_t)(p[2] - lo[2]) << 42);
+			const auto [it, inserted] = vertexIds.try_emplace(key, (uint32_t)out.vertices.size());
+			if(inserted)
+				out.vertices.push_back(volume.origin() + vec3((real)p[0], (real)p[1], (real)p[2]) * volume.voxelSize());
+			return it->second;
+		};
+
+		size_t faces = 0;
+		std::vector<size_t> mask;
+		for(int d = 0; d < 3; d++) {
+			const int u = (d + 1) % 3, v = (d + 2) % 3; // e_u x e_v = e_d
+			const int sizeU = hi[u] - lo[u], sizeV = hi[v] - lo[v];
+			mask.resize((size_t)sizeU * sizeV);
+
+			for(const int side : { -1, 1 }) {
+				for(int k = lo[d]; k < hi[d]; k++) {
+					// this slice's faces towards side
+					for(int b = 0; b < sizeV; b++) {
+						const size_t row = (size_t)(k - lo[d] + 1) * strides[d] + (size_t)(b + 1) * strides[v] + strides[u];
+						for(int a = 0; a < sizeU; a++) {
+							const size_t p = row + (size_t)a * strides[u];
+							mask[(size_t)b * sizeU + a] = face(voxels[p], voxels[p + side * strides[d]]);
+							faces += mask[(size_t)b * sizeU + a] != 0;
+						}
+					}
+
+					// grow rectangles along u, then v
+					for(int b = 0; b < sizeV; b++) {
+						for(int a = 0; a < sizeU; ) {
+							const size_t m = mask[(size_t)b * sizeU + a];
+							if(m == 0) {
+								a++;
+								continue;
+							}
+
+							int w = 1;
+							while(a + w < sizeU && mask[(size_t)b * sizeU + a + w] == m)
+								w++;
+
+							int h = 1;
+							for(; b + h < sizeV; h++) {
+								bool rowMatches = true;
+								for(int x = 0; x < w && rowMatches; x++)
+									rowMatches = mask[(size_t)(b + h) * sizeU + a + x] == m;
+								if(!rowMatches)
+									break;
+							}
+
+							for(int y = 0; y < h; y++)
+								for(int x = 0; x < w; x++)
+									mask[(size_t)(b + y) * sizeU + a + x] = 0;
+
+							// corners of the rectangle on the voxel's side-facing plane
+							int corner[4][3];
+							for(int q = 0; q < 4; q++) {
+								corner[q][d] = k + (side > 0);
+								corner[q][u] = lo[u] + a + (q == 1 || q == 2 ? w : 0);
+								corner[q][v] = lo[v] + b + (q >= 2 ? h : 0);
+							}
+							const uint32_t ids[4] = { vertex(corner[0]), vertex(corner[1]), vertex(corner[2]), vertex(corner[3]) };
+
+							// counter-clockwise around +d, reversed for faces towards -d
+							const int first = side > 0 ? 1 : 2, second = 3 - first;
+							out.indices.insert(out.indices.end(), { ids[0], ids[first], ids[second], ids[0], ids[first + 1], ids[second + 1] });
+							out.materials.insert(out.materials.end(), 2, volume.material(m));
+
+							a += w;
+						}
+					}
+				}
+			}
+		}
+		return faces;
+	}
+};
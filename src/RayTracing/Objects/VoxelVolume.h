@@ -1,198 +1,680 @@
-#pragma once
-
-#include <memory>
-
-
-#include "RayTracing/vec.h"
-#include "RayTracing/Ray.h"
-#include "RayTracing/AABB.h"
-#include "RayTracing/hit_record.h"
-
-#include "hittable.h"
-
-#include "RayTracing/Materials/Material.h"
-#include "RayTracing/Materials/Lambertian.h"
-#include "RayTracing/Materials/Metal.h"
-#include "RayTracing/Materials/Dielectric.h"
-
-
-class VoxelVolume : public hittable {
-	std::vector<std::shared_ptr<Material>> materials;
-
-private:
-	size_t width = 8, height = 8, depth = 8;
-	// size_t width = 32, height = 32, depth = 32;
-	size_t *voxels; // 0 = air
-	vec3 scale;
-	AABB aabb;
-
-	size_t index(const size_t x, const size_t y, const size_t z) const {
-		return z * (width * height) + y * width + x;
-	}
-
-public:
-	VoxelVolume():
-			materials{} {
-		voxels = new size_t[width * height * depth]{};
-		scale = vec3(1.f);
-		// scale = vec3(.1f);
-
-		aabb = AABB(vec3(0, 0, 0), vec3(width * scale.x(), height * scale.y(), depth * scale.z()));
-		// aabb.max *= .75f;
-		
-		// materials.push_back(std::make_unique<Dielectric>(1.5f)); // glass
-		// materials.push_back(std::make_unique<Dielectric>(1.f)); // glass
-		materials.push_back(std::make_unique<Metal>(vec3(1.f, .2f, .2f), .001f)); // metal
-
-		// materials.push_back(std::make_unique<Lambertian>(vec3(1.f, 0.f, .5f))); // purple
-		materials.push_back(std::make_unique<Lambertian>(vec3(1.f, 0.f, 0.f))); // red
-		materials.push_back(std::make_unique<Lambertian>(vec3(0.f, 1.f, 0.f))); // green
-		materials.push_back(std::make_unique<Lambertian>(vec3(0.f, 0.f, 1.f))); // blue
-		materials.push_back(std::make_unique<Metal>(vec3(1.f, .2f, .2f), .001f)); // metal
-
-		// materials.push_back(std::make_unique<Dielectric>(1.5f)); // glass
-		// materials.push_back(std::make_unique<Dielectric>(1.f)); // glass
-
-
-		// for(size_t x = 0; x < width; x++) {
-		// 	for(size_t y = 0; y < height; y++) {
-		// 		voxels[index(x, y, 0)] = 6;
-		// 		voxels[index(x, y, depth - 1)] = 6;
-		// 	}
-		// }
-
-		// for(size_t x = 2; x < width - 2; x++) {
-		// 	for(size_t y = 2; y < height - 2; y++) {
-		// 		voxels[index(x, y, 2)] = 5;
-		// 		voxels[index(x, y, depth - 1 - 2)] = 5;
-		// 	}
-		// }
-
-		// for(size_t x = 0; x < width; x++)
-		// 	for(size_t y = 0; y < height; y++)
-		// 		for(size_t z = 0; z < depth; z++)
-		// 			// if(vec3((int)x - width / 2, (int)y - height / 2, (int)z - depth / 2).length<float>() < width / 2)
-		// 			if(rand() %  5 == 0)
-		// 				voxels[index(x, y, z)] = rand() % (materials.size() + 1);
-
-		// voxels[index(3, 3, 3)] = 1;
-		// voxels[index(3, 3, 4)] = 1;
-		// voxels[index(3, 4, 3)] = 1;
-		// voxels[index(3, 4, 4)] = 1;
-		// voxels[index(4, 3, 3)] = 1;
-		// voxels[index(4, 3, 4)] = 1;
-		// voxels[index(4, 4, 3)] = 1;
-		// voxels[index(4, 4, 4)] = 1;
-
-		// voxels[index(2, 3, 3)] = 2;
-		// voxels[index(2, 3, 4)] = 2;
-		// voxels[index(2, 4, 3)] = 2;
-		// voxels[index(2, 4, 4)] = 2;
-
-		// voxels[index(3, 2, 3)] = 3;
-		// voxels[index(3, 2, 4)] = 3;
-		// voxels[index(4, 2, 3)] = 3;
-		// voxels[index(4, 2, 4)] = 3;
-
-		// voxels[index(3, 3, 2)] = 4;
-		// voxels[index(3, 4, 2)] = 4;
-		// voxels[index(4, 3, 2)] = 4;
-		// voxels[index(4, 4, 2)] = 4;
-
-		voxels[index(0, 0, 0)] = 1;
-		voxels[index(0, 0, 1)] = 1;
-		voxels[index(0, 1, 0)] = 1;
-		voxels[index(0, 1, 1)] = 1;
-
-		voxels[index(2, 0, 0)] = 2;
-		voxels[index(2, 0, 1)] = 2;
-		voxels[index(2, 1, 0)] = 2;
-		voxels[index(2, 1, 1)] = 2;
-
-		voxels[index(3, 0, 0)] = 3;
-		voxels[index(3, 0, 1)] = 3;
-		voxels[index(3, 1, 0)] = 3;
-		voxels[index(3, 1, 1)] = 3;
-	}
-
-	virtual bool hit(const Ray& r, const double t_min, const double t_max, hit_record& rec) const override {
-		float tHitBounds;
-		ivec3 hitBoundsNormal;
-
-		if(!aabb.intersects(r, hitBoundsNormal, tHitBounds))
-			return false;
-
-		// const vec3 viewPos = r.origin() / scale;
-		// const vec3 viewPos = r.at(tHitBounds > 0 ? tHitBounds : 0) / scale;
-		const vec3 viewPos = r.at(tHitBounds > 0 ? tHitBounds : 0) / scale + normalize(r.direction()) * .01f;
-		const vec3 viewDir = r.direction();
-
-		ivec3 currentBlock = floor(viewPos);
-		const vec3 deltaT = abs(1.f / viewDir);
-
-
-		//calculate step and initial sideDist:
-		ivec3 step;
-		vec3 sideDist;
-		for(uint8_t dim = 0; dim < 3; dim++) {
-			step[dim] = viewDir[dim] < 0 ? -1 : 1;
-			sideDist[dim] = (viewDir[dim] < 0)
-				?  (viewPos[dim] - currentBlock[dim]) * deltaT[dim]
-				: -(viewPos[dim] - currentBlock[dim] - 1.) * deltaT[dim];
-		}
-
-
-
-		int side = 0;
-		// for(int i = 0; i < 500; i++) {
-		for(;;) {
-
-			//jump to next cube
-			const float minDim = std::min<float>(std::min<float>(sideDist.x(), sideDist.y()), sideDist.z());
-			for(uint8_t dim = 0; dim < 3; dim++) {
-				if (sideDist[dim] == minDim) {
-					sideDist[dim] += deltaT[dim];
-					currentBlock[dim] += step[dim];
-					side = dim;
-					break;
-				}
-			}
-
-			const auto inside =
-				[=](const ivec3& pos) -> bool {
-					if(pos.x() < 0 || pos.x() >= width) return false;
-					if(pos.y() < 0 || pos.y() >= height) return false;
-					if(pos.z() < 0 || pos.z() >= depth) return false;
-					return true;
-				};
-
-			//Check if ray hit
-			if(!inside(currentBlock))
-				return false;
-
-			ivec3 normal(0);
-			normal[side] = viewDir[side] > 0 ? -1 : 1;
-
-			const ivec3 prev = currentBlock + normal;
-
-			const size_t mat = voxels[index(currentBlock.x(), currentBlock.y(), currentBlock.z())];
-			const size_t prevMat = inside(prev) ? voxels[index(prev.x(), prev.y(), prev.z())] : 0;
-
-			if(mat != prevMat) {
-			// if(mat) {
-				// rec.front_face = true;
-				// rec.material = materials[mat - 1];
-
-				rec.front_face = mat != 0;
-				rec.material = (mat != 0) ? materials[mat - 1] : materials[prevMat - 1];
-
-				rec.p = vec3(currentBlock.x(), currentBlock.y(), currentBlock.z());
-				// rec.p -= sideDist * normalize(viewDir);
-				rec.p *= scale;
-				rec.normal = vec3(normal.x(), normal.y(), normal.z());
-
-				return true;
-			}
-		}
-	}
-};
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/Ray.h"
+#include "RayTracing/AABB.h"
+#include "RayTracing/hit_record.h"
+
+#include "hittable.h"
+
+#include "RayTracing/Materials/Material.h"
+#include "RayTracing/Materials/MaterialTable.h"
+
+#include "RayTracing/Lights/LightList.h"
+
+#include "RayTracing/Profiling/Profiler.h"
+
+
+class VoxelVolume : public hittable {
+	std::vector<material_id> materials; // voxel value - 1 -> material
+
+private:
+	size_t width = 8, height = 8, depth = 8;
+	// size_t width = 32, height = 32, depth = 32;
+	size_t *voxels; // 0 = air, padded by one cell of OUTSIDE on every side (see index)
+	vec3 scale;
+	AABB aabb; // world space, voxel (x, y, z) spans aabb._min + [x, x + 1] * scale (and so on)
+
+	std::vector<bool> emissive; // per voxel value, filled by collectLights
+	bool emittersFlagged = false; // levels carry HAS_EMITTER flags
+	std::vector<color> emission;
+	std::unordered_map<size_t, uint32_t> lightIds; // voxel index -> light_id of the emissive voxels
+	LightList *lights = nullptr; // kept up to date by set() once collectLights ran
+
+	// Coarser copies for level-of-detail traversal: a cell of level l covers 2^3 cells of level l - 1
+	// and holds a representative value (see summarize). levels[l - 1] is level l, level 0 is `voxels`.
+	// Cells with emissive voxels below them are flagged: emitters are only ever hit at full
+	// resolution, where their geometry matches the lights next-event estimation samples.
+	struct Level {
+		size_t width, height, depth;
+		std::vector<size_t> cells;
+	};
+	std::vector<Level> levels;
+	static constexpr size_t HAS_EMITTER = (size_t)1 << 63;
+
+	// Per CHUNK_SIZE^3 block: bumped by every set() that can change the block's surface, so derived
+	// data (see VoxelMesher) can tell which blocks to redo
+	std::vector<uint32_t> chunkRevisions;
+
+	static constexpr size_t OUTSIDE = HAS_EMITTER - 1; // padding: the DDA stops when it steps into it
+
+	// A level's cells, padded like `voxels`
+	struct Grid {
+		const size_t *cells;
+		size_t width, height, depth;
+
+		inline bool inside(const ivec3& p) const {
+			return p.x() >= 0 && p.x() < (int)width && p.y() >= 0 && p.y() < (int)height && p.z() >= 0 && p.z() < (int)depth;
+		}
+		inline size_t index(const ivec3& p) const {
+			return ((size_t)(p.z() + 1) * (height + 2) + (size_t)(p.y() + 1)) * (width + 2) + (size_t)(p.x() + 1);
+		}
+		inline size_t operator[](const ivec3& p) const {
+			return cells[index(p)];
+		}
+		inline ivec3 cell(size_t i) const {
+			const int x = (int)(i % (width + 2)) - 1;
+			i /= width + 2;
+			return ivec3(x, (int)(i % (height + 2)) - 1, (int)(i / (height + 2)) - 1);
+		}
+	};
+
+	// Padded size of a width x height x depth grid
+	static inline size_t paddedSize(const size_t width, const size_t height, const size_t depth) {
+		return (width + 2) * (height + 2) * (depth + 2);
+	}
+
+	size_t index(const size_t x, const size_t y, const size_t z) const {
+		return ((z + 1) * (height + 2) + (y + 1)) * (width + 2) + (x + 1);
+	}
+
+	inline Grid grid(const uint32_t level) const {
+		if(level == 0)
+			return Grid{ voxels, width, height, depth };
+		const Level& l = levels[level - 1];
+		return Grid{ l.cells.data(), l.width, l.height, l.depth };
+	}
+
+	// Fills a padded grid's border with OUTSIDE
+	static void pad(size_t *const cells, const size_t width, const size_t height, const size_t depth) {
+		const Grid g{ cells, width, height, depth };
+		for(int z = -1; z <= (int)depth; z++)
+			for(int y = -1; y <= (int)height; y++)
+				for(int x = -1; x <= (int)width; x++)
+					if(!g.inside(ivec3(x, y, z)))
+						cells[g.index(ivec3(x, y, z))] = OUTSIDE;
+	}
+
+public:
+	static constexpr uint32_t MAX_LEVELS = 5;
+	static constexpr size_t CHUNK_SIZE = 32;
+
+	// Rays switch to a coarser level in empty space once their cone (Ray::coneWidth / coneSpread)
+	// is wider than lodThreshold cells of that level
+	uint32_t maxLod = MAX_LEVELS; // 0: always full resolution
+	real lodThreshold = 2;
+
+	// Empty volume with its minimum corner at origin; voxel value v != 0 uses materials[v - 1]
+	VoxelVolume(const size_t width, const size_t height, const size_t depth, const std::vector<material_id>& materials, const vec3& scale = vec3(1.f), const vec3& origin = vec3(0.f)):
+			materials(materials),
+			width(width), height(height), depth(depth),
+			voxels(new size_t[paddedSize(width, height, depth)]{}),
+			scale(scale),
+			aabb(origin, origin + vec3(width * scale.x(), height * scale.y(), depth * scale.z())) {
+		pad(voxels, width, height, depth);
+		chunkRevisions.assign(numChunks(0) * numChunks(1) * numChunks(2), 0);
+		allocateLevels(); // all air: every cell summarizes to 0
+	}
+
+	// Small demo volume
+	VoxelVolume(MaterialTable& materialTable):
+			VoxelVolume(8, 8, 8, {}) {
+		// scale = vec3(.1f);
+		// aabb.max *= .75f;
+		
+		// materials.push_back(materialTable.add(Dielectric(1.5f))); // glass
+		// materials.push_back(materialTable.add(Dielectric(1.f))); // glass
+		materials.push_back(materialTable.add(Metal(vec3(1.f, .2f, .2f), .001f))); // metal
+
+		// materials.push_back(materialTable.add(Lambertian(vec3(1.f, 0.f, .5f)))); // purple
+		materials.push_back(materialTable.add(Lambertian(vec3(1.f, 0.f, 0.f)))); // red
+		materials.push_back(materialTable.add(Lambertian(vec3(0.f, 1.f, 0.f)))); // green
+		materials.push_back(materialTable.add(Lambertian(vec3(0.f, 0.f, 1.f)))); // blue
+		materials.push_back(materialTable.add(Metal(vec3(1.f, .2f, .2f), .001f))); // metal
+
+		// materials.push_back(materialTable.add(Dielectric(1.5f))); // glass
+		// materials.push_back(materialTable.add(Dielectric(1.f))); // glass
+
+
+		// for(size_t x = 0; x < width; x++) {
+		// 	for(size_t y = 0; y < height; y++) {
+		// 		voxels[index(x, y, 0)] = 6;
+		// 		voxels[index(x, y, depth - 1)] = 6;
+		// 	}
+		// }
+
+		// for(size_t x = 2; x < width - 2; x++) {
+		// 	for(size_t y = 2; y < height - 2; y++) {
+		// 		voxels[index(x, y, 2)] = 5;
+		// 		voxels[index(x, y, depth - 1 - 2)] = 5;
+		// 	}
+		// }
+
+		// for(size_t x = 0; x < width; x++)
+		// 	for(size_t y = 0; y < height; y++)
+		// 		for(size_t z = 0; z < depth; z++)
+		// 			// if(vec3((int)x - width / 2, (int)y - height / 2, (int)z - depth / 2).length<float>() < width / 2)
+		// 			if(rand() %  5 == 0)
+		// 				voxels[index(x, y, z)] = rand() % (materials.size() + 1);
+
+		// voxels[index(3, 3, 3)] = 1;
+		// voxels[index(3, 3, 4)] = 1;
+		// voxels[index(3, 4, 3)] = 1;
+		// voxels[index(3, 4, 4)] = 1;
+		// voxels[index(4, 3, 3)] = 1;
+		// voxels[index(4, 3, 4)] = 1;
+		// voxels[index(4, 4, 3)] = 1;
+		// voxels[index(4, 4, 4)] = 1;
+
+		// voxels[index(2, 3, 3)] = 2;
+		// voxels[index(2, 3, 4)] = 2;
+		// voxels[index(2, 4, 3)] = 2;
+		// voxels[index(2, 4, 4)] = 2;
+
+		// voxels[index(3, 2, 3)] = 3;
+		// voxels[index(3, 2, 4)] = 3;
+		// voxels[index(4, 2, 3)] = 3;
+		// voxels[index(4, 2, 4)] = 3;
+
+		// voxels[index(3, 3, 2)] = 4;
+		// voxels[index(3, 4, 2)] = 4;
+		// voxels[index(4, 3, 2)] = 4;
+		// voxels[index(4, 4, 2)] = 4;
+
+		voxels[index(0, 0, 0)] = 1;
+		voxels[index(0, 0, 1)] = 1;
+		voxels[index(0, 1, 0)] = 1;
+		voxels[index(0, 1, 1)] = 1;
+
+		voxels[index(2, 0, 0)] = 2;
+		voxels[index(2, 0, 1)] = 2;
+		voxels[index(2, 1, 0)] = 2;
+		voxels[index(2, 1, 1)] = 2;
+
+		voxels[index(3, 0, 0)] = 3;
+		voxels[index(3, 0, 1)] = 3;
+		voxels[index(3, 1, 0)] = 3;
+		voxels[index(3, 1, 1)] = 3;
+
+		buildLevels();
+	}
+
+	VoxelVolume(const VoxelVolume&) = delete;
+	VoxelVolume& operator=(const VoxelVolume&) = delete;
+
+	~VoxelVolume() {
+		delete[] voxels;
+	}
+
+	inline size_t get(const size_t x, const size_t y, const size_t z) const {
+		return voxels[index(x, y, z)];
+	}
+
+	inline size_t numLevels() const { return 1 + levels.size(); }
+
+	inline size_t size(const int axis) const { return axis == 0 ? width : axis == 1 ? height : depth; }
+	inline const vec3& voxelSize() const { return scale; }
+	inline const vec3& origin() const { return aabb._min; }
+	inline size_t numValues() const { return materials.size(); }
+	inline material_id material(const size_t value) const { return materials[value - 1]; }
+
+	inline size_t numChunks(const int axis) const { return (size(axis) + CHUNK_SIZE - 1) / CHUNK_SIZE; }
+	inline uint32_t chunkRevision(const size_t cx, const size_t cy, const size_t cz) const {
+		return chunkRevisions[(cz * numChunks(1) + cy) * numChunks(0) + cx];
+	}
+
+	// Also updates the coarser levels and, after collectLights, the light list (the voxel and its
+	// neighbours' exposed faces)
+	inline void set(const size_t x, const size_t y, const size_t z, const size_t value) {
+		voxels[index(x, y, z)] = value;
+		updateLevels(x, y, z);
+		touchChunks(x, y, z);
+
+		if(lights) {
+			refreshLight(x, y, z);
+			if(x > 0) refreshLight(x - 1, y, z);
+			if(y > 0) refreshLight(x, y - 1, z);
+			if(z > 0) refreshLight(x, y, z - 1);
+			if(x + 1 < width) refreshLight(x + 1, y, z);
+			if(y + 1 < height) refreshLight(x, y + 1, z);
+			if(z + 1 < depth) refreshLight(x, y, z + 1);
+		}
+	}
+
+	// Replaces every voxel, values[(z * height + y) * width + x]: set() without the per-voxel
+	// bookkeeping, the coarser levels are rebuilt once (what loading a volume wants). Without
+	// `rebuildLevels` they're left to buildLevels / restoreLevels.
+	template<typename T>
+	void assign(const T *const values, const bool rebuildLevels = true) {
+		for(size_t z = 0; z < depth; z++)
+			for(size_t y = 0; y < height; y++)
+				for(size_t x = 0; x < width; x++)
+					voxels[index(x, y, z)] = (size_t)values[(z * height + y) * width + x];
+		for(uint32_t& revision : chunkRevisions)
+			revision++;
+
+		if(lights)
+			for(size_t z = 0; z < depth; z++)
+				for(size_t y = 0; y < height; y++)
+					for(size_t x = 0; x < width; x++)
+						refreshLight(x, y, z);
+
+		if(rebuildLevels)
+			buildLevels();
+	}
+
+	// The padded voxel grid (see index) as stored, e.g. to hash it
+	inline const size_t* data() const { return voxels; }
+	inline size_t dataSize() const { return paddedSize(width, height, depth); }
+
+	// Padded cells of the coarser level l (1 .. numLevels() - 1), e.g. to cache them
+	inline const std::vector<size_t>& levelCells(const uint32_t l) const { return levels[l - 1].cells; }
+
+	// Emitter flags the levels depend on: per voxel value, empty before collectLights
+	inline const std::vector<bool>& emitters() const { return emissive; }
+
+	// Puts back the levelCells of a volume with the same voxels and emitters instead of building them;
+	// cells[l - 1] holds level l. False (and the levels rebuilt) if they don't fit this volume: wrong
+	// sizes, padding that isn't OUTSIDE or cells that aren't a voxel value (possibly with HAS_EMITTER).
+	bool restoreLevels(const std::vector<std::pair<const size_t*, size_t>>& cells) {
+		allocateLevels();
+		bool fits = cells.size() == levels.size();
+		for(size_t l = 0; fits && l < levels.size(); l++)
+			fits = cells[l].second == levels[l].cells.size();
+		for(size_t l = 0; fits && l < levels.size(); l++) {
+			const Grid g = grid((uint32_t)l + 1);
+			for(size_t i = 0; fits && i < cells[l].second; i++) {
+				const size_t cell = cells[l].first[i];
+				fits = g.inside(g.cell(i)) ? (cell & ~HAS_EMITTER) <= numValues() : cell == OUTSIDE;
+			}
+		}
+		if(!fits) {
+			buildLevels();
+			return false;
+		}
+
+		for(size_t l = 0; l < levels.size(); l++)
+			std::copy(cells[l].first, cells[l].first + cells[l].second, levels[l].cells.begin());
+		emittersFlagged = std::find(emissive.begin(), emissive.end(), true) != emissive.end();
+		return true;
+	}
+
+	// Summarizes every coarser level from scratch
+	void buildLevels() {
+		allocateLevels();
+		for(uint32_t l = 1; l <= levels.size(); l++) {
+			Level& level = levels[l - 1];
+			const Grid g = grid(l);
+			for(int z = 0; z < (int)level.depth; z++)
+				for(int y = 0; y < (int)level.height; y++)
+					for(int x = 0; x < (int)level.width; x++)
+						level.cells[g.index(ivec3(x, y, z))] = summarize(l, ivec3(x, y, z));
+		}
+		emittersFlagged = std::find(emissive.begin(), emissive.end(), true) != emissive.end();
+	}
+
+	virtual bool hit(const Ray& r, const real t_min, const real t_max, hit_record& rec) const override {
+		Surface surface;
+		if(!march(r, t_min, t_max, surface))
+			return false;
+
+		// rec.front_face = true;
+		// rec.material = materials[mat - 1];
+
+		const size_t mat = surface.mat, prevMat = surface.prevMat;
+		rec.front_face = mat != 0;
+		rec.material = (mat != 0) ? materials[mat - 1] : materials[prevMat - 1];
+
+		rec.t = surface.t;
+		rec.p = r.at(surface.t);
+		rec.normal = vec3(surface.normal.x(), surface.normal.y(), surface.normal.z());
+
+		rec.light_id = NO_LIGHT;
+		if(rec.front_face && mat < emissive.size() && emissive[mat]) { // always at full resolution
+			const auto light = lightIds.find(index(surface.block.x(), surface.block.y(), surface.block.z()));
+			if(light != lightIds.end())
+				rec.light_id = light->second;
+		}
+		return true;
+	}
+
+	// Stops at the first material boundary, no record
+	virtual bool occluded(const Ray& r, const real t_max) const override {
+		Surface surface;
+		return march(r, RAY_T_MIN, t_max, surface);
+	}
+
+	virtual bool boundingBox(AABB& box) const override {
+		box = aabb;
+		return true;
+	}
+
+	// One box light per emissive voxel that has a face towards a different voxel value,
+	// its emission cone bounding the normals of those faces. The volume keeps feeding edits
+	// to this list (collecting into another one moves it there).
+	virtual void collectLights(LightList& lightList, const MaterialTable& materialTable) override {
+		emissive.assign(materials.size() + 1, false);
+		emission.assign(materials.size() + 1, color(0.f));
+		for(size_t v = 1; v <= materials.size(); v++) {
+			emission[v] = materialTable.emission(materials[v - 1]);
+			emissive[v] = emission[v].x() + emission[v].y() + emission[v].z() > 0;
+		}
+
+		lights = &lightList;
+		lightIds.clear();
+		for(size_t z = 0; z < depth; z++)
+			for(size_t y = 0; y < height; y++)
+				for(size_t x = 0; x < width; x++)
+					refreshLight(x, y, z);
+
+		if(emittersFlagged || std::find(emissive.begin(), emissive.end(), true) != emissive.end())
+			buildLevels(); // emitter flags
+	}
+
+private:
+	// The voxel's chunk and the ones sharing a face with it
+	void touchChunks(const size_t x, const size_t y, const size_t z) {
+		const size_t c[3] = { x / CHUNK_SIZE, y / CHUNK_SIZE, z / CHUNK_SIZE };
+		const size_t p[3] = { x, y, z };
+		const auto touch = [&](const int axis, const int offset) {
+			size_t n[3] = { c[0], c[1], c[2] };
+			n[axis] += offset;
+			chunkRevisions[(n[2] * numChunks(1) + n[1]) * numChunks(0) + n[0]]++;
+		};
+
+		touch(0, 0);
+		for(int axis = 0; axis < 3; axis++) {
+			if(p[axis] % CHUNK_SIZE == 0 && c[axis] > 0)
+				touch(axis, -1);
+			if(p[axis] % CHUNK_SIZE == CHUNK_SIZE - 1 && c[axis] + 1 < numChunks(axis))
+				touch(axis, 1);
+		}
+	}
+
+	// Sizes the coarser levels, padded, cells unset
+	void allocateLevels() {
+		levels.clear();
+		for(uint32_t l = 1; l <= MAX_LEVELS; l++) {
+			const Grid below = grid(l - 1);
+			if(below.width <= 1 && below.height <= 1 && below.depth <= 1)
+				break;
+
+			levels.push_back(Level{ (below.width + 1) / 2, (below.height + 1) / 2, (below.depth + 1) / 2, {} });
+			Level& level = levels.back();
+			level.cells.resize(paddedSize(level.width, level.height, level.depth));
+			pad(level.cells.data(), level.width, level.height, level.depth);
+		}
+	}
+
+	// Recomputes the cells covering voxel (x, y, z), up to the first level that doesn't change
+	void updateLevels(size_t x, size_t y, size_t z) {
+		for(uint32_t l = 1; l <= levels.size(); l++) {
+			x /= 2;
+			y /= 2;
+			z /= 2;
+			const ivec3 c((int)x, (int)y, (int)z);
+			size_t& cell = levels[l - 1].cells[grid(l).index(c)];
+			const size_t value = summarize(l, c);
+			if(cell == value)
+				return;
+			cell = value;
+		}
+	}
+
+	// Cell c of level l from its (up to) 8 children. Solid if at least 2 of them are: with half, thin
+	// walls and pillars off the 2^l grid vanish and light leaks through them; with any, everything
+	// thickens. Its value is the one with the most faces towards air children (what's visible of the
+	// block, e.g. the grass on top of a slope rather than the dirt of its steps) or, in a full block,
+	// the most common one. Plus HAS_EMITTER if any child is or has an emitter.
+	size_t summarize(const uint32_t l, const ivec3& c) const {
+		const Grid below = grid(l - 1);
+		size_t children[8];
+		size_t flags = 0;
+		int solid = 0;
+		for(int i = 0; i < 8; i++) {
+			const ivec3 child(c.x() * 2 + (i & 1), c.y() * 2 + ((i >> 1) & 1), c.z() * 2 + (i >> 2));
+			const size_t cell = below.inside(child) ? below[child] : 0;
+			if(l == 1 ? cell < emissive.size() && emissive[cell] : (cell & HAS_EMITTER) != 0)
+				flags = HAS_EMITTER;
+			children[i] = cell & ~HAS_EMITTER;
+			solid += children[i] != 0;
+		}
+		if(solid < 2)
+			return flags;
+
+		// face neighbours within the block differ in one index bit
+		int weight[8];
+		bool exposed = false;
+		for(int i = 0; i < 8; i++) {
+			weight[i] = children[i] != 0 ? (children[i ^ 1] == 0) + (children[i ^ 2] == 0) + (children[i ^ 4] == 0) : 0;
+			exposed |= weight[i] > 0;
+		}
+
+		size_t best = 0;
+		int bestWeight = 0;
+		for(int i = 0; i < 8; i++) {
+			int total = 0;
+			for(int j = 0; j < 8; j++)
+				if(children[j] == children[i])
+					total += exposed ? weight[j] : 1;
+			if(children[i] != 0 && total > bestWeight) {
+				best = children[i];
+				bestWeight = total;
+			}
+		}
+		return best | flags;
+	}
+
+	// Adds, updates or removes the light of one voxel
+	void refreshLight(const size_t x, const size_t y, const size_t z) {
+		const size_t i = index(x, y, z);
+		const size_t v = voxels[i];
+		const auto existing = lightIds.find(i);
+
+		Light light;
+		if(v < emissive.size() && emissive[v] && emitter(x, y, z, v, light)) {
+			if(existing != lightIds.end())
+				lights->update(existing->second, light);
+			else
+				lightIds[i] = lights->add(light);
+		} else if(existing != lightIds.end()) {
+			lights->remove(existing->second);
+			lightIds.erase(existing);
+		}
+	}
+
+	// Box light of voxel (x, y, z) with value v, emitting from the faces that border a different
+	// value (or the outside); false if there are none
+	bool emitter(const size_t x, const size_t y, const size_t z, const size_t v, Light& light) const {
+		const auto differs = [&](const int64_t nx, const int64_t ny, const int64_t nz) {
+			if(nx < 0 || ny < 0 || nz < 0 || nx >= (int64_t)width || ny >= (int64_t)height || nz >= (int64_t)depth)
+				return true;
+			return voxels[index(nx, ny, nz)] != v;
+		};
+
+		uint8_t faces = 0;
+		for(int f = 0; f < 6; f++) {
+			int64_t n[3] = { (int64_t)x, (int64_t)y, (int64_t)z };
+			n[f / 2] += f % 2 ? 1 : -1;
+			if(differs(n[0], n[1], n[2]))
+				faces |= 1 << f;
+		}
+		if(faces == 0)
+			return false;
+
+		const vec3 lo = aabb._min + vec3(x, y, z) * scale;
+		light = Light::box(lo, lo + scale, emission[v], faces);
+		return true;
+	}
+
+	// A boundary between two voxel values found by march: mat is the value of block, prevMat that of
+	// the cell the ray came from (block + normal)
+	struct Surface {
+		real t;
+		ivec3 block, normal;
+		size_t mat, prevMat;
+	};
+
+	// DDA until the first boundary between different voxel values (within [t_min, t_max]). A ray
+	// entering from outside reports the entry face of a solid first voxel. In empty space the DDA moves
+	// up to coarser levels as the ray cone widens (see maxLod), and back to full resolution at cells
+	// with emitters.
+	bool march(const Ray& r, const real t_min, const real t_max, Surface& surface) const {
+		ivec3 entryNormal;
+		real tEntry;
+		if(!aabb.intersects(RayPrecomp(r), entryNormal, tEntry) || tEntry > t_max)
+			return false;
+
+		const real INF = 1. / 0.;
+		const real dirLength = r.direction().length<real>();
+		const real voxelSize = std::min<real>(std::min<real>(scale.x(), scale.y()), scale.z());
+
+		// start a hundredth of a voxel inside the volume (or off the surface the ray starts on)
+		real tStart = std::max<real>(tEntry, t_min) + real(.01) * voxelSize / dirLength;
+
+		// the entry point is on the box, but may round to a cell outside
+		const auto clampToGrid = [](ivec3 p, const Grid& g) {
+			const int size[3] = { (int)g.width, (int)g.height, (int)g.depth };
+			for(uint8_t dim = 0; dim < 3; dim++)
+				p[dim] = std::clamp(p[dim], 0, size[dim] - 1);
+			return p;
+		};
+		bool clampStart = tEntry >= t_min;
+
+		if(tEntry >= t_min) {
+			const ivec3 first = clampToGrid(floor((r.at(tStart) - aabb._min) / scale), grid(0));
+			const size_t mat = voxels[index(first.x(), first.y(), first.z())];
+			if(mat != 0) {
+				surface = Surface{ tEntry, first, entryNormal, mat, 0 };
+				return true;
+			}
+		}
+
+		// ray t from which the cone is wide enough for level l
+		const auto lodStart = [&](const uint32_t l) -> real {
+			const real width = lodThreshold * voxelSize * real(1 << l);
+			if(r.coneSpread <= 0)
+				return r.coneWidth >= width ? -INF : INF;
+			return (width - r.coneWidth) / (r.coneSpread * dirLength);
+		};
+		const uint32_t maxLevel = std::min<uint32_t>(maxLod, (uint32_t)levels.size());
+
+		// the coarsest allowed level whose cell at the start is air
+		uint32_t level = 0;
+		while(level < maxLevel && tStart >= lodStart(level + 1)) {
+			const Grid coarser = grid(level + 1);
+			const ivec3 cell = floor((r.at(tStart) - aabb._min) / (scale * real(1 << (level + 1))));
+			if(coarser.inside(cell) && coarser[cell] != 0) // solid or has emitters
+				break;
+			level++;
+		}
+
+		real tFullResolution = -INF; // stay at level 0 until here (the far side of a cell with emitters)
+		bool refined = false; // just moved down to level 0, at the boundary of a cell with emitters
+		real tBoundary = 0; // that boundary
+		ivec3 boundaryNormal(0);
+		for(;;) {
+			const Grid g = grid(level);
+			const vec3 cellScale = scale * real(1 << level);
+			const vec3 viewPos = (r.at(tStart) - aabb._min) / cellScale;
+			const vec3 viewDir = r.direction() / cellScale;
+			const real tCoarser = level < maxLevel ? std::max(lodStart(level + 1), tFullResolution) : INF;
+
+			ivec3 start = floor(viewPos);
+			if(clampStart) {
+				start = clampToGrid(start, g);
+				clampStart = false;
+			}
+
+			// the value the ray travels through; its start cell is not tested. The current cell is
+			// only tracked as its index i.
+			size_t i = g.index(start);
+			const size_t prevMat = g.cells[i];
+			if(prevMat == OUTSIDE) // started on the volume's surface, leaving it
+				return false;
+
+			// the restart before the boundary rounded into a solid voxel behind it: the ray enters there
+			if(refined && prevMat != 0) {
+				surface = Surface{ tBoundary, start, boundaryNormal, prevMat, 0 };
+				return true;
+			}
+			refined = false;
+
+			// per axis: cell and index steps, ray t between boundaries, ray t to the next boundary
+			const ptrdiff_t strides[3] = { 1, (ptrdiff_t)g.width + 2, ((ptrdiff_t)g.width + 2) * ((ptrdiff_t)g.height + 2) };
+			int step[3];
+			ptrdiff_t indexStep[3];
+			real deltaT[3], sideDist[3];
+			for(uint8_t dim = 0; dim < 3; dim++) {
+				step[dim] = viewDir[dim] < 0 ? -1 : 1;
+				indexStep[dim] = step[dim] * strides[dim];
+				deltaT[dim] = std::abs(1 / viewDir[dim]);
+				sideDist[dim] = (viewDir[dim] < 0)
+					?  (viewPos[dim] - start[dim]) * deltaT[dim]
+					: -(viewPos[dim] - start[dim] - 1) * deltaT[dim];
+			}
+
+			for(;;) {
+				RT_COUNT(DDASteps);
+
+				// axis of the nearest boundary as a one-hot comparison mask (ties go to the lower axis);
+				// all three axes are updated through it, so the state stays in registers
+				const bool mx = sideDist[0] <= sideDist[1] && sideDist[0] <= sideDist[2];
+				const bool my = !mx && sideDist[1] <= sideDist[2];
+				const bool mz = !mx && !my;
+
+				const real t = tStart + std::min<real>(std::min<real>(sideDist[0], sideDist[1]), sideDist[2]);
+				if(t > t_max)
+					return false;
+
+				sideDist[0] += mx ? deltaT[0] : 0;
+				sideDist[1] += my ? deltaT[1] : 0;
+				sideDist[2] += mz ? deltaT[2] : 0;
+				i += mx ? indexStep[0] : my ? indexStep[1] : indexStep[2];
+
+				// the only test per step: padding and emitter flags differ from any value travelled through
+				const size_t mat = g.cells[i];
+				if(mat != prevMat) {
+					if(mat == OUTSIDE)
+						return false;
+
+					const int side = mx ? 0 : my ? 1 : 2;
+					ivec3 normal(0);
+					normal[side] = -step[side];
+
+					// emitters below: continue at full resolution from just before this cell to its far side
+					if(mat & HAS_EMITTER) {
+						tFullResolution = tStart + std::min<real>(std::min<real>(sideDist[0], sideDist[1]), sideDist[2]);
+						tStart = t - real(.01) * voxelSize / dirLength;
+						level = 0;
+						refined = true;
+						tBoundary = t;
+						boundaryNormal = normal;
+						break;
+					}
+
+					surface = Surface{ t, g.cell(i), normal, mat, prevMat };
+					return true;
+				}
+
+				// wide enough for the next level and its cell here is empty: continue there, from the
+				// middle of this cell so the new DDA starts in that empty cell
+				if(t >= tCoarser && mat == 0) {
+					const ivec3 block = g.cell(i);
+					const ivec3 parent(block.x() >> 1, block.y() >> 1, block.z() >> 1);
+					if(grid(level + 1)[parent] == 0) {
+						const real tNext = tStart + std::min<real>(std::min<real>(sideDist[0], sideDist[1]), sideDist[2]);
+						tStart = (t + tNext) / 2;
+						level++;
+						break;
+					}
+				}
+			}
+		}
+	}
+};
@@ -1,10 +1,45 @@
-#pragma once
-
-#include "RayTracing/vec.h"
-#include "RayTracing/Ray.h"
-#include "RayTracing/hit_record.h"
-
-class hittable {
-public:
-	virtual bool hit(const Ray& r, const double t_min, const double t_max, hit_record& rec) const = 0;
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/Ray.h"
+#include "RayTracing/AABB.h"
+#include "RayTracing/hit_record.h"
+
+class LightList;
+class MaterialTable;
+
+// Closest distance accepted along secondary rays (avoids re-hitting the surface they start on)
+constexpr real RAY_T_MIN = .00001f;
+
+class hittable {
+public:
+	virtual bool hit(const Ray& r, const real t_min, const real t_max, hit_record& rec) const = 0;
+
+	// Any-hit query: is there an intersection in [RAY_T_MIN, t_max]? Stops at the first one found.
+	// Falls back to closest-hit for hittables without a dedicated path.
+	virtual bool occluded(const Ray& r, const real t_max) const {
+		hit_record rec;
+		return hit(r, RAY_T_MIN, t_max, rec);
+	}
+
+	// Batched any-hit: sets occluded[i] for rays that are blocked; entries that are already set are skipped
+	virtual void occludedBatch(const Ray *const rays, const real *const t_max, uint8_t *const occluded, const size_t count) const {
+		for(size_t i = 0; i < count; i++)
+			if(!occluded[i])
+				occluded[i] = this->occluded(rays[i], t_max[i]);
+	}
+
+	// Box around everything hit() can report; false if there's none (such objects are tested by every ray)
+	virtual bool boundingBox(AABB& box) const { return false; }
+
+	// Registers the emissive surfaces for light sampling; they report the returned ids in hit_record::light_id
+	virtual void collectLights(LightList& lights, const MaterialTable& materials) { }
+
+	// Animated objects: moves them to the shutter interval [open, close] (scene time). From then on
+	// boundingBox covers their motion within it and the lights they collected sit where they are at
+	// its middle. Returns true if the object moves in it, i.e. its box may have changed.
+	virtual bool animate(const real open, const real close, LightList& lights) { return false; }
 };
\ No newline at end of file
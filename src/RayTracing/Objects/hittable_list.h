@@ -1,37 +1,190 @@
-#pragma once
-
-#include <memory>
-#include <vector>
-
-#include "hittable.h"
-#include "RayTracing/Ray.h"
-
-class hittable_list : public hittable {
-	public:
-		std::vector<std::shared_ptr<hittable>> objects;
-
-	public:
-		hittable_list() {}
-		hittable_list(std::shared_ptr<hittable> object) { add(object); }
-
-		void clear() { objects.clear(); }
-		void add(std::shared_ptr<hittable> object) { objects.push_back(object); }
-
-		virtual bool hit(const Ray& r, const double t_min, const double t_max, hit_record& rec) const override;
-};
-
-bool hittable_list::hit(const Ray& r, const double t_min, const double t_max, hit_record& rec) const {
-	hit_record temp_rec;
-	bool hit_anything = false;
-	auto closest_so_far = t_max;
-
-	for (const auto& object : objects) {
-		if (object->hit(r, t_min, closest_so_far, temp_rec)) {
-			hit_anything = true;
-			closest_so_far = temp_rec.t;
-			rec = temp_rec;
-		}
-	}
-
-	return hit_anything;
-}
\ No newline at end of file
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <utility>
+
+#include "hittable.h"
+#include "RayTracing/Ray.h"
+#include "RayTracing/AABB.h"
+#include "RayTracing/BVH.h"
+
+#include "RayTracing/Memory/Arena.h"
+
+// Until build() every ray tests every object in turn. build() puts the objects with a bounding box
+// into a BVH, so a ray only visits the ones along it, nearest first; add / clear drop it again.
+// Objects are either shared (add) or owned by the list's arena (emplace): those sit next to each
+// other in memory and are freed together with the list.
+class hittable_list : public hittable {
+	public:
+		std::vector<std::shared_ptr<hittable>> objects;
+
+	private:
+		Arena arena;
+		BVH bvh;
+		std::vector<const hittable*> bounded; // BVH primitive -> object
+		std::vector<const hittable*> unbounded; // tested by every ray
+		bool built = false;
+
+	public:
+		hittable_list() {}
+		hittable_list(std::shared_ptr<hittable> object) { add(object); }
+
+		void clear() { objects.clear(); arena.reset(); unbuild(); }
+		void add(std::shared_ptr<hittable> object) { objects.push_back(object); unbuild(); }
+
+		// Constructs the object in the arena; its entry in `objects` doesn't own it (no control block,
+		// no reference count) and is only valid until clear() or the list's destruction
+		template<typename T, typename... Args>
+		T& emplace(Args&&... args) {
+			T *const object = arena.create<T>(std::forward<Args>(args)...);
+			objects.push_back(std::shared_ptr<hittable>(std::shared_ptr<hittable>(), object));
+			unbuild();
+			return *object;
+		}
+
+		void build();
+		// After the bounded objects moved or changed shape: new bounds, same tree (see BVH::refit)
+		void refit();
+		inline bool isBuilt() const { return built; }
+		inline const BVH& hierarchy() const { return bvh; }
+
+		virtual bool hit(const Ray& r, const real t_min, const real t_max, hit_record& rec) const override;
+		virtual bool occluded(const Ray& r, const real t_max) const override;
+		virtual void occludedBatch(const Ray *const rays, const real *const t_max, uint8_t *const occluded, const size_t count) const override;
+		virtual bool boundingBox(AABB& box) const override;
+		virtual void collectLights(LightList& lights, const MaterialTable& materials) override;
+		// Every object, then a refit of the BVH if any of them moves (once per frame, between frames)
+		virtual bool animate(const real open, const real close, LightList& lights) override;
+
+	private:
+		void unbuild() {
+			bvh.clear();
+			bounded.clear();
+			unbounded.clear();
+			built = false;
+		}
+};
+
+void hittable_list::build() {
+	unbuild();
+
+	std::vector<AABB> boxes;
+	for (const auto& object : objects) {
+		AABB box;
+		if (object->boundingBox(box)) {
+			boxes.push_back(box);
+			bounded.push_back(object.get());
+		} else {
+			unbounded.push_back(object.get());
+		}
+	}
+
+	bvh.build(boxes);
+	built = true;
+}
+
+void hittable_list::refit() {
+	if (!built)
+		return build();
+
+	std::vector<AABB> boxes(bounded.size());
+	for (size_t i = 0; i < bounded.size(); i++) {
+		if (!bounded[i]->boundingBox(boxes[i]))
+			return build(); // lost its bounds
+	}
+	bvh.refit(boxes);
+}
+
+bool hittable_list::hit(const Ray& r, const real t_min, const real t_max, hit_record& rec) const {
+	hit_record temp_rec;
+	bool hit_anything = false;
+	auto closest_so_far = t_max;
+
+	if (built) {
+		for (const hittable* object : unbounded) {
+			if (object->hit(r, t_min, closest_so_far, temp_rec)) {
+				hit_anything = true;
+				closest_so_far = temp_rec.t;
+				rec = temp_rec;
+			}
+		}
+
+		return bvh.closest(r, closest_so_far, [&](const uint32_t i, real& t) {
+			if (!bounded[i]->hit(r, t_min, t, temp_rec))
+				return false;
+			t = temp_rec.t;
+			rec = temp_rec;
+			return true;
+		}) || hit_anything;
+	}
+
+	for (const auto& object : objects) {
+		if (object->hit(r, t_min, closest_so_far, temp_rec)) {
+			hit_anything = true;
+			closest_so_far = temp_rec.t;
+			rec = temp_rec;
+		}
+	}
+
+	return hit_anything;
+}
+
+bool hittable_list::occluded(const Ray& r, const real t_max) const {
+	if (built) {
+		for (const hittable* object : unbounded)
+			if (object->occluded(r, t_max))
+				return true;
+
+		return bvh.any(r, t_max, [&](const uint32_t i) {
+			return bounded[i]->occluded(r, t_max);
+		});
+	}
+
+	for (const auto& object : objects)
+		if (object->occluded(r, t_max))
+			return true;
+
+	return false;
+}
+
+// Unbuilt object-major: each object sees the whole batch (minus rays already blocked) at once.
+// Built, each ray only visits the objects along it.
+void hittable_list::occludedBatch(const Ray *const rays, const real *const t_max, uint8_t *const occluded, const size_t count) const {
+	if (built) {
+		for (size_t i = 0; i < count; i++)
+			if (!occluded[i])
+				occluded[i] = this->occluded(rays[i], t_max[i]);
+		return;
+	}
+
+	for (const auto& object : objects)
+		object->occludedBatch(rays, t_max, occluded, count);
+}
+
+bool hittable_list::boundingBox(AABB& box) const {
+	if (objects.empty())
+		return false;
+
+	for (size_t i = 0; i < objects.size(); i++) {
+		AABB objectBox;
+		if (!objects[i]->boundingBox(objectBox))
+			return false;
+		box = i == 0 ? objectBox : AABB::surrounding(box, objectBox);
+	}
+	return true;
+}
+
+void hittable_list::collectLights(LightList& lights, const MaterialTable& materials) {
+	for (const auto& object : objects)
+		object->collectLights(lights, materials);
+}
+
+bool hittable_list::animate(const real open, const real close, LightList& lights) {
+	bool moved = false;
+	for (const auto& object : objects)
+		moved |= object->animate(open, close, lights);
+	if (moved && built)
+		refit();
+	return moved;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <ostream>
+#include <algorithm>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/color.h"
+
+#include "RayTracing/Texture/fTexture.h"
+
+#include "RayTracing/Profiling/Profiler.h"
+
+// What the heatmap debug view shows per pixel instead of radiance (averaged per sample).
+// The counter modes read the profiler's per-thread counters, so they stay at 0 unless
+// RT_PROFILING is defined; Nanoseconds always works.
+enum class HeatmapMode : uint8_t {
+	Off,
+	DDASteps,
+	BVHNodes,
+	TriangleTests,
+	Bounces,
+	Nanoseconds,
+	Count
+};
+
+inline const char* heatmapModeName(const HeatmapMode mode) {
+	static constexpr const char* NAMES[(size_t)HeatmapMode::Count] = { "off", "dda_steps", "bvh_nodes", "triangle_tests", "bounces", "nanoseconds" };
+	return NAMES[(size_t)mode];
+}
+
+// Measures the cost of the work done on the calling thread between construction and stop()
+class CostProbe {
+	const HeatmapMode mode;
+	const uint64_t start;
+
+	static uint64_t read(const HeatmapMode mode) {
+		switch(mode) {
+			case HeatmapMode::DDASteps: return Profiler::thread().counters[(size_t)ProfileCounter::DDASteps].load(std::memory_order_relaxed);
+			case HeatmapMode::BVHNodes: return Profiler::thread().counters[(size_t)ProfileCounter::BVHNodesVisited].load(std::memory_order_relaxed);
+			case HeatmapMode::TriangleTests: return Profiler::thread().counters[(size_t)ProfileCounter::TriangleTests].load(std::memory_order_relaxed);
+			case HeatmapMode::Bounces: return Profiler::thread().counters[(size_t)ProfileCounter::Bounces].load(std::memory_order_relaxed);
+			case HeatmapMode::Nanoseconds: return Profiler::now();
+			default: return 0;
+		}
+	}
+
+public:
+	CostProbe(const HeatmapMode mode): mode(mode), start(read(mode)) { }
+
+	inline uint64_t stop() const {
+		return read(mode) - start;
+	}
+};
+
+// Per-pixel cost buffer, shown as a false-color image normalized to the 99th percentile
+class CostHeatmap {
+public:
+	HeatmapMode mode = HeatmapMode::Off;
+	uint32_t width = 0, height = 0;
+	std::vector<float> cost;
+
+public:
+	CostHeatmap() { }
+	CostHeatmap(const uint32_t width, const uint32_t height) { resize(width, height); }
+
+	void resize(const uint32_t w, const uint32_t h) {
+		width = w;
+		height = h;
+		cost.assign((size_t)w * h, 0.f);
+	}
+
+	inline void store(const uint32_t x, const uint32_t y, const uint64_t pixelCost, const uint32_t samples) {
+		cost[(size_t)y * width + x] = (float)pixelCost / samples;
+	}
+
+	// Black -> blue -> cyan -> green -> yellow -> red -> white over t in [0, 1]
+	static color heatColor(const float t) {
+		static const color STOPS[] = {
+			color(0.f, 0.f, 0.f), color(0.f, 0.f, 1.f), color(0.f, 1.f, 1.f),
+			color(0.f, 1.f, 0.f), color(1.f, 1.f, 0.f), color(1.f, 0.f, 0.f), color(1.f, 1.f, 1.f)
+		};
+		constexpr int LAST = sizeof(STOPS) / sizeof(STOPS[0]) - 1;
+
+		const float s = std::clamp(t, 0.f, 1.f) * LAST;
+		const int i = std::min((int)s, LAST - 1);
+		const float f = s - i;
+		return STOPS[i] * (1.f - f) + STOPS[i + 1] * f;
+	}
+
+	float percentile(const float p) const {
+		if(cost.empty())
+			return 0.f;
+		std::vector<float> sorted = cost;
+		const size_t k = std::min(sorted.size() - 1, (size_t)(p * sorted.size()));
+		std::nth_element(sorted.begin(), sorted.begin() + k, sorted.end());
+		return sorted[k];
+	}
+
+	void resolve(fTexture& target) const {
+		const float p99 = percentile(.99f);
+		const float scale = p99 > 0 ? 1.f / p99 : 0.f;
+
+		for(uint32_t y = 0; y < height; y++)
+			for(uint32_t x = 0; x < width; x++)
+				target.pixels[y * target.width + x] = intColor(heatColor(cost[(size_t)y * width + x] * scale));
+	}
+
+	// Summary + equal-width bins from 0 to the maximum cost
+	void writeHistogram(std::ostream& out, const uint32_t numBins = 32) const {
+		if(cost.empty())
+			return;
+
+		double sum = 0;
+		float maxCost = 0;
+		for(const float c : cost) {
+			sum += c;
+			maxCost = std::max(maxCost, c);
+		}
+
+		std::vector<uint32_t> bins(numBins, 0);
+		for(const float c : cost)
+			bins[std::min<uint32_t>(numBins - 1, maxCost > 0 ? (uint32_t)(c / maxCost * numBins) : 0)]++;
+
+		out << "heatmap " << heatmapModeName(mode) << ": mean " << (sum / cost.size())
+			<< ", p50 " << percentile(.5f) << ", p99 " << percentile(.99f) << ", max " << maxCost << "\n";
+		for(uint32_t b = 0; b < numBins; b++)
+			out << "  [" << (maxCost * b / numBins) << ", " << (maxCost * (b + 1) / numBins) << "): " << bins[b] << "\n";
+	}
+};
@@ -0,0 +1,249 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+
+// Hot-path instrumentation: per-thread counters and scoped timing zones.
+// Everything below RT_COUNT / RT_ZONE compiles to nothing unless RT_PROFILING is defined
+// (CMake option RT_ENABLE_PROFILING).
+
+enum class ProfileCounter : uint32_t {
+	RaysCast,
+	Bounces,
+	DDASteps,
+	TriangleTests,
+	BVHNodesVisited,
+	SkyboxLookups,
+	ShadowRays,
+	Count
+};
+
+constexpr size_t NUM_PROFILE_COUNTERS = (size_t)ProfileCounter::Count;
+
+struct ProfileZoneEvent {
+	const char *name;
+	uint64_t start, end; // ns since the profiler epoch
+};
+
+// One slot per live thread. Only the owning thread writes, so counters are plain
+// relaxed load+store and events are published through numEvents (release). Events are a ring
+// buffer: the latest ones are kept, older ones are overwritten and counted as dropped.
+// Slots are recycled when a thread exits; their counters keep accumulating.
+// Threads beyond the slots share one more slot, which adds atomically and keeps no events.
+struct alignas(64) ProfileThreadSlot {
+	std::atomic_uint64_t counters[NUM_PROFILE_COUNTERS]{};
+	std::unique_ptr<ProfileZoneEvent[]> events;
+	std::atomic_uint64_t numEvents = 0; // zones recorded in total
+	std::atomic_uint64_t dropped = 0; // zones overwritten or not recorded
+	std::atomic_bool inUse = false;
+};
+
+struct ProfileFrameStats {
+	uint64_t counters[NUM_PROFILE_COUNTERS]{};
+	uint64_t droppedZones = 0;
+	double milliseconds = 0;
+	uint64_t timestamp = 0; // end of the frame, ns since the profiler epoch
+};
+
+class Profiler {
+public:
+	using ZoneEvent = ProfileZoneEvent;
+	using ThreadSlot = ProfileThreadSlot;
+	using FrameStats = ProfileFrameStats;
+
+	static constexpr size_t NUM_COUNTERS = NUM_PROFILE_COUNTERS;
+	static constexpr size_t MAX_THREADS = 256;
+	static constexpr uint32_t MAX_EVENTS_PER_THREAD = 1 << 16; // the latest are kept
+
+private:
+	static inline ThreadSlot slots[MAX_THREADS + 1]; // the last is shared by threads that found no free slot
+	static inline std::atomic_uint32_t numSlotsUsed = 0;
+	static inline const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	// main thread only
+	static inline uint64_t lastTotals[NUM_COUNTERS]{};
+	static inline uint64_t lastDropped = 0;
+	static inline uint64_t lastFrameEnd = 0;
+	static inline std::vector<FrameStats> frames;
+
+	struct SlotOwner {
+		ThreadSlot *slot;
+
+		SlotOwner(): slot(nullptr) {
+			size_t i = 0;
+			while(i < MAX_THREADS && slots[i].inUse.exchange(true, std::memory_order_acquire))
+				i++;
+			slot = &slots[i];
+			if(i < MAX_THREADS && !slot->events)
+				slot->events.reset(new ZoneEvent[MAX_EVENTS_PER_THREAD]);
+
+			uint32_t used = numSlotsUsed.load();
+			while(used < i + 1 && !numSlotsUsed.compare_exchange_weak(used, (uint32_t)i + 1));
+		}
+
+		~SlotOwner() {
+			if(!shared(*slot))
+				slot->inUse.store(false, std::memory_order_release);
+		}
+	};
+
+public:
+	static inline uint64_t now() {
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+	}
+
+	static inline bool shared(const ThreadSlot& slot) {
+		return &slot == &slots[MAX_THREADS];
+	}
+
+	static inline ThreadSlot& thread() {
+		thread_local static SlotOwner owner;
+		return *owner.slot;
+	}
+
+	static inline void count(const ProfileCounter counter, const uint64_t n = 1) {
+		ThreadSlot& slot = thread();
+		std::atomic_uint64_t& c = slot.counters[(size_t)counter];
+		if(shared(slot))
+			c.fetch_add(n, std::memory_order_relaxed);
+		else
+			c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	static inline void zone(const char *const name, const uint64_t start, const uint64_t end) {
+		ThreadSlot& slot = thread();
+		if(shared(slot)) {
+			slot.dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		const uint64_t i = slot.numEvents.load(std::memory_order_relaxed);
+		if(i >= MAX_EVENTS_PER_THREAD)
+			slot.dropped.store(slot.dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		slot.events[i % MAX_EVENTS_PER_THREAD] = ZoneEvent{ name, start, end };
+		slot.numEvents.store(i + 1, std::memory_order_release);
+	}
+
+	static const char* counterName(const ProfileCounter counter) {
+		static constexpr const char* NAMES[NUM_COUNTERS] = { "rays", "bounces", "dda_steps", "triangle_tests", "bvh_nodes", "skybox_lookups", "shadow_rays" };
+		return NAMES[(size_t)counter];
+	}
+
+	// Sums all thread slots (lock-free, relaxed reads)
+	static void totals(uint64_t (&out)[NUM_COUNTERS]) {
+		for(size_t c = 0; c < NUM_COUNTERS; c++)
+			out[c] = 0;
+		const uint32_t used = numSlotsUsed.load();
+		for(uint32_t i = 0; i < used; i++)
+			for(size_t c = 0; c < NUM_COUNTERS; c++)
+				out[c] += slots[i].counters[c].load(std::memory_order_relaxed);
+	}
+
+	// Zones that were overwritten, or recorded by threads without a slot of their own
+	static uint64_t droppedZones() {
+		uint64_t dropped = 0;
+		const uint32_t used = numSlotsUsed.load();
+		for(uint32_t i = 0; i < used; i++)
+			dropped += slots[i].dropped.load(std::memory_order_relaxed);
+		return dropped;
+	}
+
+	// Call once per frame from the main thread: counters since the previous call
+	static FrameStats endFrame() {
+		FrameStats stats;
+		stats.timestamp = now();
+		stats.milliseconds = (stats.timestamp - lastFrameEnd) / 1e6;
+		lastFrameEnd = stats.timestamp;
+
+		uint64_t current[NUM_COUNTERS];
+		totals(current);
+		for(size_t c = 0; c < NUM_COUNTERS; c++) {
+			stats.counters[c] = current[c] - lastTotals[c];
+			lastTotals[c] = current[c];
+		}
+		const uint64_t dropped = droppedZones();
+		stats.droppedZones = dropped - lastDropped;
+		lastDropped = dropped;
+
+		zone("frame", stats.timestamp - (uint64_t)(stats.milliseconds * 1e6), stats.timestamp);
+		frames.push_back(stats);
+		return stats;
+	}
+
+	static std::string statsLine(const FrameStats& stats) {
+		std::ostringstream line;
+		line.precision(3);
+		line << "frame " << stats.milliseconds << "ms";
+		for(size_t c = 0; c < NUM_COUNTERS; c++)
+			line << " | " << counterName((ProfileCounter)c) << " " << stats.counters[c];
+		if(stats.droppedZones)
+			line << " | dropped_zones " << stats.droppedZones;
+		return line.str();
+	}
+
+	// Chrome trace / Perfetto JSON: one track per thread slot (its latest zones), frame counters as
+	// counter tracks. Zones a thread overwrites while they are being written out are left out.
+	static bool writeChromeTrace(const std::string& path) {
+		std::ofstream out(path);
+		if(!out)
+			return false;
+
+		out << "{\"traceEvents\":[\n";
+		bool first = true;
+		const auto separator = [&]() -> const char* {
+			const char* s = first ? "" : ",\n";
+			first = false;
+			return s;
+		};
+
+		const uint32_t used = numSlotsUsed.load();
+		for(uint32_t t = 0; t < used && t < MAX_THREADS; t++) {
+			const uint64_t n = slots[t].numEvents.load(std::memory_order_acquire);
+			for(uint64_t e = n > MAX_EVENTS_PER_THREAD ? n - MAX_EVENTS_PER_THREAD : 0; e < n; e++) {
+				const ZoneEvent ev = slots[t].events[e % MAX_EVENTS_PER_THREAD];
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if(slots[t].numEvents.load(std::memory_order_relaxed) >= e + MAX_EVENTS_PER_THREAD)
+					continue;
+				out << separator() << "{\"name\":\"" << ev.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << t
+					<< ",\"ts\":" << (ev.start / 1000.) << ",\"dur\":" << ((ev.end - ev.start) / 1000.) << "}";
+			}
+		}
+
+		for(const FrameStats& frame : frames) {
+			out << separator() << "{\"name\":\"counters\",\"ph\":\"C\",\"pid\":1,\"ts\":" << (frame.timestamp / 1000.) << ",\"args\":{";
+			for(size_t c = 0; c < NUM_COUNTERS; c++)
+				out << (c ? "," : "") << "\"" << counterName((ProfileCounter)c) << "\":" << frame.counters[c];
+			out << ",\"dropped_zones\":" << frame.droppedZones << "}}";
+		}
+
+		out << "\n]}\n";
+		return (bool)out;
+	}
+};
+
+class ProfileZone {
+	const char *const name;
+	const uint64_t start;
+
+public:
+	ProfileZone(const char *const name): name(name), start(Profiler::now()) { }
+	~ProfileZone() { Profiler::zone(name, start, Profiler::now()); }
+};
+
+#define RT_PROFILE_CONCAT_(a, b) a##b
+#define RT_PROFILE_CONCAT(a, b) RT_PROFILE_CONCAT_(a, b)
+
+#ifdef RT_PROFILING
+	#define RT_COUNT(counter) Profiler::count(ProfileCounter::counter)
+	#define RT_COUNT_N(counter, n) Profiler::count(ProfileCounter::counter, (n))
+	#define RT_ZONE(name) const ProfileZone RT_PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+	#define RT_COUNT(counter) ((void)0)
+	#define RT_COUNT_N(counter, n) ((void)0)
+	#define RT_ZONE(name) ((void)0)
+#endif
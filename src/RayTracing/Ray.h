@@ -1,21 +1,58 @@
-#pragma once
-
-#include "vec.h"
-#include "color.h"
-
-class Ray {
-public:
-	point3 orig;
-	vec3 dir;
-
-public:
-	Ray(): orig{}, dir{} {}
-	Ray(const point3& origin, const vec3& direction): orig(origin), dir(direction) {}
-
-	point3 origin() const { return orig; }
-	vec3 direction() const { return dir; }
-
-	point3 at(double t) const {
-		return orig + t * dir;
-	}
-};
\ No newline at end of file
+#pragma once
+
+#include <cmath>
+
+#include "vec.h"
+#include "color.h"
+
+class Ray {
+public:
+	point3 orig;
+	vec3 dir;
+
+	// Ray cone (Akenine-Moller et al., "Texture Level of Detail Strategies for Real-Time Ray Tracing"):
+	// footprint width at orig and spread angle, both 0 for an infinitely thin ray
+	real coneWidth = 0, coneSpread = 0;
+
+	// Scene time the ray samples (motion blur: somewhere in the camera's shutter interval); rays
+	// spawned at a hit keep it
+	real time = 0;
+
+public:
+	Ray(): orig{}, dir{} {}
+	Ray(const point3& origin, const vec3& direction, const real coneWidth = 0, const real coneSpread = 0, const real time = 0):
+		orig(origin), dir(direction), coneWidth(coneWidth), coneSpread(coneSpread), time(time) {}
+
+	point3 origin() const { return orig; }
+	vec3 direction() const { return dir; }
+
+	point3 at(const real t) const {
+		return orig + t * dir;
+	}
+
+	// Footprint width where the cone reaches p
+	real widthAt(const point3& p) const {
+		return coneWidth + coneSpread * (p - orig).length<real>();
+	}
+};
+
+// Per-ray constants for slab tests, computed once and reused for every box the ray visits
+struct RayPrecomp {
+	vec3 invDir;
+	vec3 orgInvDir; // orig * invDir, so a slab distance is one multiply-subtract
+	int sign[3]; // 1 where the direction is negative (index of the near plane)
+
+	RayPrecomp(const Ray& r) {
+		// zero components become tiny instead: inf * 0 would give NaN in the multiply-subtract form
+		constexpr real EPS = 1e-20f;
+		vec3 d = r.dir;
+		for(int i = 0; i < 3; i++)
+			if(std::abs(d[i]) < EPS)
+				d[i] = std::copysign(EPS, d[i]);
+
+		invDir = 1 / d;
+		orgInvDir = r.orig * invDir;
+		for(int i = 0; i < 3; i++)
+			sign[i] = d[i] < 0;
+	}
+};
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+#include "RayTracing/vec.h"
+
+// What pixelColor / the integrators compute per sample: the full path tracer or one of the
+// cheap preview modes, which only look at the primary hit (plus a few short rays)
+enum class RenderMode : uint8_t {
+	Path,
+	Direct, // emission + one light sample + one BSDF sample, no indirect bounces
+	AmbientOcclusion, // albedo * fraction of PreviewSettings::aoRays that escape within aoRadius
+	Albedo, // lit by a head light, so shapes stay readable
+	Normal,
+	Count
+};
+
+inline const char* renderModeName(const RenderMode mode) {
+	static constexpr const char* NAMES[(size_t)RenderMode::Count] = { "path", "direct", "ambient_occlusion", "albedo", "normal" };
+	return NAMES[(size_t)mode];
+}
+
+struct PreviewSettings {
+	uint32_t aoRays = 4;
+	real aoRadius = 2;
+};
@@ -1,37 +1,76 @@
-#include "fTexture.h"
-
-void swap(auto& a, auto& b) {
-	const auto tmp = a;
-	a = b;
-	b = tmp;
-}
-
-fTexture::fTexture():
-		pixels(nullptr),
-		width(0),
-		height(0) {
-}
-
-fTexture::fTexture(const uint32_t width, const uint32_t height):
-		pixels(new uint32_t[width * height]),
-		width(width),
-		height(height) {
-}
-
-fTexture::fTexture(fTexture&& other): fTexture() {
-	swap(pixels, other.pixels);
-	swap(width, other.width);
-	swap(height, other.height);
-}
-
-fTexture& fTexture::operator=(fTexture&& other) {
-	if(this == &other) return *this;
-	swap(pixels, other.pixels);
-	swap(width, other.width);
-	swap(height, other.height);
-	return *this;
-}
-
-fTexture::~fTexture() {
-	delete[] pixels;
+#include "fTexture.h"
+
+void swap(auto& a, auto& b) {
+	const auto tmp = a;
+	a = b;
+	b = tmp;
+}
+
+fTexture::fTexture():
+		pixels(nullptr),
+		width(0),
+		height(0) {
+}
+
+fTexture::fTexture(const uint32_t width, const uint32_t height):
+		pixels(new uint32_t[width * height]),
+		width(width),
+		height(height) {
+}
+
+fTexture::fTexture(fTexture&& other): fTexture() {
+	swap(pixels, other.pixels);
+	swap(width, other.width);
+	swap(height, other.height);
+	mips.swap(other.mips);
+}
+
+fTexture& fTexture::operator=(fTexture&& other) {
+	if(this == &other) return *this;
+	swap(pixels, other.pixels);
+	swap(width, other.width);
+	swap(height, other.height);
+	mips.swap(other.mips);
+	return *this;
+}
+
+fTexture::~fTexture() {
+	delete[] pixels;
+}
+
+void fTexture::generateMips() {
+	mips.clear();
+
+	const fTexture *src = this;
+	while(src->width > 1 || src->height > 1) {
+		const int w = src->width > 1 ? src->width / 2 : 1;
+		const int h = src->height > 1 ? src->height / 2 : 1;
+		fTexture dst(w, h);
+
+		for(int y = 0; y < h; y++) {
+			for(int x = 0; x < w; x++) {
+				// odd sizes: the last row / column folds into the previous texel's footprint
+				const int x0 = x * src->width / w, x1 = (x + 1) * src->width / w;
+				const int y0 = y * src->height / h, y1 = (y + 1) * src->height / h;
+
+				uint32_t sum[4]{};
+				for(int sy = y0; sy < y1; sy++) {
+					for(int sx = x0; sx < x1; sx++) {
+						const uint32_t texel = src->pixels[sy * src->width + sx];
+						for(int c = 0; c < 4; c++)
+							sum[c] += (texel >> (c * 8)) & 0xFF;
+					}
+				}
+
+				const uint32_t n = (x1 - x0) * (y1 - y0);
+				uint32_t texel = 0;
+				for(int c = 0; c < 4; c++)
+					texel |= ((sum[c] + n / 2) / n) << (c * 8);
+				dst.pixels[y * w + x] = texel;
+			}
+		}
+
+		mips.push_back(std::move(dst));
+		src = &mips.back();
+	}
 }
\ No newline at end of file
@@ -1,15 +1,24 @@
-#pragma once
-
-#include <cstdint>
-
-class fTexture {
-public:
-	uint32_t *pixels;
-	int width, height;
-
-	fTexture();
-	fTexture(const uint32_t width, const uint32_t height);
-	fTexture(fTexture&& other);
-	fTexture& operator=(fTexture&& other);
-	~fTexture();
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class fTexture {
+public:
+	uint32_t *pixels;
+	int width, height;
+
+	std::vector<fTexture> mips; // levels 1.., each half the size of the previous one; see generateMips
+
+	fTexture();
+	fTexture(const uint32_t width, const uint32_t height);
+	fTexture(fTexture&& other);
+	fTexture& operator=(fTexture&& other);
+	~fTexture();
+
+	// (Re)builds the mip chain down to 1x1 with a 2x2 box filter
+	void generateMips();
+
+	inline int numLevels() const { return 1 + (int)mips.size(); }
+	inline const fTexture& level(const int i) const { return i == 0 ? *this : mips[i - 1]; }
 };
\ No newline at end of file
@@ -1,11 +1,22 @@
-#pragma once
-
-#include <cstdint>
-
-#include "vec.h"
-
-inline uint32_t intColor(const color& col) {
-	return	static_cast<uint32_t>(255.999 * col.x()) << 16 |
-			static_cast<uint32_t>(255.999 * col.y()) << 8 |
-			static_cast<uint32_t>(255.999 * col.z());
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#include "vec.h"
+
+inline uint32_t intColor(const color& col) {
+	return	static_cast<uint32_t>(255.999 * col.x()) << 16 |
+			static_cast<uint32_t>(255.999 * col.y()) << 8 |
+			static_cast<uint32_t>(255.999 * col.z());
+}
+
+// Gamma-2 encoded and clamped, for linear radiance that may leave [0, 1]
+inline uint32_t gammaColor(const color& linear) {
+	return intColor(color(
+		std::sqrt(std::clamp<float>(linear.x(), 0.f, 1.f)),
+		std::sqrt(std::clamp<float>(linear.y(), 0.f, 1.f)),
+		std::sqrt(std::clamp<float>(linear.z(), 0.f, 1.f))
+	));
 }
\ No newline at end of file
@@ -1,76 +1,206 @@
-#pragma once
-
-#include "RayTracing/Objects/hittable.h"
-#include "RayTracing/Objects/hittable_list.h"
-
-#include "RayTracing/Objects/Sphere.h"
-#include "RayTracing/Objects/Triangle.h"
-
-void genScene1(hittable_list& world) {
-	std::shared_ptr<Material> material_ground = std::make_shared<Lambertian>(color(0.8, 0.8, 0.0));
-
-	// std::shared_ptr<Material> material_center = std::make_shared<Lambertian>(color(0.1, 0.2, 0.5)); // center
-	std::shared_ptr<Material> material_center = std::make_shared<Metal>(color(0.9, 0.9, 0.9), .01);
-	// std::shared_ptr<Material> material_center = std::make_shared<Dielectric>(1.5);
-
-	// std::shared_ptr<Material> material_left   = std::make_shared<Metal>(color(0.8, 0.8, 0.8), .3); // left
-	std::shared_ptr<Material> material_left   = std::make_shared<Dielectric>(1.5);
-
-	std::shared_ptr<Material> material_right  = std::make_shared<Metal>(color(0.8, 0.6, 0.2), .8); // .8 // right
-
-	world.add(std::make_shared<Sphere>(vec3( 0.0, 100.5, 1.0), 100.0, material_ground));
-	world.add(std::make_shared<Sphere>(vec3( 0.0, 0.0, 1.0), 0.5, material_center));
-
-	world.add(std::make_shared<Sphere>(vec3(-1.0, 0.0, 1.0), 0.5, material_left));
-	// world.add(std::make_shared<Sphere>(vec3(-1.0, 0.0, 1.0), -0.4, material_left)); // hollow Cavity
-
-	world.add(std::make_shared<Sphere>(vec3( 1.0, 0.0, 1.0), 0.5, material_right));
-}
-
-void genScene2(hittable_list& world) {
-	// ground sphere:
-	// std::shared_ptr<Material> ground_material = std::make_shared<Lambertian>(color(0.5, 0.5, 0.5));
-	// world.add(std::make_shared<Sphere>(vec3(0, 1000, 0), 1000, ground_material));
-
-	// ton of spheres:
-	for (int a = -4; a < 4; a++) {
-		for (int b = -4; b < 4; b++) {
-	// for (int a = -11; a < 11; a++) {
-	// 	for (int b = -11; b < 11; b++) {
-			double choose_mat = random_double(0, 1);
-			vec3 center = vec3(a + 0.9*random_double(0, 1.), -0.2, b + 0.9*random_double(0, 1.));
-
-			if ((center - vec3(4, 0.2, 0)).length<float>() > 0.9) {
-				std::shared_ptr<Material> sphere_material;
-
-				if (choose_mat < .8) { // .8
-					// diffuse
-					color albedo = color(random_double(0, 1.)*random_double(0, 1.), random_double(0, 1.)*random_double(0, 1.), random_double(0, 1.)*random_double(0, 1.));
-					sphere_material = std::make_shared<Lambertian>(albedo);
-					world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
-				} else if (choose_mat < .95) { // .95
-					// metal
-					color albedo = color(random_double(0.5, 1.), random_double(0.5, 1.), random_double(0.5, 1.));
-					double fuzz = random_double(0, 0.5);
-					sphere_material = std::make_shared<Metal>(albedo, fuzz);
-					world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
-				} else {
-					// glass
-					sphere_material = std::make_shared<Dielectric>(1.5);
-					world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
-				}
-			}
-		}
-	}
-
-
-	// 3 distinctive spheres:
-	// std::shared_ptr<Material> material1 = std::make_shared<Dielectric>(1.5);
-	// world.add(std::make_shared<Sphere>(vec3(0, -1, 0), 1.0, material1));
-
-	// std::shared_ptr<Material> material2 = std::make_shared<Lambertian>(color(0.4, 0.2, 0.1));
-	// world.add(std::make_shared<Sphere>(vec3(-4, -1, 0), 1.0, material2));
-
-	// std::shared_ptr<Material> material3 = std::make_shared<Metal>(color(0.7, 0.6, 0.5), 0.0);
-	// world.add(std::make_shared<Sphere>(vec3(4, -1, 0), 1.0, material3));
-}
\ No newline at end of file
+#pragma once
+
+#include "RayTracing/Objects/hittable.h"
+#include "RayTracing/Objects/hittable_list.h"
+
+#include "RayTracing/Objects/Sphere.h"
+#include "RayTracing/Objects/Triangle.h"
+#include "RayTracing/Objects/Mesh.h"
+#include "RayTracing/Objects/VoxelVolume.h"
+
+#include "RayTracing/Materials/MaterialTable.h"
+
+#include "Noise/FastNoiseLite.h"
+
+void genScene1(hittable_list& world, MaterialTable& materials) {
+	const material_id material_ground = materials.add(Lambertian(color(0.8, 0.8, 0.0)));
+
+	// const material_id material_center = materials.add(Lambertian(color(0.1, 0.2, 0.5))); // center
+	const material_id material_center = materials.add(Metal(color(0.9, 0.9, 0.9), .01));
+	// const material_id material_center = materials.add(Dielectric(1.5));
+
+	// const material_id material_left   = materials.add(Metal(color(0.8, 0.8, 0.8), .3)); // left
+	const material_id material_left   = materials.add(Dielectric(1.5));
+
+	const material_id material_right  = materials.add(Metal(color(0.8, 0.6, 0.2), .8)); // .8 // right
+
+	world.emplace<Sphere>(vec3( 0.0, 100.5, 1.0), 100.0, material_ground);
+	world.emplace<Sphere>(vec3( 0.0, 0.0, 1.0), 0.5, material_center);
+
+	world.emplace<Sphere>(vec3(-1.0, 0.0, 1.0), 0.5, material_left);
+	// world.emplace<Sphere>(vec3(-1.0, 0.0, 1.0), -0.4, material_left); // hollow Cavity
+
+	world.emplace<Sphere>(vec3( 1.0, 0.0, 1.0), 0.5, material_right);
+}
+
+// Spheres on a grid of (2 * extent)^2 cells (the full "Ray Tracing in One Weekend" cover is extent 11)
+void genScene2(hittable_list& world, MaterialTable& materials, const int extent = 4) {
+	// ground sphere:
+	// const material_id ground_material = materials.add(Lambertian(color(0.5, 0.5, 0.5)));
+	// world.emplace<Sphere>(vec3(0, 1000, 0), 1000, ground_material);
+
+	// ton of spheres:
+	for (int a = -extent; a < extent; a++) {
+		for (int b = -extent; b < extent; b++) {
+			double choose_mat = random_double(0, 1);
+			vec3 center = vec3(a + 0.9*random_double(0, 1.), -0.2, b + 0.9*random_double(0, 1.));
+
+			if ((center - vec3(4, 0.2, 0)).length<float>() > 0.9) {
+				material_id sphere_material;
+
+				if (choose_mat < .8) { // .8
+					// diffuse
+					color albedo = color(random_double(0, 1.)*random_double(0, 1.), random_double(0, 1.)*random_double(0, 1.), random_double(0, 1.)*random_double(0, 1.));
+					sphere_material = materials.add(Lambertian(albedo));
+					world.emplace<Sphere>(center, 0.2, sphere_material);
+				} else if (choose_mat < .95) { // .95
+					// metal
+					color albedo = color(random_double(0.5, 1.), random_double(0.5, 1.), random_double(0.5, 1.));
+					double fuzz = random_double(0, 0.5);
+					sphere_material = materials.add(Metal(albedo, fuzz));
+					world.emplace<Sphere>(center, 0.2, sphere_material);
+				} else {
+					// glass
+					sphere_material = materials.add(Dielectric(1.5));
+					world.emplace<Sphere>(center, 0.2, sphere_material);
+				}
+			}
+		}
+	}
+
+
+	// 3 distinctive spheres:
+	// const material_id material1 = materials.add(Dielectric(1.5));
+	// world.emplace<Sphere>(vec3(0, -1, 0), 1.0, material1);
+
+	// const material_id material2 = materials.add(Lambertian(color(0.4, 0.2, 0.1)));
+	// world.emplace<Sphere>(vec3(-4, -1, 0), 1.0, material2);
+
+	// const material_id material3 = materials.add(Metal(color(0.7, 0.6, 0.5), 0.0));
+	// world.emplace<Sphere>(vec3(4, -1, 0), 1.0, material3);
+}
+
+// Noise heightmap terrain of size x (size / 2) x size voxels (grass on dirt on stone), water below sea level
+void genVoxelTerrain(hittable_list& world, MaterialTable& materials, const size_t size = 128, const int seed = 1337) {
+	const std::vector<material_id> palette {
+		materials.add(Lambertian(color(.5f, .5f, .5f))), // 1 stone
+		materials.add(Lambertian(color(.45f, .3f, .15f))), // 2 dirt
+		materials.add(Lambertian(color(.2f, .6f, .15f))), // 3 grass
+		materials.add(Metal(color(.3f, .45f, .8f), .05f)), // 4 water
+	};
+
+	const size_t height = size / 2;
+	VoxelVolume& volume = world.emplace<VoxelVolume>(size, height, size, palette);
+
+	FastNoiseLite noise(seed);
+	noise.SetNoiseType(FastNoiseLite::NoiseType_OpenSimplex2);
+	noise.SetFrequency(.02f);
+
+	const size_t seaLevel = height / 3;
+
+	for (size_t z = 0; z < size; z++) {
+		for (size_t x = 0; x < size; x++) {
+			const float n = noise.GetNoise((float)x, (float)z) * .5f + .5f; // 0..1
+			const size_t ground = std::min<size_t>(height - 1, (size_t)(n * height * .8f) + 1);
+
+			// y points down
+			for (size_t h = 0; h < std::max(ground, seaLevel); h++) {
+				size_t value = 4;
+				if (h < ground)
+					value = (h + 1 == ground) ? (ground > seaLevel ? 3 : 2) : (h + 4 < ground ? 1 : 2);
+				volume.set(x, height - 1 - h, z, value);
+			}
+		}
+	}
+}
+
+// Closed stone room (size x size / 3 x size voxels) with pillars, torches and a lava pool:
+// lit only by emissive voxels, the skybox can't be reached
+void genVoxelLights(hittable_list& world, MaterialTable& materials, const size_t size = 48) {
+	const std::vector<material_id> palette {
+		materials.add(Lambertian(color(.6f, .6f, .6f), 1)), // 1 stone
+		materials.add(Lambertian(color(.45f, .3f, .15f), 1)), // 2 wood
+		materials.add(Emissive(color(12.f, 8.f, 3.f))), // 3 torch
+		materials.add(Emissive(color(6.f, 1.5f, .2f))), // 4 lava
+	};
+
+	const size_t height = size / 3;
+	VoxelVolume& volume = world.emplace<VoxelVolume>(size, height, size, palette);
+
+	// shell, y points down
+	for (size_t a = 0; a < size; a++) {
+		for (size_t b = 0; b < size; b++) {
+			volume.set(a, 0, b, 1);
+			volume.set(a, height - 1, b, 1);
+		}
+		for (size_t y = 0; y < height; y++) {
+			volume.set(a, y, 0, 1);
+			volume.set(a, y, size - 1, 1);
+			volume.set(0, y, a, 1);
+			volume.set(size - 1, y, a, 1);
+		}
+	}
+
+	// 2x2 wooden pillars with a torch on every side at half height
+	for (size_t x = 8; x + 8 < size; x += 12) {
+		for (size_t z = 8; z + 8 < size; z += 12) {
+			for (size_t y = 1; y + 1 < height; y++)
+				for (size_t d = 0; d < 4; d++)
+					volume.set(x + d % 2, y, z + d / 2, 2);
+
+			const size_t y = height / 2;
+			volume.set(x - 1, y, z, 3);
+			volume.set(x + 2, y, z + 1, 3);
+			volume.set(x + 1, y, z - 1, 3);
+			volume.set(x, y, z + 2, 3);
+		}
+	}
+
+	// lava pool in the floor
+	const float r = size / 8.f;
+	for (size_t z = 0; z < size; z++)
+		for (size_t x = 0; x < size; x++)
+			if (vec3(x + .5f - size / 2.f, 0, z + .5f - size / 2.f).length<float>() < r)
+				volume.set(x, height - 1, z, 4);
+}
+
+// count x count small voxel models (noisy blobs, size^3 voxels each, their own volumes) on a triangle
+// mesh floor, with a metal sphere next to every model: many bounded objects for the top-level BVH
+void genVoxelModels(hittable_list& world, MaterialTable& materials, const int count = 8, const size_t size = 16, const int seed = 1337) {
+	const std::vector<material_id> palette {
+		materials.add(Lambertian(color(.7f, .3f, .2f))), // 1
+		materials.add(Lambertian(color(.3f, .6f, .3f))), // 2
+		materials.add(Lambertian(color(.3f, .4f, .7f))), // 3
+	};
+	const material_id floor = materials.add(Lambertian(color(.5f, .5f, .5f)));
+	const material_id metal = materials.add(Metal(color(.9f, .9f, .9f), .05f));
+
+	FastNoiseLite noise(seed);
+	noise.SetNoiseType(FastNoiseLite::NoiseType_OpenSimplex2);
+	noise.SetFrequency(.15f);
+
+	const real spacing = real(size) * 2;
+	for (int a = 0; a < count; a++) {
+		for (int b = 0; b < count; b++) {
+			const vec3 origin(a * spacing, 0, b * spacing);
+			VoxelVolume& model = world.emplace<VoxelVolume>(size, size, size, palette, vec3(1.f), origin);
+
+			// a ball displaced by 2D noise sheared along y, value by height; y points down
+			const float c = (size - 1) / 2.f;
+			for (size_t z = 0; z < size; z++)
+				for (size_t y = 0; y < size; y++)
+					for (size_t x = 0; x < size; x++) {
+						const float n = noise.GetNoise((float)(x + a * spacing + y), (float)(z + b * spacing) - y);
+						const float d = vec3(x - c, y - c, z - c).length<float>() / c;
+						if (d < .75f + .35f * n)
+							model.set(x, y, z, 1 + y * 3 / size);
+					}
+
+			world.emplace<Sphere>(origin + vec3(spacing * .75f, real(size) - 3, real(size) / 2), 3, metal);
+		}
+	}
+
+	const real extent = count * spacing;
+	const vec3 p0(-spacing, real(size), -spacing), p1(extent, real(size), -spacing), p2(extent, real(size), extent), p3(-spacing, real(size), extent);
+	world.emplace<Mesh>(std::vector<Triangle>{ Triangle(p0, p1, p2, floor), Triangle(p0, p2, p3, floor) });
+}
@@ -1,59 +1,265 @@
-#pragma once
-
-#include <cmath>
-
-#include "RayTracing/vec.h"
-#include "RayTracing/color.h"
-#include "RayTracing/Ray.h"
-#include "RayTracing/Objects/hittable_list.h"
-
-#include "RayTracing/Texture/fTexture.h"
-
-
-// https://en.wikipedia.org/wiki/UV_mapping#Finding_UV_on_a_sphere
-// z output unused
-vec3 sampleSphericalMap(vec3 v) { // Equirectangular map
-	v = normalize(v);
-
-    vec3 uv; // z output unused
-	uv.x() = .5 + atan2(v.z(), v.x()) / (2 * 3.1415926535);
-	uv.y() = .5 + asin(v.y()) / 3.1415926535;
-
-    return uv;
-}
-
-color ray_color(const Ray& r, const hittable& world, const fTexture& skybox, const int depth) {
-	if (depth <= 0) // max bounces between objects
-		return color(0, 0, 0);
-
-	const double INF = 1. / 0.;
-
-	hit_record rec;
-	if (world.hit(r, 0.00001, INF, rec)) {
-		Ray scattered;
-		color attenuation;
-		if (rec.material->scatter(r, rec, attenuation, scattered))
-			return attenuation * ray_color(scattered, world, skybox, depth-1);
-		return color(0, 0, 0); // ?? un-reachable ??
-	}
-
-	// const vec3 unit_direction = unit_vector(r.dir);
-	// const float t = 0.5 * (unit_direction.y() + 1.0);
-	// return lerp(color(1.0, 1.0, 1.0), color(0.5, 0.7, 1.0), t);
-
-	vec3 skyboxIndex = sampleSphericalMap(r.dir);
-	skyboxIndex.x() = std::min<float>(std::max<float>(skyboxIndex.x(), 0), 1);
-	skyboxIndex.y() = std::min<float>(std::max<float>(skyboxIndex.y(), 0), 1);
-
-	const uint32_t col = skybox.pixels[
-		std::min<size_t>((size_t)(skyboxIndex.y() * skybox.height), skybox.height - 1)
-			* skybox.width
-			+ std::min<size_t>((size_t)(skyboxIndex.x() * skybox.width), skybox.width - 1)
-	];
-
-	return vec3(
-		(col >> 16) & 0xFF, // R
-		(col >> 8) & 0xFF, // G
-		(col >> 0) & 0xFF // B
-	 ) / 255.f;
-}
\ No newline at end of file
+#pragma once
+
+#include <cmath>
+
+#include "RayTracing/vec.h"
+#include "RayTracing/color.h"
+#include "RayTracing/Ray.h"
+#include "RayTracing/Camera.h"
+#include "RayTracing/RenderMode.h"
+#include "RayTracing/Objects/hittable_list.h"
+
+#include "RayTracing/Materials/MaterialTable.h"
+
+#include "RayTracing/Lights/LightList.h"
+
+#include "RayTracing/Caching/RadianceCache.h"
+
+#include "RayTracing/Texture/fTexture.h"
+
+#include "RayTracing/Denoising/AOVBuffer.h"
+
+#include "RayTracing/Profiling/Profiler.h"
+
+
+// https://en.wikipedia.org/wiki/UV_mapping#Finding_UV_on_a_sphere
+// z output unused
+vec3 sampleSphericalMap(vec3 v) { // Equirectangular map
+	v = normalize(v);
+
+    vec3 uv; // z output unused
+	uv.x() = real(.5) + std::atan2(v.z(), v.x()) / real(2 * 3.1415926535);
+	uv.y() = real(.5) + std::asin(v.y()) / real(3.1415926535);
+
+    return uv;
+}
+
+// Equirectangular skybox lookup for a ray direction. spread is the ray's cone angle: if the skybox has
+// mips, the lookup blends the two levels whose texels are closest to the cone's footprint.
+inline color skyColor(const vec3& dir, const fTexture& skybox, const real spread = 0) {
+	RT_COUNT(SkyboxLookups);
+
+	vec3 skyboxIndex = sampleSphericalMap(dir);
+	skyboxIndex.x() = std::min<real>(std::max<real>(skyboxIndex.x(), 0), 1);
+	skyboxIndex.y() = std::min<real>(std::max<real>(skyboxIndex.y(), 0), 1);
+
+	const auto texel = [&](const fTexture& level) {
+		const uint32_t col = level.pixels[
+			std::min<size_t>((size_t)(skyboxIndex.y() * level.height), level.height - 1)
+				* level.width
+				+ std::min<size_t>((size_t)(skyboxIndex.x() * level.width), level.width - 1)
+		];
+
+		return vec3(
+			(col >> 16) & 0xFF, // R
+			(col >> 8) & 0xFF, // G
+			(col >> 0) & 0xFF // B
+		 ) / 255.f;
+	};
+
+	// footprint in level 0 texels: horizontally a texel spans 2 pi / width radians
+	const real footprint = spread * skybox.width / real(2 * 3.1415926535);
+	if (skybox.mips.empty() || footprint <= 1)
+		return texel(skybox);
+
+	const real lod = std::min<real>(std::log2(footprint), real(skybox.numLevels() - 1));
+	const int level = (int)lod;
+	if (level + 1 >= skybox.numLevels())
+		return texel(skybox.level(level));
+
+	const real f = lod - level;
+	return texel(skybox.level(level)) * (1 - f) + texel(skybox.level(level + 1)) * f;
+}
+
+// Emission seen along r at rec. If r was BSDF-sampled with density scatterPdf (0 for camera rays and
+// specular bounces) and the emitter can also be reached by light sampling, the MIS weight is applied.
+inline color emittedRadiance(const Ray& r, const hit_record& rec, const MaterialTable& materials, const LightList *const lights, const real scatterPdf) {
+	const color emission = materials.emitted(rec);
+	if (scatterPdf <= 0 || !lights || rec.light_id == NO_LIGHT || emission.x() + emission.y() + emission.z() <= 0)
+		return emission;
+
+	return emission * LightList::powerHeuristic(scatterPdf, lights->pdf(r.orig, r.time, rec.light_id, rec.p, rec.normal));
+}
+
+// Next-event estimation at a diffuse hit: one light sample, MIS-weighted against the BSDF.
+// Returns false if the sample can't contribute; otherwise the contribution applies if shadowRay
+// is unoccluded up to t_max. The shadow ray keeps the incoming cone's width at the hit (no spread),
+// so it sees the volume at the same level of detail as the hit, and the incoming ray's time.
+inline bool sampleDirect(const hit_record& rec, const real coneWidth, const real time, const MaterialTable& materials, const LightList& lights, Ray& shadowRay, real& t_max, color& contribution) {
+	LightSample light;
+	if (!lights.sample(rec.p, time, light))
+		return false;
+
+	real scatterPdf;
+	const color f = materials.eval(rec, light.dir, scatterPdf);
+	if (scatterPdf <= 0)
+		return false;
+
+	shadowRay = Ray(rec.p, light.dir, coneWidth, 0, time);
+	t_max = light.dist * real(.999);
+	contribution = f * light.emission * (LightList::powerHeuristic(light.pdf, scatterPdf) / light.pdf);
+	return true;
+}
+
+// aov (optional) receives the first-hit features of this path.
+// lights (optional) enables next-event estimation on diffuse hits, scatterPdf is the density r was
+// sampled with (see emittedRadiance).
+// cache (optional) ends the path at secondary diffuse hits with cached radiance and learns from the others.
+color ray_color(const Ray& r, const hittable& world, const MaterialTable& materials, const fTexture& skybox, const int depth, AOVSample *const aov = nullptr, const LightList *const lights = nullptr, const real scatterPdf = 0, RadianceCache *const cache = nullptr, const bool primary = true) {
+	if (depth <= 0) // max bounces between objects
+		return color(0, 0, 0);
+
+	const real INF = 1. / 0.;
+
+	RT_COUNT(RaysCast);
+
+	hit_record rec;
+	if (world.hit(r, RAY_T_MIN, INF, rec)) {
+		color radiance = emittedRadiance(r, rec, materials, lights, scatterPdf);
+
+		Ray scattered;
+		color attenuation;
+		if (materials.scatter(r, rec, attenuation, scattered)) {
+			RT_COUNT(Bounces);
+			if (aov)
+				*aov = AOVSample::fromHit(r, rec, attenuation);
+
+			const bool diffuse = materials.samplesLights(rec.material);
+			const uint64_t cacheKey = cache && diffuse ? cache->key(rec) : RadianceCache::EMPTY;
+			color reflected(0.f);
+			if (cacheKey != RadianceCache::EMPTY && !primary && cache->lookup(cacheKey, reflected))
+				return radiance + reflected;
+
+			real pdf = 0;
+			if (lights && diffuse && depth > 1) { // a light sample is one more bounce
+				Ray shadowRay;
+				real t_max;
+				color contribution;
+				if (sampleDirect(rec, r.widthAt(rec.p), r.time, materials, *lights, shadowRay, t_max, contribution)) {
+					RT_COUNT(ShadowRays);
+					if (!world.occluded(shadowRay, t_max))
+						reflected += contribution;
+				}
+
+				materials.eval(rec, scattered.dir, pdf);
+			}
+
+			reflected += attenuation * ray_color(scattered, world, materials, skybox, depth-1, nullptr, lights, pdf, cache, false);
+			if (cacheKey != RadianceCache::EMPTY && depth > 1) // not cut off by the bounce limit right away
+				cache->update(cacheKey, reflected);
+			return radiance + reflected;
+		}
+
+		if (aov) // emitter
+			*aov = AOVSample::fromHit(r, rec, min(radiance, color(1.f)));
+		return radiance;
+	}
+
+	// const vec3 unit_direction = unit_vector(r.dir);
+	// const float t = 0.5 * (unit_direction.y() + 1.0);
+	// return lerp(color(1.0, 1.0, 1.0), color(0.5, 0.7, 1.0), t);
+
+	const color sky = skyColor(r.dir, skybox, r.coneSpread);
+
+	if (aov)
+		*aov = AOVSample::fromSky(r, sky);
+
+	return sky;
+}
+
+// Preview modes (everything but RenderMode::Path) for camera ray r, given its primary hit (if any)
+inline color previewShade(const Ray& r, const bool didHit, const hit_record& rec, const hittable& world, const MaterialTable& materials, const fTexture& skybox, const RenderMode mode, const PreviewSettings& preview, const LightList *const lights, AOVSample *const aov) {
+	if (!didHit) {
+		const color sky = mode == RenderMode::Normal ? color(0.f) : skyColor(r.dir, skybox, r.coneSpread);
+		if (aov)
+			*aov = AOVSample::fromSky(r, sky);
+		return sky;
+	}
+
+	const color emitted = materials.emitted(rec);
+	Ray scattered;
+	color albedo;
+	const bool scatters = materials.scatter(r, rec, albedo, scattered);
+	if (aov)
+		*aov = AOVSample::fromHit(r, rec, scatters ? albedo : min(emitted, color(1.f)));
+
+	switch (mode) {
+		case RenderMode::Normal:
+			return rec.normal * real(.5) + vec3(real(.5));
+
+		case RenderMode::Albedo:
+			return scatters ? albedo * (real(.25) + real(.75) * std::abs(dot(rec.normal, normalize(r.dir)))) : emitted;
+
+		case RenderMode::AmbientOcclusion: {
+			if (!scatters)
+				return emitted;
+			uint32_t open = 0;
+			for (uint32_t i = 0; i < preview.aoRays; i++) { // cosine-weighted directions
+				RT_COUNT(ShadowRays);
+				open += !world.occluded(Ray(rec.p, rec.normal + random_unit_vector(), r.widthAt(rec.p), 0, r.time), preview.aoRadius);
+			}
+			return albedo * (real(open) / std::max<uint32_t>(preview.aoRays, 1));
+		}
+
+		default: { // Direct
+			color radiance = emittedRadiance(r, rec, materials, lights, 0);
+			if (!scatters)
+				return radiance;
+
+			real pdf = 0;
+			if (lights && materials.samplesLights(rec.material)) {
+				Ray shadowRay;
+				real t_max;
+				color contribution;
+				if (sampleDirect(rec, r.widthAt(rec.p), r.time, materials, *lights, shadowRay, t_max, contribution)) {
+					RT_COUNT(ShadowRays);
+					if (!world.occluded(shadowRay, t_max))
+						radiance += contribution;
+				}
+				materials.eval(rec, scattered.dir, pdf);
+			}
+
+			// the BSDF sample only counts what it sees directly: emitters and the sky
+			RT_COUNT(RaysCast);
+			hit_record next;
+			if (world.hit(scattered, RAY_T_MIN, 1. / 0., next))
+				return radiance + albedo * emittedRadiance(scattered, next, materials, lights, pdf);
+			return radiance + albedo * skyColor(scattered.dir, skybox, scattered.coneSpread);
+		}
+	}
+}
+
+// Returns the linear radiance averaged over all samples, aov receives the averaged first-hit features
+inline color pixelColor(const vec3 uv, const vec3 pixelSize, const hittable& world, const MaterialTable& materials, const fTexture& skybox, const Camera& cam, const uint32_t SAMPLES_PER_PIXEL, const uint32_t MAX_NUM_BOUNCES, const uint32_t x, const uint32_t y, AOVSample& aov, const LightList *const lights = nullptr, RadianceCache *const cache = nullptr, const RenderMode mode = RenderMode::Path, const PreviewSettings& preview = PreviewSettings{}) {
+	color pixel_color{};
+	aov = AOVSample{};
+
+	for (uint32_t s = 0; s < SAMPLES_PER_PIXEL; s++) {
+		const vec3 screenPos = uv + vec3(random_real(0, 1), random_real(0, 1), 0) * pixelSize;
+
+		const Ray r = cam.getRay(screenPos.x(), screenPos.y(), cam.pixelSpread(pixelSize.x()));
+
+		AOVSample sample;
+		if (mode == RenderMode::Path) {
+			pixel_color += ray_color(r, world, materials, skybox, MAX_NUM_BOUNCES, &sample, lights, 0, cache);
+		} else {
+			RT_COUNT(RaysCast);
+			hit_record rec;
+			const bool didHit = world.hit(r, RAY_T_MIN, 1. / 0., rec);
+			pixel_color += previewShade(r, didHit, rec, world, materials, skybox, mode, preview, lights, &sample);
+		}
+
+		aov.albedo += sample.albedo;
+		aov.normal += sample.normal;
+		aov.position += sample.position;
+		aov.depth += sample.depth;
+	}
+
+	const float scale = 1.f / SAMPLES_PER_PIXEL;
+	aov.albedo *= scale;
+	aov.normal *= scale;
+	aov.position *= scale;
+	aov.depth *= scale;
+
+	return pixel_color * scale;
+}
@@ -1,21 +1,25 @@
-#pragma once
-
-#include "vec.h"
-#include "Ray.h"
-#include "Materials/Material.h"
-
-#include <memory>
-
-class hit_record {
-public:
-	vec3 p;
-	vec3 normal;
-	std::shared_ptr<Material> material;
-	double t;
-	bool front_face;
-
-	void set_face_normal(Ray r, vec3 outward_normal) {
-		front_face = dot(r.dir, outward_normal) < 0;
-		normal = front_face ? outward_normal : (outward_normal * -1);
-	}
+#pragma once
+
+#include <cstdint>
+
+#include "vec.h"
+#include "Ray.h"
+#include "Materials/Material.h"
+
+// hit_record::light_id of surfaces that aren't in a LightList
+constexpr uint32_t NO_LIGHT = UINT32_MAX;
+
+class hit_record {
+public:
+	vec3 p;
+	vec3 normal;
+	material_id material;
+	uint32_t light_id = NO_LIGHT; // for MIS-weighting emission found by BSDF sampling
+	real t;
+	bool front_face;
+
+	void set_face_normal(Ray r, vec3 outward_normal) {
+		front_face = dot(r.dir, outward_normal) < 0;
+		normal = front_face ? outward_normal : (outward_normal * -1);
+	}
 };
\ No newline at end of file
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <condition_variable>
+
+#include "RayTracing/vec.h"
+
+inline uint32_t hardwareThreads() {
+	return std::max<uint32_t>(1, std::thread::hardware_concurrency());
+}
+
+// Long-lived workers for parallel_for, so a call doesn't pay for starting threads and whatever
+// the workers keep in thread_local storage (scratch arenas, profiler slots, random generators)
+// survives from one call to the next. Workers are only ever added, up to the most any call asked for.
+class ThreadPool {
+public:
+	// One parallel_for call: `run` is entered by the caller and by up to `helpers` workers
+	struct Job {
+		void (*run)(void*);
+		void *context;
+		uint32_t helpers; // workers that may still join
+		uint32_t active = 0; // workers inside run()
+	};
+
+	// Never destroyed: the workers wait for jobs until the process exits
+	static ThreadPool& instance() {
+		static ThreadPool *const pool = new ThreadPool();
+		return *pool;
+	}
+
+	// Runs job.run on the calling thread and on up to job.helpers (> 0) idle workers, returns once all
+	// of them left it. Calls may nest (a job may start another): the caller always works on its
+	// own job, so it completes even when every worker is busy.
+	void run(Job& job) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			while(workers.size() < job.helpers)
+				workers.emplace_back([this]() { work(); });
+			jobs.push_back(&job);
+		}
+		wake.notify_all();
+
+		job.run(job.context);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		jobs.erase(std::remove(jobs.begin(), jobs.end(), &job), jobs.end());
+		done.wait(lock, [&]() { return job.active == 0; });
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	std::vector<Job*> jobs; // with helpers > 0, oldest first
+	std::vector<std::thread> workers;
+
+	ThreadPool() = default;
+
+	void work() {
+		std::unique_lock<std::mutex> lock(mutex);
+		for(;;) {
+			wake.wait(lock, [&]() { return !jobs.empty(); });
+
+			Job& job = *jobs.front();
+			job.active++;
+			if(--job.helpers == 0)
+				jobs.erase(jobs.begin());
+
+			lock.unlock();
+			job.run(job.context);
+			lock.lock();
+
+			if(--job.active == 0)
+				done.notify_all();
+		}
+	}
+};
+
+// Calls body(i) for every i in [begin, end) on numThreads threads (the calling thread included).
+// Indices are handed out in chunks of `grain` through an atomic counter, so uneven work balances out.
+// Each chunk starts from a random seed drawn from the caller's generator and its own index, so what
+// the body draws (random_real, ...) doesn't depend on the thread count or on which thread ran it.
+template<typename F>
+inline void parallel_for(const size_t begin, const size_t end, const F& body, const uint32_t numThreads = hardwareThreads(), const size_t grain = 1) {
+	if(begin >= end)
+		return;
+
+	const uint32_t seed = (uint32_t)random_generator()();
+
+	struct Range {
+		std::atomic_size_t next;
+		size_t begin, end, grain;
+		uint32_t seed;
+		const F *body;
+	} range{ { begin }, begin, end, grain, seed, &body };
+
+	const auto worker = [](void *const context) {
+		Range& r = *(Range*)context;
+		for(;;) {
+			const size_t first = r.next.fetch_add(r.grain);
+			if(first >= r.end)
+				return;
+
+			reseed_random(mix_seed(r.seed, (first - r.begin) / r.grain));
+			const size_t last = std::min(first + r.grain, r.end);
+			for(size_t i = first; i < last; i++)
+				(*r.body)(i);
+		}
+	};
+
+	const size_t numChunks = (end - begin + grain - 1) / grain;
+	const uint32_t threads = (uint32_t)std::max<size_t>(1, std::min<size_t>(numThreads, numChunks));
+
+	if(threads == 1) {
+		worker(&range);
+	} else {
+		ThreadPool::Job job{ worker, &range, threads - 1 };
+		ThreadPool::instance().run(job);
+	}
+
+	// the caller ran some of the chunks: it goes on from a seed of its own
+	reseed_random(mix_seed(seed, numChunks));
+}
+
+// Stable counting sort of the items [0, n) by bucket(i) < numBuckets: place(i, slot) is called once
+// per item with its sorted position. Blocks of `grain` items are counted in parallel, a prefix sum
+// over (bucket, block) gives each block its first slot in every bucket, then the blocks scatter in
+// parallel. Ties keep their index order, so the result doesn't depend on the thread count either.
+template<typename Bucket, typename Place>
+inline void parallel_counting_sort(const size_t n, const size_t numBuckets, const Bucket& bucket, const Place& place, const uint32_t numThreads = hardwareThreads(), const size_t grain = 16384) {
+	const size_t numBlocks = (n + grain - 1) / grain;
+	std::vector<size_t> offsets(numBlocks * numBuckets, 0); // block-major
+
+	parallel_for(0, numBlocks, [&](const size_t block) {
+		size_t *const counts = &offsets[block * numBuckets];
+		const size_t last = std::min(n, (block + 1) * grain);
+		for(size_t i = block * grain; i < last; i++)
+			counts[bucket(i)]++;
+	}, numThreads);
+
+	size_t sum = 0;
+	for(size_t b = 0; b < numBuckets; b++)
+		for(size_t block = 0; block < numBlocks; block++) {
+			const size_t count = offsets[block * numBuckets + b];
+			offsets[block * numBuckets + b] = sum;
+			sum += count;
+		}
+
+	parallel_for(0, numBlocks, [&](const size_t block) {
+		size_t *const slots = &offsets[block * numBuckets];
+		const size_t last = std::min(n, (block + 1) * grain);
+		for(size_t i = block * grain; i < last; i++)
+			place(i, slots[bucket(i)]++);
+	}, numThreads);
+}
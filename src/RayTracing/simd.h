@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+	#define RT_SSE2
+	#include <emmintrin.h>
+#endif
+
+// 4 float lanes; SSE2 when available, plain arrays otherwise
+struct float4 {
+#ifdef RT_SSE2
+	__m128 v;
+
+	float4(): v(_mm_setzero_ps()) {}
+	float4(const __m128 v): v(v) {}
+	explicit float4(const float s): v(_mm_set1_ps(s)) {}
+
+	static inline float4 load(const float *const p) { return _mm_loadu_ps(p); }
+	inline void store(float *const p) const { _mm_storeu_ps(p, v); }
+#else
+	float v[4];
+
+	float4(): v{0, 0, 0, 0} {}
+	explicit float4(const float s): v{s, s, s, s} {}
+
+	static inline float4 load(const float *const p) { float4 r; for(int i = 0; i < 4; i++) r.v[i] = p[i]; return r; }
+	inline void store(float *const p) const { for(int i = 0; i < 4; i++) p[i] = v[i]; }
+#endif
+};
+
+#ifdef RT_SSE2
+inline float4 operator+(const float4 &a, const float4 &b) { return _mm_add_ps(a.v, b.v); }
+inline float4 operator-(const float4 &a, const float4 &b) { return _mm_sub_ps(a.v, b.v); }
+inline float4 operator*(const float4 &a, const float4 &b) { return _mm_mul_ps(a.v, b.v); }
+inline float4 operator/(const float4 &a, const float4 &b) { return _mm_div_ps(a.v, b.v); }
+inline float4 min(const float4 &a, const float4 &b) { return _mm_min_ps(a.v, b.v); }
+inline float4 max(const float4 &a, const float4 &b) { return _mm_max_ps(a.v, b.v); }
+#else
+#define RT_FLOAT4_OP(NAME, EXPR) \
+	inline float4 NAME(const float4 &a, const float4 &b) { float4 r; for(int i = 0; i < 4; i++) r.v[i] = EXPR; return r; }
+RT_FLOAT4_OP(operator+, a.v[i] + b.v[i])
+RT_FLOAT4_OP(operator-, a.v[i] - b.v[i])
+RT_FLOAT4_OP(operator*, a.v[i] * b.v[i])
+RT_FLOAT4_OP(operator/, a.v[i] / b.v[i])
+RT_FLOAT4_OP(min, std::min(a.v[i], b.v[i]))
+RT_FLOAT4_OP(max, std::max(a.v[i], b.v[i]))
+#undef RT_FLOAT4_OP
+#endif
+
+inline float4& operator+=(float4 &a, const float4 &b) { return a = a + b; }
+
+// e^x, accurate to ~1e-5 relative; inputs are clamped to [-87, 0] (enough for filter weights)
+inline float4 exp_neg(float4 x) {
+	x = min(max(x, float4(-87.f)), float4(0.f));
+#ifdef RT_SSE2
+	const __m128 t = _mm_mul_ps(x.v, _mm_set1_ps(1.44269504f)); // x * log2(e)
+
+	// floor(t) (cvtt truncates towards zero, t <= 0)
+	__m128i ti = _mm_cvttps_epi32(t);
+	const __m128 tr = _mm_cvtepi32_ps(ti);
+	ti = _mm_add_epi32(ti, _mm_castps_si128(_mm_cmpgt_ps(tr, t)));
+	const __m128 f = _mm_sub_ps(t, _mm_cvtepi32_ps(ti));
+
+	// 2^f on [0, 1)
+	__m128 p = _mm_set1_ps(.0096181291f);
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(.0555041087f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(.2402265070f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(.6931471806f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.f));
+
+	// * 2^floor(t)
+	const __m128i bits = _mm_slli_epi32(_mm_add_epi32(ti, _mm_set1_epi32(127)), 23);
+	return _mm_mul_ps(p, _mm_castsi128_ps(bits));
+#else
+	float4 r;
+	for(int i = 0; i < 4; i++) r.v[i] = std::exp(x.v[i]);
+	return r;
+#endif
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+// SSE specialization of vec<float>, included by vec.h when RT_SIMD_VEC is defined.
+// A vector is one register; the 4th lane is padding, never read back by the scalar accessors
+// and ignored by dot/length.
+
+#include <emmintrin.h>
+
+template<>
+class alignas(16) vec<float> {
+public:
+	union {
+		__m128 m;
+		float e[4];
+	};
+
+public:
+	vec() : m(_mm_setzero_ps()) {}
+	explicit vec(const float t) : m(_mm_set1_ps(t)) {}
+	vec(const float e0, const float e1, const float e2) : m(_mm_setr_ps(e0, e1, e2, 0.f)) {}
+	vec(const __m128 m) : m(m) {}
+
+	vec(const vec& other) = default;
+	vec& operator=(const vec& other) = default;
+
+	inline float x() const { return e[0]; }
+	inline float y() const { return e[1]; }
+	inline float z() const { return e[2]; }
+
+	inline float& x() { return e[0]; }
+	inline float& y() { return e[1]; }
+	inline float& z() { return e[2]; }
+
+	inline vec operator-() const { return _mm_xor_ps(m, _mm_set1_ps(-0.f)); }
+	inline float operator[](const size_t i) const { return e[i]; }
+	inline float& operator[](const size_t i) { return e[i]; }
+
+	inline vec& operator+=(const float t) { m = _mm_add_ps(m, _mm_set1_ps(t)); return *this; }
+	inline vec& operator+=(const vec& v) { m = _mm_add_ps(m, v.m); return *this; }
+	inline vec& operator-=(const float t) { m = _mm_sub_ps(m, _mm_set1_ps(t)); return *this; }
+	inline vec& operator-=(const vec& v) { m = _mm_sub_ps(m, v.m); return *this; }
+	inline vec& operator*=(const float t) { m = _mm_mul_ps(m, _mm_set1_ps(t)); return *this; }
+	inline vec& operator*=(const vec& v) { m = _mm_mul_ps(m, v.m); return *this; }
+	inline vec& operator/=(const float t) { m = _mm_mul_ps(m, _mm_set1_ps(1.f / t)); return *this; }
+	inline vec& operator/=(const vec& v) { m = _mm_div_ps(m, v.m); return *this; }
+
+	// x*x + y*y + z*z in the lowest lane
+	inline __m128 length_squared_ss() const {
+		const __m128 sq = _mm_mul_ps(m, m);
+		return _mm_add_ss(_mm_add_ss(sq, _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(1, 1, 1, 1))), _mm_shuffle_ps(sq, sq, _MM_SHUFFLE(2, 2, 2, 2)));
+	}
+
+	inline float length_squared() const {
+		return _mm_cvtss_f32(length_squared_ss());
+	}
+
+	template<typename L>
+	inline L length() const {
+		return _mm_cvtss_f32(_mm_sqrt_ss(length_squared_ss()));
+	}
+
+	static inline vec random() {
+		return vec(random_real(), random_real(), random_real());
+	}
+};
+
+inline vec<float> operator+(const vec<float> &u, const vec<float> &v) { return _mm_add_ps(u.m, v.m); }
+inline vec<float> operator-(const vec<float> &u, const vec<float> &v) { return _mm_sub_ps(u.m, v.m); }
+inline vec<float> operator*(const vec<float> &u, const vec<float> &v) { return _mm_mul_ps(u.m, v.m); }
+inline vec<float> operator*(const float t, const vec<float> &v) { return _mm_mul_ps(_mm_set1_ps(t), v.m); }
+inline vec<float> operator*(const vec<float> &v, const float t) { return _mm_mul_ps(v.m, _mm_set1_ps(t)); }
+inline vec<float> operator/(const vec<float> &v, const float t) { return _mm_mul_ps(v.m, _mm_set1_ps(1.f / t)); }
+// exact division: axis-parallel directions must become +-inf for the slab tests
+inline vec<float> operator/(const float t, const vec<float> &v) { return _mm_div_ps(_mm_set1_ps(t), v.m); }
+inline vec<float> operator/(const vec<float> &a, const vec<float> &b) { return _mm_div_ps(a.m, b.m); }
+
+inline float dot(const vec<float> &u, const vec<float> &v) {
+	const __m128 p = _mm_mul_ps(u.m, v.m);
+	return _mm_cvtss_f32(_mm_add_ss(_mm_add_ss(p, _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1))), _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2))));
+}
+
+inline vec<float> cross(const vec<float> &u, const vec<float> &v) {
+	const __m128 uYZX = _mm_shuffle_ps(u.m, u.m, _MM_SHUFFLE(3, 0, 2, 1));
+	const __m128 vYZX = _mm_shuffle_ps(v.m, v.m, _MM_SHUFFLE(3, 0, 2, 1));
+	const __m128 c = _mm_sub_ps(_mm_mul_ps(u.m, vYZX), _mm_mul_ps(uYZX, v.m)); // (z, x, y) order
+	return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+// rsqrt estimate + one Newton-Raphson step (~22 bits)
+inline vec<float> normalize(const vec<float> &v) {
+	const __m128 len2 = _mm_shuffle_ps(v.length_squared_ss(), v.length_squared_ss(), _MM_SHUFFLE(0, 0, 0, 0));
+	const __m128 r = _mm_rsqrt_ps(len2);
+	const __m128 nr = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(.5f), r), _mm_sub_ps(_mm_set1_ps(3.f), _mm_mul_ps(_mm_mul_ps(len2, r), r)));
+	return _mm_mul_ps(v.m, nr);
+}
+
+inline vec<float> abs(const vec<float> &v) { return _mm_andnot_ps(_mm_set1_ps(-0.f), v.m); }
+
+// Lane-wise, branch-free; like minps/maxps the second operand wins if either is NaN
+inline vec<float> min(const vec<float> &u, const vec<float> &v) { return _mm_min_ps(u.m, v.m); }
+inline vec<float> max(const vec<float> &u, const vec<float> &v) { return _mm_max_ps(u.m, v.m); }